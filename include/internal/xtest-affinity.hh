@@ -0,0 +1,128 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_INCLUDE_INTERNAL_XTEST_AFFINITY_HH_
+#define XTEST_INCLUDE_INTERNAL_XTEST_AFFINITY_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "xtest-registrar.hh"
+
+namespace xtest {
+namespace internal {
+// A CPU the process may run on and where it sits in the machine.
+struct CpuInfo {
+  int32_t cpu;      // Number of the CPU, as the kernel knows it.
+  int32_t node;     // NUMA node; `0` on a machine without NUMA.
+  int32_t package;  // Physical package, i.e., socket.
+  int32_t core;     // Physical core within the package.
+};
+
+// Returns the CPUs the calling process may run on, by number, with their NUMA
+// node, package and core as found in "/sys/devices/system".  What cannot be
+// found there is taken to be a core of its own on node `0`.  Returns no CPU on
+// platforms other than Linux.
+std::vector<CpuInfo> GetCpuTopology();
+
+// Parses `list`, a list of CPU numbers and ranges such as "0,2,4-7" in the
+// format of the kernel's "cpulist" files, into `cpus`.  Returns false if it is
+// not a valid list.
+bool ParseCpuList(const std::string& list, std::vector<int32_t>* cpus);
+
+// The CPUs the workers of a parallel run are pinned to, see
+// `--xtest_cpu_affinity`, so that a timing sensitive test keeps its caches and
+// the memory it allocates rather than moving between CPUs and sockets.
+//
+// A worker is pinned to a single CPU and prefers to allocate memory on the NUMA
+// node of that CPU.  A test that declares more than one CPU with
+// `TEST_WITH_COST()` is let onto every CPU of that node while it runs, see
+// `PlaceTest()`.
+class CpuAffinity {
+ public:
+  // No worker is pinned.
+  CpuAffinity() = default;
+
+  // Plans the CPUs of `num_workers` workers on `cpus` by `policy`:
+  //
+  //   "compact"  fills the cores of one NUMA node after the other,
+  //   "scatter"  spreads the workers round-robin over the NUMA nodes,
+  //   a list     such as "0,2,4-7" hands out the CPUs in that order.
+  //
+  // Both "compact" and "scatter" use one hardware thread of every core before
+  // its siblings.  When there are more workers than CPUs, the CPUs are handed
+  // out again from the start.  Returns false, with `error` saying why, if
+  // `policy` is not valid or names a CPU the process may not run on.
+  bool Plan(const std::string& policy, const std::vector<CpuInfo>& cpus,
+            const std::size_t& num_workers, std::string* error);
+
+  // True when no worker is pinned.
+  bool empty() const { return worker_cpus_.empty(); }
+
+  // CPU every worker is pinned to.
+  const std::vector<int32_t>& worker_cpus() const { return worker_cpus_; }
+
+  // Pins the calling thread, worker `worker`, to its CPU and has it prefer the
+  // memory of that CPU's NUMA node.  Threads the worker starts, and a process
+  // it forks, inherit both.  Does nothing if the thread is that worker already.
+  // Returns false if the kernel refused.
+  bool PinWorker(const std::size_t& worker) const;
+
+ private:
+  std::vector<int32_t> worker_cpus_;
+
+  // NUMA node of every worker's CPU and the index of its CPUs in
+  // `node_cpus_`, which holds the CPUs of every node.
+  std::vector<int32_t> worker_nodes_;
+  std::vector<std::size_t> worker_node_cpus_;
+  std::vector<std::vector<int32_t>> node_cpus_;
+
+  // True on a machine with more than one NUMA node.
+  bool numa_ = false;
+};
+
+// Lets the test about to run on the calling thread onto the CPUs it declared
+// with `TEST_WITH_COST()`: the CPU of its worker, or every CPU of that CPU's
+// NUMA node when it takes more than one.  Does nothing on a thread that was
+// not pinned by `CpuAffinity::PinWorker()`.
+void PlaceTest(const TestCost& cost);
+
+// Returns the CPU the calling thread runs on if it was pinned by
+// `CpuAffinity::PinWorker()`, else `-1`.
+int32_t GetCurrentCpu();
+
+// Gives the calling thread back the CPUs and the memory policy it had before
+// `CpuAffinity::PinWorker()` pinned it.
+void UnpinCurrentThread();
+}  // namespace internal
+}  // namespace xtest
+
+#endif  // XTEST_INCLUDE_INTERNAL_XTEST_AFFINITY_HH_
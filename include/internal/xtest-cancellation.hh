@@ -0,0 +1,57 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_INCLUDE_INTERNAL_XTEST_CANCELLATION_HH_
+#define XTEST_INCLUDE_INTERNAL_XTEST_CANCELLATION_HH_
+
+namespace xtest {
+namespace internal {
+// Cancels the test run: the workers start no further test and the tests still
+// running see `XTEST_CANCELLED()` turn true.  Safe to call from any thread, and
+// from any worker process forked after `ResetTestRunCancellation()`, which
+// cancels the run in the parent and in every other worker too.
+void CancelTestRun();
+
+// Returns true once the test run has been cancelled.  Cheap enough to be polled
+// in a loop: a single relaxed atomic load.
+bool IsTestRunCancelled();
+
+// Cancels the test run, see `CancelTestRun()`, with `--xtest_fail_fast`.
+// Called on every test failure.
+void CancelTestRunIfFailingFast();
+
+// Forgets the cancellation of the previous run, so that the tests can be run
+// again in the same process.  Must be called before the worker processes of
+// the run are forked, as the cancellation is shared with them through memory
+// mapped when this is first called.
+void ResetTestRunCancellation();
+}  // namespace internal
+}  // namespace xtest
+
+#endif  // XTEST_INCLUDE_INTERNAL_XTEST_CANCELLATION_HH_
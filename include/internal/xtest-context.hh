@@ -0,0 +1,231 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_INCLUDE_INTERNAL_XTEST_CONTEXT_HH_
+#define XTEST_INCLUDE_INTERNAL_XTEST_CONTEXT_HH_
+
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "internal/xtest-port.hh"
+#include "internal/xtest-printers.hh"
+#include "xtest-registrar.hh"
+
+namespace xtest {
+namespace internal {
+// Lock-free list of the console output of the helper threads of a test, see
+// `ScopedTestContext`.  Any number of helper threads may push their output at
+// once, without waiting for each other or for the thread running the test,
+// which prints all of it once the test has returned.
+class HelperOutputList {
+ public:
+  HelperOutputList() : head_(nullptr) {}
+  ~HelperOutputList();
+
+  // Adds `output` to the list.  Safe to call from any thread.
+  void Push(const OutputCapture& output);
+
+  // Removes everything pushed so far from the list and returns it in the order
+  // it was pushed.
+  std::vector<OutputCapture> TakeAll();
+
+ private:
+  struct Node {
+    OutputCapture output;
+    Node* next;
+  };
+
+  std::atomic<Node*> head_;
+
+  XTEST_DISALLOW_COPY_AND_ASSIGN_(HelperOutputList);
+};
+
+// A thread a test started, e.g., for a `TestThread` or a `LoopbackServer`,
+// which has to be over by the end of the test.
+class HelperThread {
+ public:
+  // Takes over `thread`.  `stop`, if not empty, asks the thread to return,
+  // e.g., by waking up its event loop, and is called before joining it.
+  HelperThread(std::thread thread, std::function<void()> stop);
+  ~HelperThread();
+
+  // Stops the thread, if it can be asked to, and waits for it to finish.  Safe
+  // to call more than once and from several threads at a time: only the first
+  // call joins the thread, the others wait for it to.
+  void Join();
+
+  // Returns true once the thread has been joined.
+  bool joined() const { return joined_.load(); }
+
+ private:
+  std::thread thread_;
+  std::function<void()> stop_;
+  std::mutex mutex_;
+  std::condition_variable joined_condition_;
+  bool joining_;               // Guarded by `mutex_`.
+  std::atomic<bool> joined_;
+
+  XTEST_DISALLOW_COPY_AND_ASSIGN_(HelperThread);
+};
+
+// The helper threads of a test that are still to be joined, see
+// `AdoptHelperThread()`.
+class HelperThreadList {
+ public:
+  HelperThreadList() = default;
+  ~HelperThreadList() { JoinAll(); }
+
+  // Adds `thread` to the list.  Safe to call from any thread.
+  void Add(const std::shared_ptr<HelperThread>& thread);
+
+  // Joins every thread added so far, including those added by the threads it
+  // joins.
+  void JoinAll();
+
+ private:
+  std::mutex mutex_;
+  std::vector<std::shared_ptr<HelperThread>> threads_;  // Guarded by `mutex_`.
+
+  XTEST_DISALLOW_COPY_AND_ASSIGN_(HelperThreadList);
+};
+
+// The test the assertions made on a thread are recorded against, and where the
+// thread's output goes, see `GetCurrentTestContext()`.
+struct TestContext {
+  TestRegistrar* test = nullptr;
+
+  // Output of the helper threads of `test`; `nullptr` when there is no test.
+  HelperOutputList* helper_output = nullptr;
+
+  // Helper threads of `test` to join once it is over; `nullptr` when there is
+  // no test.
+  HelperThreadList* helper_threads = nullptr;
+};
+
+// Takes over `thread`, started for the test of the calling thread, and hands
+// it over to the test, which joins it before a fatal assertion jumps out of
+// the test past the destructor of its owner, and once the test is over, unless
+// it was joined before, see `HelperThread`.  Outside of a test the thread is
+// only joined by its owner.
+std::shared_ptr<HelperThread> AdoptHelperThread(
+    std::thread thread, std::function<void()> stop = nullptr);
+
+// Joins the helper threads of the test of the calling thread that were not
+// joined yet, see `AdoptHelperThread()`.  Called by a fatal assertion before it
+// jumps out of the test.
+void JoinCurrentTestHelperThreads();
+
+// Thrown by a fatal assertion that fails on a `TestThread` to end the thread,
+// which cannot jump out of the test, and caught by `RunHelperThread()`.
+struct HelperThreadFatalFailure {};
+
+// Runs `body` on the calling thread, started by a `TestThread`, as a helper
+// thread of the test of `context`, see `ScopedTestContext`.  A fatal assertion
+// failing in `body` leaves it by throwing a `HelperThreadFatalFailure`.
+void RunHelperThread(const TestContext& context,
+                     const std::function<void()>& body);
+
+// Returns true if a fatal assertion failing on the calling thread is to end
+// it, see `RunHelperThread()`.
+bool HelperThreadEndsOnFatalFailure();
+
+// Returns the context of the calling thread: the test it runs, or helps run as
+// one of the helper threads the test started, see `ScopedTestContext`.  Empty
+// on any other thread.
+TestContext GetCurrentTestContext();
+
+// Returns the test the assertions made on the calling thread are recorded
+// against: the test of its context or, on a thread without one, e.g., a thread
+// the test started with `std::thread`, the test running in this process if it
+// is the only one.  Returns `nullptr` when the thread has no context and no
+// test or more than one test is running, as which test started the thread
+// cannot be told then.
+TestRegistrar* GetCurrentTest();
+
+// Returns true if the calling thread is a helper thread of a test rather than
+// the thread running it.
+bool IsTestHelperThread();
+
+// Returns true if the calling thread is the one running a test, the only one a
+// fatal assertion can jump out of the test on.  Elsewhere a fatal assertion
+// fails like a non-fatal one and the thread carries on, unless it is a
+// `TestThread`, see `HelperThreadEndsOnFatalFailure()`.
+bool IsTestThread();
+
+// Makes the calling thread the one running `test` for the lifetime of this
+// object, see `GetCurrentTestContext()`.  Used by the test runner.
+class ScopedTestRun {
+ public:
+  explicit ScopedTestRun(TestRegistrar* test);
+  ~ScopedTestRun();
+
+  // Waits for the helper threads of the test that were not joined yet, see
+  // `AdoptHelperThread()`.  Called once the test is over.
+  void JoinHelperThreads() { helper_threads_.JoinAll(); }
+
+  // Prints the output the helper threads of the test have pushed so far on the
+  // calling thread, in the order they finished.
+  void PrintHelperOutput();
+
+ private:
+  HelperOutputList helper_output_;
+  HelperThreadList helper_threads_;  // Joined before `helper_output_` goes.
+  const TestContext saved_context_;
+  const bool saved_helper_;
+
+  XTEST_DISALLOW_COPY_AND_ASSIGN_(ScopedTestRun);
+};
+
+// Makes the calling thread a helper thread of the test of `context`, taken on
+// the thread running the test with `GetCurrentTestContext()`, for the lifetime
+// of this object.  The assertions made on the thread are recorded against the
+// test and its output is collected and printed along with the test's once the
+// helper is done.  The test must outlive its helper threads.
+class ScopedTestContext {
+ public:
+  explicit ScopedTestContext(const TestContext& context);
+  ~ScopedTestContext();
+
+ private:
+  const TestContext saved_context_;
+  const bool saved_helper_;
+  OutputCapture output_;
+  ScopedOutputCapture capture_;
+
+  XTEST_DISALLOW_COPY_AND_ASSIGN_(ScopedTestContext);
+};
+}  // namespace internal
+}  // namespace xtest
+
+#endif  // XTEST_INCLUDE_INTERNAL_XTEST_CONTEXT_HH_
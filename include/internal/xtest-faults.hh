@@ -0,0 +1,75 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_INCLUDE_INTERNAL_XTEST_FAULTS_HH_
+#define XTEST_INCLUDE_INTERNAL_XTEST_FAULTS_HH_
+
+#include <cstdint>
+#include <string>
+
+namespace xtest {
+namespace internal {
+// A synchronous fault signal raised by a thread, e.g., on a null dereference.
+struct Fault {
+  int32_t signal;       // `SIGSEGV`, `SIGBUS`, `SIGFPE` or `SIGILL`.
+  const void* address;  // Faulting address, as the kernel reported it.
+};
+
+// Called on the faulting thread, on its alternate signal stack, by the handler
+// of the fault signals.  Expected to leave the faulting code, e.g., by jumping
+// out of it with `std::longjmp()`; if it returns, the fault is not handled and
+// the process is killed by the signal as if there were no handler.
+typedef void (*FaultHandler)(const Fault& fault);
+
+// Installs `handler` for `SIGSEGV`, `SIGBUS`, `SIGFPE` and `SIGILL`, saving the
+// handlers installed before.  The handler runs on the alternate signal stack of
+// the faulting thread, if it has one (see `EnsureAlternateSignalStack()`), so
+// that a stack overflow can be handled too.
+//
+// Does nothing on Windows, which has no signals for these faults.
+void InstallFaultHandlers(FaultHandler handler);
+
+// Restores the handlers saved by `InstallFaultHandlers()`.
+void RestoreFaultHandlers();
+
+// Returns the handler installed by `InstallFaultHandlers()`, or `nullptr` if
+// the fault handlers are not installed.
+FaultHandler GetFaultHandler();
+
+// Gives the calling thread an alternate signal stack if it does not have one
+// yet.  The stack is freed when the thread exits.
+void EnsureAlternateSignalStack();
+
+// Returns a human readable description of `fault`, e.g., "signal 11
+// (Segmentation fault) at address 0x0".
+std::string DescribeFault(const Fault& fault);
+}  // namespace internal
+}  // namespace xtest
+
+#endif  // XTEST_INCLUDE_INTERNAL_XTEST_FAULTS_HH_
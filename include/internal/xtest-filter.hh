@@ -0,0 +1,123 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_INCLUDE_INTERNAL_XTEST_FILTER_HH_
+#define XTEST_INCLUDE_INTERNAL_XTEST_FILTER_HH_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "internal/xtest-port.hh"
+
+namespace xtest {
+namespace internal {
+// A `--xtest_filter`, compiled once to match the full names ("Suite.Test") of
+// any number of tests.
+//
+// The filter has the syntax of googletest's: a ':'-separated list of positive
+// patterns, optionally followed by '-' and a ':'-separated list of negative
+// patterns.  A pattern is a glob in which '*' matches any string and '?' any
+// single character.  A name matches the filter if it matches at least one
+// positive pattern, or there is none, and no negative pattern.  A list of full
+// names, e.g., "Foo.Bar:Foo.Baz", is a filter too.
+//
+// All of the patterns are compiled into a single nondeterministic automaton
+// whose states are shared by patterns with a common prefix, which is turned
+// into a deterministic one lazily, as names are matched.  Matching a name then
+// costs one table look-up per character, however many patterns there are.
+class TestFilter {
+ public:
+  // Compiles the patterns of `filter`.
+  explicit TestFilter(const std::string& filter);
+
+  // Returns true if the full name `test_name` matches the filter.  Not const
+  // as it extends the deterministic automaton.
+  bool Matches(const std::string& test_name);
+
+ private:
+  // Which patterns a name matches.
+  enum Match : uint8_t { kPositive = 1, kNegative = 2 };
+
+  // A state of the nondeterministic automaton: a prefix of some patterns.
+  struct PatternState {
+    // Next state on a character, on any character ('?') and, without input,
+    // after a '*'.
+    std::unordered_map<char, int32_t> on_char;
+    int32_t on_any_char = -1;
+    int32_t on_star = -1;
+
+    bool loops = false;   // True after a '*': stays on any character.
+    uint8_t matches = 0;  // `Match` of the patterns ending here.
+  };
+
+  // A state of the deterministic automaton: a set of pattern states.
+  struct NameState {
+    std::vector<int32_t> pattern_states;  // Sorted.
+    uint8_t matches = 0;        // `Match` of all of `pattern_states`.
+    std::vector<int32_t> next;  // Per character class, `kUnknown` until known.
+  };
+
+  static constexpr int32_t kUnknown = -1;
+  static constexpr int32_t kNoMatch = 0;  // The state of no pattern.
+
+  // Largest number of transitions of the deterministic states kept; past it
+  // they are dropped and computed again, which bounds the memory the filter
+  // takes for any number of tests.
+  static constexpr std::size_t kMaxTransitions = std::size_t{1} << 20;
+
+  void AddPattern(const std::string& pattern, const Match& match);
+  void AddClosure(const int32_t& state, std::vector<int32_t>* states) const;
+  int32_t GetNameState(std::vector<int32_t> pattern_states);
+  int32_t Step(const int32_t& name_state, const int32_t& char_class);
+  void Reset();
+
+  // The states of the nondeterministic automaton; the first one is the start.
+  std::vector<PatternState> pattern_states_;
+
+  // Characters no pattern tells apart share a class, so that a deterministic
+  // state has a transition per class rather than per character.  Class `0` is
+  // that of the characters no pattern names.
+  std::array<int32_t, 256> char_class_;
+  std::vector<char> class_char_;  // A character of every class.
+
+  std::vector<NameState> name_states_;
+  std::map<std::vector<int32_t>, int32_t> name_state_ids_;
+  int32_t start_;
+
+  XTEST_DISALLOW_COPY_AND_ASSIGN_(TestFilter);
+};
+}  // namespace internal
+}  // namespace xtest
+
+#endif  // XTEST_INCLUDE_INTERNAL_XTEST_FILTER_HH_
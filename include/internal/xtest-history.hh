@@ -0,0 +1,107 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_INCLUDE_INTERNAL_XTEST_HISTORY_HH_
+#define XTEST_INCLUDE_INTERNAL_XTEST_HISTORY_HH_
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "internal/xtest-port.hh"
+#include "xtest-registrar.hh"
+
+namespace xtest {
+namespace internal {
+// What the test history knows about a single test.
+struct TestHistoryEntry {
+  uint32_t runs = 0;          // Number of runs the test was recorded in.
+  double mean_time = 0.0;     // Moving average of its elapsed time in ms.
+  double failure_rate = 0.0;  // Moving average of its failures, 0 to 1.
+
+  // Number of runs since the test last failed; `runs` if it never failed.
+  uint32_t runs_since_failure = 0;
+};
+
+// Elapsed times of the tests of earlier runs, kept in a file across runs.
+//
+// Every test is stored as one line of text,
+//
+// ```
+// FooTest.Bar 12 804.25 0.0900 3
+// ```
+//
+// holding its full name, the number of runs it was recorded in, exponentially
+// weighted moving averages of its elapsed time in milliseconds and of its
+// failures, so that a test that got slower or flakier is soon scheduled
+// accordingly, and the number of runs since it last failed.
+// Tests that are no longer run are kept, as they may only be filtered out
+// this time.
+class TestHistory {
+ public:
+  TestHistory() = default;
+
+  // Reads the history kept in the file at `path`, replacing the current one.
+  // A missing file is an empty history.  Returns false, setting `errno`, if
+  // the file exists but cannot be read.
+  bool Load(const std::string& path);
+
+  // Writes the history to the file at `path`.  The file is replaced at once,
+  // so a run killed while writing it leaves the old history behind.  Returns
+  // false, setting `errno`, if the file cannot be written.
+  bool Save(const std::string& path) const;
+
+  // Adds the elapsed time and the result of `test` to its history.
+  void Record(const TestRegistrar* test);
+
+  // Returns the elapsed time `test` is expected to take in milliseconds.  A
+  // test without history is expected to take as long as the average test
+  // with history, and every test as long as `0` if the history is empty.
+  TimeInMillis ExpectedTime(const TestRegistrar* test) const;
+
+  // Returns how likely `test` is to fail, for running the likeliest failures
+  // first: its failure rate plus, if it ever failed, `1 / (1 + runs since it
+  // last failed)`, so that a recent failure counts more than an old one.  A
+  // test without history is new or changed and ranks above all others.
+  double FailurePriority(const TestRegistrar* test) const;
+
+  bool empty() const { return entries_.empty(); }
+
+ private:
+  // Entries keyed by full test name, "Suite.Test", so that the file is
+  // written in the same order every time.
+  std::map<std::string, TestHistoryEntry> entries_;
+  double total_mean_time_ = 0.0;  // Sum of the moving averages of `entries_`.
+
+  XTEST_DISALLOW_COPY_AND_ASSIGN_(TestHistory);
+};
+}  // namespace internal
+}  // namespace xtest
+
+#endif  // XTEST_INCLUDE_INTERNAL_XTEST_HISTORY_HH_
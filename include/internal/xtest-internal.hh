@@ -32,4 +32,12 @@
 
 #define XTEST_STRINGIFY_(name) #name
 
+// Marks a parameter that may be left unused, e.g., the `current_test` of a test
+// that does not refer to it, so that `-Wunused-parameter` does not flag it.
+#if defined(__GNUC__) || defined(__clang__)
+#define XTEST_ATTRIBUTE_UNUSED_ __attribute__((unused))
+#else
+#define XTEST_ATTRIBUTE_UNUSED_
+#endif
+
 #endif  // XTEST_INCLUDE_INTERNAL_XTEST_INTERNAL_HH_
@@ -0,0 +1,151 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_INCLUDE_INTERNAL_XTEST_ISOLATION_HH_
+#define XTEST_INCLUDE_INTERNAL_XTEST_ISOLATION_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "internal/xtest-affinity.hh"
+#include "internal/xtest-port.hh"
+#include "internal/xtest-scheduler.hh"
+
+namespace xtest {
+namespace internal {
+// How `RunTestPlanInProcesses()` uses its worker processes.
+struct WorkerPoolOptions {
+  // Number of worker processes running at the same time.
+  std::size_t num_workers = 1;
+
+  // Number of tests handed out to a worker at once.  `0` hands out batches
+  // of a share of the remaining expected time that shrinks as the run nears
+  // its end so that the workers finish at about the same time.
+  std::size_t batch_size = 0;
+
+  // When true every batch is run by a freshly forked worker that exits once
+  // the batch is done, so every batch starts from a copy-on-write snapshot of
+  // the parent taken after it warmed up ("zygote" mode).  Otherwise the
+  // workers are long-lived and run batch after batch.
+  bool fork_per_batch = false;
+
+  // Time a test may run for unless it says otherwise, see `GetTestTimeout()`;
+  // `0` means no limit.  A worker whose test runs out of time is expected to
+  // interrupt it itself, see `ArmTestWatchdog()`; one that has not reported
+  // back `2 * kTimeoutGracePeriod` milliseconds after that is killed.
+  TimeInMillis test_timeout = 0;
+
+  // Largest resident set size in bytes a test may reach; `0` means no limit.
+  // A worker has its peak resident set size measured after every test and is
+  // polled by the parent while it runs one, and its address space is capped at
+  // what it had at the start plus twice the limit.  A test that goes over the
+  // limit is marked as `FAILED` with its peak resident set size and its worker
+  // is replaced.
+  uint64_t max_rss = 0;
+
+  // CPUs the workers are pinned to, by the index of their slot; null leaves
+  // them to the kernel.
+  const CpuAffinity* cpu_affinity = nullptr;
+};
+
+// Runs the tests in `plan` with `run_test` in worker processes forked from the
+// calling process.
+//
+// The parent process hands out batches of test indices, longest expected time
+// first (see `OrderTestsLongestFirst()`), to the workers over pipes and the
+// workers send back the result, the elapsed time, the number of failed
+// assertions and the captured console output of every test they run.  The
+// results are printed in plan order by the parent.  A batch only takes tests
+// whose resources no other worker holds and that fit into the CPU slots and
+// memory the other workers leave, see `ResourceLocks`, which the worker holds
+// until it reports the tests back.
+//
+// A worker that dies while running a test, e.g., on a segmentation fault, or
+// that is killed for being stuck in a test that ran out of time, takes only
+// that test down: the test is marked as `FAILED`, the rest of the worker's
+// batch is handed out again and a new worker is forked in its place.
+//
+// `on_test_completed`, if not null, is told about every test that completes,
+// in the parent process.
+//
+// Once the run is cancelled, see `CancelTestRun()`, in the parent or in any
+// worker, no further batch is handed out and the workers report the rest of
+// their batches back without running them.
+//
+// On platforms without `fork()` the tests are run on worker threads instead.
+void RunTestPlanInProcesses(const TestPlan& plan,
+                            const WorkerPoolOptions& options,
+                            TestRunner run_test,
+                            TestCompletionListener on_test_completed = nullptr);
+
+// Marks `test`, which let a `std::bad_alloc` out, as `FAILED` and says in its
+// output that it ran out of memory.  In a worker process of
+// `RunTestPlanInProcesses()` with a `WorkerPoolOptions::max_rss`, that is under
+// that limit, with the size the failed allocation was larger than, rather than
+// the peak resident set size of the test, which it never reached.
+void ReportAllocationFailure(TestRegistrar* test);
+
+// How the last test of a sequence run by `RunTestsInChildProcess()` did.
+enum class ChildRunResult {
+  kPassed,
+  kFailed,      // It failed, or the child process died while running it.
+  kNotReached,  // The child process died before it got to run it.
+};
+
+// Runs `tests` in order with `run_test` in a child process forked from the
+// calling process, with their console output discarded, and returns how the
+// last of them did.  Used to replay a test order without the tests polluting
+// the calling process.
+//
+// On platforms without `fork()` no test is run and `kNotReached` is returned.
+ChildRunResult RunTestsInChildProcess(const std::vector<TestRegistrar*>& tests,
+                                      TestRunner run_test);
+
+// Returns the length of the shortest prefix of a sequence of `num_tests` tests
+// after which a test fails, where `fails_after(length)` tells whether it fails
+// after the first `length` tests.
+//
+// Assumes that the test passes on its own, fails after all `num_tests` tests,
+// and keeps failing once a prefix has made it fail, i.e., that the tests that
+// run before it only ever add to whatever state makes it fail.  Bisects the
+// sequence, calling `fails_after` about log2(num_tests) times.
+std::size_t FindShortestFailingPrefix(
+    const std::size_t& num_tests,
+    const std::function<bool(std::size_t length)>& fails_after);
+
+// Returns a human readable description of a `waitpid()` status, e.g.,
+// "killed by signal 11 (Segmentation fault)".
+std::string DescribeExitStatus(const int32_t& status);
+}  // namespace internal
+}  // namespace xtest
+
+#endif  // XTEST_INCLUDE_INTERNAL_XTEST_ISOLATION_HH_
@@ -0,0 +1,110 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_INCLUDE_INTERNAL_XTEST_JOURNAL_HH_
+#define XTEST_INCLUDE_INTERNAL_XTEST_JOURNAL_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "internal/xtest-port.hh"
+#include "xtest-registrar.hh"
+
+namespace xtest {
+namespace internal {
+// Result of a test as recorded in a test journal.
+struct JournalEntry {
+  TestResult result;
+  TimeInMillis elapsed_time;
+};
+
+// Results recorded in a test journal keyed by full test name, "Suite.Test".
+using JournalEntries = std::unordered_map<std::string, JournalEntry>;
+
+// Append-only journal of the results of the tests completed so far, written to
+// a memory-mapped file.
+//
+// Every completed test is appended as one line of text,
+//
+// ```
+// PASSED 12 FooTest.Bar
+// FAILED 3 FooTest.Baz
+// SKIPPED 0 FooTest.Qux
+// ```
+//
+// holding its result, its elapsed time in milliseconds and its full name.  The
+// lines are copied straight into the shared mapping of the file, so whatever
+// was appended survives the process being killed, e.g., by the OOM killer,
+// without a system call per test.  The file grows in large steps and is cut
+// back to the journal's length when the journal is closed; the zero bytes a
+// killed process leaves behind are ignored when the journal is read.
+class TestJournal {
+ public:
+  TestJournal();
+
+  // Closes the journal if it is open.
+  ~TestJournal();
+
+  // Opens the journal at `path` for appending, creating the file if it does
+  // not exist.  Results already in the file are kept.  Returns false, setting
+  // `errno`, if the file cannot be opened or mapped.
+  bool Open(const std::string& path);
+
+  // Appends the result of `test` to the journal.  Does nothing if the journal
+  // is not open.
+  void Append(const TestRegistrar* test);
+
+  // Cuts the file back to the journal's length and closes it.
+  void Close();
+
+  bool is_open() const { return fd_ >= 0; }
+
+ private:
+  // Makes room for at least `size` more bytes, growing and remapping the file
+  // if needed.  Returns false if the file cannot be grown.
+  bool Reserve(const std::size_t& size);
+
+  int32_t fd_;
+  char* data_;            // Mapping of the first `capacity_` bytes.
+  std::size_t size_;      // Length of the journal in bytes.
+  std::size_t capacity_;  // Length of the file and of the mapping.
+
+  XTEST_DISALLOW_COPY_AND_ASSIGN_(TestJournal);
+};
+
+// Reads the results recorded in the journal at `path` into `entries`.  A line
+// cut short by a crash is ignored.  Returns false if the file exists but cannot
+// be read; a missing file is an empty journal.
+bool ReadTestJournal(const std::string& path, JournalEntries* entries);
+}  // namespace internal
+}  // namespace xtest
+
+#endif  // XTEST_INCLUDE_INTERNAL_XTEST_JOURNAL_HH_
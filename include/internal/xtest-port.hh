@@ -30,6 +30,7 @@
 #ifndef XTEST_INCLUDE_INTERNAL_XTEST_PORT_HH_
 #define XTEST_INCLUDE_INTERNAL_XTEST_PORT_HH_
 
+#include <atomic>
 #include <chrono>  // NOLINT
 #include <cstdint>
 #include <cstdio>
@@ -103,6 +104,19 @@ class Timer {
  private:
   std::chrono::steady_clock::time_point start_;
 };
+
+// Parses a duration such as "120s", "2m", "1.5h" or "500ms" into `duration` in
+// milliseconds.  A number without a unit is in seconds.  Returns false, leaving
+// `duration` alone, if `str` is not a non-negative duration.
+bool ParseDuration(const char* str, TimeInMillis* duration);
+
+// Parses a size such as "512M", "2G", "1.5G" or "64K" into `size` in bytes.
+// The units are powers of 1024; a number without a unit is in bytes.  Returns
+// false, leaving `size` alone, if `str` is not a non-negative size.
+bool ParseByteSize(const char* str, uint64_t* size);
+
+// Formats `size` bytes for humans, e.g., "1.5 GiB" or "512.0 MiB".
+std::string FormatByteSize(const uint64_t& size);
 }  // namespace internal
 
 // New string width for the aligned string returned by the function
@@ -192,7 +206,8 @@ inline const char* GetEnv(const char* name) { return std::getenv(name); }
 
 #define XTEST_FLAG_(flagName) flag_xtest_##flagName
 #define XTEST_FLAG_GET_(flagName) ::xtest::XTEST_FLAG_(flagName)
-#define XTEST_FLAG_SET_(flagName, value) (void)(XTEST_FLAG_(flagName) = (value))
+#define XTEST_FLAG_SET_(flagName, value) \
+  (void)(::xtest::XTEST_FLAG_(flagName) = (value))
 
 #define XTEST_FLAG_DECLARE_bool_(flagName) \
   namespace xtest {                        \
@@ -253,6 +268,20 @@ inline const char* GetEnv(const char* name) { return std::getenv(name); }
   }                                                   \
   static_assert(true, "no-op to require trailing semicolon")
 
+// Atomic counterparts of the `uint64_t` globals for the counters that are
+// updated from inside of the tests, which may run on several threads at once.
+#define XTEST_GLOBAL_DECLARE_atomic_uint64_(name)            \
+  namespace xtest {                                          \
+  extern std::atomic<uint64_t> XTEST_GLOBAL_INSTANCE_(name); \
+  }                                                          \
+  static_assert(true, "no-op to require trailing semicolon")
+
+#define XTEST_GLOBAL_DEFINE_atomic_uint64_(name, value, doc) \
+  namespace xtest {                                          \
+  std::atomic<uint64_t> XTEST_GLOBAL_INSTANCE_(name)(value); \
+  }                                                          \
+  static_assert(true, "no-op to require trailing semicolon")
+
 #define XTEST_STATIC_DECLARE_vector_(name, T, doc)    \
   namespace xtest {                                   \
   static std::vector<T> XTEST_GLOBAL_INSTANCE_(name); \
@@ -261,8 +290,15 @@ inline const char* GetEnv(const char* name) { return std::getenv(name); }
 // Global counter for non-fatal test failures.
 //
 // This global counter is defined in the object file xtest.cc and incremented
-// every time a non-fatal test assertion fails.
-XTEST_GLOBAL_DECLARE_uint64_(failure_count);
+// every time a non-fatal test assertion fails.  It is atomic because the
+// assertions of tests running on different worker threads update it
+// concurrently.
+XTEST_GLOBAL_DECLARE_atomic_uint64_(failure_count);
+
+// Global counter for the assertion failures that no test could be blamed for,
+// see `AssertionContext::MarkFailed()`.  Each is counted in `failure_count` as
+// well, so that the run fails.
+XTEST_GLOBAL_DECLARE_atomic_uint64_(unattributed_failure_count);
 
 XTEST_GLOBAL_DECLARE_uint64_(test_count);
 XTEST_GLOBAL_DECLARE_uint64_(test_suite_count);
@@ -275,12 +311,191 @@ XTEST_FLAG_DECLARE_bool_(help);
 // When this flag is specified, tests' order is randomized on every iteration.
 XTEST_FLAG_DECLARE_bool_(shuffle);
 
+// Seed to shuffle the tests with, in [1, 99999]; `0` picks one from the
+// current time.  The seed is printed so that an order can be replayed.
+XTEST_FLAG_DECLARE_uint32_(random_seed);
+
 // Prints the list of all tests with there suite names.
 XTEST_FLAG_DECLARE_bool_(list_tests);
 
+// Number of worker threads to run the tests on.  `1` runs the tests serially on
+// the main thread and `0` uses one worker thread per online CPU.
+XTEST_FLAG_DECLARE_uint32_(jobs);
+
+// CPUs the workers of a parallel run are pinned to: "compact", "scatter" or a
+// list of CPUs such as "0,2,4-7", see `internal::CpuAffinity`.  Empty leaves
+// the workers to the kernel.
+XTEST_FLAG_DECLARE_string_(cpu_affinity);
+
+// Isolation of the tests from each other.  "none" runs the tests in this
+// process and "process" runs them in forked worker processes so that a
+// crashing test does not take the whole run down.  "zygote" forks a fresh
+// worker for every batch of tests from the warmed up parent process.
+XTEST_FLAG_DECLARE_string_(isolate);
+
+// Number of tests each worker forked with `--xtest_isolate=zygote` runs before
+// it exits.  `0` hands out batches that shrink as the run nears its end.
+XTEST_FLAG_DECLARE_uint32_(zygote_batch);
+
+// Runs only the tests whose full names ("Suite.Test") match this filter of
+// positive and negative glob patterns, see `internal::TestFilter`.  An empty
+// filter runs all tests.
+XTEST_FLAG_DECLARE_string_(filter);
+
+// Runs only the tests whose tags match this expression, e.g., "fast,!network".
+// See `internal::TagIndex`.  An empty expression runs all tests.
+XTEST_FLAG_DECLARE_string_(tags);
+
+// When true the tests whose suite or test name starts with "DISABLED_" are run
+// too.
+XTEST_FLAG_DECLARE_bool_(also_run_disabled_tests);
+
+// Path of the Unix domain socket to serve test runs on instead of running the
+// tests once.  See `internal::ServeTests()`.
+XTEST_FLAG_DECLARE_string_(serve);
+
+// Path of the journal every completed test is recorded in as soon as it
+// completes.  See `internal::TestJournal`.
+XTEST_FLAG_DECLARE_string_(journal);
+
+// Path of the journal of an earlier run to resume: the tests recorded in it are
+// not run again, and the run is recorded in it unless `--xtest_journal` says
+// otherwise.
+XTEST_FLAG_DECLARE_string_(resume);
+
+// Path of the file the elapsed times of the tests are kept in across runs.
+// The tests are scheduled longest first and shards are balanced by expected
+// running time.  See `internal::TestHistory`.
+XTEST_FLAG_DECLARE_string_(history);
+
+// Wall-clock time the run may take, e.g., "120s".  Only the tests likeliest to
+// fail that are expected to fit in it, according to the `--xtest_history`
+// file, are run.  Empty means no limit.
+XTEST_FLAG_DECLARE_string_(time_budget);
+
+// Wall-clock time to keep running the tests for, shuffled, e.g., "2h", while
+// the resources of the process are tracked for steady growth.  Empty runs the
+// tests once.
+XTEST_FLAG_DECLARE_string_(soak);
+
+// Time a test may run for, e.g., "30s", unless it was registered with
+// `TEST_WITH_TIMEOUT()`.  A test that runs out of time is interrupted, after
+// the stacks of all threads are dumped, and fails.  Empty or `0` means no
+// limit.
+XTEST_FLAG_DECLARE_string_(timeout);
+
+// Largest resident set size a test may reach, e.g., "2G" or "512M", with
+// `--xtest_isolate`.  A test that goes over it fails with its peak resident set
+// size and its worker process is replaced.  Empty means no limit.
+XTEST_FLAG_DECLARE_string_(max_rss);
+
+// When true a test that raises `SIGSEGV`, `SIGBUS`, `SIGFPE` or `SIGILL` is
+// jumped out of and fails, and the run goes on with the next test.
+XTEST_FLAG_DECLARE_bool_(catch_faults);
+
+// When true the run is cancelled on the first failure: no further test is
+// started, in any worker, and the tests still running see `XTEST_CANCELLED()`
+// turn true so that they can stop early.
+XTEST_FLAG_DECLARE_bool_(fail_fast);
+
+// Full name ("Suite.Test") of a test that fails only after some of the tests
+// run before it.  Instead of running the tests, the tests before it are
+// bisected in forked child processes for the shortest run of them after which
+// it fails.
+XTEST_FLAG_DECLARE_string_(bisect_order);
+
 // This flag enables using colors in terminal output. Available values are "yes"
 // to enable colors, "no" (disable colors), or "auto" (the default) to let XTest
 // decide.
 XTEST_FLAG_DECLARE_string_(color);
 
+namespace xtest {
+namespace internal {
+// Saves the values of all the xtest flags on construction and restores them on
+// destruction, so that flags changed for a single run do not leak into the
+// next one.  Every new flag must be added here.
+class XTestFlagSaver {
+ public:
+  XTestFlagSaver()
+      : help_(XTEST_FLAG_GET_(help)),
+        shuffle_(XTEST_FLAG_GET_(shuffle)),
+        random_seed_(XTEST_FLAG_GET_(random_seed)),
+        list_tests_(XTEST_FLAG_GET_(list_tests)),
+        jobs_(XTEST_FLAG_GET_(jobs)),
+        cpu_affinity_(XTEST_FLAG_GET_(cpu_affinity)),
+        isolate_(XTEST_FLAG_GET_(isolate)),
+        zygote_batch_(XTEST_FLAG_GET_(zygote_batch)),
+        filter_(XTEST_FLAG_GET_(filter)),
+        tags_(XTEST_FLAG_GET_(tags)),
+        also_run_disabled_tests_(XTEST_FLAG_GET_(also_run_disabled_tests)),
+        serve_(XTEST_FLAG_GET_(serve)),
+        journal_(XTEST_FLAG_GET_(journal)),
+        resume_(XTEST_FLAG_GET_(resume)),
+        history_(XTEST_FLAG_GET_(history)),
+        time_budget_(XTEST_FLAG_GET_(time_budget)),
+        soak_(XTEST_FLAG_GET_(soak)),
+        timeout_(XTEST_FLAG_GET_(timeout)),
+        max_rss_(XTEST_FLAG_GET_(max_rss)),
+        catch_faults_(XTEST_FLAG_GET_(catch_faults)),
+        fail_fast_(XTEST_FLAG_GET_(fail_fast)),
+        bisect_order_(XTEST_FLAG_GET_(bisect_order)),
+        color_(XTEST_FLAG_GET_(color)) {}
+
+  ~XTestFlagSaver() {
+    XTEST_FLAG_SET_(help, help_);
+    XTEST_FLAG_SET_(shuffle, shuffle_);
+    XTEST_FLAG_SET_(random_seed, random_seed_);
+    XTEST_FLAG_SET_(list_tests, list_tests_);
+    XTEST_FLAG_SET_(jobs, jobs_);
+    XTEST_FLAG_SET_(cpu_affinity, cpu_affinity_);
+    XTEST_FLAG_SET_(isolate, isolate_);
+    XTEST_FLAG_SET_(zygote_batch, zygote_batch_);
+    XTEST_FLAG_SET_(filter, filter_);
+    XTEST_FLAG_SET_(tags, tags_);
+    XTEST_FLAG_SET_(also_run_disabled_tests, also_run_disabled_tests_);
+    XTEST_FLAG_SET_(serve, serve_);
+    XTEST_FLAG_SET_(journal, journal_);
+    XTEST_FLAG_SET_(resume, resume_);
+    XTEST_FLAG_SET_(history, history_);
+    XTEST_FLAG_SET_(time_budget, time_budget_);
+    XTEST_FLAG_SET_(soak, soak_);
+    XTEST_FLAG_SET_(timeout, timeout_);
+    XTEST_FLAG_SET_(max_rss, max_rss_);
+    XTEST_FLAG_SET_(catch_faults, catch_faults_);
+    XTEST_FLAG_SET_(fail_fast, fail_fast_);
+    XTEST_FLAG_SET_(bisect_order, bisect_order_);
+    XTEST_FLAG_SET_(color, color_);
+  }
+
+  XTestFlagSaver(const XTestFlagSaver&) = delete;
+  XTestFlagSaver& operator=(const XTestFlagSaver&) = delete;
+
+ private:
+  bool help_;
+  bool shuffle_;
+  uint32_t random_seed_;
+  bool list_tests_;
+  uint32_t jobs_;
+  std::string cpu_affinity_;
+  std::string isolate_;
+  uint32_t zygote_batch_;
+  std::string filter_;
+  std::string tags_;
+  bool also_run_disabled_tests_;
+  std::string serve_;
+  std::string journal_;
+  std::string resume_;
+  std::string history_;
+  std::string time_budget_;
+  std::string soak_;
+  std::string timeout_;
+  std::string max_rss_;
+  bool catch_faults_;
+  bool fail_fast_;
+  std::string bisect_order_;
+  std::string color_;
+};
+}  // namespace internal
+}  // namespace xtest
+
 #endif  // XTEST_INCLUDE_INTERNAL_XTEST_PORT_HH_
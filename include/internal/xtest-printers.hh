@@ -31,18 +31,92 @@
 #define XTEST_INCLUDE_INTERNAL_XTEST_PRINTERS_HH_
 
 #include <cstdarg>
+#include <cstdio>
+#include <functional>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace xtest {
 namespace internal {
 enum class XTestColor { kDefault, kRed, kGreen, kYellow };
 
+// Collects the text a thread prints through `StreamPrintf()` so that it can be
+// replayed on the real streams later on.
+//
+// The parallel runner installs one `OutputCapture` per running test so that
+// the console output of tests that run concurrently still reads the same as
+// the output of a serial run.
+class OutputCapture {
+ public:
+  using Chunk = std::pair<FILE*, std::string>;
+
+  // Appends `text` printed on `stream` to the capture.  Consecutive text
+  // printed on the same stream is merged into a single chunk.
+  void Append(FILE* stream, const std::string& text);
+
+  // Sets a function called before every `Append()`, e.g., by a worker process
+  // to take in first what the test wrote straight to the file descriptors of
+  // the streams, so that it keeps its place among the text printed through
+  // `StreamPrintf()`.  Appending from the function does not call it again.
+  void set_before_append(std::function<void()> before_append) {
+    before_append_ = std::move(before_append);
+  }
+
+  // Writes the captured chunks to their streams in the order they were
+  // captured and flushes the streams.
+  void Replay() const;
+
+  // Discards everything captured so far.
+  void Clear();
+
+  const std::vector<Chunk>& chunks() const { return chunks_; }
+
+ private:
+  std::vector<Chunk> chunks_;
+  std::function<void()> before_append_;
+};
+
+// Installs an `OutputCapture` for the calling thread for the lifetime of this
+// object; the previously installed capture (if any) is restored on
+// destruction.
+class ScopedOutputCapture {
+ public:
+  explicit ScopedOutputCapture(OutputCapture* capture);
+  ~ScopedOutputCapture();
+
+ private:
+  OutputCapture* const saved_;
+
+  ScopedOutputCapture(const ScopedOutputCapture&) = delete;
+  ScopedOutputCapture& operator=(const ScopedOutputCapture&) = delete;
+};
+
+// Returns the `OutputCapture` installed for the calling thread or `nullptr`.
+OutputCapture* GetCurrentOutputCapture();
+
+// Prints to `stream` like `std::fprintf()` unless an `OutputCapture` is
+// installed for the calling thread in which case the text is appended to the
+// capture instead.
+void StreamPrintf(FILE* stream, const char* fmt, ...);
+
+// `va_list` version of `StreamPrintf()`.
+void StreamVPrintf(FILE* stream, const char* fmt, va_list args);
+
+// Flushes `stream` unless the calling thread's output is being captured.
+void StreamFlush(FILE* stream);
+
 // Returns true only if the output stream is a TTY.
 //
 // Uses posix compatible functions `IsAtty()` and `FileNo()` to check if the
 // output stream is a TTY.
 bool ShouldUseColor(bool stdout_is_tty);
 
+// Makes `ColoredPrintf()` go on taking `stdout` for a TTY if it is one now, in
+// a process about to redirect it to capture the output, e.g., a worker process
+// whose output is replayed on the console by its parent.
+void KeepStdoutTtyState();
+
 // Prints text with colors in both Windows and Unix-like systems by setting the
 // console text attributes and emitting colors respectively.  If the output is
 // redirected to a file then we disable color output.
@@ -0,0 +1,349 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_INCLUDE_INTERNAL_XTEST_SCHEDULER_HH_
+#define XTEST_INCLUDE_INTERNAL_XTEST_SCHEDULER_HH_
+
+#include <condition_variable>  // NOLINT
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <set>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "internal/xtest-affinity.hh"
+#include "internal/xtest-port.hh"
+#include "internal/xtest-printers.hh"
+#include "xtest-registrar.hh"
+
+namespace xtest {
+namespace internal {
+// Ordered list of the test suites, and their tests, selected for a run.
+//
+// Tests of the same suite are kept together so that the console output of a
+// parallel run reads exactly like the output of a serial run.
+using TestPlan = std::vector<XTestUnitTestPair>;
+
+// Runs a single test on the calling thread and records its result and elapsed
+// time in the given `TestRegistrar` instance.
+using TestRunner = void (*)(TestRegistrar* test);
+
+// Called on the calling thread of a test run, one test at a time, every time a
+// test completes, in the order the tests complete.
+using TestCompletionListener = void (*)(TestRegistrar* test);
+
+// Prints the results of the tests of a `TestPlan` in plan order while the tests
+// themselves complete in any order.
+//
+// Tests are identified by their index in the flattened plan.  The console
+// output of a test is collected in its `OutputCapture` while it runs and is
+// printed, surrounded by the test suite header and footer, once the test and
+// every test before it in the plan have completed.  A test that was not run,
+// as the run was cancelled (see `CancelTestRun()`), completes without a result
+// and test suites none of whose tests were run are left out.  This class is
+// not thread-safe.
+class OrderedResultPrinter {
+ public:
+  // Constructs a printer for the tests of `plan` that also tells
+  // `on_test_completed`, if not null, about every test that completes.
+  explicit OrderedResultPrinter(
+      const TestPlan& plan, TestCompletionListener on_test_completed = nullptr);
+
+  // Returns the tests of the plan in plan order.
+  const std::vector<TestRegistrar*>& tests() const { return tests_; }
+
+  // Returns the capture to collect the console output of test `index` in.
+  OutputCapture* output(const std::size_t& index) { return &outputs_[index]; }
+
+  // Marks test `index` as completed and prints the results of the tests that
+  // are ready to be printed.
+  void OnTestCompleted(const std::size_t& index);
+
+ private:
+  const TestPlan& plan_;
+  TestCompletionListener on_test_completed_;
+  std::vector<TestRegistrar*> tests_;
+  std::vector<std::size_t> suite_of_test_;  // Index into `plan_`.
+  std::vector<OutputCapture> outputs_;
+  std::vector<bool> completed_;
+  std::size_t next_to_print_;
+  bool suite_printed_;  // Whether the header of the current suite was.
+
+  XTEST_DISALLOW_COPY_AND_ASSIGN_(OrderedResultPrinter);
+};
+
+// Returns the names of the resources `test` uses, see `TEST_WITH_RESOURCES()`
+// and `XTEST_RESOURCE()`, sorted and without duplicates.
+std::vector<std::string> GetTestResources(const TestRegistrar* test);
+
+// Number of memory units the tests running at the same time share, see
+// `TestCost`.
+constexpr std::size_t kMemoryUnits = 4;
+
+// Returns the number of memory units a test of memory class `mem` takes up.
+std::size_t GetMemoryUnits(const MemoryClass& mem);
+
+// The named resources held by the workers of a parallel run, see
+// `TEST_WITH_RESOURCES()`, and the CPU slots and memory units they take up,
+// see `TEST_WITH_COST()`.
+//
+// A worker claims all the resources of a test before it starts it and releases
+// them when the test completes.  A resource is held by one worker at a time,
+// which may claim it again for further tests, e.g., the tests of a batch run by
+// a worker process; it is free once every test that claimed it has released
+// it.  Claiming all the resources of a test at once, or none of them, keeps two
+// workers from each holding a resource the other one waits for.
+//
+// A worker takes up as many CPU slots and memory units as the costliest of the
+// tests it holds claims for, as it runs them one after the other, and the
+// workers together take up at most `cpu_slots` slots and `kMemoryUnits` units.
+// A test is taken to need at most all of them, so that it can always run once
+// no other test does.  This class is thread-safe.
+class ResourceLocks {
+ public:
+  // Constructs the locks for `tests`, which are identified by their index, run
+  // by workers that share `cpu_slots` CPU slots.
+  ResourceLocks(const std::vector<TestRegistrar*>& tests,
+                const std::size_t& cpu_slots);
+
+  // Returns true if no test uses any resource and every test takes up a single
+  // CPU slot and no memory unit, i.e., every claim of a worker that holds no
+  // other claim succeeds.
+  bool empty() const { return empty_; }
+
+  // Claims the resources of test `test` for `worker`.  Returns false, claiming
+  // none of them, if another worker holds any of them or if the workers would
+  // take up more CPU slots or memory units than there are.
+  bool TryClaim(const std::size_t& test, const std::size_t& worker);
+
+  // Releases the resources claimed for test `test`.
+  void Release(const std::size_t& test);
+
+ private:
+  // CPU slots and memory units taken up by the tests a worker holds claims
+  // for; the worker takes up the largest of each.
+  struct WorkerUsage {
+    std::multiset<std::size_t> cpu_slots;
+    std::multiset<std::size_t> memory_units;
+  };
+
+  // Returns the largest of `values`, or `0` if there is none.
+  static std::size_t Largest(const std::multiset<std::size_t>& values);
+
+  std::vector<std::vector<std::string>> resources_of_test_;
+  std::vector<std::size_t> cpu_slots_of_test_;
+  std::vector<std::size_t> memory_units_of_test_;
+  std::vector<std::size_t> worker_of_test_;
+  const std::size_t cpu_slots_;
+  bool empty_;
+  std::mutex mutex_;
+  // Worker holding a resource and the number of its tests that claimed it.
+  std::map<std::string, std::pair<std::size_t, std::size_t>> held_;
+  std::map<std::size_t, WorkerUsage> usage_of_worker_;
+  std::size_t cpu_slots_in_use_;
+  std::size_t memory_units_in_use_;
+
+  XTEST_DISALLOW_COPY_AND_ASSIGN_(ResourceLocks);
+};
+
+// A pool of worker threads that runs a fixed set of tasks.
+//
+// Every worker owns a double ended queue of task indices.  A worker takes tasks
+// from the front of its own queue and once its queue runs dry it steals tasks
+// from the back of the other workers' queues, so that a worker stuck on a long
+// running test does not hold up the tasks queued behind it.
+//
+// A task may have to be claimed before it can run, e.g., to keep two tests
+// that use the same resource apart.  A worker then takes the first task it can
+// claim rather than the first one, and waits for a running task to complete
+// when it can claim none of the tasks left.
+class WorkStealingPool {
+ public:
+  // Called with the index of the worker thread and the index of the task.
+  using Task = std::function<void(std::size_t worker, std::size_t task)>;
+
+  // Called with the index of the worker thread and the index of a task it is
+  // about to take; returns false if the task cannot run yet.  A claim must only
+  // fail because of a task that is running.
+  using Claim = std::function<bool(std::size_t worker, std::size_t task)>;
+
+  // Constructs a pool of `num_workers` workers.  The worker threads are not
+  // started until `Start()` is called.
+  explicit WorkStealingPool(std::size_t num_workers);
+
+  // Joins the worker threads if `Join()` has not been called yet.
+  ~WorkStealingPool();
+
+  // Distributes `tasks` round-robin over the workers' queues, preserving their
+  // order, and starts the worker threads that call `task` for every one of
+  // them, once `claim`, if any, succeeds for it.
+  void Start(const std::vector<std::size_t>& tasks, const Task& task,
+             const Claim& claim = nullptr);
+
+  // Blocks until every task has been run and the worker threads have exited.
+  void Join();
+
+  std::size_t num_workers() const { return queues_.size(); }
+
+ private:
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<std::size_t> tasks;
+  };
+
+  // Pops the first task `worker` can claim from `queue`, from the front or,
+  // when stealing, from the back.  Returns false if there is none.
+  bool PopClaimableTask(std::size_t worker, WorkerQueue* queue, bool steal,
+                        std::size_t* task);
+
+  // Pops the next task for `worker`, from its own queue if possible or else
+  // steals one from another worker, waiting for a running task to complete if
+  // there is none it can claim.  Returns false when there is no task left.
+  bool PopTask(std::size_t worker, std::size_t* task);
+
+  // Runs tasks on the calling thread until there is no task left.
+  void WorkerMain(std::size_t worker);
+
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+  std::vector<std::thread> threads_;
+  Task task_;
+  Claim claim_;
+
+  // Number of tasks not taken yet and the number of tasks completed so far,
+  // which a worker that could not claim any task waits to change.
+  std::mutex progress_mutex_;
+  std::condition_variable progress_;
+  std::size_t tasks_left_;
+  std::size_t tasks_completed_;
+
+  XTEST_DISALLOW_COPY_AND_ASSIGN_(WorkStealingPool);
+};
+
+// Returns a hash of the full name "suite_name.test_name" of a test.
+//
+// The hash (64-bit FNV-1a) only depends on the name, unlike the order of the
+// tests in the registry which depends on where the linker placed the names, so
+// it stays the same across rebuilds, machines and platforms.
+uint64_t HashTestName(const char* suite_name, const char* test_name);
+
+// Returns true if and only if `test` belongs to shard `shard_index` out of
+// `total_shards` shards.
+bool IsTestOnShard(const TestRegistrar* test, const int32_t& total_shards,
+                   const int32_t& shard_index);
+
+// Returns the indices of `tests` in the order to run them in: longest expected
+// time first, see `TestRegistrar::expected_time_`, as handing out the longest
+// tests first keeps a long test started last from holding up the end of a
+// parallel run.  Tests expected to take equally long keep their order, so
+// without a test history the order is left as is.
+std::vector<std::size_t> OrderTestsLongestFirst(
+    const std::vector<TestRegistrar*>& tests);
+
+// Splits `tests` into `total_shards` shards expected to take about equally
+// long and returns the shard of every test.
+//
+// The tests are placed longest expected time first, every one on the shard
+// with the least expected time so far.  Ties are broken by test name rather
+// than by the order of `tests`, which depends on where the linker placed the
+// names, so every shard computes the same split as long as all of them see
+// the same expected times.
+std::vector<int32_t> PackTestsIntoShards(
+    const std::vector<TestRegistrar*>& tests, const int32_t& total_shards);
+
+// Largest seed `--xtest_random_seed` takes; see `GetRandomSeedFromFlag()`.
+constexpr uint32_t kMaxRandomSeed = 99999;
+
+// Returns the seed to shuffle the tests with for the value of the
+// `--xtest_random_seed` flag: the flag itself if it is in [1, kMaxRandomSeed]
+// or else, e.g., for the default `0`, a seed picked from the current time.
+uint32_t GetRandomSeedFromFlag(const uint32_t& random_seed_flag);
+
+// Shuffles the order of the test suites of `plan` and of the tests within
+// every test suite, keeping the tests of a suite together.
+//
+// The shuffle is a Fisher-Yates shuffle driven by `std::mt19937` seeded with
+// `seed`; unlike `std::shuffle()`, whose use of the generator is up to the
+// standard library, it gives the same order for the same seed and plan with
+// every compiler, so that an order that made a test fail can be replayed.  The
+// suites are put in name order first, as the registry order may change when
+// the test binary is rebuilt.
+void ShuffleTestPlan(TestPlan* plan, const uint32_t& seed);
+
+// Puts the tests of `plan` in the order they come in `order`, keeping the tests
+// of a suite together: every suite moves to where its first test in `order`
+// is, and its tests follow in the order they come in `order`.  Tests and suites
+// that are not in `order` go after the rest, in the order they were in.
+void OrderTestPlan(TestPlan* plan,
+                   const std::vector<const TestRegistrar*>& order);
+
+// Reads the test sharding environment variables `XTEST_TOTAL_SHARDS` and
+// `XTEST_SHARD_INDEX`, or their Bazel counterparts `TEST_TOTAL_SHARDS` and
+// `TEST_SHARD_INDEX`, into `total_shards` and `shard_index`.
+//
+// Returns false, leaving the output parameters alone, when sharding is not
+// requested.  Exits the program when the variables hold invalid values, as
+// running every test on every shard would silently multiply the work.  Also
+// touches the file named by `TEST_SHARD_STATUS_FILE`, if any, to tell Bazel
+// that this binary supports sharding.
+bool ReadShardingEnvironment(int32_t* total_shards, int32_t* shard_index);
+
+// Returns the number of worker threads to use for the value of the
+// `--xtest_jobs` flag; `0` means one worker thread per online CPU.
+std::size_t GetNumberOfJobs(const uint32_t& jobs);
+
+// Runs the tests in `plan` with `run_test` on `num_jobs` worker threads.
+//
+// The tests are started longest expected time first, see
+// `OrderTestsLongestFirst()`, except that two tests that use the same resource
+// never run at the same time and that the tests running at the same time take
+// up at most `num_jobs` CPUs, see `ResourceLocks`.  Every test's console
+// output is captured while it runs and printed, together with the test suite
+// header and footer, in the order of `plan` as soon as the test and all the
+// tests before it have completed.  `on_test_completed`, if not null, is told
+// about every test that completes.  Both happen on the worker thread that
+// completed the test, not on the calling thread, one test at a time under a
+// mutex the workers share.  The worker threads are pinned to the CPUs of
+// `cpu_affinity`, if not null.  Once the run is cancelled, see
+// `CancelTestRun()`, the workers complete the remaining tests without running
+// them.
+void RunTestPlanInParallel(const TestPlan& plan, const std::size_t& num_jobs,
+                           TestRunner run_test,
+                           TestCompletionListener on_test_completed = nullptr,
+                           const CpuAffinity* cpu_affinity = nullptr);
+}  // namespace internal
+}  // namespace xtest
+
+#endif  // XTEST_INCLUDE_INTERNAL_XTEST_SCHEDULER_HH_
@@ -0,0 +1,68 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_INCLUDE_INTERNAL_XTEST_SERVER_HH_
+#define XTEST_INCLUDE_INTERNAL_XTEST_SERVER_HH_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace xtest {
+namespace internal {
+// Runs the tests once with the given xtest command line flags applied on top of
+// the flags the server was started with and returns the number of failed
+// assertions.
+using TestRequestHandler = uint64_t (*)(const std::vector<std::string>& flags);
+
+// Splits a request line into the xtest command line flags it holds.  Flags are
+// separated by blanks; there is no quoting.
+std::vector<std::string> SplitTestRequest(const std::string& request);
+
+// Serves test runs on the Unix domain socket at `socket_path` until the process
+// receives `SIGINT` or `SIGTERM`, so that an editor or IDE can run tests over
+// and over again without paying for starting the test binary every time.
+//
+// A client connects, sends one line of xtest command line flags, e.g.,
+// "--xtest_filter=Foo.Bar:Foo.Baz --xtest_color=yes", and reads the console
+// output of the run until the server closes the connection.  The run is done by
+// `handle_request` with the standard output and error streams redirected to
+// the connection.
+//
+// A failed `accept()` is retried when a signal interrupted it or the client
+// gave up, and retried after a growing delay when the process or the system ran
+// out of file descriptors.  Returns `EXIT_SUCCESS` once the server is stopped,
+// or `EXIT_FAILURE` after printing why if `accept()` fails for any other
+// reason; exits the process if the socket cannot be set up.
+int32_t ServeTests(const std::string& socket_path,
+                   TestRequestHandler handle_request);
+}  // namespace internal
+}  // namespace xtest
+
+#endif  // XTEST_INCLUDE_INTERNAL_XTEST_SERVER_HH_
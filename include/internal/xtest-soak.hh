@@ -0,0 +1,105 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_INCLUDE_INTERNAL_XTEST_SOAK_HH_
+#define XTEST_INCLUDE_INTERNAL_XTEST_SOAK_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace xtest {
+namespace internal {
+// Resources held by the calling process, sampled after every iteration of a
+// `--xtest_soak` run.
+struct ResourceUsage {
+  uint64_t rss = 0;       // Resident set size in bytes.
+  uint64_t open_fds = 0;  // Number of open file descriptors.
+  uint64_t threads = 0;   // Number of threads.
+};
+
+// Sets `usage` to the resources the calling process holds.  Returns false on
+// platforms where they cannot be measured; only Linux, through "/proc", is
+// supported.
+bool GetResourceUsage(ResourceUsage* usage);
+
+// Samples of a quantity taken at regular intervals, e.g., after every iteration
+// of a soak run, kept in bounded memory however long the run: once there are
+// `kMaxSamples` of them every two adjacent samples are merged into their mean,
+// and from then on a sample stands for twice as many intervals.
+class SampleSeries {
+ public:
+  static constexpr std::size_t kMaxSamples = 1024;
+
+  SampleSeries() : stride_(1), pending_sum_(0.0), pending_count_(0) {}
+
+  void Add(const double& sample);
+
+  // The samples, each one the mean of the same number of intervals.  The
+  // intervals of a sample still being filled are left out.
+  const std::vector<double>& samples() const { return samples_; }
+
+ private:
+  std::vector<double> samples_;
+  std::size_t stride_;  // Number of intervals every sample stands for.
+
+  // Sum and number of the intervals of the sample being filled.
+  double pending_sum_;
+  std::size_t pending_count_;
+};
+
+// Straight line fitted by least squares to a series of samples taken at
+// regular intervals.
+struct LinearTrend {
+  double slope = 0.0;      // Growth from one sample to the next.
+  double r_squared = 0.0;  // Share of the variance the line explains, 0 to 1.
+};
+
+// Returns the line fitted to `samples`.  Fewer than two samples, or samples
+// that do not vary at all, have a flat trend that explains nothing.
+LinearTrend FitLinearTrend(const std::vector<double>& samples);
+
+// Smallest number of samples a trend is judged from.
+constexpr std::size_t kMinTrendSamples = 5;
+
+// Smallest share of the variance of the samples the fitted line must explain
+// for the growth to count as steady.  A single step up, e.g., a cache filled
+// once, explains at most 75% of it however many samples there are.
+constexpr double kMinSteadyGrowthRSquared = 0.8;
+
+// Returns true if `samples` grow steadily, i.e., like a leak rather than noise:
+// there are at least `kMinTrendSamples` of them, the fitted line rises by at
+// least `min_growth` over them and explains at least
+// `kMinSteadyGrowthRSquared` of their variance.
+bool IsSteadyGrowth(const std::vector<double>& samples,
+                    const double& min_growth);
+}  // namespace internal
+}  // namespace xtest
+
+#endif  // XTEST_INCLUDE_INTERNAL_XTEST_SOAK_HH_
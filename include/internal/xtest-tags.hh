@@ -0,0 +1,89 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#ifndef XTEST_INCLUDE_INTERNAL_XTEST_TAGS_HH_
+#define XTEST_INCLUDE_INTERNAL_XTEST_TAGS_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "internal/xtest-port.hh"
+#include "xtest-registrar.hh"
+
+namespace xtest {
+namespace internal {
+// Returns the tags of `test`, see `TEST_WITH_TAGS()` and `XTEST_TAGS()`, sorted
+// and without duplicates.
+std::vector<std::string> GetTestTags(const TestRegistrar* test);
+
+// An index of the tests that carry every tag, built once for a list of tests,
+// to select the tests matching a `--xtest_tags` expression.
+//
+// An expression combines tags with `!` (not), `,` or `&` (and) and `|` (or),
+// in that order of precedence, and parentheses, e.g., "fast,!network" or
+// "(db|cache)&!slow".  A tag is made of letters, digits and any of "_-.:/";
+// spaces between tags and operators are ignored.  A tag no test carries is
+// valid and matches no test.
+//
+// The set of tests matching every part of the expression is computed as a
+// bitset over all of the tests at once, so that selecting from a large number
+// of tests costs a few word operations per test and operator rather than a
+// look-up per test, tag and operator.
+class TagIndex {
+ public:
+  // Builds the index of the tags of `tests`, which are identified by their
+  // index.
+  explicit TagIndex(const std::vector<TestRegistrar*>& tests);
+
+  // Sets `selected` to whether every test matches `expression`.  Returns
+  // false, with `error` saying why, if `expression` is not a valid expression.
+  bool Select(const std::string& expression, std::vector<bool>* selected,
+              std::string* error) const;
+
+ private:
+  // One bit per test, set for the tests in the set.
+  using Bitset = std::vector<uint64_t>;
+
+  class Parser;
+
+  std::size_t num_tests_;
+  std::unordered_map<std::string, Bitset> tests_with_tag_;
+
+  XTEST_DISALLOW_COPY_AND_ASSIGN_(TagIndex);
+};
+
+// Returns true if `expression` is a valid `--xtest_tags` expression, else sets
+// `error` to why it is not.
+bool IsValidTagExpression(const std::string& expression, std::string* error);
+}  // namespace internal
+}  // namespace xtest
+
+#endif  // XTEST_INCLUDE_INTERNAL_XTEST_TAGS_HH_
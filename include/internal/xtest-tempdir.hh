@@ -0,0 +1,72 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_INCLUDE_INTERNAL_XTEST_TEMPDIR_HH_
+#define XTEST_INCLUDE_INTERNAL_XTEST_TEMPDIR_HH_
+
+#include <string>
+
+#include "xtest-registrar.hh"
+
+namespace xtest {
+namespace internal {
+// Returns the directory the scratch directories of the tests go under: the
+// first of "/dev/shm", `$XDG_RUNTIME_DIR`, `$TMPDIR` and "/tmp" that is a
+// writable tmpfs, so that creating and removing files costs no disk I/O, else
+// the first of `$TMPDIR` and "/tmp" that is writable.
+std::string GetTempDirBase();
+
+// Creates the directory the scratch directories of the run go under, a fresh
+// "xtest-XXXXXX" in `GetTempDirBase()`.  Must be called before the worker
+// processes of the run are forked, so that their tests share it and the parent
+// can remove what a crashed worker left behind.
+void CreateTempDirRoot();
+
+// Removes the directory created by `CreateTempDirRoot()` with whatever is left
+// in it, once the cleanups still pending are stopped.  Does nothing in a forked
+// worker process, where the directory belongs to the parent.
+void RemoveTempDirRoot();
+
+// Returns the scratch directory of `test`, creating it on the first call; see
+// `TestTempDir()`.  Safe to call from the helper threads of the test.  Returns
+// an empty string if `test` is null or the directory cannot be created.
+std::string GetTestTempDir(TestRegistrar* test);
+
+// Hands the scratch directory of `test`, if it asked for one, to a background
+// thread that removes it, so that the next test does not wait for the removal.
+// Called once the test is over.
+void ReleaseTestTempDir(TestRegistrar* test);
+
+// Removes `path` and everything under it without following symbolic links.
+// Returns false if anything could not be removed.
+bool RemoveDirectoryTree(const std::string& path);
+}  // namespace internal
+}  // namespace xtest
+
+#endif  // XTEST_INCLUDE_INTERNAL_XTEST_TEMPDIR_HH_
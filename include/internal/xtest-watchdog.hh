@@ -0,0 +1,81 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_INCLUDE_INTERNAL_XTEST_WATCHDOG_HH_
+#define XTEST_INCLUDE_INTERNAL_XTEST_WATCHDOG_HH_
+
+#include "internal/xtest-port.hh"
+#include "xtest-registrar.hh"
+
+namespace xtest {
+namespace internal {
+// Time a test that ran out of time is given to leave the test once it has been
+// interrupted.  A process whose test is still stuck after that is given up on.
+constexpr TimeInMillis kTimeoutGracePeriod = 5000;
+
+// Called on the thread running a test that ran out of time, from the signal
+// handler that interrupts it.  Expected to leave the test, e.g., by jumping out
+// of it with `std::longjmp()`; if it returns, the test is left to finish on its
+// own.
+typedef void (*TimeoutInterruptHandler)();
+
+// Returns the time `test` may run for: its own timeout if it was registered
+// with `TEST_WITH_TIMEOUT()`, otherwise `default_timeout`.  `0` means no limit.
+TimeInMillis GetTestTimeout(const TestRegistrar* test,
+                            const TimeInMillis& default_timeout);
+
+// Starts watching `test`, which the calling thread is about to run, for running
+// longer than `timeout` milliseconds.  Does nothing if `timeout` is `0`.
+//
+// There is a single watchdog thread per process, started by the first test it
+// watches, also in a forked worker process.  When a test runs out of time the
+// watchdog prints which one, then has every thread of the process print its
+// stack trace on `stderr` and finally calls `interrupt` on the thread running
+// the test.  Every thread is made to do so by a signal (`SIGURG`) whose handler
+// only walks the stack; a thread that blocks the signal is reported as not
+// responding.  If the test has not been left `kTimeoutGracePeriod` milliseconds
+// later the process exits with `EXIT_FAILURE`.
+//
+// On Linux the threads are found in "/proc/self/task", elsewhere only the
+// threads running tests are dumped.  On Windows, where threads cannot be
+// interrupted, the process exits as soon as a test runs out of time.
+void ArmTestWatchdog(const TestRegistrar* test, const TimeInMillis& timeout,
+                     TimeoutInterruptHandler interrupt);
+
+// Stops watching the test running on the calling thread.  Returns true if it
+// ran out of time, after the watchdog is done dumping the stacks for it.
+bool DisarmTestWatchdog();
+
+// Stops the watchdog thread of this process, if it was started.  Called once no
+// test is running any more.
+void StopTestWatchdog();
+}  // namespace internal
+}  // namespace xtest
+
+#endif  // XTEST_INCLUDE_INTERNAL_XTEST_WATCHDOG_HH_
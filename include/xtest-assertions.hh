@@ -33,7 +33,10 @@
 #include <cstdlib>
 #include <iostream>
 
+#include "internal/xtest-cancellation.hh"
+#include "internal/xtest-context.hh"
 #include "internal/xtest-port.hh"
+#include "internal/xtest-printers.hh"
 #include "internal/xtest-string.hh"
 #include "xtest-message.hh"
 #include "xtest-registrar.hh"
@@ -54,6 +57,10 @@ class AssertionContext {
   AssertionContext(const char* file, uint64_t line,
                    TestRegistrar* const& current_test);
 
+  // Constructs a AssertionContext for the test of the calling thread, see
+  // `GetCurrentTest()`, so that assertions work on the threads a test starts.
+  AssertionContext(const char* file, uint64_t line);
+
   // Returns file name inside which the {EXPECT|ASSERT} assertion has been used.
   const char* file() const noexcept;
 
@@ -64,6 +71,15 @@ class AssertionContext {
   // is present.
   TestRegistrar* const current_test() const noexcept;
 
+  // Marks the test of the assertion as `xtest::TestResult::PASSED`, unless an
+  // assertion of it failed already.  Does nothing without a test.
+  void MarkPassed() const;
+
+  // Marks the test of the assertion as `xtest::TestResult::FAILED`.  Without a
+  // test, e.g., on a `std::thread` while several tests run in parallel, reports
+  // the failure as one of the run instead, see `GetCurrentTest()`.
+  void MarkFailed() const;
+
  private:
   const char* file_;
   const uint64_t line_;
@@ -84,24 +100,33 @@ class PrettyAssertionResultPrinter {
   static void OnTestAssertionEnd(const TestRegistrar* const& test,
                                  const TimeInMillis& elapsed_time);
 
+  // Prints out the information of the test suite and the test name with
+  // `result`, the result of a single assertion, which may differ from the
+  // result of the test when other assertions failed.
+  static void OnTestAssertionEnd(const TestRegistrar* const& test,
+                                 const TimeInMillis& elapsed_time,
+                                 const TestResult& result);
+
   // Prints out a trace on {EXPECT|ASSERT} assertion failure with the file and
   // the line number.
   template <typename T1, typename T2>
   static void OnTestAssertionFailure(
       const char* lhs_expr, const char* rhs_expr, const T1& lhs, const T2& rhs,
       const AssertionContext& assertion_context) {
-    std::fprintf(stderr,
+    StreamPrintf(stderr,
                  "%s(%lu): error: Value of: %s\n  Actual: %s\nExpected: %s\n",
                  assertion_context.file(), assertion_context.line(), lhs_expr,
                  ::xtest::String::Repr(StreamableToString(lhs)).c_str(),
                  ::xtest::String::Repr(StreamableToString(rhs)).c_str());
-    std::fflush(stderr);
+    StreamFlush(stderr);
 
-    // Mark the current test as `xtest::TestResult::FAILED` on failure.
-    assertion_context.current_test()->test_result_ =
-        ::xtest::TestResult::FAILED;
+    // Mark the current test as `xtest::TestResult::FAILED` on failure; no
+    // assertion made on another thread of the test can undo it.
+    assertion_context.MarkFailed();
     // Add this test in the global test failure counter.
     ++XTEST_GLOBAL_INSTANCE_GET_(failure_count);
+    // Stop the other workers from starting tests with `--xtest_fail_fast`.
+    CancelTestRunIfFailingFast();
   }
 };
 
@@ -116,24 +141,41 @@ class AssertionResult {
   AssertionResult(const bool& success, const bool& fatal)
       : success_(success), fatal_(fatal) {}
 
+  // Takes over `other`, which no longer stops the thread on a fatal failure, so
+  // that only one of the two does.
+  AssertionResult(AssertionResult&& other)
+      : fatal_(other.fatal_), success_(other.success_) {
+    other.fatal_ = false;
+  }
+
   // Streams data to the `stderr` stream when this instance represents a
   // {EXPECT|ASSERT} assertion failure.  There will be not output in case of
   // {EXPECT|ASSERT} assertion success.
   template <typename Streamable>
-  AssertionResult operator<<(const Streamable& streamable) {
+  AssertionResult& operator<<(const Streamable& streamable) {
     if (!success_) {
-      std::fprintf(stderr, "%s\n", StreamableToString(streamable).c_str());
-      std::fflush(stderr);
+      StreamPrintf(stderr, "%s\n", StreamableToString(streamable).c_str());
+      StreamFlush(stderr);
     }
     return *this;
   }
 
-  ~AssertionResult() {
+  ~AssertionResult() noexcept(false) {
     // We raise an abort signal in case `is_fatal` is true; this is to catch the
     // abort signal later and mark the result of the test suite as
-    // `xtest::TestResult::FAILED`.
-    if (!success_ && fatal_)
+    // `xtest::TestResult::FAILED`.  Only the thread running the test can jump
+    // out of it, and the failure is recorded already.  A `TestThread` ends
+    // instead, see `RunHelperThread()`.
+    if (success_ || !fatal_)
+      return;
+    if (IsTestThread()) {
+      // The jump skips the destructors of the objects owning helper threads,
+      // which may use them, so the threads have to be over first.
+      JoinCurrentTestHelperThreads();
       std::abort();
+    }
+    if (HelperThreadEndsOnFatalFailure())
+      throw HelperThreadFatalFailure();
   }
 
  private:
@@ -163,17 +205,18 @@ AssertionResult AssertionFailure(const bool& is_fatal);
       internal::Timer timer;                                                   \
       internal::PrettyAssertionResultPrinter::OnTestAssertionStart(            \
           assertion_context.current_test());                                   \
-      if ((actual) == (boolean)) {                                             \
-        assertion_context.current_test()->test_result_ =                       \
-            ::xtest::TestResult::PASSED;                                       \
+      const bool passed = (actual) == (boolean);                               \
+      if (passed) {                                                            \
+        assertion_context.MarkPassed();                                        \
       } else {                                                                 \
         internal::PrettyAssertionResultPrinter::OnTestAssertionFailure(        \
             actual_expr, #boolean, actual, boolean, assertion_context);        \
       }                                                                        \
       internal::PrettyAssertionResultPrinter::OnTestAssertionEnd(              \
-          assertion_context.current_test(), timer.Elapsed());                  \
-      return ((actual) == (boolean)) ? internal::AssertionSuccess()            \
-                                     : internal::AssertionFailure(is_fatal);   \
+          assertion_context.current_test(), timer.Elapsed(),                   \
+          passed ? ::xtest::TestResult::PASSED : ::xtest::TestResult::FAILED); \
+      return passed ? internal::AssertionSuccess()                             \
+                    : internal::AssertionFailure(is_fatal);                    \
     }                                                                          \
                                                                                \
     template <typename T>                                                      \
@@ -183,17 +226,18 @@ AssertionResult AssertionFailure(const bool& is_fatal);
       internal::Timer timer;                                                   \
       internal::PrettyAssertionResultPrinter::OnTestAssertionStart(            \
           assertion_context.current_test());                                   \
-      if ((actual) == (boolean)) {                                             \
-        assertion_context.current_test()->test_result_ =                       \
-            ::xtest::TestResult::PASSED;                                       \
+      const bool passed = (actual) == (boolean);                               \
+      if (passed) {                                                            \
+        assertion_context.MarkPassed();                                        \
       } else {                                                                 \
         internal::PrettyAssertionResultPrinter::OnTestAssertionFailure(        \
             actual_expr, #boolean, actual, boolean, assertion_context);        \
       }                                                                        \
       internal::PrettyAssertionResultPrinter::OnTestAssertionEnd(              \
-          assertion_context.current_test(), timer.Elapsed());                  \
-      return ((actual) == (boolean)) ? internal::AssertionSuccess()            \
-                                     : internal::AssertionFailure(is_fatal);   \
+          assertion_context.current_test(), timer.Elapsed(),                   \
+          passed ? ::xtest::TestResult::PASSED : ::xtest::TestResult::FAILED); \
+      return passed ? internal::AssertionSuccess()                             \
+                    : internal::AssertionFailure(is_fatal);                    \
     }                                                                          \
   };
 
@@ -204,20 +248,18 @@ XTEST_IMPL_CHECK_HELPER_(False, false)
 
 #undef XTEST_IMPL_CHECK_HELPER_
 
-#define XTEST_ASSERT_TRUE_(actual, fatal)                                    \
-  ::xtest::BoolTrueHelper::Check(                                            \
-      #actual, actual,                                                       \
-      ::xtest::internal::AssertionContext(__FILE__, __LINE__, current_test), \
-      fatal)
+#define XTEST_ASSERT_TRUE_(actual, fatal)                             \
+  ::xtest::BoolTrueHelper::Check(                                     \
+      #actual, actual,                                                \
+      ::xtest::internal::AssertionContext(__FILE__, __LINE__), fatal)
 
 #define EXPECT_TRUE(actual) XTEST_ASSERT_TRUE_(actual, false)
 #define ASSERT_TRUE(actual) XTEST_ASSERT_TRUE_(actual, true)
 
-#define XTEST_ASSERT_FALSE_(actual, fatal)                                   \
-  ::xtest::BoolFalseHelper::Check(                                           \
-      #actual, actual,                                                       \
-      ::xtest::internal::AssertionContext(__FILE__, __LINE__, current_test), \
-      fatal)
+#define XTEST_ASSERT_FALSE_(actual, fatal)                            \
+  ::xtest::BoolFalseHelper::Check(                                    \
+      #actual, actual,                                                \
+      ::xtest::internal::AssertionContext(__FILE__, __LINE__), fatal)
 
 #define EXPECT_FALSE(actual) XTEST_ASSERT_FALSE_(actual, false)
 #define ASSERT_FALSE(actual) XTEST_ASSERT_FALSE_(actual, true)
@@ -308,17 +350,18 @@ XTEST_IMPL_CHECK_HELPER_(False, false)
       internal::Timer timer;                                                   \
       internal::PrettyAssertionResultPrinter::OnTestAssertionStart(            \
           assertion_context.current_test());                                   \
-      if (lhs opr rhs) {                                                       \
-        assertion_context.current_test()->test_result_ =                       \
-            ::xtest::TestResult::PASSED;                                       \
+      const bool passed = lhs opr rhs;                                         \
+      if (passed) {                                                            \
+        assertion_context.MarkPassed();                                        \
       } else {                                                                 \
         internal::PrettyAssertionResultPrinter::OnTestAssertionFailure(        \
             lhs_expr, rhs_expr, lhs, rhs, assertion_context);                  \
       }                                                                        \
       internal::PrettyAssertionResultPrinter::OnTestAssertionEnd(              \
-          assertion_context.current_test(), timer.Elapsed());                  \
-      return (lhs opr rhs) ? internal::AssertionSuccess()                      \
-                           : internal::AssertionFailure(is_fatal);             \
+          assertion_context.current_test(), timer.Elapsed(),                   \
+          passed ? ::xtest::TestResult::PASSED : ::xtest::TestResult::FAILED); \
+      return passed ? internal::AssertionSuccess()                             \
+                    : internal::AssertionFailure(is_fatal);                    \
     }                                                                          \
   };
 
@@ -337,56 +380,50 @@ XTEST_IMPL_CMP_HELPER_(GT, >)
 
 #undef XTEST_IMPL_CMP_HELPER_
 
-#define XTEST_ASSERT_EQ_(val1, val2, fatal)                                  \
-  ::xtest::EQHelper::Compare(                                                \
-      #val1, #val2, val1, val2,                                              \
-      ::xtest::internal::AssertionContext(__FILE__, __LINE__, current_test), \
-      fatal)
+#define XTEST_ASSERT_EQ_(val1, val2, fatal)                           \
+  ::xtest::EQHelper::Compare(                                         \
+      #val1, #val2, val1, val2,                                       \
+      ::xtest::internal::AssertionContext(__FILE__, __LINE__), fatal)
 
 #define EXPECT_EQ(val1, val2) XTEST_ASSERT_EQ_(val1, val2, false)
 #define ASSERT_EQ(val1, val2) XTEST_ASSERT_EQ_(val1, val2, true)
 
-#define XTEST_ASSERT_NE_(val1, val2, fatal)                                  \
-  ::xtest::NEHelper::Compare(                                                \
-      #val1, #val2, val1, val2,                                              \
-      ::xtest::internal::AssertionContext(__FILE__, __LINE__, current_test), \
-      fatal)
+#define XTEST_ASSERT_NE_(val1, val2, fatal)                           \
+  ::xtest::NEHelper::Compare(                                         \
+      #val1, #val2, val1, val2,                                       \
+      ::xtest::internal::AssertionContext(__FILE__, __LINE__), fatal)
 
 #define EXPECT_NE(val1, val2) XTEST_ASSERT_NE_(val1, val2, false)
 #define ASSERT_NE(val1, val2) XTEST_ASSERT_NE_(val1, val2, true)
 
-#define XTEST_ASSERT_LE_(val1, val2, fatal)                                  \
-  ::xtest::LEHelper::Compare(                                                \
-      #val1, #val2, val1, val2,                                              \
-      ::xtest::internal::AssertionContext(__FILE__, __LINE__, current_test), \
-      fatal)
+#define XTEST_ASSERT_LE_(val1, val2, fatal)                           \
+  ::xtest::LEHelper::Compare(                                         \
+      #val1, #val2, val1, val2,                                       \
+      ::xtest::internal::AssertionContext(__FILE__, __LINE__), fatal)
 
 #define EXPECT_LE(val1, val2) XTEST_ASSERT_LE_(val1, val2, false)
 #define ASSERT_LE(val1, val2) XTEST_ASSERT_LE_(val1, val2, true)
 
-#define XTEST_ASSERT_LT_(val1, val2, fatal)                                  \
-  ::xtest::LTHelper::Compare(                                                \
-      #val1, #val2, val1, val2,                                              \
-      ::xtest::internal::AssertionContext(__FILE__, __LINE__, current_test), \
-      fatal)
+#define XTEST_ASSERT_LT_(val1, val2, fatal)                           \
+  ::xtest::LTHelper::Compare(                                         \
+      #val1, #val2, val1, val2,                                       \
+      ::xtest::internal::AssertionContext(__FILE__, __LINE__), fatal)
 
 #define EXPECT_LT(val1, val2) XTEST_ASSERT_LT_(val1, val2, false)
 #define ASSERT_LT(val1, val2) XTEST_ASSERT_LT_(val1, val2, true)
 
-#define XTEST_ASSERT_GE_(val1, val2, fatal)                                  \
-  ::xtest::GEHelper::Compare(                                                \
-      #val1, #val2, val1, val2,                                              \
-      ::xtest::internal::AssertionContext(__FILE__, __LINE__, current_test), \
-      fatal)
+#define XTEST_ASSERT_GE_(val1, val2, fatal)                           \
+  ::xtest::GEHelper::Compare(                                         \
+      #val1, #val2, val1, val2,                                       \
+      ::xtest::internal::AssertionContext(__FILE__, __LINE__), fatal)
 
 #define EXPECT_GE(val1, val2) XTEST_ASSERT_GE_(val1, val2, false)
 #define ASSERT_GE(val1, val2) XTEST_ASSERT_GE_(val1, val2, true)
 
-#define XTEST_ASSERT_GT_(val1, val2, fatal)                                  \
-  ::xtest::GTHelper::Compare(                                                \
-      #val1, #val2, val1, val2,                                              \
-      ::xtest::internal::AssertionContext(__FILE__, __LINE__, current_test), \
-      fatal)
+#define XTEST_ASSERT_GT_(val1, val2, fatal)                           \
+  ::xtest::GTHelper::Compare(                                         \
+      #val1, #val2, val1, val2,                                       \
+      ::xtest::internal::AssertionContext(__FILE__, __LINE__), fatal)
 
 #define EXPECT_GT(val1, val2) XTEST_ASSERT_GT_(val1, val2, false)
 #define ASSERT_GT(val1, val2) XTEST_ASSERT_GT_(val1, val2, true)
@@ -0,0 +1,85 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_INCLUDE_XTEST_CLOCK_HH_
+#define XTEST_INCLUDE_XTEST_CLOCK_HH_
+
+#include <chrono>  // NOLINT
+
+namespace xtest {
+// A clock for the tests of code that waits, times out or retries, so that the
+// tests do not have to wait in real time.  It meets the requirements of a
+// `std::chrono` clock, so that it can be injected wherever the code under test
+// takes its clock as a template parameter, e.g., instead of
+// `std::chrono::steady_clock`, and only moves when it is moved:
+//
+// ```C++
+// TEST_WITH_FAKE_TIME(LeaseTest, ExpiresAfterItsTerm) {
+//   Lease<xtest::FakeClock> lease(std::chrono::seconds(10));
+//   xtest::FakeClock::Advance(std::chrono::seconds(9));
+//   EXPECT_FALSE(lease.Expired());
+//   xtest::FakeClock::Advance(std::chrono::seconds(1));
+//   EXPECT_TRUE(lease.Expired());
+// }
+// ```
+//
+// Code that sleeps should sleep through its clock as well, e.g., with a
+// `Clock::SleepFor()` that is `std::this_thread::sleep_for()` for a real clock:
+// `FakeClock::SleepFor()` returns right away with the clock moved forward.
+//
+// A test created with `TEST_WITH_FAKE_TIME()` has a clock of its own, shared by
+// the threads it starts, see `TestThread`.  Anywhere else the whole process
+// shares one.  The time the framework reports for a test is measured in real
+// time, whatever the fake time does.
+class FakeClock {
+ public:
+  using duration = std::chrono::nanoseconds;
+  using rep = duration::rep;
+  using period = duration::period;
+  using time_point = std::chrono::time_point<FakeClock>;
+
+  // The fake time never goes backwards while a test runs.
+  static constexpr bool is_steady = true;
+
+  // Returns the current fake time.
+  static time_point now() noexcept;
+
+  // Moves the fake time forward by `time`.  Safe to call from any thread.
+  static void Advance(const duration& time);
+
+  // Moves the fake time forward by `time` like `Advance()`, for the code under
+  // test that sleeps through its clock.
+  static void SleepFor(const duration& time);
+
+  // Moves the fake time forward to `deadline`, unless it is past it already.
+  static void SleepUntil(const time_point& deadline);
+};
+}  // namespace xtest
+
+#endif  // XTEST_INCLUDE_XTEST_CLOCK_HH_
@@ -0,0 +1,170 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_INCLUDE_XTEST_LOOPBACK_HH_
+#define XTEST_INCLUDE_XTEST_LOOPBACK_HH_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "internal/xtest-context.hh"
+
+namespace xtest {
+class LoopbackServer;
+
+// A client connection accepted by a `LoopbackServer`.  Only used by the handler
+// of the server, on the thread of its event loop.
+class LoopbackConnection {
+ public:
+  // Bytes received from the client that the handler has not consumed yet.  The
+  // handler erases the bytes it is done with and leaves an incomplete request
+  // for the next call.
+  std::string& input() { return input_; }
+
+  // True once the client has shut down its end of the connection: no more input
+  // follows.
+  bool input_closed() const { return input_closed_; }
+
+  // Queues `data` to be sent to the client once the handler returns.
+  void Send(const std::string& data) { output_ += data; }
+
+  // Closes the connection once the data queued with `Send()` has been sent.
+  void Close() { closing_ = true; }
+
+ private:
+  friend class LoopbackServer;
+
+  explicit LoopbackConnection(const int32_t& socket)
+      : socket_(socket), input_closed_(false), closing_(false) {}
+
+  int32_t socket_;      // Non-blocking socket of the connection.
+  std::string input_;   // Received and not yet consumed.
+  std::string output_;  // Queued and not yet sent.
+  bool input_closed_;   // True once the client shut down its end.
+  bool closing_;        // True once the handler asked to close.
+};
+
+// A stand-in server for the tests of a network client, listening on the
+// loopback interface only, e.g.,
+//
+// ```C++
+// TEST(EchoClientTest, GetsBackWhatItSent) {
+//   xtest::LoopbackServer server([](xtest::LoopbackConnection* connection) {
+//     connection->Send(connection->input());
+//     connection->input().clear();
+//   });
+//   ASSERT_TRUE(server.listening());
+//   EchoClient client("127.0.0.1", server.port());
+//   EXPECT_EQ(client.Echo("ping"), "ping");
+// }
+// ```
+//
+// The server listens on a TCP port the kernel picks, or on a Unix domain socket
+// in a directory of its own, so that servers of tests running in parallel never
+// collide.  It listens before the constructor returns: a client may connect
+// right away and never has to wait or retry until the server is ready.
+//
+// The connections are served by an event loop on a thread of the server, which
+// calls the handler whenever a connection received data, and once more when
+// the client shut down its end of it.  The thread makes its assertions for the
+// test that created the server, like a `TestThread`.  The event loop is stopped
+// and every connection closed when the server is destroyed, or by the test if
+// a fatal assertion jumps out of it past the destructor of the server.
+//
+// Not supported on Windows, where the server never listens.
+class LoopbackServer {
+ public:
+  // Kind of socket the server listens on.
+  enum class Transport {
+    kTcp,   // A TCP port of 127.0.0.1.
+    kUnix,  // A Unix domain socket.
+  };
+
+  // Called by the event loop for a connection that received data or whose
+  // client shut down its end.
+  using Handler = std::function<void(LoopbackConnection* connection)>;
+
+  // Starts listening on a new socket of `transport` and serving it with
+  // `handler`.  See `listening()` for whether it succeeded.
+  explicit LoopbackServer(Handler handler,
+                          const Transport& transport = Transport::kTcp);
+
+  // Stops the event loop, closes every connection and removes the socket.
+  ~LoopbackServer();
+
+  LoopbackServer(const LoopbackServer&) = delete;
+  LoopbackServer& operator=(const LoopbackServer&) = delete;
+
+  // Returns true if the server is listening, else `error()` says why not.
+  bool listening() const { return thread_ != nullptr; }
+
+  // Returns why the server is not listening, empty if it is.
+  const std::string& error() const { return error_; }
+
+  // Returns the TCP port the server listens on, `0` for a Unix domain socket.
+  uint16_t port() const { return port_; }
+
+  // Returns the address the server listens on: "127.0.0.1:<port>" or the path
+  // of the Unix domain socket.
+  const std::string& address() const { return address_; }
+
+  // Returns a new blocking socket connected to the server, which the caller
+  // closes, or `-1` if it could not connect.
+  int32_t Connect() const;
+
+ private:
+  // The handler and the sockets of a listening server, owned by the thread of
+  // its event loop, which closes them once it is joined, also when a fatal
+  // assertion jumped out of the test past the destructor of the server.
+  struct State;
+
+  // Body of the event loop thread, making its assertions for `context`.
+  static void Run(const std::shared_ptr<State>& state,
+                  const internal::TestContext& context);
+
+  // Reads what `connection` received, hands it to the handler of `state` and
+  // sends what the handler queued, as far as the socket takes it without
+  // blocking.  `events` are the events `poll()` reported for the socket.
+  // Returns false once the connection is to be closed.
+  static bool ServeConnection(State* state, LoopbackConnection* connection,
+                              const int16_t& events);
+
+  Transport transport_;
+  uint16_t port_;        // TCP port, or `0`.
+  std::string address_;  // See `address()`.
+  std::string error_;    // See `error()`.
+  // Runs the event loop, see `internal::AdoptHelperThread()`; `nullptr`
+  // unless listening.
+  std::shared_ptr<internal::HelperThread> thread_;
+};
+}  // namespace xtest
+
+#endif  // XTEST_INCLUDE_XTEST_LOOPBACK_HH_
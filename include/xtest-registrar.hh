@@ -30,12 +30,15 @@
 #ifndef XTEST_INCLUDE_XTEST_REGISTRAR_HH_
 #define XTEST_INCLUDE_XTEST_REGISTRAR_HH_
 
-#include <csetjmp>
+#include <atomic>
 #include <cstdint>
+#include <initializer_list>
 #include <iostream>
 #include <list>
 #include <map>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include "internal/xtest-internal.hh"
 #include "internal/xtest-port.hh"
@@ -55,18 +58,130 @@ using XTestUnitTestPair = std::pair<const char*, std::list<TestRegistrar*>>;
 // For the best usage of this macro avoid giving same suite_name and test_name
 // to different test suites, otherwise compiler will complain regarding the
 // multiple definitions and declarations of the same function.
-#define TEST(suite_name, test_name)                                    \
-  static_assert(sizeof(XTEST_STRINGIFY_(suite_name)) > 1,              \
-                "suite_name must not be empty!");                      \
-  static_assert(sizeof(XTEST_STRINGIFY_(test_name)) > 1,               \
-                "test_name must not be empty!");                       \
-  void TESTFUNCTION__##suite_name##test_name(                          \
-      xtest::TestRegistrar* current_test);                             \
-  namespace {                                                          \
-  xtest::TestRegistrar TESTREGISTRAR__##suite_name##test_name(         \
-      #suite_name, #test_name, TESTFUNCTION__##suite_name##test_name); \
-  }                                                                    \
-  void TESTFUNCTION__##suite_name##test_name(xtest::TestRegistrar* current_test)
+#define TEST(suite_name, test_name) XTEST_TEST_(suite_name, test_name, 0)
+
+// Creates a test like `TEST()` that fails if it runs for longer than `timeout`
+// milliseconds, whatever `--xtest_timeout` says, e.g.,
+//
+// ```C++
+// TEST_WITH_TIMEOUT(ConnectionTest, ReconnectsAfterDrop, 30000) {
+//   ...
+// }
+// ```
+#define TEST_WITH_TIMEOUT(suite_name, test_name, timeout) \
+  XTEST_TEST_(suite_name, test_name, timeout)
+
+// Creates a test like `TEST()` that uses the named resources given after the
+// test name, e.g., a port range or an on-disk cache, that no other test may use
+// at the same time:
+//
+// ```C++
+// TEST_WITH_RESOURCES(CacheTest, EvictsTheOldestEntry, "gpu-sim-cache") {
+//   ...
+// }
+// ```
+//
+// A parallel run never runs two tests that use the same resource at the same
+// time but runs them alongside any other test.  Resources are just names; the
+// tests agree on what they stand for.
+#define TEST_WITH_RESOURCES(suite_name, test_name, ...) \
+  XTEST_TEST_(suite_name, test_name, 0, {__VA_ARGS__})
+
+// Declares that every test of `suite_name` uses the named resources that
+// follow, as if each of them were created with `TEST_WITH_RESOURCES()`, e.g.,
+//
+// ```C++
+// XTEST_RESOURCE(GpuSimulatorTest, "gpu-sim-cache", "ports-9100-9199");
+// ```
+//
+// Goes at namespace scope, once per test suite.
+#define XTEST_RESOURCE(suite_name, ...)                                      \
+  static_assert(sizeof(XTEST_STRINGIFY_(suite_name)) > 1,                    \
+                "suite_name must not be empty!");                            \
+  static xtest::TestSuiteResourceRegistrar TESTRESOURCES__##suite_name(      \
+      #suite_name, {__VA_ARGS__})
+
+// Creates a test like `TEST()` that declares how much of the machine it takes
+// up, e.g., for a test that runs 8 threads of its own and holds a large data
+// set in memory:
+//
+// ```C++
+// TEST_WITH_COST(SimulationTest, ConvergesOnTheReferenceGrid, cpus = 8,
+//                mem = large) {
+//   ...
+// }
+// ```
+//
+// `cpus` is the number of CPUs the test keeps busy and `mem` its memory class:
+// `small`, `medium` or `large`; either can be left out.  A parallel run counts
+// them against the CPUs and the memory of the machine, see `TestCost`, rather
+// than counting every test as one job.
+#define TEST_WITH_COST(suite_name, test_name, ...)                        \
+  struct TESTCOST__##suite_name##test_name : xtest::TestCostDeclaration { \
+    TESTCOST__##suite_name##test_name() { __VA_ARGS__; }                  \
+  };                                                                      \
+  XTEST_TEST_(suite_name, test_name, 0, {},                               \
+              TESTCOST__##suite_name##test_name())
+
+// Creates a test like `TEST()` that carries the tags given after the test name,
+// which `--xtest_tags` selects tests by, e.g.,
+//
+// ```C++
+// TEST_WITH_TAGS(ParserTest, ReadsAnEmptyDocument, "fast", "parser") {
+//   ...
+// }
+// ```
+#define TEST_WITH_TAGS(suite_name, test_name, ...) \
+  XTEST_TEST_(suite_name, test_name, 0, {}, xtest::TestCost(), {__VA_ARGS__})
+
+// Declares that every test of `suite_name` carries the tags that follow, as if
+// each of them were created with `TEST_WITH_TAGS()`, e.g.,
+//
+// ```C++
+// XTEST_TAGS(DownloaderTest, "network", "slow");
+// ```
+//
+// Goes at namespace scope, once per test suite.
+#define XTEST_TAGS(suite_name, ...)                                          \
+  static_assert(sizeof(XTEST_STRINGIFY_(suite_name)) > 1,                    \
+                "suite_name must not be empty!");                            \
+  static xtest::TestSuiteTagRegistrar TESTTAGS__##suite_name(                \
+      #suite_name, {__VA_ARGS__})
+
+// Creates a test like `TEST()` with a `FakeClock` of its own, which starts at
+// its epoch every time the test runs and only moves when the test moves it,
+// e.g.,
+//
+// ```C++
+// TEST_WITH_FAKE_TIME(RetryTest, GivesUpAfterTheDeadline) {
+//   Retrier<xtest::FakeClock> retrier(std::chrono::seconds(30));
+//   EXPECT_FALSE(retrier.Run([]() { return false; }));
+//   EXPECT_TRUE(xtest::FakeClock::now().time_since_epoch() ==
+//               std::chrono::seconds(30));
+// }
+// ```
+//
+// The threads the test starts share its clock, so tests with fake time can run
+// in parallel without moving each other's clock.
+#define TEST_WITH_FAKE_TIME(suite_name, test_name) \
+  XTEST_TEST_(suite_name, test_name, 0, {}, xtest::TestCost(), {}, true)
+
+// Defines the test function and the `TestRegistrar` registering it, which is
+// constructed with the rest of the arguments after the test function.
+#define XTEST_TEST_(suite_name, test_name, ...)                              \
+  static_assert(sizeof(XTEST_STRINGIFY_(suite_name)) > 1,                    \
+                "suite_name must not be empty!");                            \
+  static_assert(sizeof(XTEST_STRINGIFY_(test_name)) > 1,                     \
+                "test_name must not be empty!");                             \
+  void TESTFUNCTION__##suite_name##test_name(                                \
+      xtest::TestRegistrar* current_test);                                   \
+  namespace {                                                                \
+  xtest::TestRegistrar TESTREGISTRAR__##suite_name##test_name(               \
+      #suite_name, #test_name, TESTFUNCTION__##suite_name##test_name,        \
+      __VA_ARGS__);                                                          \
+  }                                                                          \
+  void TESTFUNCTION__##suite_name##test_name(                                \
+      xtest::TestRegistrar* current_test XTEST_ATTRIBUTE_UNUSED_)
 
 typedef internal::TimeInMillis TimeInMillis;
 
@@ -76,22 +191,184 @@ typedef internal::TimeInMillis TimeInMillis;
 // to register as a test suite entry for automatic test execution.
 typedef void (*TestFunction)(TestRegistrar* current_test);
 
-enum class TestResult { UNKNOWN, PASSED, FAILED };
+enum class TestResult { UNKNOWN, PASSED, FAILED, SKIPPED };
+
+// The result of a test, which the assertions made on every thread the test
+// started update at once, see `TestThread`.
+//
+// A failure always sticks: a passing assertion only turns an `UNKNOWN` result
+// into `PASSED` and a skip never overrides `FAILED`, whichever thread gets
+// there first.  Reads and plain assignments, e.g., by the runner before and
+// after the test, behave as they would on a `TestResult`.  Copying copies the
+// current value.
+class AtomicTestResult {
+ public:
+  AtomicTestResult(const TestResult& result = TestResult::UNKNOWN)  // NOLINT
+      : value_(result) {}
+  AtomicTestResult(const AtomicTestResult& other) : value_(other) {}
+
+  AtomicTestResult& operator=(const AtomicTestResult& other) {
+    value_.store(other);
+    return *this;
+  }
+  AtomicTestResult& operator=(const TestResult& result) {
+    value_.store(result);
+    return *this;
+  }
+
+  operator TestResult() const { return value_.load(); }  // NOLINT
+
+  // Records a passing assertion: `UNKNOWN` turns into `PASSED`.
+  void MarkPassed() {
+    TestResult expected = TestResult::UNKNOWN;
+    value_.compare_exchange_strong(expected, TestResult::PASSED);
+  }
+
+  // Records a failing assertion.
+  void MarkFailed() { value_.store(TestResult::FAILED); }
+
+  // Records that the test skipped itself, unless it failed already.
+  void MarkSkipped() {
+    TestResult expected = value_.load();
+    while (expected != TestResult::FAILED &&
+           !value_.compare_exchange_weak(expected, TestResult::SKIPPED)) {
+    }
+  }
+
+ private:
+  std::atomic<TestResult> value_;
+};
+
+// The time of the `FakeClock` of a test in nanoseconds since the epoch of the
+// clock, read and moved forward by any thread of the test.  Copying copies the
+// current time.
+class AtomicFakeTime {
+ public:
+  AtomicFakeTime() : nanoseconds_(0) {}
+  AtomicFakeTime(const AtomicFakeTime& other) : nanoseconds_(other.Load()) {}
+
+  AtomicFakeTime& operator=(const AtomicFakeTime& other) {
+    Store(other.Load());
+    return *this;
+  }
+
+  int64_t Load() const { return nanoseconds_.load(std::memory_order_acquire); }
+
+  void Store(const int64_t& nanoseconds) {
+    nanoseconds_.store(nanoseconds, std::memory_order_release);
+  }
+
+  // Moves the time forward to `nanoseconds`, unless it is there already.
+  void AdvanceTo(const int64_t& nanoseconds) {
+    int64_t current = Load();
+    while (current < nanoseconds &&
+           !nanoseconds_.compare_exchange_weak(current, nanoseconds,
+                                               std::memory_order_acq_rel)) {
+    }
+  }
+
+  // Moves the time forward by `nanoseconds`.
+  void Advance(const int64_t& nanoseconds) {
+    nanoseconds_.fetch_add(nanoseconds, std::memory_order_acq_rel);
+  }
+
+ private:
+  std::atomic<int64_t> nanoseconds_;
+};
+
+// How much memory a test takes up compared to the other tests.
+enum class MemoryClass { kSmall, kMedium, kLarge };
+
+// How much of the machine a test takes up while it runs, see
+// `TEST_WITH_COST()`.
+//
+// A parallel run has a CPU slot per worker and a test takes up `cpus` of them,
+// at most all of them.  The memory is split into four units, of which a
+// `kMedium` test takes up one and a `kLarge` test two; a `kSmall` test is not
+// counted.  A test only starts once the tests running already leave enough of
+// both.
+struct TestCost {
+  int32_t cpus = 1;
+  MemoryClass mem = MemoryClass::kSmall;
+};
+
+// The cost `TEST_WITH_COST()` declares, with the names its declaration is
+// written in.
+struct TestCostDeclaration : TestCost {
+  static constexpr MemoryClass small = MemoryClass::kSmall;
+  static constexpr MemoryClass medium = MemoryClass::kMedium;
+  static constexpr MemoryClass large = MemoryClass::kLarge;
+};
 
 class TestRegistrar {
  public:
   // Constructs a new TestRegistrar instance.  Also links test functions from
-  // similar test suites together.
+  // similar test suites together.  The test fails if it runs for longer than
+  // `timeout` milliseconds; `0` leaves it to `--xtest_timeout`.  It uses the
+  // named `resources`, see `TEST_WITH_RESOURCES()`, takes up `cost` of the
+  // machine, see `TEST_WITH_COST()`, carries `tags`, see `TEST_WITH_TAGS()`,
+  // and has a `FakeClock` of its own if `fake_time`, see
+  // `TEST_WITH_FAKE_TIME()`.
   TestRegistrar(const char* suite_name, const char* test_name,
-                TestFunction test_func);
+                TestFunction test_func, TimeInMillis timeout = 0,
+                std::initializer_list<const char*> resources = {},
+                const TestCost& cost = TestCost(),
+                std::initializer_list<const char*> tags = {},
+                bool fake_time = false);
 
  public:
   const char* test_name_;   // Test name.
   const char* suite_name_;  // Test suite name.
 
-  TestFunction test_func_;     // Test function to execute.
-  TestResult test_result_;     // Result of the test suite.
-  TimeInMillis elapsed_time_;  // Elapsed time in milliseconds.
+  TestFunction test_func_;        // Test function to execute.
+  AtomicTestResult test_result_;  // Result of the test suite.
+  TimeInMillis elapsed_time_;     // Elapsed time in milliseconds.
+
+  // Elapsed time the test is expected to take in milliseconds, from the test
+  // history of earlier runs; `0` when there is no history.
+  TimeInMillis expected_time_;
+
+  // Time in milliseconds the test may run for, see `TEST_WITH_TIMEOUT()`; `0`
+  // when it is left to `--xtest_timeout`.
+  TimeInMillis timeout_;
+
+  // Names of the resources the test uses besides those of its test suite, see
+  // `TEST_WITH_RESOURCES()`.
+  std::vector<const char*> resources_;
+
+  // How much of the machine the test takes up, see `TEST_WITH_COST()`.
+  TestCost cost_;
+
+  // Tags the test carries besides those of its test suite, see
+  // `TEST_WITH_TAGS()`.
+  std::vector<const char*> tags_;
+
+  // CPU the test started on when the workers are pinned with
+  // `--xtest_cpu_affinity`, else `-1`.
+  int32_t cpu_;
+
+  // Scratch directory of the test, see `TestTempDir()`; empty until the test
+  // asks for it.  It is removed in the background once the test is over.
+  std::string temp_dir_;
+
+  // True for a test created with `TEST_WITH_FAKE_TIME()`, whose `FakeClock`
+  // reads `fake_time_`.  The time is reset to the epoch before every run of the
+  // test.
+  bool has_fake_time_;
+  AtomicFakeTime fake_time_;
+};
+
+// Registers the resources every test of a test suite uses, see
+// `XTEST_RESOURCE()`.
+struct TestSuiteResourceRegistrar {
+  TestSuiteResourceRegistrar(const char* suite_name,
+                             std::initializer_list<const char*> resources);
+};
+
+// Registers the tags every test of a test suite carries, see `XTEST_TAGS()`.
+struct TestSuiteTagRegistrar {
+  TestSuiteTagRegistrar(const char* suite_name,
+                        std::initializer_list<const char*> tags);
 };
 
 // Constructs a `map` object that links test suites to their test cases.
@@ -100,16 +377,22 @@ class TestRegistrar {
 // test cases to traverse through all of the test cases and run them to later
 // group the result of test cases with their test suites.
 //
-// This structure also contains an instance of `std::jmp_buf` that stores the
-// environment information for the function `xtest::RunRegisteredTests()`.
+// The environment information used to jump out of a test on a fatal assertion
+// failure is not kept here; it is thread-local to the runner in `xtest.cc` so
+// that tests running on different worker threads do not share it.
 struct TestRegistry {
  public:
   XTestUnitTest test_registry_table_;
 
-  // jump_out_of_test_ instance stores the environment information for function
-  // run_registered_tests() to later make a long jump using function
-  // std::longjmp to register the test result as TestResult::FAILED.
-  std::jmp_buf jump_out_of_test_;
+  // Names of the resources used by every test of a test suite, by test suite
+  // name, see `XTEST_RESOURCE()`.  Keyed by the name itself rather than by its
+  // address as the declaration may live in another translation unit than the
+  // tests.
+  std::map<std::string, std::vector<const char*>> suite_resources_;
+
+  // Tags carried by every test of a test suite, by test suite name, see
+  // `XTEST_TAGS()`.
+  std::map<std::string, std::vector<const char*>> suite_tags_;
 };
 
 // `XTestUnitTest` instance that links nodes of different test suites.
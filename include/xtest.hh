@@ -32,8 +32,14 @@
 
 #include <cinttypes>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <thread>  // NOLINT
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+#include "internal/xtest-context.hh"
 #include "internal/xtest-port.hh"
 #include "xtest-message.hh"
 #include "xtest-registrar.hh"
@@ -78,6 +84,28 @@ uint64_t RunRegisteredTests();
 
 #define RUN_ALL_TESTS() xtest::RunRegisteredTests()
 
+// Skips the rest of the test it is used in, which is reported as `SKIPPED`
+// rather than as passed, e.g., when the test does not apply to the machine it
+// runs on.  A test that failed already stays failed.  Can only be used in the
+// body of a test, which it returns from.
+#define XTEST_SKIP() return ::xtest::SkipTest(current_test)
+
+// Marks `test` as `SKIPPED`, unless it failed already; see `XTEST_SKIP()`.
+void SkipTest(TestRegistrar* test);
+
+// Returns true once the test run has been cancelled, e.g., by the first failure
+// with `--xtest_fail_fast`, in which case a test that runs for long should stop
+// and return.  Cheap enough to be polled in the test's inner loop, and from the
+// threads the test started, see `TestThread`.  The test is then reported as
+// `SKIPPED` unless it failed already.  Outside of a test, or on a thread whose
+// test cannot be told, see `TestThread`, it only tells whether to stop.
+#define XTEST_CANCELLED() \
+  ::xtest::IsTestCancelled(::xtest::internal::GetCurrentTest())
+
+// Returns true once the test run has been cancelled, marking `test` as
+// `SKIPPED` unless it failed already or is `nullptr`; see `XTEST_CANCELLED()`.
+bool IsTestCancelled(TestRegistrar* test);
+
 class PrettyUnitTestResultPrinter {
  public:
   // No instance should instantiate from this class.
@@ -132,6 +160,19 @@ class PrettyUnitTestResultPrinter {
   //
   // Note: This function should only be called when there are failed tests.
   static void PrintFailedTests();
+
+  // Prints `skipped_tests`, the tests that skipped themselves with
+  // `XTEST_SKIP()`.
+  //
+  // Note: This function should only be called when tests did.
+  static void PrintSelfSkippedTests(
+      const std::vector<const TestRegistrar*>& skipped_tests);
+
+  // Prints the tests left out of the run because they did not fit in the
+  // `--xtest_time_budget`.
+  //
+  // Note: This function should only be called when tests were left out.
+  static void PrintSkippedTests();
 };
 
 // Parses all the xtest command line flags.
@@ -152,8 +193,113 @@ void PostFlagParsing();
 // decremented.  Calling the function for the second time has no user-visible
 // effect.
 void InitXTest(int32_t* argc, char** argv);
+
+// Registers `hook` to be called once, right before the first test is run.
+//
+// Warm-up hooks build the expensive global state the tests share, e.g.,
+// loading a large dataset or filling a cache.  With `--xtest_isolate=zygote`
+// the hooks run in the parent process only and every batch of tests starts
+// from a copy-on-write snapshot of the warmed up process, so the state is
+// built once per run instead of once per worker.
+void AddWarmUpHook(void (*hook)());
+
+// Returns the scratch directory of the test running on the calling thread, or
+// of the test the thread works for, see `TestThread`: a directory no other test
+// uses, even when the tests run in parallel, created on the first call, e.g.,
+//
+// ```C++
+// TEST(LogTest, ReopensTheFileItWasWriting) {
+//   const std::string path = xtest::TestTempDir() + "/log";
+//   ...
+// }
+// ```
+//
+// The directory is on a tmpfs such as "/dev/shm" when there is one, so that
+// the test does no disk I/O, and on disk in the temporary directory otherwise.
+// It is removed with everything in it by a background thread once the test is
+// over, so that the next test does not wait for it.  Returns an empty string
+// outside of a test, if the directory cannot be created and on Windows.
+std::string TestTempDir();
+
+// The test the calling thread makes its assertions for, see `TestThread`.
+using TestContext = internal::TestContext;
+
+// Makes the calling thread make its assertions for the test of a `TestContext`
+// for the lifetime of this object, like a `TestThread` does, e.g., on a worker
+// of a thread pool the test hands work to:
+//
+// ```C++
+// const xtest::TestContext context = xtest::GetTestContext();
+// pool.Submit([context]() {
+//   xtest::ScopedTestContext scope(context);
+//   EXPECT_TRUE(Compute());
+// });
+// ```
+using ScopedTestContext = internal::ScopedTestContext;
+
+// Returns the context of the calling thread, to be handed over to a thread that
+// works for the test with `ScopedTestContext`.
+TestContext GetTestContext();
+
+// A thread started by a test that makes its assertions for the test, e.g.,
+//
+// ```C++
+// TEST(QueueTest, DeliversTheItemPushedOnAnotherThread) {
+//   Queue queue;
+//   xtest::TestThread consumer([&queue]() { EXPECT_EQ(queue.Pop(), 1); });
+//   queue.Push(1);
+//   consumer.Join();
+// }
+// ```
+//
+// The assertions made on the thread work as on the thread running the test and
+// update its result atomically, so that a failure on any thread fails it,
+// except that a fatal assertion (`ASSERT_*`) cannot jump out of the test: it
+// fails the test and ends the thread, skipping the rest of `function`.  The
+// console output of the thread is printed after the test's own, in one piece.
+// The thread is joined when this object is destroyed and, should a fatal
+// assertion jump out of the test past that, by the test once it is over, so
+// that it cannot outlive the test.
+//
+// A plain `std::thread` only knows its test while no other test runs, i.e.,
+// with `--xtest_jobs=1`.  With several tests running, a failed assertion made
+// on it cannot be blamed on a test: it fails the run rather than its test.
+class TestThread {
+ public:
+  // Starts a thread that calls `function` with `args`.
+  template <typename Function, typename... Args>
+  explicit TestThread(Function&& function, Args&&... args)
+      : thread_(internal::AdoptHelperThread(
+            std::thread(&TestThread::Run<typename std::decay<Function>::type,
+                                         typename std::decay<Args>::type...>,
+                        GetTestContext(), std::forward<Function>(function),
+                        std::forward<Args>(args)...))) {}
+
+  TestThread(TestThread&&) = default;
+  TestThread& operator=(TestThread&&) = delete;
+
+  ~TestThread() { Join(); }
+
+  // Waits for the thread to finish, unless it was joined already.
+  void Join() {
+    if (thread_ != nullptr)
+      thread_->Join();
+  }
+
+ private:
+  template <typename Function, typename... Args>
+  static void Run(const TestContext& context, Function function,
+                  Args... args) {
+    internal::RunHelperThread(context,
+                              [&]() { function(std::move(args)...); });
+  }
+
+  std::shared_ptr<internal::HelperThread> thread_;
+};
 }  // namespace xtest
 
 #include "xtest-assertions.hh"
+#include "xtest-clock.hh"
+#include "xtest-loopback.hh"
 
 #endif  // XTEST_INCLUDE_XTEST_HH_
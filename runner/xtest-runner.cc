@@ -0,0 +1,441 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// `xtest_runner` runs the tests of many xtest binaries on one pool of worker
+// threads.
+//
+// Usage:
+//
+// ```shell
+// xtest_runner [--xtest_jobs=N] [--xtest_color=(yes|no|auto)] BINARY...
+//              [-- FLAG...]
+// ```
+//
+// The tests of every binary are discovered with `--xtest_list_tests` and put
+// in one global queue, so a `--xtest_filter` among the FLAGs selects the tests
+// to run.  Every test is then run in a process of its own, as
+// `BINARY FLAG... --xtest_filter=Suite.Test`, by as many workers as
+// `--xtest_jobs` says (one per online CPU by default), so that no core sits
+// idle while the slowest tests of one binary finish.  The FLAGs that make a
+// binary do something else than run its tests once, e.g., `--xtest_list_tests`,
+// are rejected.  The output of the tests
+// is printed in the order they were discovered in followed by one summary for
+// all the binaries.
+//
+// The runner exits with `EXIT_FAILURE` if a test failed or a binary could not
+// be run, and with `EXIT_SUCCESS` otherwise.
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "internal/xtest-port-arch.hh"
+
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "internal/xtest-isolation.hh"
+#include "internal/xtest-port.hh"
+#include "internal/xtest-printers.hh"
+#include "internal/xtest-scheduler.hh"
+#include "xtest.hh"
+
+namespace xtest {
+namespace runner {
+// A test of one of the binaries given to the runner.
+struct RemoteTest {
+  // Registers the test with the runner under the test suite `suite_label`.
+  RemoteTest(const std::size_t& binary, const std::string& suite,
+             const std::string& test, const char* suite_label)
+      : binary(binary),
+        suite_name(suite),
+        test_name(test),
+        registrar(suite_label, test_name.c_str(), nullptr) {}
+
+  std::size_t binary;      // Index of the binary in `binaries`.
+  std::string suite_name;  // Suite name as the binary knows it.
+  std::string test_name;   // Test name as the binary knows it.
+
+  // Stands in for the test in the runner's registry, so that the runner's
+  // result printer and summary treat it like a test of its own.
+  TestRegistrar registrar;
+};
+
+// Binaries to run the tests of and the flags to pass to each of them.
+static std::vector<std::string> binaries;
+static std::vector<std::string> forwarded_flags;
+
+// Tests discovered in `binaries`.  A deque, since the registrars in the tests
+// must not move once they are registered.
+static std::deque<RemoteTest> remote_tests;
+static std::unordered_map<const TestRegistrar*, const RemoteTest*>
+    remote_test_of;
+
+// Names the tests suites of every binary are registered under with the
+// runner: the suite name prefixed with the binary, e.g., "./foo_test:FooTest".
+static std::deque<std::string> suite_labels;
+
+// Prints how to use the runner.
+static void PrintUsage() {
+  internal::PrintColorEncoded(
+      "Usage: @Gxtest_runner@D [@G--" XTEST_FLAG_PREFIX_
+      "jobs=@YN@D] [@G--" XTEST_FLAG_PREFIX_
+      "color=@Y(@Gyes@Y|@Gno@Y|@Gauto@Y)@D] @YBINARY@D... "
+      "[@G--@D @YFLAG@D...]\n"
+      "\n"
+      "Runs the tests of all the xtest BINARY files on one pool of N workers,\n"
+      "one process per test, and prints one summary for all of them.  N "
+      "defaults\n"
+      "to one worker per CPU.  The FLAGs after @G--@D are passed to every "
+      "BINARY;\n"
+      "a @G--" XTEST_FLAG_PREFIX_ "filter@D among them selects the tests to "
+      "run.\n");
+}
+
+// Flags that make a binary do something else than run the test it is given
+// once, and so cannot be passed to the binaries.
+static const char* const kExclusiveFlags[] = {"list_tests", "serve", "soak",
+                                              "bisect_order"};
+
+// Returns the name of the flag in `kExclusiveFlags` that `arg` sets, or
+// `nullptr` if it sets none of them.
+static const char* FindExclusiveFlag(const std::string& arg) {
+  static const std::string kPrefix = "--" XTEST_FLAG_PREFIX_;
+  if (arg.compare(0, kPrefix.size(), kPrefix) != 0)
+    return nullptr;
+  const std::string name =
+      arg.substr(kPrefix.size(), arg.find('=') - kPrefix.size());
+  for (const char* const& flag : kExclusiveFlags) {
+    if (name == flag)
+      return flag;
+  }
+  return nullptr;
+}
+
+// Parses the command line of the runner.  The `--xtest_*` flags before `--`
+// configure the runner itself; they are parsed by `InitXTest()`.  Returns
+// false, saying why, if a flag after `--` cannot be passed to the binaries.
+static bool ParseCommandLine(int32_t argc, char** argv) {
+  bool forwarding = false;
+  for (int32_t i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (forwarding) {
+      const char* const exclusive_flag = FindExclusiveFlag(arg);
+      if (exclusive_flag != nullptr) {
+        internal::ColoredPrintf(internal::XTestColor::kRed,
+                                "--" XTEST_FLAG_PREFIX_
+                                "%s cannot be passed to the binaries.\n",
+                                exclusive_flag);
+        return false;
+      }
+      forwarded_flags.push_back(arg);
+    } else if (arg == "--")
+      forwarding = true;
+    else if (arg.compare(0, 2, "--") != 0)
+      binaries.push_back(arg);
+  }
+  return true;
+}
+
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+// Runs `argv` with its standard output and error streams connected to a pipe
+// and stores what it printed in `output`.  Returns the `waitpid()` status of
+// the process, or -1 if it could not be started.
+static int32_t RunProcess(const std::vector<std::string>& argv,
+                          std::string* output) {
+  int32_t output_pipe[2];
+#if XTEST_OS_LINUX
+  // Close-on-exec from the start, so that processes started at the same time
+  // by other workers do not inherit the pipe and keep it open.
+  if (pipe2(output_pipe, O_CLOEXEC) < 0)
+    return -1;
+#else
+  if (pipe(output_pipe) < 0)
+    return -1;
+  fcntl(output_pipe[0], F_SETFD, FD_CLOEXEC);
+  fcntl(output_pipe[1], F_SETFD, FD_CLOEXEC);
+#endif
+
+  std::vector<char*> args;
+  for (const std::string& arg : argv)
+    args.push_back(const_cast<char*>(arg.c_str()));
+  args.push_back(nullptr);
+
+  const pid_t pid = fork();
+  if (pid < 0) {
+    close(output_pipe[0]);
+    close(output_pipe[1]);
+    return -1;
+  }
+  if (pid == 0) {
+    dup2(output_pipe[1], STDOUT_FILENO);
+    dup2(output_pipe[1], STDERR_FILENO);
+    execv(args[0], args.data());
+    _exit(127);
+  }
+  close(output_pipe[1]);
+
+  char buffer[4096];
+  for (;;) {
+    const ssize_t read_size = read(output_pipe[0], buffer, sizeof(buffer));
+    if (read_size < 0 && errno == EINTR)
+      continue;
+    if (read_size <= 0)
+      break;
+    output->append(buffer, static_cast<std::size_t>(read_size));
+  }
+  close(output_pipe[0]);
+
+  int32_t status = 0;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+  }
+  return status;
+}
+
+// Returns true if `status` is the status of a process that exited with code 0.
+static bool Succeeded(const int32_t& status) {
+  return status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Discovers the tests of `binary` with `--xtest_list_tests` and appends them
+// to `tests` as suite and test name pairs.  Returns false if the binary could
+// not be run.
+static bool DiscoverTests(
+    const std::string& binary,
+    std::vector<std::pair<std::string, std::string>>* tests) {
+  std::vector<std::string> argv = {binary,
+                                   "--" XTEST_FLAG_PREFIX_ "list_tests"};
+  argv.insert(argv.end(), forwarded_flags.begin(), forwarded_flags.end());
+  std::string output;
+  if (!Succeeded(RunProcess(argv, &output)))
+    return false;
+
+  // The list has a "Suite." line for every test suite followed by a
+  // "  Test" line for every test of that suite.
+  std::string suite_name;
+  std::size_t begin = 0;
+  while (begin < output.size()) {
+    std::size_t end = output.find('\n', begin);
+    if (end == std::string::npos)
+      end = output.size();
+    const std::string line = output.substr(begin, end - begin);
+    begin = end + 1;
+    if (line.compare(0, 2, "  ") == 0 && !suite_name.empty())
+      tests->emplace_back(suite_name, line.substr(2));
+    else if (!line.empty() && line.back() == '.')
+      suite_name = line.substr(0, line.size() - 1);
+  }
+  return true;
+}
+
+// Removes the escape sequences that color the console output of a binary.
+// Binaries built with their own tests enabled print colors even when told not
+// to.
+static std::string StripColors(const std::string& output) {
+  std::string stripped;
+  stripped.reserve(output.size());
+  for (std::size_t i = 0; i < output.size(); ++i) {
+    if (output[i] == '\x1b' && i + 1 < output.size() && output[i + 1] == '[') {
+      const std::size_t end = output.find('m', i);
+      if (end != std::string::npos) {
+        i = end;
+        continue;
+      }
+    }
+    stripped += output[i];
+  }
+  return stripped;
+}
+
+// Returns the part of the console output of a single test run that belongs to
+// the test, i.e., what is printed between the header and the footer of its
+// test suite.  Returns all of `output` if there is no such header, e.g., if
+// the binary crashed before running the test.
+static std::string ExtractTestOutput(const std::string& output) {
+  static const char kSeparator[] = "[----------] ";
+  std::size_t begin = std::string::npos;
+  for (std::size_t line = 0; line < output.size();) {
+    std::size_t next_line = output.find('\n', line);
+    next_line = next_line == std::string::npos ? output.size() : next_line + 1;
+    if (output.compare(line, sizeof(kSeparator) - 1, kSeparator) == 0) {
+      if (begin != std::string::npos)
+        return output.substr(begin, line - begin);
+      if (output.find(" tests from ", line) < next_line)
+        begin = next_line;
+    }
+    line = next_line;
+  }
+  return begin == std::string::npos ? output : output.substr(begin);
+}
+
+// Prints the output of a test run by a binary with the result tags colored
+// the way the runner's own console output is.
+static void PrintTestOutput(const std::string& output) {
+  static const struct {
+    const char* tag;
+    internal::XTestColor color;
+  } kTags[] = {{"[ RUN      ] ", internal::XTestColor::kGreen},
+               {"[       OK ] ", internal::XTestColor::kGreen},
+               {"[  FAILED  ] ", internal::XTestColor::kRed}};
+
+  std::size_t begin = 0;
+  while (begin < output.size()) {
+    std::size_t end = output.find('\n', begin);
+    end = end == std::string::npos ? output.size() : end + 1;
+    std::string line = output.substr(begin, end - begin);
+    begin = end;
+    for (const auto& tag : kTags) {
+      if (line.compare(0, std::strlen(tag.tag), tag.tag) == 0) {
+        internal::ColoredPrintf(tag.color, "%s", tag.tag);
+        line.erase(0, std::strlen(tag.tag));
+        break;
+      }
+    }
+    internal::StreamPrintf(stdout, "%s", line.c_str());
+  }
+}
+
+// Runs `test` in a process of its own and records its result.  Runs on the
+// runner's worker threads.
+static void RunRemoteTest(TestRegistrar* test) {
+  const RemoteTest* const remote_test = remote_test_of.at(test);
+  std::vector<std::string> argv = {binaries[remote_test->binary]};
+  argv.insert(argv.end(), forwarded_flags.begin(), forwarded_flags.end());
+  // After the forwarded flags, as the last value of a flag wins: a forwarded
+  // `--xtest_filter` must not run more than `test`.
+  argv.push_back("--" XTEST_FLAG_PREFIX_ "filter=" + remote_test->suite_name +
+                 '.' + remote_test->test_name);
+  argv.push_back("--" XTEST_FLAG_PREFIX_ "color=no");
+
+  internal::Timer timer;
+  std::string output;
+  const int32_t status = RunProcess(argv, &output);
+  test->elapsed_time_ = timer.Elapsed();
+  test->test_result_ =
+      Succeeded(status) ? TestResult::PASSED : TestResult::FAILED;
+
+  PrintTestOutput(ExtractTestOutput(StripColors(output)));
+  if (test->test_result_ == TestResult::FAILED) {
+    ++XTEST_GLOBAL_INSTANCE_GET_(failure_count);
+    internal::StreamPrintf(
+        stderr, "error: %s running %s.%s %s\n",
+        binaries[remote_test->binary].c_str(), remote_test->suite_name.c_str(),
+        remote_test->test_name.c_str(),
+        status < 0 ? "could not be started"
+                   : internal::DescribeExitStatus(status).c_str());
+  }
+}
+
+// Discovers the tests of all `binaries` and registers them with the runner.
+// Returns false if the tests of a binary could not be listed.
+static bool RegisterRemoteTests(internal::TestPlan* plan) {
+  std::vector<std::vector<std::pair<std::string, std::string>>> tests(
+      binaries.size());
+  std::vector<char> listed(binaries.size(), 0);
+  std::vector<std::size_t> tasks;
+  for (std::size_t i = 0; i < binaries.size(); ++i)
+    tasks.push_back(i);
+  internal::WorkStealingPool pool(
+      internal::GetNumberOfJobs(XTEST_FLAG_GET_(jobs)));
+  pool.Start(tasks, [&tests, &listed](std::size_t /* worker */,
+                                      std::size_t binary) {
+    listed[binary] = DiscoverTests(binaries[binary], &tests[binary]);
+  });
+  pool.Join();
+
+  bool all_listed = true;
+  for (std::size_t binary = 0; binary < binaries.size(); ++binary) {
+    if (!listed[binary]) {
+      internal::ColoredPrintf(internal::XTestColor::kRed,
+                              "Could not list the tests of %s\n",
+                              binaries[binary].c_str());
+      all_listed = false;
+      continue;
+    }
+    for (const std::pair<std::string, std::string>& test : tests[binary]) {
+      const std::string label = binaries[binary] + ':' + test.first;
+      if (plan->empty() || label != plan->back().first) {
+        suite_labels.push_back(label);
+        plan->emplace_back(suite_labels.back().c_str(),
+                           std::list<TestRegistrar*>());
+      }
+      remote_tests.emplace_back(binary, test.first, test.second,
+                                plan->back().first);
+      RemoteTest& remote_test = remote_tests.back();
+      remote_test_of[&remote_test.registrar] = &remote_test;
+      plan->back().second.push_back(&remote_test.registrar);
+    }
+  }
+  return all_listed;
+}
+#endif  // XTEST_OS_LINUX || XTEST_OS_MAC
+
+// Runs the runner and returns its exit code.
+static int32_t RunnerMain(int32_t argc, char** argv) {
+  // Unlike a test binary the runner uses all the CPUs by default.
+  XTEST_FLAG_SET_(jobs, 0);
+  InitXTest(&argc, argv);
+  if (!ParseCommandLine(argc, argv))
+    return EXIT_FAILURE;
+  if (binaries.empty()) {
+    PrintUsage();
+    return EXIT_FAILURE;
+  }
+
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+  internal::TestPlan plan;
+  const bool all_listed = RegisterRemoteTests(&plan);
+
+  PrettyUnitTestResultPrinter::OnTestExecutionStart();
+  internal::RunTestPlanInParallel(
+      plan, internal::GetNumberOfJobs(XTEST_FLAG_GET_(jobs)), RunRemoteTest);
+  PrettyUnitTestResultPrinter::OnTestExecutionEnd();
+  return all_listed && GetFailedTestCount() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+#else
+  internal::ColoredPrintf(internal::XTestColor::kRed,
+                          "xtest_runner is not supported on this platform.\n");
+  return EXIT_FAILURE;
+#endif
+}
+}  // namespace runner
+}  // namespace xtest
+
+int main(int argc, char** argv) {
+  return xtest::runner::RunnerMain(argc, argv);
+}
@@ -0,0 +1,109 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_TESTS_XTEST_AFFINITY_TEST_HH_
+#define XTEST_TESTS_XTEST_AFFINITY_TEST_HH_
+
+#include <cstdint>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "internal/xtest-affinity.hh"
+#include "xtest.hh"
+
+TEST(ParseCpuListTest, ParsesNumbersAndRanges) {
+  std::vector<int32_t> cpus;
+  EXPECT_TRUE(xtest::internal::ParseCpuList("0,2,4-7", &cpus));
+  EXPECT_TRUE(cpus == std::vector<int32_t>({0, 2, 4, 5, 6, 7}));
+  EXPECT_TRUE(xtest::internal::ParseCpuList("3", &cpus));
+  EXPECT_TRUE(cpus == std::vector<int32_t>({3}));
+  EXPECT_FALSE(xtest::internal::ParseCpuList("", &cpus));
+  EXPECT_FALSE(xtest::internal::ParseCpuList("0,", &cpus));
+  EXPECT_FALSE(xtest::internal::ParseCpuList("4-2", &cpus));
+  EXPECT_FALSE(xtest::internal::ParseCpuList("0-99999999", &cpus));
+}
+
+// Returns a machine with two NUMA nodes of two cores with two hardware threads
+// each, numbered like Linux does: the first threads of all cores, then their
+// siblings.
+static std::vector<xtest::internal::CpuInfo> MakeTwoNodeMachine() {
+  std::vector<xtest::internal::CpuInfo> cpus;
+  for (int32_t cpu = 0; cpu < 8; ++cpu) {
+    xtest::internal::CpuInfo info;
+    info.cpu = cpu;
+    info.package = (cpu / 2) % 2;
+    info.node = info.package;
+    info.core = cpu % 2;
+    cpus.push_back(info);
+  }
+  return cpus;
+}
+
+TEST(CpuAffinityTest, PlansCompactScatterAndListedCpus) {
+  const std::vector<xtest::internal::CpuInfo> cpus = MakeTwoNodeMachine();
+  xtest::internal::CpuAffinity affinity;
+  std::string error;
+  using Cpus = std::vector<int32_t>;
+
+  EXPECT_TRUE(affinity.Plan("compact", cpus, 8, &error));
+  EXPECT_TRUE(affinity.worker_cpus() == Cpus({0, 1, 4, 5, 2, 3, 6, 7}));
+  EXPECT_TRUE(affinity.Plan("scatter", cpus, 5, &error));
+  EXPECT_TRUE(affinity.worker_cpus() == Cpus({0, 2, 1, 3, 4}));
+  EXPECT_TRUE(affinity.Plan("6,1-2", cpus, 4, &error));
+  EXPECT_TRUE(affinity.worker_cpus() == Cpus({6, 1, 2, 6}));
+
+  EXPECT_FALSE(affinity.Plan("8", cpus, 1, &error));
+  EXPECT_EQ(error, "CPU 8 is not one this process may run on");
+  EXPECT_FALSE(affinity.Plan("spread", cpus, 1, &error));
+  EXPECT_TRUE(affinity.empty());
+}
+
+TEST(CpuAffinityTest, PinsAWorkerThread) {
+  const std::vector<xtest::internal::CpuInfo> cpus =
+      xtest::internal::GetCpuTopology();
+  xtest::internal::CpuAffinity affinity;
+  std::string error;
+  if (!affinity.Plan("compact", cpus, 1, &error))
+    return;  // The CPUs cannot be listed on this platform.
+
+  int32_t cpu_while_pinned = -1;
+  int32_t cpu_after_unpinning = 0;
+  std::thread worker([&]() {
+    affinity.PinWorker(0);
+    cpu_while_pinned = xtest::internal::GetCurrentCpu();
+    xtest::internal::UnpinCurrentThread();
+    cpu_after_unpinning = xtest::internal::GetCurrentCpu();
+  });
+  worker.join();
+  EXPECT_EQ(cpu_while_pinned, affinity.worker_cpus()[0]);
+  EXPECT_EQ(cpu_after_unpinning, -1);
+}
+
+#endif  // XTEST_TESTS_XTEST_AFFINITY_TEST_HH_
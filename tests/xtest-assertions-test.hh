@@ -102,6 +102,8 @@ TEST(PrettyAssertionResultPrinterTest,
   xtest::internal::PrettyAssertionResultPrinter::OnTestAssertionEnd(current_test,
                                                                     100);
   stdout_redirector_context.RestoreStream();
+  // A failure sticks, so the test must not stay failed for real.
+  current_test->test_result_ = xtest::TestResult::UNKNOWN;
   std::string actual(stdout_redirector_context.M_output_buffer_);
   std::string expected(
       "\x1b[0;31m[  FAILED  ] "
@@ -119,6 +121,9 @@ TEST(PrettyAssertionResultPrinterTest, OnTestAssertionFailureTest) {
       "lhs_expression", "rhs_expression", "lhs_expression", "rhs_expression",
       xtest::internal::AssertionContext(__FILE__, 120, current_test));
   stdout_redirector_context.RestoreStream();
+  // A failure sticks, so the test must not stay failed for real.
+  current_test->test_result_ = xtest::TestResult::UNKNOWN;
+  --XTEST_GLOBAL_INSTANCE_GET_(failure_count);
   std::string actual(stdout_redirector_context.M_output_buffer_);
   std::string expected(__FILE__
                        "(120): error: Value of: lhs_expression\n  Actual: "
@@ -0,0 +1,72 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_TESTS_XTEST_CANCELLATION_TEST_HH_
+#define XTEST_TESTS_XTEST_CANCELLATION_TEST_HH_
+
+#include "internal/xtest-cancellation.hh"
+#include "internal/xtest-port-arch.hh"
+#include "xtest.hh"
+
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Takes up every CPU slot so that no other test runs, and sees the run
+// cancelled, while the run is cancelled.
+TEST_WITH_COST(CancelTestRunTest, IsSeenByTheParentOfAForkedWorker,
+               cpus = 1024) {
+  const bool cancelled = xtest::internal::IsTestRunCancelled();
+  const pid_t pid = fork();
+  if (pid == 0) {
+    xtest::internal::CancelTestRun();
+    _exit(0);
+  }
+  int32_t status = 0;
+  waitpid(pid, &status, 0);
+  EXPECT_TRUE(xtest::internal::IsTestRunCancelled());
+  if (!cancelled)
+    xtest::internal::ResetTestRunCancellation();
+  EXPECT_EQ(xtest::internal::IsTestRunCancelled(), cancelled);
+}
+#endif  // XTEST_OS_LINUX || XTEST_OS_MAC
+
+// Takes up every CPU slot so that no other test runs while the run is
+// cancelled.
+TEST_WITH_COST(CancelTestRunTest, IsSeenOutsideOfATest, cpus = 1024) {
+  const bool cancelled = xtest::internal::IsTestRunCancelled();
+  xtest::internal::CancelTestRun();
+  EXPECT_TRUE(xtest::IsTestCancelled(nullptr));
+  if (!cancelled)
+    xtest::internal::ResetTestRunCancellation();
+  EXPECT_EQ(xtest::IsTestCancelled(nullptr), cancelled);
+}
+
+#endif  // XTEST_TESTS_XTEST_CANCELLATION_TEST_HH_
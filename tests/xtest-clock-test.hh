@@ -0,0 +1,103 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_TESTS_XTEST_CLOCK_TEST_HH_
+#define XTEST_TESTS_XTEST_CLOCK_TEST_HH_
+
+#include <chrono>  // NOLINT
+#include <cstdint>
+#include <vector>
+
+#include "internal/xtest-port.hh"
+#include "xtest.hh"
+
+// Retries `attempt` every `backoff` until it succeeds or `deadline` is reached,
+// sleeping through `Clock` like the code under test of a fake clock does.
+template <typename Clock>
+static bool RetryUntil(bool (*attempt)(),
+                       const typename Clock::duration& backoff,
+                       const typename Clock::time_point& deadline) {
+  while (!attempt()) {
+    if (Clock::now() + backoff > deadline)
+      return false;
+    Clock::SleepFor(backoff);
+  }
+  return true;
+}
+
+static bool NeverSucceeds() { return false; }
+
+TEST_WITH_FAKE_TIME(FakeClockTest, StartsAtTheEpochAndOnlyMovesWhenMoved) {
+  EXPECT_TRUE(xtest::FakeClock::now() == xtest::FakeClock::time_point());
+  xtest::FakeClock::Advance(std::chrono::hours(1));
+  xtest::FakeClock::Advance(std::chrono::seconds(-5));
+  EXPECT_TRUE(xtest::FakeClock::now().time_since_epoch() ==
+              std::chrono::hours(1));
+  xtest::FakeClock::SleepUntil(xtest::FakeClock::time_point());
+  EXPECT_TRUE(xtest::FakeClock::now().time_since_epoch() ==
+              std::chrono::hours(1));
+  EXPECT_TRUE(current_test->has_fake_time_);
+}
+
+TEST_WITH_FAKE_TIME(FakeClockTest, DoesNotSlowDownTheCodeThatSleepsOnIt) {
+  const xtest::FakeClock::time_point deadline =
+      xtest::FakeClock::now() + std::chrono::minutes(10);
+  xtest::internal::Timer timer;
+  EXPECT_FALSE(RetryUntil<xtest::FakeClock>(
+      NeverSucceeds, std::chrono::milliseconds(100), deadline));
+  EXPECT_TRUE(xtest::FakeClock::now() == deadline);
+  // The framework's own clock keeps measuring real time.
+  EXPECT_TRUE(timer.Elapsed() < 60 * 1000);
+}
+
+TEST_WITH_FAKE_TIME(FakeClockTest, IsSharedByTheThreadsOfTheTest) {
+  std::vector<xtest::TestThread> threads;
+  for (int32_t i = 0; i < 8; ++i)
+    threads.emplace_back([]() {
+      for (int32_t j = 0; j < 1000; ++j)
+        xtest::FakeClock::Advance(std::chrono::nanoseconds(1));
+    });
+  for (xtest::TestThread& thread : threads)
+    thread.Join();
+  EXPECT_EQ(xtest::FakeClock::now().time_since_epoch().count(), 8000);
+}
+
+TEST(FakeClockTest, IsSharedByTheProcessOutsideOfATestWithFakeTime) {
+  xtest::TestRegistrar test = *current_test;
+  test.has_fake_time_ = true;
+  const xtest::FakeClock::time_point process_time = xtest::FakeClock::now();
+  {
+    xtest::internal::ScopedTestRun run(&test);
+    xtest::FakeClock::Advance(std::chrono::seconds(1));
+    EXPECT_EQ(test.fake_time_.Load(), 1000 * 1000 * 1000);
+  }
+  EXPECT_TRUE(xtest::FakeClock::now() == process_time);
+  EXPECT_FALSE(current_test->has_fake_time_);
+}
+#endif  // XTEST_TESTS_XTEST_CLOCK_TEST_HH_
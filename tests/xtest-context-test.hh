@@ -0,0 +1,210 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_TESTS_XTEST_CONTEXT_TEST_HH_
+#define XTEST_TESTS_XTEST_CONTEXT_TEST_HH_
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "internal/xtest-context.hh"
+#include "internal/xtest-port-arch.hh"
+#include "internal/xtest-printers.hh"
+#include "xtest.hh"
+
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif  // XTEST_OS_LINUX || XTEST_OS_MAC
+
+TEST(AtomicTestResultTest, KeepsAFailure) {
+  xtest::AtomicTestResult result;
+  result.MarkPassed();
+  EXPECT_TRUE(result == xtest::TestResult::PASSED);
+  result.MarkFailed();
+  result.MarkPassed();
+  result.MarkSkipped();
+  EXPECT_TRUE(result == xtest::TestResult::FAILED);
+
+  xtest::AtomicTestResult skipped;
+  skipped.MarkPassed();
+  skipped.MarkSkipped();
+  EXPECT_TRUE(skipped == xtest::TestResult::SKIPPED);
+}
+
+TEST(HelperOutputListTest, TakesTheOutputOfEveryThreadInPushOrder) {
+  xtest::internal::HelperOutputList list;
+  xtest::internal::OutputCapture first;
+  first.Append(stdout, "first");
+  xtest::internal::OutputCapture second;
+  second.Append(stderr, "second");
+  list.Push(first);
+  list.Push(second);
+  const std::vector<xtest::internal::OutputCapture> taken = list.TakeAll();
+  ASSERT_EQ(taken.size(), 2u);
+  EXPECT_EQ(taken[0].chunks()[0].second, std::string("first"));
+  EXPECT_EQ(taken[1].chunks()[0].second, std::string("second"));
+  EXPECT_TRUE(list.TakeAll().empty());
+
+  const std::size_t num_threads = 8;
+  const std::size_t pushes_per_thread = 1000;
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < num_threads; ++i)
+    threads.emplace_back([&list, &first]() {
+      for (std::size_t j = 0; j < pushes_per_thread; ++j)
+        list.Push(first);
+    });
+  for (std::thread& thread : threads)
+    thread.join();
+  EXPECT_EQ(list.TakeAll().size(), num_threads * pushes_per_thread);
+}
+
+// Serializes the tests that count the failures of their threads, which would
+// count each other's when run in parallel.
+static std::mutex failure_counting_mutex;
+
+TEST(TestThreadTest, FailsTheTestThatStartedIt) {
+  std::lock_guard<std::mutex> lock(failure_counting_mutex);
+  xtest::TestRegistrar test = *current_test;
+  test.test_result_ = xtest::TestResult::UNKNOWN;
+  std::atomic<int32_t> finished(0);
+  {
+    xtest::internal::ScopedTestRun run(&test);
+    std::vector<xtest::TestThread> threads;
+    for (int32_t i = 0; i < 8; ++i)
+      threads.emplace_back([i, &finished]() {
+        EXPECT_TRUE(i != 3);
+        ASSERT_TRUE(i != 5);  // Ends the helper thread, not the run.
+        EXPECT_TRUE(xtest::internal::GetCurrentTest() != nullptr);
+        ++finished;
+      });
+  }
+  // Only the two failures of the threads are taken back: with tests running
+  // in parallel, the count may take in the failures of other tests.
+  if (test.test_result_ == xtest::TestResult::FAILED)
+    XTEST_GLOBAL_INSTANCE_GET_(failure_count) -= 2;
+  EXPECT_EQ(finished.load(), 7);
+  EXPECT_TRUE(test.test_result_ == xtest::TestResult::FAILED);
+  EXPECT_TRUE(current_test->test_result_ != xtest::TestResult::FAILED);
+}
+
+TEST(TestThreadTest, EndsOnItsOwnFatalFailure) {
+  std::lock_guard<std::mutex> lock(failure_counting_mutex);
+  xtest::TestRegistrar test = *current_test;
+  test.test_result_ = xtest::TestResult::UNKNOWN;
+  bool carried_on = false;
+  {
+    xtest::internal::ScopedTestRun run(&test);
+    xtest::TestThread thread([&carried_on]() {
+      ASSERT_TRUE(false) << "ends the thread";
+      carried_on = true;
+    });
+  }
+  // Only the failure of the thread is taken back, as above.
+  if (test.test_result_ == xtest::TestResult::FAILED)
+    --XTEST_GLOBAL_INSTANCE_GET_(failure_count);
+  EXPECT_FALSE(carried_on);
+  EXPECT_TRUE(test.test_result_ == xtest::TestResult::FAILED);
+}
+
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+TEST(TestThreadTest, IsJoinedBeforeAFatalFailureJumpsOutOfTheTest) {
+  int32_t done_pipe[2];
+  ASSERT_EQ(pipe(done_pipe), 0);
+  std::fflush(stdout);
+  std::fflush(stderr);
+  const pid_t pid = fork();
+  if (pid == 0) {
+    // Let the abort kill the child rather than jump out of the test it copied.
+    std::signal(SIGABRT, SIG_DFL);
+    const int32_t null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+    close(done_pipe[0]);
+    xtest::TestRegistrar test = *current_test;
+    xtest::internal::ScopedTestRun run(&test);
+    const int32_t done_fd = done_pipe[1];
+    xtest::TestThread helper([done_fd]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      const char done = 'j';
+      if (write(done_fd, &done, 1) != 1)
+        _exit(1);
+    });
+    ASSERT_TRUE(false) << "jumps out of the test while the helper runs";
+    _exit(0);
+  }
+  close(done_pipe[1]);
+  char done = 0;
+  EXPECT_EQ(read(done_pipe[0], &done, 1), 1);
+  close(done_pipe[0]);
+  int32_t status = 0;
+  waitpid(pid, &status, 0);
+  EXPECT_TRUE(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+  EXPECT_EQ(done, 'j');
+}
+#endif  // XTEST_OS_LINUX || XTEST_OS_MAC
+
+TEST(TestThreadTest, FailsTheRunFromAPlainThreadWhileTestsRunInParallel) {
+  std::lock_guard<std::mutex> lock(failure_counting_mutex);
+  xtest::TestRegistrar test = *current_test;
+  test.test_result_ = xtest::TestResult::UNKNOWN;
+  const uint64_t unattributed_before =
+      XTEST_GLOBAL_INSTANCE_GET_(unattributed_failure_count);
+  {
+    // Along with this test, at least two tests are running.
+    xtest::internal::ScopedTestRun run(&test);
+    std::thread thread([]() {
+      EXPECT_TRUE(xtest::internal::GetCurrentTest() == nullptr);
+      EXPECT_TRUE(false);
+      ASSERT_TRUE(false);  // Does not end the run from a thread of no test.
+    });
+    thread.join();
+  }
+  // Each of them counts in the failures of the run as well.
+  const uint64_t unattributed =
+      XTEST_GLOBAL_INSTANCE_GET_(unattributed_failure_count) -
+      unattributed_before;
+  XTEST_GLOBAL_INSTANCE_GET_(failure_count) -= unattributed;
+  XTEST_GLOBAL_INSTANCE_GET_(unattributed_failure_count) -= unattributed;
+  EXPECT_EQ(unattributed, 2u);
+  EXPECT_TRUE(test.test_result_ == xtest::TestResult::UNKNOWN);
+  EXPECT_TRUE(current_test->test_result_ != xtest::TestResult::FAILED);
+}
+
+#endif  // XTEST_TESTS_XTEST_CONTEXT_TEST_HH_
@@ -0,0 +1,143 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_TESTS_XTEST_FAULTS_TEST_HH_
+#define XTEST_TESTS_XTEST_FAULTS_TEST_HH_
+
+#include <csetjmp>
+#include <csignal>
+#include <cstdint>
+#include <thread>  // NOLINT
+
+#include "internal/xtest-faults.hh"
+#include "xtest.hh"
+
+TEST(DescribeFaultTest, DescribesTheSignalAndTheAddress) {
+  xtest::internal::Fault fault = {SIGSEGV, nullptr};
+  EXPECT_TRUE(xtest::internal::DescribeFault(fault).find("signal 11") == 0);
+  EXPECT_TRUE(xtest::internal::DescribeFault(fault).find("at address 0x0") !=
+              std::string::npos);
+}
+
+#if !XTEST_OS_WINDOWS
+static thread_local std::jmp_buf jump_out_of_faulting_code;
+static thread_local xtest::internal::Fault caught_fault;
+
+// True on the thread of `CatchFault()`.
+static thread_local bool catching_faults = false;
+
+// Handler installed before `CatchFault()`, e.g., by the runner with
+// `--xtest_catch_faults`.
+static xtest::internal::FaultHandler saved_fault_handler = nullptr;
+
+static void JumpOutOfFaultingCode(const xtest::internal::Fault& fault) {
+  if (!catching_faults) {
+    // The fault of another test, for the handler installed before.
+    if (saved_fault_handler != nullptr)
+      saved_fault_handler(fault);
+    return;
+  }
+  caught_fault = fault;
+  std::longjmp(jump_out_of_faulting_code, 1);
+}
+
+// Depth `OverflowTheStack()` stops at, far beyond any stack; volatile so that
+// the compiler can neither prove the recursion endless nor bound it.
+static volatile int32_t max_recursion_depth = INT32_MAX;
+
+static int32_t OverflowTheStack(int32_t depth) {
+  volatile char frame[1024];
+  frame[0] = static_cast<char>(depth);
+  if (depth >= max_recursion_depth)
+    return frame[0];
+  return OverflowTheStack(depth + 1) + frame[0];
+}
+
+// Runs `code`, which faults, with the fault handlers installed and returns the
+// fault it was jumped out of.  The handlers are process-wide: the handler
+// installed before, if any, is handed the faults of the other threads and
+// installed again afterwards.
+template <typename Code>
+static xtest::internal::Fault CatchFault(Code code) {
+  xtest::internal::Fault fault = {0, nullptr};
+  saved_fault_handler = xtest::internal::GetFaultHandler();
+  std::thread thread([&]() {
+    xtest::internal::EnsureAlternateSignalStack();
+    caught_fault.signal = 0;
+    catching_faults = true;
+    xtest::internal::InstallFaultHandlers(JumpOutOfFaultingCode);
+    if (setjmp(jump_out_of_faulting_code) == 0)
+      code();
+    if (saved_fault_handler != nullptr)
+      xtest::internal::InstallFaultHandlers(saved_fault_handler);
+    else
+      xtest::internal::RestoreFaultHandlers();
+    fault = caught_fault;
+  });
+  thread.join();
+  return fault;
+}
+
+// The tests share the process-wide fault handlers.
+XTEST_RESOURCE(FaultHandlersTest, "fault-handlers");
+
+TEST(FaultHandlersTest, JumpOutOfANullDereference) {
+  const xtest::internal::Fault fault = CatchFault([]() {
+    volatile int32_t* volatile pointer = nullptr;
+    *pointer = 1;
+  });
+  EXPECT_EQ(fault.signal, SIGSEGV);
+  EXPECT_TRUE(fault.address == nullptr);
+}
+
+TEST(FaultHandlersTest, JumpOutOfADivisionByZero) {
+  const xtest::internal::Fault fault = CatchFault([]() {
+    volatile int32_t dividend = 1;
+    volatile int32_t divisor = 0;
+    volatile int32_t quotient = dividend / divisor;
+    (void)quotient;
+  });
+#if defined(__x86_64__) || defined(__i386__)
+  EXPECT_EQ(fault.signal, SIGFPE);
+#else
+  // Other architectures, e.g., ARM, do not trap on an integer division by zero.
+  EXPECT_TRUE(fault.signal == 0 || fault.signal == SIGFPE);
+#endif
+}
+
+TEST(FaultHandlersTest, JumpOutOfAStackOverflow) {
+  const xtest::internal::Fault fault =
+      CatchFault([]() { OverflowTheStack(0); });
+  EXPECT_EQ(fault.signal, SIGSEGV);
+  // The handler of the runner, with `--xtest_catch_faults`, is back.
+  EXPECT_TRUE(xtest::internal::GetFaultHandler() == saved_fault_handler);
+}
+#endif  // !XTEST_OS_WINDOWS
+
+#endif  // XTEST_TESTS_XTEST_FAULTS_TEST_HH_
@@ -0,0 +1,96 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_TESTS_XTEST_FILTER_TEST_HH_
+#define XTEST_TESTS_XTEST_FILTER_TEST_HH_
+
+#include <cstdint>
+#include <string>
+
+#include "internal/xtest-filter.hh"
+#include "xtest.hh"
+
+TEST(TestFilterTest, MatchesAllTestsWhenEmpty) {
+  xtest::internal::TestFilter filter("");
+  EXPECT_TRUE(filter.Matches("Foo.Bar"));
+  EXPECT_TRUE(filter.Matches(""));
+}
+
+TEST(TestFilterTest, MatchesAListOfFullNames) {
+  xtest::internal::TestFilter filter("Foo.Bar:Foo.Baz");
+  EXPECT_TRUE(filter.Matches("Foo.Bar"));
+  EXPECT_TRUE(filter.Matches("Foo.Baz"));
+  EXPECT_FALSE(filter.Matches("Foo.Ba"));
+  EXPECT_FALSE(filter.Matches("Foo.Bars"));
+  EXPECT_FALSE(filter.Matches("Foo.Qux"));
+}
+
+TEST(TestFilterTest, MatchesWildcards) {
+  xtest::internal::TestFilter filter("Foo.*:*.Bar?:A*B*C");
+  EXPECT_TRUE(filter.Matches("Foo.Anything"));
+  EXPECT_TRUE(filter.Matches("Foo."));
+  EXPECT_TRUE(filter.Matches("Qux.Bar1"));
+  EXPECT_FALSE(filter.Matches("Qux.Bar"));
+  EXPECT_FALSE(filter.Matches("Qux.Bar12"));
+  EXPECT_TRUE(filter.Matches("ABC"));
+  EXPECT_TRUE(filter.Matches("AxxBxBxxC"));
+  EXPECT_FALSE(filter.Matches("AxxBxxCx"));
+  EXPECT_FALSE(filter.Matches("Bar.Foo"));
+}
+
+TEST(TestFilterTest, LeavesOutTheTestsMatchingANegativePattern) {
+  xtest::internal::TestFilter filter("Foo.*:Bar.*-Foo.Slow*:*.Flaky");
+  EXPECT_TRUE(filter.Matches("Foo.Fast"));
+  EXPECT_FALSE(filter.Matches("Foo.SlowOne"));
+  EXPECT_FALSE(filter.Matches("Bar.Flaky"));
+  EXPECT_TRUE(filter.Matches("Bar.Steady"));
+  EXPECT_FALSE(filter.Matches("Qux.Steady"));
+
+  xtest::internal::TestFilter negative_only("-*.Flaky");
+  EXPECT_TRUE(negative_only.Matches("Qux.Steady"));
+  EXPECT_FALSE(negative_only.Matches("Qux.Flaky"));
+}
+
+TEST(TestFilterTest, MatchesManyPatterns) {
+  std::string patterns;
+  for (int32_t i = 0; i < 1000; ++i)
+    patterns += "Suite" + std::to_string(i) + ".Test*:";
+  patterns += "-Suite7*.TestSlow";
+  xtest::internal::TestFilter filter(patterns);
+  EXPECT_TRUE(filter.Matches("Suite0.Test"));
+  EXPECT_TRUE(filter.Matches("Suite999.TestFast"));
+  EXPECT_FALSE(filter.Matches("Suite1000.TestFast"));
+  EXPECT_FALSE(filter.Matches("Suite71.TestSlow"));
+  EXPECT_TRUE(filter.Matches("Suite81.TestSlow"));
+  // Names matched again take the states computed for the first ones.
+  for (int32_t i = 0; i < 10000; ++i)
+    EXPECT_TRUE(filter.Matches("Suite" + std::to_string(i % 1000) + ".Test"));
+}
+
+#endif  // XTEST_TESTS_XTEST_FILTER_TEST_HH_
@@ -0,0 +1,110 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_TESTS_XTEST_HISTORY_TEST_HH_
+#define XTEST_TESTS_XTEST_HISTORY_TEST_HH_
+
+#include <cstdio>
+
+#include "internal/xtest-history.hh"
+#include "xtest.hh"
+
+static const char kHistoryTestPath[] = "xtest-history-test.txt";
+
+TEST(TestHistoryTest, KeepsAMovingAverageOfTheElapsedTime) {
+  xtest::TestRegistrar test = *current_test;
+  xtest::internal::TestHistory history;
+  EXPECT_TRUE(history.empty());
+  EXPECT_EQ(history.ExpectedTime(&test), 0);
+
+  test.elapsed_time_ = 100;
+  history.Record(&test);
+  EXPECT_EQ(history.ExpectedTime(&test), 100);
+  test.elapsed_time_ = 200;
+  history.Record(&test);
+  EXPECT_EQ(history.ExpectedTime(&test), 130);
+
+  // A test without history is expected to take as long as the average test.
+  xtest::TestRegistrar other_test = *current_test;
+  other_test.test_name_ = "OtherTest";
+  EXPECT_EQ(history.ExpectedTime(&other_test), 130);
+}
+
+TEST(TestHistoryTest, SurvivesASaveAndLoad) {
+  xtest::TestRegistrar test = *current_test;
+  test.elapsed_time_ = 42;
+  {
+    xtest::internal::TestHistory history;
+    history.Record(&test);
+    EXPECT_TRUE(history.Save(kHistoryTestPath));
+  }
+
+  xtest::internal::TestHistory history;
+  EXPECT_TRUE(history.Load(kHistoryTestPath));
+  EXPECT_FALSE(history.empty());
+  EXPECT_EQ(history.ExpectedTime(&test), 42);
+  std::remove(kHistoryTestPath);
+
+  // A missing file is an empty history.
+  EXPECT_TRUE(history.Load(kHistoryTestPath));
+  EXPECT_TRUE(history.empty());
+}
+
+TEST(TestHistoryTest, RanksNewAndRecentlyFailedTestsFirst) {
+  xtest::TestRegistrar stable_test = *current_test;
+  stable_test.test_name_ = "StableTest";
+  xtest::TestRegistrar failed_long_ago = *current_test;
+  failed_long_ago.test_name_ = "FailedLongAgo";
+  xtest::TestRegistrar failed_last_run = *current_test;
+  failed_last_run.test_name_ = "FailedLastRun";
+  xtest::TestRegistrar new_test = *current_test;
+  new_test.test_name_ = "NewTest";
+
+  xtest::internal::TestHistory history;
+  for (int32_t run = 0; run < 5; ++run) {
+    stable_test.test_result_ = xtest::TestResult::PASSED;
+    failed_long_ago.test_result_ =
+        run == 0 ? xtest::TestResult::FAILED : xtest::TestResult::PASSED;
+    failed_last_run.test_result_ =
+        run == 4 ? xtest::TestResult::FAILED : xtest::TestResult::PASSED;
+    history.Record(&stable_test);
+    history.Record(&failed_long_ago);
+    history.Record(&failed_last_run);
+  }
+
+  EXPECT_EQ(history.FailurePriority(&stable_test), 0.0);
+  EXPECT_GT(history.FailurePriority(&failed_long_ago),
+            history.FailurePriority(&stable_test));
+  EXPECT_GT(history.FailurePriority(&failed_last_run),
+            history.FailurePriority(&failed_long_ago));
+  EXPECT_GT(history.FailurePriority(&new_test),
+            history.FailurePriority(&failed_last_run));
+}
+
+#endif  // XTEST_TESTS_XTEST_HISTORY_TEST_HH_
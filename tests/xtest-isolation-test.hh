@@ -0,0 +1,296 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_TESTS_XTEST_ISOLATION_TEST_HH_
+#define XTEST_TESTS_XTEST_ISOLATION_TEST_HH_
+
+#include <chrono>  // NOLINT
+#include <csignal>
+#include <cstddef>
+#include <cstdio>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "internal/xtest-isolation.hh"
+#include "internal/xtest-port-arch.hh"
+#include "internal/xtest-printers.hh"
+#include "xtest.hh"
+
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Forks a child that runs `child` and returns its `waitpid()` status.
+static int32_t GetExitStatusOfChild(void (*child)()) {
+  const pid_t pid = fork();
+  if (pid == 0) {
+    child();
+    _exit(0);
+  }
+  int32_t status = 0;
+  waitpid(pid, &status, 0);
+  return status;
+}
+
+TEST(DescribeExitStatusTest, WhenTheProcessExited) {
+  const int32_t status = GetExitStatusOfChild([]() { _exit(3); });
+  EXPECT_EQ(xtest::internal::DescribeExitStatus(status),
+            std::string("exited with code 3"));
+}
+
+TEST(DescribeExitStatusTest, WhenTheProcessWasKilledBySignal) {
+  const int32_t status = GetExitStatusOfChild([]() { raise(SIGKILL); });
+  EXPECT_TRUE(xtest::internal::DescribeExitStatus(status).find(
+                  "killed by signal 9") == 0);
+}
+
+// State a polluting test leaves behind for `FailIfPolluted()` to trip over.
+static bool isolation_test_polluted = false;
+
+static void Pollute(xtest::TestRegistrar* /* current_test */) {
+  isolation_test_polluted = true;
+}
+
+static void FailIfPolluted(xtest::TestRegistrar* current_test) {
+  current_test->test_result_ = isolation_test_polluted
+                                   ? xtest::TestResult::FAILED
+                                   : xtest::TestResult::PASSED;
+}
+
+static void Crash(xtest::TestRegistrar* /* current_test */) { raise(SIGKILL); }
+
+static void RunTestFunction(xtest::TestRegistrar* test) {
+  test->test_func_(test);
+}
+
+TEST(RunTestsInChildProcessTest, ReportsHowTheLastTestDid) {
+  xtest::TestRegistrar polluter = *current_test;
+  polluter.test_func_ = Pollute;
+  xtest::TestRegistrar victim = *current_test;
+  victim.test_func_ = FailIfPolluted;
+  xtest::TestRegistrar crasher = *current_test;
+  crasher.test_func_ = Crash;
+
+  EXPECT_TRUE(xtest::internal::RunTestsInChildProcess({&victim},
+                                                      RunTestFunction) ==
+              xtest::internal::ChildRunResult::kPassed);
+  EXPECT_TRUE(xtest::internal::RunTestsInChildProcess({&polluter, &victim},
+                                                      RunTestFunction) ==
+              xtest::internal::ChildRunResult::kFailed);
+  EXPECT_TRUE(xtest::internal::RunTestsInChildProcess({&victim, &crasher},
+                                                      RunTestFunction) ==
+              xtest::internal::ChildRunResult::kFailed);
+  EXPECT_TRUE(xtest::internal::RunTestsInChildProcess({&crasher, &victim},
+                                                      RunTestFunction) ==
+              xtest::internal::ChildRunResult::kNotReached);
+  // The children's pollution stays in the children.
+  EXPECT_FALSE(isolation_test_polluted);
+}
+
+// Prints around the output of the framework, straight to the streams, after
+// giving the next test the time to finish first.
+static void PrintSlowly(xtest::TestRegistrar* current_test) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  std::printf("user output A\n");
+  xtest::internal::StreamPrintf(stdout, "framework output A\n");
+  std::cout << "user output A again" << std::endl;
+  current_test->test_result_ = xtest::TestResult::PASSED;
+}
+
+static void PrintRightAway(xtest::TestRegistrar* current_test) {
+  std::printf("user output B\n");
+  current_test->test_result_ = xtest::TestResult::PASSED;
+}
+
+TEST(RunTestPlanInProcessesTest, KeepsWhatATestPrintsItselfInOrder) {
+  xtest::TestRegistrar slow = *current_test;
+  slow.test_func_ = PrintSlowly;
+  xtest::TestRegistrar fast = *current_test;
+  fast.test_func_ = PrintRightAway;
+  const xtest::internal::TestPlan plan = {
+      {"RunTestPlanInProcessesTest", {&slow, &fast}}};
+  xtest::internal::WorkerPoolOptions options;
+  options.num_workers = 2;
+
+  std::FILE* const output_file = std::tmpfile();
+  ASSERT_TRUE(output_file != nullptr);
+  std::fflush(stdout);
+  const int32_t saved_stdout = dup(STDOUT_FILENO);
+  dup2(fileno(output_file), STDOUT_FILENO);
+  xtest::internal::RunTestPlanInProcesses(plan, options, RunTestFunction);
+  std::fflush(stdout);
+  dup2(saved_stdout, STDOUT_FILENO);
+  close(saved_stdout);
+
+  std::string output;
+  std::rewind(output_file);
+  char buffer[256];
+  std::size_t size;
+  while ((size = std::fread(buffer, 1, sizeof(buffer), output_file)) > 0)
+    output.append(buffer, size);
+  std::fclose(output_file);
+  const std::size_t slow_output = output.find(
+      "user output A\nframework output A\nuser output A again\n");
+  const std::size_t fast_output = output.find("user output B\n");
+  ASSERT_NE(slow_output, std::string::npos) << output;
+  ASSERT_NE(fast_output, std::string::npos) << output;
+  EXPECT_LT(slow_output, fast_output) << output;
+}
+#endif  // XTEST_OS_LINUX || XTEST_OS_MAC
+
+#if XTEST_OS_LINUX
+#include <fcntl.h>
+
+// Touches more memory than the limit of 48 MiB below but less than the twice as
+// much the worker may allocate, so the worker runs it to its end.
+static void UseMemory(xtest::TestRegistrar* current_test) {
+  std::vector<char> memory(64 << 20, 1);
+  current_test->test_result_ = memory.back() == 1 ? xtest::TestResult::PASSED
+                                                  : xtest::TestResult::FAILED;
+}
+
+static void Pass(xtest::TestRegistrar* current_test) {
+  current_test->test_result_ = xtest::TestResult::PASSED;
+}
+
+TEST(RunTestPlanInProcessesTest, FailsATestThatGoesOverTheMemoryLimit) {
+  xtest::TestRegistrar hog = *current_test;
+  hog.test_func_ = UseMemory;
+  xtest::TestRegistrar next = *current_test;
+  next.test_func_ = Pass;
+  const xtest::internal::TestPlan plan = {
+      {"RunTestPlanInProcessesTest", {&hog, &next}}};
+  xtest::internal::WorkerPoolOptions options;
+  options.max_rss = 48 << 20;
+
+  // Keep the output of the run out of the output of the unit tests.
+  std::fflush(stdout);
+  std::fflush(stderr);
+  const int32_t saved_stdout = dup(STDOUT_FILENO);
+  const int32_t saved_stderr = dup(STDERR_FILENO);
+  const int32_t null_fd = open("/dev/null", O_WRONLY);
+  dup2(null_fd, STDOUT_FILENO);
+  dup2(null_fd, STDERR_FILENO);
+  close(null_fd);
+  const uint64_t failure_count = XTEST_GLOBAL_INSTANCE_GET_(failure_count);
+  xtest::internal::RunTestPlanInProcesses(plan, options, RunTestFunction);
+  XTEST_GLOBAL_INSTANCE_GET_(failure_count) = failure_count;
+  std::fflush(stdout);
+  std::fflush(stderr);
+  dup2(saved_stdout, STDOUT_FILENO);
+  dup2(saved_stderr, STDERR_FILENO);
+  close(saved_stdout);
+  close(saved_stderr);
+
+  EXPECT_TRUE(hog.test_result_ == xtest::TestResult::FAILED);
+  EXPECT_TRUE(next.test_result_ == xtest::TestResult::PASSED);
+}
+
+// Allocates far more than the twice 48 MiB the worker below may allocate.
+static void AllocateTooMuch(xtest::TestRegistrar* current_test) {
+  std::vector<char> memory(std::size_t{1} << 30, 1);
+  current_test->test_result_ = memory.back() == 1 ? xtest::TestResult::PASSED
+                                                  : xtest::TestResult::FAILED;
+}
+
+// Runs a test the way the framework does when it runs out of memory.
+static void RunTestFunctionOutOfMemory(xtest::TestRegistrar* test) {
+  try {
+    test->test_func_(test);
+  } catch (const std::bad_alloc&) {
+    xtest::internal::ReportAllocationFailure(test);
+  }
+}
+
+TEST(RunTestPlanInProcessesTest, ReportsTheLimitAnAllocationFailedUnder) {
+  xtest::TestRegistrar hog = *current_test;
+  hog.test_func_ = AllocateTooMuch;
+  xtest::TestRegistrar next = *current_test;
+  next.test_func_ = Pass;
+  const xtest::internal::TestPlan plan = {
+      {"RunTestPlanInProcessesTest", {&hog, &next}}};
+  xtest::internal::WorkerPoolOptions options;
+  options.max_rss = 48 << 20;
+
+  std::FILE* const output_file = std::tmpfile();
+  ASSERT_TRUE(output_file != nullptr);
+  std::fflush(stdout);
+  std::fflush(stderr);
+  const int32_t saved_stdout = dup(STDOUT_FILENO);
+  const int32_t saved_stderr = dup(STDERR_FILENO);
+  dup2(fileno(output_file), STDOUT_FILENO);
+  dup2(fileno(output_file), STDERR_FILENO);
+  const uint64_t failure_count = XTEST_GLOBAL_INSTANCE_GET_(failure_count);
+  xtest::internal::RunTestPlanInProcesses(plan, options,
+                                          RunTestFunctionOutOfMemory);
+  XTEST_GLOBAL_INSTANCE_GET_(failure_count) = failure_count;
+  std::fflush(stdout);
+  std::fflush(stderr);
+  dup2(saved_stdout, STDOUT_FILENO);
+  dup2(saved_stderr, STDERR_FILENO);
+  close(saved_stdout);
+  close(saved_stderr);
+  std::string output;
+  std::rewind(output_file);
+  char buffer[256];
+  std::size_t size;
+  while ((size = std::fread(buffer, 1, sizeof(buffer), output_file)) > 0)
+    output.append(buffer, size);
+  std::fclose(output_file);
+
+  EXPECT_TRUE(hog.test_result_ == xtest::TestResult::FAILED);
+  EXPECT_TRUE(next.test_result_ == xtest::TestResult::PASSED);
+  EXPECT_NE(output.find("ran out of memory under the limit of 48"),
+            std::string::npos)
+      << output;
+  EXPECT_EQ(output.find("peak RSS"), std::string::npos) << output;
+  EXPECT_EQ(output.find("terminate"), std::string::npos) << output;
+}
+#endif  // XTEST_OS_LINUX
+
+TEST(FindShortestFailingPrefixTest, FindsThePollutingTestInLogarithmicRuns) {
+  for (std::size_t num_tests = 1; num_tests <= 100; ++num_tests) {
+    for (std::size_t polluter = 0; polluter < num_tests; ++polluter) {
+      std::size_t runs = 0;
+      const std::size_t length = xtest::internal::FindShortestFailingPrefix(
+          num_tests, [polluter, &runs](std::size_t length) {
+            ++runs;
+            return length > polluter;
+          });
+      ASSERT_EQ(length, polluter + 1);
+      ASSERT_LE(runs, 7u);  // ceil(log2(100))
+    }
+  }
+}
+
+#endif  // XTEST_TESTS_XTEST_ISOLATION_TEST_HH_
@@ -0,0 +1,85 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_TESTS_XTEST_JOURNAL_TEST_HH_
+#define XTEST_TESTS_XTEST_JOURNAL_TEST_HH_
+
+#include <cstdio>
+#include <string>
+
+#include "internal/xtest-journal.hh"
+#include "xtest.hh"
+
+static const char kJournalTestPath[] = "xtest-journal-test.log";
+
+TEST(TestJournalTest, RecordsCompletedTestsAndReadsThemBack) {
+  std::remove(kJournalTestPath);
+  {
+    xtest::internal::TestJournal journal;
+    EXPECT_TRUE(journal.Open(kJournalTestPath));
+    journal.Append(current_test);
+  }
+  {
+    // Reopening keeps the recorded results and appends after them.
+    xtest::internal::TestJournal journal;
+    EXPECT_TRUE(journal.Open(kJournalTestPath));
+    journal.Append(current_test);
+  }
+
+  xtest::internal::JournalEntries entries;
+  EXPECT_TRUE(xtest::internal::ReadTestJournal(kJournalTestPath, &entries));
+  EXPECT_EQ(entries.size(), 1u);
+  EXPECT_EQ(entries.count(
+                "TestJournalTest.RecordsCompletedTestsAndReadsThemBack"),
+            1u);
+  std::remove(kJournalTestPath);
+}
+
+TEST(TestJournalTest, IgnoresALineCutShortByACrash) {
+  std::FILE* const file = std::fopen(kJournalTestPath, "wb");
+  const char contents[] = "PASSED 5 Foo.Bar\nFAILED 7 Foo.Baz\nPASSED 1 Fo\0\0";
+  std::fwrite(contents, 1, sizeof(contents) - 1, file);
+  std::fclose(file);
+
+  xtest::internal::JournalEntries entries;
+  EXPECT_TRUE(xtest::internal::ReadTestJournal(kJournalTestPath, &entries));
+  EXPECT_EQ(entries.size(), 2u);
+  EXPECT_EQ(entries["Foo.Bar"].elapsed_time, 5);
+  EXPECT_TRUE(entries["Foo.Baz"].result == xtest::TestResult::FAILED);
+  std::remove(kJournalTestPath);
+}
+
+TEST(TestJournalTest, MissingJournalIsEmpty) {
+  xtest::internal::JournalEntries entries;
+  EXPECT_TRUE(xtest::internal::ReadTestJournal("xtest-no-such-journal.log",
+                                               &entries));
+  EXPECT_TRUE(entries.empty());
+}
+
+#endif  // XTEST_TESTS_XTEST_JOURNAL_TEST_HH_
@@ -0,0 +1,179 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_TESTS_XTEST_LOOPBACK_TEST_HH_
+#define XTEST_TESTS_XTEST_LOOPBACK_TEST_HH_
+
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "internal/xtest-port-arch.hh"
+#include "xtest.hh"
+
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Answers every line it receives with "echo: <line>".
+static void EchoLines(xtest::LoopbackConnection* connection) {
+  std::string& input = connection->input();
+  std::size_t end;
+  while ((end = input.find('\n')) != std::string::npos) {
+    connection->Send("echo: " + input.substr(0, end + 1));
+    input.erase(0, end + 1);
+  }
+}
+
+// Sends `request` on `socket`, shuts down the sending end and returns all the
+// server sent until it closed the connection.
+static std::string Exchange(const int32_t& socket, const std::string& request) {
+  if (write(socket, request.data(), request.size()) !=
+      static_cast<ssize_t>(request.size()))
+    return "<write failed>";
+  shutdown(socket, SHUT_WR);
+  std::string reply;
+  char buffer[256];
+  ssize_t size;
+  while ((size = read(socket, buffer, sizeof(buffer))) > 0)
+    reply.append(buffer, static_cast<std::size_t>(size));
+  return reply;
+}
+
+TEST(LoopbackServerTest, ServesAClientOverTcp) {
+  xtest::LoopbackServer server(EchoLines);
+  ASSERT_TRUE(server.listening());
+  EXPECT_TRUE(server.error().empty());
+  EXPECT_NE(server.port(), 0);
+  EXPECT_EQ(server.address(), "127.0.0.1:" + std::to_string(server.port()));
+
+  const int32_t client = server.Connect();
+  ASSERT_TRUE(client >= 0);
+  EXPECT_EQ(Exchange(client, "a\nb\n"), "echo: a\necho: b\n");
+  close(client);
+}
+
+TEST(LoopbackServerTest, ServesAClientOverAUnixSocket) {
+  std::string address;
+  {
+    xtest::LoopbackServer server(EchoLines,
+                                 xtest::LoopbackServer::Transport::kUnix);
+    ASSERT_TRUE(server.listening());
+    EXPECT_EQ(server.port(), 0);
+    address = server.address();
+    EXPECT_EQ(access(address.c_str(), F_OK), 0);
+
+    const int32_t client = server.Connect();
+    ASSERT_TRUE(client >= 0);
+    EXPECT_EQ(Exchange(client, "a\n"), "echo: a\n");
+    close(client);
+  }
+  EXPECT_NE(access(address.c_str(), F_OK), 0);
+}
+
+TEST(LoopbackServerTest, ServesManyClientsAtOnceOnPortsOfTheirOwn) {
+  xtest::LoopbackServer server(EchoLines);
+  xtest::LoopbackServer other_server(EchoLines);
+  ASSERT_TRUE(server.listening());
+  ASSERT_TRUE(other_server.listening());
+  EXPECT_NE(server.port(), other_server.port());
+
+  // Every client is connected before any of them is served.
+  std::vector<int32_t> clients;
+  for (int32_t i = 0; i < 16; ++i)
+    clients.push_back(server.Connect());
+  for (std::size_t i = 0; i < clients.size(); ++i) {
+    ASSERT_TRUE(clients[i] >= 0);
+    const std::string line = std::to_string(i) + "\n";
+    EXPECT_EQ(Exchange(clients[i], line), "echo: " + line);
+    close(clients[i]);
+  }
+}
+
+TEST(LoopbackServerTest, HandsTheEndOfTheInputToTheHandler) {
+  xtest::LoopbackServer server([](xtest::LoopbackConnection* connection) {
+    if (!connection->input_closed())
+      return;
+    connection->Send(std::to_string(connection->input().size()));
+    connection->Close();
+  });
+  ASSERT_TRUE(server.listening());
+  const int32_t client = server.Connect();
+  ASSERT_TRUE(client >= 0);
+  EXPECT_EQ(Exchange(client, std::string(100000, 'x')), "100000");
+  close(client);
+}
+
+TEST(LoopbackServerTest, IsStoppedWhenAFatalFailureJumpsOutOfTheTest) {
+  int32_t address_pipe[2];
+  ASSERT_EQ(pipe(address_pipe), 0);
+  std::fflush(stdout);
+  std::fflush(stderr);
+  const pid_t pid = fork();
+  if (pid == 0) {
+    // Let the abort kill the child rather than jump out of the test it copied.
+    std::signal(SIGABRT, SIG_DFL);
+    const int32_t null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+    close(address_pipe[0]);
+    xtest::TestRegistrar test = *current_test;
+    xtest::internal::ScopedTestRun run(&test);
+    xtest::LoopbackServer server(EchoLines,
+                                 xtest::LoopbackServer::Transport::kUnix);
+    const std::string& address = server.address();
+    if (write(address_pipe[1], address.data(), address.size()) !=
+        static_cast<ssize_t>(address.size()))
+      _exit(1);
+    ASSERT_TRUE(false) << "jumps out of the test past the server";
+    _exit(0);
+  }
+  close(address_pipe[1]);
+  std::string address;
+  char buffer[256];
+  ssize_t size;
+  while ((size = read(address_pipe[0], buffer, sizeof(buffer))) > 0)
+    address.append(buffer, static_cast<std::size_t>(size));
+  close(address_pipe[0]);
+  int32_t status = 0;
+  waitpid(pid, &status, 0);
+  EXPECT_TRUE(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+  ASSERT_FALSE(address.empty());
+  // The event loop was stopped and the socket removed before the jump.
+  EXPECT_NE(access(address.c_str(), F_OK), 0);
+}
+#endif  // XTEST_OS_LINUX || XTEST_OS_MAC
+
+#endif  // XTEST_TESTS_XTEST_LOOPBACK_TEST_HH_
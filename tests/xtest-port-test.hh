@@ -112,4 +112,59 @@ TEST(PosixIsAttyTest, WithStdoutAndStderrStreams) {
   stderr_redirector_context.RestoreStream();
 }
 
+TEST(ParseDurationTest, WithAndWithoutUnits) {
+  xtest::internal::TimeInMillis duration = 0;
+  EXPECT_TRUE(xtest::internal::ParseDuration("120s", &duration));
+  EXPECT_EQ(duration, 120000);
+  EXPECT_TRUE(xtest::internal::ParseDuration("2m", &duration));
+  EXPECT_EQ(duration, 120000);
+  EXPECT_TRUE(xtest::internal::ParseDuration("1.5h", &duration));
+  EXPECT_EQ(duration, 5400000);
+  EXPECT_TRUE(xtest::internal::ParseDuration("500ms", &duration));
+  EXPECT_EQ(duration, 500);
+  EXPECT_TRUE(xtest::internal::ParseDuration("3", &duration));
+  EXPECT_EQ(duration, 3000);
+}
+
+TEST(ParseDurationTest, RejectsWhatIsNotADuration) {
+  xtest::internal::TimeInMillis duration = 42;
+  EXPECT_FALSE(xtest::internal::ParseDuration("", &duration));
+  EXPECT_FALSE(xtest::internal::ParseDuration("s", &duration));
+  EXPECT_FALSE(xtest::internal::ParseDuration("10 s", &duration));
+  EXPECT_FALSE(xtest::internal::ParseDuration("10d", &duration));
+  EXPECT_FALSE(xtest::internal::ParseDuration("-1s", &duration));
+  EXPECT_EQ(duration, 42);
+}
+
+TEST(ParseByteSizeTest, WithAndWithoutUnits) {
+  uint64_t size = 0;
+  EXPECT_TRUE(xtest::internal::ParseByteSize("512M", &size));
+  EXPECT_EQ(size, 512ull << 20);
+  EXPECT_TRUE(xtest::internal::ParseByteSize("1.5G", &size));
+  EXPECT_EQ(size, 3ull << 29);
+  EXPECT_TRUE(xtest::internal::ParseByteSize("64K", &size));
+  EXPECT_EQ(size, 65536u);
+  EXPECT_TRUE(xtest::internal::ParseByteSize("100", &size));
+  EXPECT_EQ(size, 100u);
+}
+
+TEST(ParseByteSizeTest, RejectsWhatIsNotASize) {
+  uint64_t size = 42;
+  EXPECT_FALSE(xtest::internal::ParseByteSize("", &size));
+  EXPECT_FALSE(xtest::internal::ParseByteSize("G", &size));
+  EXPECT_FALSE(xtest::internal::ParseByteSize("2 G", &size));
+  EXPECT_FALSE(xtest::internal::ParseByteSize("2GB", &size));
+  EXPECT_FALSE(xtest::internal::ParseByteSize("-1M", &size));
+  EXPECT_EQ(size, 42u);
+}
+
+TEST(FormatByteSizeTest, PicksTheLargestFittingUnit) {
+  EXPECT_EQ(xtest::internal::FormatByteSize(512), std::string("512 B"));
+  EXPECT_EQ(xtest::internal::FormatByteSize(1536), std::string("1.5 KiB"));
+  EXPECT_EQ(xtest::internal::FormatByteSize(512ull << 20),
+            std::string("512.0 MiB"));
+  EXPECT_EQ(xtest::internal::FormatByteSize(3ull << 29),
+            std::string("1.5 GiB"));
+}
+
 #endif  // XTEST_TESTS_XTEST_PORT_TEST_HH_
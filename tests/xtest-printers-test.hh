@@ -157,4 +157,38 @@ TEST(PrintColorEncodedTest, TestWithXTestColorEncodedHelpMessage) {
   EXPECT_EQ(actual, expected);
 }
 
+TEST(OutputCaptureTest, CapturesStreamPrintfOnlyWhileInstalled) {
+  xtest::internal::OutputCapture capture;
+  EXPECT_TRUE(xtest::internal::GetCurrentOutputCapture() == nullptr);
+  {
+    xtest::internal::ScopedOutputCapture scoped_capture(&capture);
+    xtest::internal::StreamPrintf(stdout, "%s.%s", "Suite", "Test");
+    xtest::internal::StreamPrintf(stdout, " (%d ms)\n", 5);
+    xtest::internal::StreamPrintf(stderr, "error: %d\n", 42);
+  }
+  EXPECT_TRUE(xtest::internal::GetCurrentOutputCapture() == nullptr);
+
+  // Consecutive text printed on the same stream is merged into one chunk.
+  EXPECT_EQ(capture.chunks().size(), 2u);
+  EXPECT_TRUE(capture.chunks()[0].first == stdout);
+  EXPECT_EQ(capture.chunks()[0].second, std::string("Suite.Test (5 ms)\n"));
+  EXPECT_TRUE(capture.chunks()[1].first == stderr);
+  EXPECT_EQ(capture.chunks()[1].second, std::string("error: 42\n"));
+}
+
+TEST(OutputCaptureTest, ReplayWritesTheCapturedTextToTheStream) {
+  xtest::internal::OutputCapture capture;
+  {
+    xtest::internal::ScopedOutputCapture scoped_capture(&capture);
+    xtest::internal::StreamPrintf(stdout, "Captured %s", "text");
+  }
+  xtest::testing::RedirectorContext stdout_redirector_context(
+      xtest::testing::RedirectorContextStream::kStdout);
+  stdout_redirector_context.ReplaceStreamWithContextBuffer();
+  capture.Replay();
+  stdout_redirector_context.RestoreStream();
+  std::string actual(stdout_redirector_context.M_output_buffer_);
+  EXPECT_EQ(actual, std::string("Captured text"));
+}
+
 #endif  // XTEST_TESTS_XTEST_PRINTERS_TEST_HH_
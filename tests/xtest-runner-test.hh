@@ -0,0 +1,116 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_TESTS_XTEST_RUNNER_TEST_HH_
+#define XTEST_TESTS_XTEST_RUNNER_TEST_HH_
+
+#include "internal/xtest-port-arch.hh"
+#include "xtest.hh"
+
+// The paths of `xtest_runner` and of the factorial sample it runs are defined
+// when both are built along with the tests.
+#if (XTEST_OS_LINUX || XTEST_OS_MAC) && defined(XTEST_RUNNER_PATH) && \
+    defined(XTEST_RUNNER_SAMPLE_PATH)
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Runs `xtest_runner` on the factorial sample with `forwarded_flags` after
+// `--`, stores what it printed without its color escape sequences in `output`
+// and returns its `waitpid()` status.
+static int32_t RunRunnerOnSample(
+    const std::vector<std::string>& forwarded_flags, std::string* output) {
+  std::vector<std::string> argv = {XTEST_RUNNER_PATH, "--xtest_jobs=2",
+                                   "--xtest_color=no", XTEST_RUNNER_SAMPLE_PATH,
+                                   "--"};
+  argv.insert(argv.end(), forwarded_flags.begin(), forwarded_flags.end());
+  std::vector<char*> args;
+  for (const std::string& arg : argv)
+    args.push_back(const_cast<char*>(arg.c_str()));
+  args.push_back(nullptr);
+
+  int32_t output_pipe[2];
+  if (pipe(output_pipe) < 0)
+    return -1;
+  const pid_t pid = fork();
+  if (pid == 0) {
+    close(output_pipe[0]);
+    dup2(output_pipe[1], STDOUT_FILENO);
+    dup2(output_pipe[1], STDERR_FILENO);
+    execv(args[0], args.data());
+    _exit(127);
+  }
+  close(output_pipe[1]);
+  char buffer[4096];
+  ssize_t read_size;
+  while ((read_size = read(output_pipe[0], buffer, sizeof(buffer))) > 0)
+    output->append(buffer, static_cast<std::size_t>(read_size));
+  close(output_pipe[0]);
+  int32_t status = 0;
+  waitpid(pid, &status, 0);
+  std::size_t escape;
+  while ((escape = output->find('\x1b')) != std::string::npos)
+    output->erase(escape, output->find('m', escape) + 1 - escape);
+  return status;
+}
+
+TEST(XtestRunnerTest, RunsEveryTestOfASampleOnceInAProcessOfItsOwn) {
+  std::string output;
+  const int32_t status =
+      RunRunnerOnSample({"--xtest_filter=TestFactorial.*"}, &output);
+
+  // The forwarded filter selects the tests, but every process still runs only
+  // the test it was started for: only the two tests doomed to fail fail.
+  EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_FAILURE)
+      << output;
+  EXPECT_NE(output.find("[  PASSED  ] 7 tests."), std::string::npos) << output;
+  EXPECT_NE(output.find("[  FAILED  ] 2 test"), std::string::npos) << output;
+  EXPECT_NE(output.find("TestFactorial.DoomedToBeFailedTestsPrimary"),
+            std::string::npos)
+      << output;
+}
+
+TEST(XtestRunnerTest, RejectsFlagsThatKeepTheBinariesFromRunningTheirTests) {
+  std::string output;
+  const int32_t status = RunRunnerOnSample({"--xtest_list_tests"}, &output);
+
+  EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_FAILURE)
+      << output;
+  EXPECT_NE(output.find("--xtest_list_tests cannot be passed to the binaries"),
+            std::string::npos)
+      << output;
+  EXPECT_EQ(output.find("TestFactorial"), std::string::npos) << output;
+}
+#endif  // (XTEST_OS_LINUX || XTEST_OS_MAC) && defined(XTEST_RUNNER_PATH) && ...
+
+#endif  // XTEST_TESTS_XTEST_RUNNER_TEST_HH_
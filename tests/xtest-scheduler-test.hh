@@ -0,0 +1,433 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_TESTS_XTEST_SCHEDULER_TEST_HH_
+#define XTEST_TESTS_XTEST_SCHEDULER_TEST_HH_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "internal/xtest-scheduler.hh"
+#include "xtest.hh"
+
+TEST(WorkStealingPoolTest, RunsEveryTaskExactlyOnce) {
+  const std::size_t num_tasks = 1000;
+  std::vector<std::atomic<uint32_t>> runs(num_tasks);
+  std::vector<std::size_t> tasks;
+  for (std::size_t i = 0; i < num_tasks; ++i)
+    tasks.push_back(i);
+
+  xtest::internal::WorkStealingPool pool(4);
+  pool.Start(tasks, [&runs](std::size_t /* worker */, std::size_t task) {
+    ++runs[task];
+  });
+  pool.Join();
+
+  std::size_t tasks_run_once = 0;
+  for (const std::atomic<uint32_t>& run : runs)
+    tasks_run_once += run.load() == 1 ? 1 : 0;
+  EXPECT_EQ(tasks_run_once, num_tasks);
+}
+
+TEST(GetNumberOfJobsTest, ZeroMeansOneJobPerOnlineCpu) {
+  EXPECT_GE(xtest::internal::GetNumberOfJobs(0), 1u);
+  EXPECT_EQ(xtest::internal::GetNumberOfJobs(1), 1u);
+  EXPECT_EQ(xtest::internal::GetNumberOfJobs(8), 8u);
+}
+
+TEST(HashTestNameTest, IsTheFnv1aHashOfTheFullTestName) {
+  // 64-bit FNV-1a of "a.b"; the value must never change or the tests would
+  // move between shards.
+  EXPECT_EQ(xtest::internal::HashTestName("a", "b"), 0xe61d99190466522cULL);
+  EXPECT_NE(xtest::internal::HashTestName("Suite", "Test"),
+            xtest::internal::HashTestName("Suit", "eTest"));
+}
+
+TEST(IsTestOnShardTest, EveryTestIsOnExactlyOneShard) {
+  const int32_t total_shards = 3;
+  for (const auto& test_suite :
+       xtest::XTestRegistryInstance.test_registry_table_) {
+    for (const xtest::TestRegistrar* const& test : test_suite.second) {
+      int32_t shards = 0;
+      for (int32_t index = 0; index < total_shards; ++index)
+        shards += xtest::internal::IsTestOnShard(test, total_shards, index);
+      ASSERT_EQ(shards, 1);
+    }
+  }
+}
+
+TEST(IsTestOnShardTest, EveryTestIsOnTheOnlyShard) {
+  EXPECT_TRUE(xtest::internal::IsTestOnShard(current_test, 1, 0));
+}
+
+// Returns copies of `test`, which unlike new instances are not registered,
+// named "a", "b", ... and expected to take `expected_times` milliseconds.
+static std::vector<xtest::TestRegistrar> MakeTestsWithExpectedTimes(
+    const xtest::TestRegistrar* test,
+    const std::vector<xtest::TimeInMillis>& expected_times) {
+  static const char* const kTestNames[] = {"a", "b", "c", "d", "e",
+                                           "f", "g", "h", "i", "j"};
+  std::vector<xtest::TestRegistrar> tests(expected_times.size(), *test);
+  for (std::size_t i = 0; i < tests.size(); ++i) {
+    tests[i].test_name_ = kTestNames[i];
+    tests[i].expected_time_ = expected_times[i];
+  }
+  return tests;
+}
+
+TEST(OrderTestsLongestFirstTest, OrdersByExpectedTimeKeepingTies) {
+  std::vector<xtest::TestRegistrar> tests =
+      MakeTestsWithExpectedTimes(current_test, {5, 20, 0, 5});
+  std::vector<xtest::TestRegistrar*> test_ptrs;
+  for (xtest::TestRegistrar& test : tests)
+    test_ptrs.push_back(&test);
+
+  const std::vector<std::size_t> order =
+      xtest::internal::OrderTestsLongestFirst(test_ptrs);
+  EXPECT_EQ(order.size(), 4u);
+  EXPECT_EQ(order[0], 1u);
+  EXPECT_EQ(order[1], 0u);
+  EXPECT_EQ(order[2], 3u);
+  EXPECT_EQ(order[3], 2u);
+}
+
+TEST(PackTestsIntoShardsTest, BalancesTheExpectedTimeOfTheShards) {
+  std::vector<xtest::TestRegistrar> tests = MakeTestsWithExpectedTimes(
+      current_test, {10, 600, 100, 200, 30, 500, 100, 200, 20, 100});
+  std::vector<xtest::TestRegistrar*> test_ptrs;
+  for (xtest::TestRegistrar& test : tests)
+    test_ptrs.push_back(&test);
+
+  const std::vector<int32_t> shard_of_test =
+      xtest::internal::PackTestsIntoShards(test_ptrs, 3);
+  std::vector<xtest::TimeInMillis> load(3, 0);
+  for (std::size_t i = 0; i < tests.size(); ++i) {
+    ASSERT_GE(shard_of_test[i], 0);
+    ASSERT_LT(shard_of_test[i], 3);
+    load[shard_of_test[i]] += tests[i].expected_time_;
+  }
+  // 1860 ms in total; longest first packs it into 630 + 620 + 610 ms.
+  EXPECT_EQ(*std::max_element(load.begin(), load.end()), 630);
+  EXPECT_EQ(*std::min_element(load.begin(), load.end()), 610);
+
+  // The split does not depend on the order the tests are given in.
+  std::reverse(test_ptrs.begin(), test_ptrs.end());
+  const std::vector<int32_t> reversed_shard_of_test =
+      xtest::internal::PackTestsIntoShards(test_ptrs, 3);
+  for (std::size_t i = 0; i < tests.size(); ++i)
+    EXPECT_EQ(reversed_shard_of_test[tests.size() - 1 - i], shard_of_test[i]);
+}
+
+TEST(GetRandomSeedFromFlagTest, KeepsSeedsInRangeAndPicksOneOtherwise) {
+  EXPECT_EQ(xtest::internal::GetRandomSeedFromFlag(1), 1u);
+  EXPECT_EQ(xtest::internal::GetRandomSeedFromFlag(99999), 99999u);
+  const uint32_t seed = xtest::internal::GetRandomSeedFromFlag(0);
+  EXPECT_GE(seed, 1u);
+  EXPECT_LE(seed, xtest::internal::kMaxRandomSeed);
+}
+
+// Returns the full names of the tests of `plan` in plan order.
+static std::vector<std::string> GetTestNamesInPlanOrder(
+    const xtest::internal::TestPlan& plan) {
+  std::vector<std::string> names;
+  for (const xtest::XTestUnitTestPair& test_suite : plan) {
+    for (const xtest::TestRegistrar* const& test : test_suite.second)
+      names.push_back(std::string(test->suite_name_) + '.' + test->test_name_);
+  }
+  return names;
+}
+
+TEST(ShuffleTestPlanTest, ReplaysTheSameOrderForTheSameSeed) {
+  const xtest::internal::TestPlan registry(
+      xtest::XTestRegistryInstance.test_registry_table_.begin(),
+      xtest::XTestRegistryInstance.test_registry_table_.end());
+  xtest::internal::TestPlan plan = registry;
+  xtest::internal::ShuffleTestPlan(&plan, 7);
+  xtest::internal::TestPlan same_seed_plan = registry;
+  xtest::internal::ShuffleTestPlan(&same_seed_plan, 7);
+  xtest::internal::TestPlan other_seed_plan = registry;
+  xtest::internal::ShuffleTestPlan(&other_seed_plan, 8);
+
+  const std::vector<std::string> names = GetTestNamesInPlanOrder(plan);
+  EXPECT_TRUE(names == GetTestNamesInPlanOrder(same_seed_plan));
+  EXPECT_FALSE(names == GetTestNamesInPlanOrder(other_seed_plan));
+
+  // Every test is still there, and still next to the rest of its suite.
+  std::vector<std::string> sorted_names = names;
+  std::vector<std::string> registry_names = GetTestNamesInPlanOrder(registry);
+  std::sort(sorted_names.begin(), sorted_names.end());
+  std::sort(registry_names.begin(), registry_names.end());
+  EXPECT_TRUE(sorted_names == registry_names);
+  EXPECT_EQ(plan.size(), registry.size());
+}
+
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+
+// Runs the tests matching `filter`, shuffled with the seed `7`, in a forked
+// child process, or lists them with `list_tests`, and returns what the child
+// printed without its color escape sequences.
+static std::string RunShuffledTestsInChild(const char* filter,
+                                           const bool& list_tests) {
+  std::FILE* const output_file = std::tmpfile();
+  if (output_file == nullptr)
+    return "";
+  std::fflush(stdout);
+  std::fflush(stderr);
+  const pid_t pid = fork();
+  if (pid == 0) {
+    dup2(fileno(output_file), STDOUT_FILENO);
+    dup2(fileno(output_file), STDERR_FILENO);
+    XTEST_FLAG_SET_(filter, filter);
+    XTEST_FLAG_SET_(shuffle, true);
+    XTEST_FLAG_SET_(random_seed, 7);
+    XTEST_FLAG_SET_(list_tests, list_tests);
+    XTEST_FLAG_SET_(jobs, 1);
+    XTEST_FLAG_SET_(isolate, "");
+    XTEST_FLAG_SET_(journal, "");
+    XTEST_FLAG_SET_(history, "");
+    XTEST_FLAG_SET_(time_budget, "");
+    xtest::RunRegisteredTests();
+    std::fflush(stdout);
+    std::fflush(stderr);
+    _exit(0);
+  }
+  int32_t status = 0;
+  waitpid(pid, &status, 0);
+  std::string output;
+  std::rewind(output_file);
+  char buffer[256];
+  std::size_t size;
+  while ((size = std::fread(buffer, 1, sizeof(buffer), output_file)) > 0)
+    output.append(buffer, size);
+  std::fclose(output_file);
+  for (std::size_t escape; (escape = output.find('\x1b')) != std::string::npos;)
+    output.erase(escape, output.find('m', escape) + 1 - escape);
+  return output;
+}
+
+// Takes up every CPU slot so that no other test holds a lock of the framework
+// while the child is forked.
+TEST_WITH_COST(ShuffleTestPlanTest, ListsTheTestsInTheOrderTheyRunIn,
+               cpus = 1024) {
+  const char* const filter =
+      "GetRandomSeedFromFlagTest.*:OrderTestPlanTest.*:"
+      "WorkStealingPoolTest.*:XtestDefaultSummaryStatusStrWidthTest.*:"
+      "CommandLineFlagsTest.*";
+  const std::string listing = RunShuffledTestsInChild(filter, true);
+  const std::string run = RunShuffledTestsInChild(filter, false);
+
+  // The listing prints every suite name followed by its indented tests, the
+  // run an "OK" line with the full name of a test for every assertion of it
+  // that passed.
+  std::vector<std::string> listed;
+  std::string suite_name;
+  std::size_t begin = 0;
+  for (std::size_t end; (end = listing.find('\n', begin)) != std::string::npos;
+       begin = end + 1) {
+    const std::string line = listing.substr(begin, end - begin);
+    if (line.compare(0, 2, "  ") == 0)
+      listed.push_back(suite_name + line.substr(2));
+    else if (!line.empty() && line.back() == '.')
+      suite_name = line;
+  }
+  std::vector<std::string> ran;
+  const std::string ok = "[       OK ] ";
+  for (std::size_t found = run.find(ok); found != std::string::npos;
+       found = run.find(ok, found + 1)) {
+    const std::size_t begin_name = found + ok.size();
+    const std::string name =
+        run.substr(begin_name, run.find(' ', begin_name) - begin_name);
+    if (ran.empty() || ran.back() != name)
+      ran.push_back(name);
+  }
+
+  EXPECT_GE(listed.size(), 4u) << listing;
+  EXPECT_TRUE(listed == ran) << listing << run;
+}
+#endif  // XTEST_OS_LINUX || XTEST_OS_MAC
+
+TEST(OrderTestPlanTest, KeepsSuitesTogetherInTheOrderOfTheirFirstTest) {
+  std::vector<xtest::TestRegistrar> tests(5, *current_test);
+  const char* const suite_names[] = {"A", "A", "B", "B", "C"};
+  const char* const test_names[] = {"A1", "A2", "B1", "B2", "C1"};
+  for (std::size_t i = 0; i < tests.size(); ++i) {
+    tests[i].suite_name_ = suite_names[i];
+    tests[i].test_name_ = test_names[i];
+  }
+  xtest::internal::TestPlan plan = {{"A", {&tests[0], &tests[1]}},
+                                    {"B", {&tests[2], &tests[3]}},
+                                    {"C", {&tests[4]}}};
+  // `C1` is not in the order, so its suite goes last.
+  xtest::internal::OrderTestPlan(&plan,
+                                 {&tests[3], &tests[1], &tests[2], &tests[0]});
+
+  EXPECT_TRUE(GetTestNamesInPlanOrder(plan) ==
+              std::vector<std::string>({"B.B2", "B.B1", "A.A2", "A.A1",
+                                        "C.C1"}));
+}
+
+XTEST_RESOURCE(TestResourcesTest, "suite-resource", "shared-resource");
+
+TEST_WITH_RESOURCES(TestResourcesTest, MergesTheResourcesOfTheTestAndItsSuite,
+                    "shared-resource", "own-resource") {
+  const std::vector<std::string> resources =
+      xtest::internal::GetTestResources(current_test);
+  EXPECT_EQ(resources.size(), 3u);
+  EXPECT_TRUE(resources ==
+              std::vector<std::string>(
+                  {"own-resource", "shared-resource", "suite-resource"}));
+}
+
+// Returns copies of `test`, which unlike new instances are not registered, that
+// use the resources `resources_of_test` and no resource of a test suite.
+static std::vector<xtest::TestRegistrar> MakeTestsWithResources(
+    const xtest::TestRegistrar* test,
+    const std::vector<std::vector<const char*>>& resources_of_test) {
+  std::vector<xtest::TestRegistrar> tests(resources_of_test.size(), *test);
+  for (std::size_t i = 0; i < tests.size(); ++i) {
+    tests[i].suite_name_ = "ResourceLocksTest.Copy";
+    tests[i].resources_ = resources_of_test[i];
+  }
+  return tests;
+}
+
+TEST(ResourceLocksTest, KeepsWorkersFromSharingAResource) {
+  std::vector<xtest::TestRegistrar> tests = MakeTestsWithResources(
+      current_test, {{"a"}, {"a", "b"}, {"b"}, {"a"}, {}});
+  std::vector<xtest::TestRegistrar*> test_ptrs;
+  for (xtest::TestRegistrar& test : tests)
+    test_ptrs.push_back(&test);
+
+  xtest::internal::ResourceLocks locks(test_ptrs, 4);
+  EXPECT_FALSE(locks.empty());
+  EXPECT_TRUE(locks.TryClaim(0, 0));
+  EXPECT_FALSE(locks.TryClaim(1, 1));  // "a" is held by worker 0.
+  EXPECT_TRUE(locks.TryClaim(2, 1));
+  EXPECT_FALSE(locks.TryClaim(1, 0));  // "b" is held by worker 1.
+  EXPECT_TRUE(locks.TryClaim(3, 0));   // Worker 0 may take "a" again.
+  EXPECT_TRUE(locks.TryClaim(4, 1));
+
+  locks.Release(2);
+  locks.Release(0);
+  EXPECT_FALSE(locks.TryClaim(1, 1));  // Test 3 still holds "a".
+  locks.Release(3);
+  EXPECT_TRUE(locks.TryClaim(1, 1));
+}
+
+TEST(WorkStealingPoolTest, NeverRunsTasksThatFailToClaimAtTheSameTime) {
+  std::vector<std::vector<const char*>> resources_of_test(200);
+  for (std::size_t i = 0; i < resources_of_test.size(); i += 2)
+    resources_of_test[i] = {"shared"};
+  std::vector<xtest::TestRegistrar> tests =
+      MakeTestsWithResources(current_test, resources_of_test);
+  std::vector<xtest::TestRegistrar*> test_ptrs;
+  for (xtest::TestRegistrar& test : tests)
+    test_ptrs.push_back(&test);
+  std::vector<std::size_t> tasks(tests.size());
+  for (std::size_t i = 0; i < tasks.size(); ++i)
+    tasks[i] = i;
+
+  xtest::internal::ResourceLocks locks(test_ptrs, 4);
+  std::vector<std::atomic<uint32_t>> runs(tasks.size());
+  std::atomic<uint32_t> running(0);
+  std::atomic<uint32_t> overlaps(0);
+  xtest::internal::WorkStealingPool pool(4);
+  pool.Start(
+      tasks,
+      [&](std::size_t /* worker */, std::size_t task) {
+        ++runs[task];
+        if (!tests[task].resources_.empty()) {
+          if (++running > 1)
+            ++overlaps;
+          std::this_thread::yield();
+          --running;
+        }
+        locks.Release(task);
+      },
+      [&locks](std::size_t worker, std::size_t task) {
+        return locks.TryClaim(task, worker);
+      });
+  pool.Join();
+
+  std::size_t tasks_run_once = 0;
+  for (const std::atomic<uint32_t>& run : runs)
+    tasks_run_once += run.load() == 1 ? 1 : 0;
+  EXPECT_EQ(tasks_run_once, tasks.size());
+  EXPECT_EQ(overlaps.load(), 0u);
+}
+
+TEST_WITH_COST(TestCostTest, RegistersTheDeclaredCost, cpus = 8, mem = large) {
+  EXPECT_EQ(current_test->cost_.cpus, 8);
+  EXPECT_TRUE(current_test->cost_.mem == xtest::MemoryClass::kLarge);
+}
+
+TEST_WITH_COST(TestCostTest, DefaultsWhatIsLeftOut, mem = medium) {
+  EXPECT_EQ(current_test->cost_.cpus, 1);
+  EXPECT_TRUE(current_test->cost_.mem == xtest::MemoryClass::kMedium);
+}
+
+TEST(ResourceLocksTest, KeepsTheWorkersWithinTheCpusAndTheMemory) {
+  std::vector<xtest::TestRegistrar> tests = MakeTestsWithResources(
+      current_test, std::vector<std::vector<const char*>>(6));
+  tests[0].cost_.cpus = 3;
+  tests[1].cost_.cpus = 16;
+  tests[3].cost_.mem = xtest::MemoryClass::kLarge;
+  tests[4].cost_.mem = xtest::MemoryClass::kLarge;
+  tests[5].cost_.mem = xtest::MemoryClass::kMedium;
+  std::vector<xtest::TestRegistrar*> test_ptrs;
+  for (xtest::TestRegistrar& test : tests)
+    test_ptrs.push_back(&test);
+
+  xtest::internal::ResourceLocks locks(test_ptrs, 4);
+  EXPECT_FALSE(locks.empty());
+  EXPECT_TRUE(locks.TryClaim(0, 0));   // 3 of 4 CPU slots.
+  EXPECT_TRUE(locks.TryClaim(2, 1));   // 4 of 4 CPU slots.
+  EXPECT_FALSE(locks.TryClaim(3, 2));  // No CPU slot left.
+  EXPECT_TRUE(locks.TryClaim(3, 1));   // Worker 1 runs it after test 2.
+  locks.Release(0);
+  locks.Release(2);
+  EXPECT_FALSE(locks.TryClaim(1, 0));  // Test 3 still takes up a slot.
+  EXPECT_TRUE(locks.TryClaim(4, 0));   // 4 of 4 memory units.
+  EXPECT_FALSE(locks.TryClaim(5, 2));  // No memory unit left.
+  locks.Release(3);
+  locks.Release(4);
+  EXPECT_TRUE(locks.TryClaim(1, 2));   // Takes up all of the CPU slots.
+  EXPECT_FALSE(locks.TryClaim(5, 0));
+}
+
+#endif  // XTEST_TESTS_XTEST_SCHEDULER_TEST_HH_
@@ -0,0 +1,128 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_TESTS_XTEST_SERVER_TEST_HH_
+#define XTEST_TESTS_XTEST_SERVER_TEST_HH_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "internal/xtest-port-arch.hh"
+#include "internal/xtest-server.hh"
+#include "xtest.hh"
+
+TEST(SplitTestRequestTest, SplitsTheRequestAtBlanks) {
+  const std::vector<std::string> flags = xtest::internal::SplitTestRequest(
+      "  --xtest_filter=Foo.Bar:Foo.Baz\t--xtest_jobs=4 \r\n");
+  EXPECT_EQ(flags.size(), 2u);
+  EXPECT_EQ(flags[0], std::string("--xtest_filter=Foo.Bar:Foo.Baz"));
+  EXPECT_EQ(flags[1], std::string("--xtest_jobs=4"));
+}
+
+TEST(SplitTestRequestTest, EmptyRequestHasNoFlags) {
+  EXPECT_TRUE(xtest::internal::SplitTestRequest("").empty());
+  EXPECT_TRUE(xtest::internal::SplitTestRequest(" \n").empty());
+}
+
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>  // NOLINT
+#include <cstdlib>
+#include <cstring>
+#include <thread>  // NOLINT
+
+static uint64_t RunNoTests(const std::vector<std::string>& /* flags */) {
+  return 0;
+}
+
+// Takes up every CPU slot so that no other test holds the lock of `stdout`
+// while the server is forked, and so that the CPU time of the server is its
+// own.
+TEST_WITH_COST(ServeTestsTest, BacksOffWhileOutOfFileDescriptors,
+               cpus = 1024) {
+  const std::string socket_path = xtest::TestTempDir() + "/serve";
+  std::fflush(stdout);
+  std::fflush(stderr);
+  const pid_t pid = fork();
+  if (pid == 0) {
+    const int32_t null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+    close(null_fd);
+    // Leave room for the listening socket only, so that every `accept()`
+    // fails with `EMFILE`.
+    const int32_t free_fd = dup(STDIN_FILENO);
+    close(free_fd);
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = static_cast<rlim_t>(free_fd + 1);
+    setrlimit(RLIMIT_NOFILE, &limit);
+    _exit(xtest::internal::ServeTests(socket_path, RunNoTests));
+  }
+
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  ASSERT_LT(socket_path.size(), sizeof(address.sun_path));
+  std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
+  const int32_t client = socket(AF_UNIX, SOCK_STREAM, 0);
+  bool connected = false;
+  for (int32_t attempt = 0; attempt < 500 && !connected; ++attempt) {
+    connected = connect(client, reinterpret_cast<sockaddr*>(&address),
+                        sizeof(address)) == 0;
+    if (!connected)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  // The connection waits in the backlog while the server backs off.
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  kill(pid, SIGTERM);
+  int32_t status = 0;
+  struct rusage usage;
+  wait4(pid, &status, 0, &usage);
+  close(client);
+
+  EXPECT_TRUE(connected);
+  EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+  // Retrying right away would have kept the server busy all along.
+  const int64_t cpu_time_us =
+      (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+      usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+  EXPECT_LT(cpu_time_us, 200000);
+}
+#endif  // XTEST_OS_LINUX || XTEST_OS_MAC
+
+#endif  // XTEST_TESTS_XTEST_SERVER_TEST_HH_
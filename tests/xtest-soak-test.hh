@@ -0,0 +1,96 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_TESTS_XTEST_SOAK_TEST_HH_
+#define XTEST_TESTS_XTEST_SOAK_TEST_HH_
+
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+#include "internal/xtest-soak.hh"
+#include "xtest.hh"
+
+TEST(FitLinearTrendTest, FitsALine) {
+  const xtest::internal::LinearTrend line =
+      xtest::internal::FitLinearTrend({3.0, 5.0, 7.0, 9.0});
+  EXPECT_TRUE(std::fabs(line.slope - 2.0) < 1e-9);
+  EXPECT_TRUE(std::fabs(line.r_squared - 1.0) < 1e-9);
+
+  const xtest::internal::LinearTrend flat =
+      xtest::internal::FitLinearTrend({4.0, 4.0, 4.0});
+  EXPECT_TRUE(flat.slope == 0.0);
+  EXPECT_TRUE(flat.r_squared == 0.0);
+}
+
+TEST(IsSteadyGrowthTest, TellsALeakFromNoiseAndFromAStep) {
+  std::vector<double> leak;
+  std::vector<double> noise;
+  std::vector<double> step;
+  for (std::size_t i = 0; i < 100; ++i) {
+    leak.push_back(100.0 + static_cast<double>(i) + (i % 3 == 0 ? 2.0 : 0.0));
+    noise.push_back(100.0 + (i % 7 == 0 ? 30.0 : 0.0) -
+                    (i % 5 == 0 ? 20.0 : 0.0));
+    step.push_back(i < 50 ? 100.0 : 200.0);
+  }
+  EXPECT_TRUE(xtest::internal::IsSteadyGrowth(leak, 10.0));
+  EXPECT_FALSE(xtest::internal::IsSteadyGrowth(leak, 1000.0));
+  EXPECT_FALSE(xtest::internal::IsSteadyGrowth(noise, 10.0));
+  EXPECT_FALSE(xtest::internal::IsSteadyGrowth(step, 10.0));
+  EXPECT_FALSE(xtest::internal::IsSteadyGrowth({1.0, 2.0, 3.0}, 1.0));
+}
+
+TEST(SampleSeriesTest, MergesSamplesToStayBounded) {
+  xtest::internal::SampleSeries series;
+  const std::size_t max_samples = xtest::internal::SampleSeries::kMaxSamples;
+  for (std::size_t i = 0; i < 3 * max_samples; ++i)
+    series.Add(static_cast<double>(i));
+  EXPECT_TRUE(series.samples().size() < max_samples);
+  // Every sample is the mean of four intervals by now.
+  EXPECT_TRUE(series.samples().front() == 1.5);
+  const xtest::internal::LinearTrend trend =
+      xtest::internal::FitLinearTrend(series.samples());
+  EXPECT_TRUE(std::fabs(trend.slope - 4.0) < 1e-9);
+}
+
+TEST(GetResourceUsageTest, CountsOpenFileDescriptors) {
+  xtest::internal::ResourceUsage before;
+  if (!xtest::internal::GetResourceUsage(&before))
+    return;  // Not supported on this platform.
+  std::FILE* const file = std::tmpfile();
+  xtest::internal::ResourceUsage after;
+  EXPECT_TRUE(xtest::internal::GetResourceUsage(&after));
+  std::fclose(file);
+  EXPECT_EQ(after.open_fds, before.open_fds + 1);
+  EXPECT_TRUE(after.rss > 0);
+  EXPECT_TRUE(after.threads >= 1);
+}
+
+#endif  // XTEST_TESTS_XTEST_SOAK_TEST_HH_
@@ -0,0 +1,134 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_TESTS_XTEST_TAGS_TEST_HH_
+#define XTEST_TESTS_XTEST_TAGS_TEST_HH_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "internal/xtest-tags.hh"
+#include "xtest.hh"
+
+XTEST_TAGS(TestTagsTest, "suite-tag", "shared-tag");
+
+TEST_WITH_TAGS(TestTagsTest, MergesTheTagsOfTheTestAndItsSuite, "shared-tag",
+               "own-tag") {
+  EXPECT_TRUE(xtest::internal::GetTestTags(current_test) ==
+              std::vector<std::string>({"own-tag", "shared-tag", "suite-tag"}));
+}
+
+// Returns copies of `test`, which unlike new instances are not registered, that
+// carry the tags `tags_of_test` and no tag of a test suite.
+static std::vector<xtest::TestRegistrar> MakeTestsWithTags(
+    const xtest::TestRegistrar* test,
+    const std::vector<std::vector<const char*>>& tags_of_test) {
+  std::vector<xtest::TestRegistrar> tests(tags_of_test.size(), *test);
+  for (std::size_t i = 0; i < tests.size(); ++i) {
+    tests[i].suite_name_ = "TagIndexTest.Copy";
+    tests[i].tags_ = tags_of_test[i];
+  }
+  return tests;
+}
+
+// Returns the indices of the tests of `index` selected by `expression`.
+static std::vector<std::size_t> SelectTests(
+    const xtest::internal::TagIndex& index, const std::string& expression) {
+  std::vector<bool> selected;
+  std::string error;
+  std::vector<std::size_t> selected_tests;
+  if (!index.Select(expression, &selected, &error))
+    return selected_tests;
+  for (std::size_t i = 0; i < selected.size(); ++i)
+    if (selected[i])
+      selected_tests.push_back(i);
+  return selected_tests;
+}
+
+TEST(TagIndexTest, SelectsTheTestsMatchingAnExpression) {
+  std::vector<xtest::TestRegistrar> tests =
+      MakeTestsWithTags(current_test, {{"fast"},
+                                       {"fast", "network"},
+                                       {"slow", "network"},
+                                       {},
+                                       {"slow", "db"}});
+  std::vector<xtest::TestRegistrar*> test_ptrs;
+  for (xtest::TestRegistrar& test : tests)
+    test_ptrs.push_back(&test);
+  const xtest::internal::TagIndex index(test_ptrs);
+
+  using Indices = std::vector<std::size_t>;
+  EXPECT_TRUE(SelectTests(index, "fast") == Indices({0, 1}));
+  EXPECT_TRUE(SelectTests(index, "fast,!network") == Indices({0}));
+  EXPECT_TRUE(SelectTests(index, "!fast") == Indices({2, 3, 4}));
+  EXPECT_TRUE(SelectTests(index, "fast | db") == Indices({0, 1, 4}));
+  EXPECT_TRUE(SelectTests(index, "slow & (db | !network)") == Indices({4}));
+  EXPECT_TRUE(SelectTests(index, "!!fast") == Indices({0, 1}));
+  EXPECT_TRUE(SelectTests(index, "unknown").empty());
+}
+
+TEST(TagIndexTest, SelectsAcrossMoreTestsThanFitInAWord) {
+  std::vector<std::vector<const char*>> tags_of_test(130);
+  for (std::size_t i = 0; i < tags_of_test.size(); i += 3)
+    tags_of_test[i] = {"every-third"};
+  std::vector<xtest::TestRegistrar> tests =
+      MakeTestsWithTags(current_test, tags_of_test);
+  std::vector<xtest::TestRegistrar*> test_ptrs;
+  for (xtest::TestRegistrar& test : tests)
+    test_ptrs.push_back(&test);
+  const xtest::internal::TagIndex index(test_ptrs);
+
+  EXPECT_EQ(SelectTests(index, "every-third").size(), 44u);
+  EXPECT_EQ(SelectTests(index, "!every-third").size(), 86u);
+}
+
+TEST(IsValidTagExpressionTest, SaysWhereAnExpressionGoesWrong) {
+  std::string error;
+  EXPECT_TRUE(xtest::internal::IsValidTagExpression("a,!(b|c)", &error));
+  EXPECT_FALSE(xtest::internal::IsValidTagExpression("", &error));
+  EXPECT_FALSE(xtest::internal::IsValidTagExpression("a,", &error));
+  EXPECT_FALSE(xtest::internal::IsValidTagExpression("(a|b", &error));
+  EXPECT_EQ(error, "expected ')' at position 5 of \"(a|b\"");
+  EXPECT_FALSE(xtest::internal::IsValidTagExpression("a b", &error));
+  EXPECT_EQ(error, "unexpected 'b' at position 3 of \"a b\"");
+}
+
+TEST(SkipTestTest, SkipsATestUnlessItFailedAlready) {
+  xtest::TestRegistrar test = *current_test;
+  test.test_result_ = xtest::TestResult::UNKNOWN;
+  xtest::SkipTest(&test);
+  EXPECT_TRUE(test.test_result_ == xtest::TestResult::SKIPPED);
+
+  test.test_result_ = xtest::TestResult::FAILED;
+  xtest::SkipTest(&test);
+  EXPECT_TRUE(test.test_result_ == xtest::TestResult::FAILED);
+}
+
+#endif  // XTEST_TESTS_XTEST_TAGS_TEST_HH_
@@ -0,0 +1,110 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_TESTS_XTEST_TEMPDIR_TEST_HH_
+#define XTEST_TESTS_XTEST_TEMPDIR_TEST_HH_
+
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <string>
+#include <thread>  // NOLINT
+
+#include "internal/xtest-port-arch.hh"
+#include "internal/xtest-tempdir.hh"
+#include "xtest.hh"
+
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Returns true if there is a file or directory at `path`.
+static bool PathExists(const std::string& path) {
+  struct stat status;
+  return lstat(path.c_str(), &status) == 0;
+}
+
+// Creates a file at `path` holding `content`.  Returns false on failure.
+static bool WriteFile(const std::string& path, const std::string& content) {
+  std::FILE* const file = std::fopen(path.c_str(), "w");
+  if (file == nullptr)
+    return false;
+  const bool written =
+      std::fwrite(content.data(), 1, content.size(), file) == content.size();
+  return std::fclose(file) == 0 && written;
+}
+
+TEST(TestTempDirTest, IsTheSameForTheTestAndTheThreadsItStarts) {
+  const std::string dir = xtest::TestTempDir();
+  ASSERT_FALSE(dir.empty());
+  EXPECT_TRUE(PathExists(dir));
+  EXPECT_TRUE(WriteFile(dir + "/file", "data"));
+  EXPECT_EQ(xtest::TestTempDir(), dir);
+
+  std::string thread_dir;
+  xtest::TestThread thread([&thread_dir]() {
+    thread_dir = xtest::TestTempDir();
+  });
+  thread.Join();
+  EXPECT_EQ(thread_dir, dir);
+}
+
+TEST(TestTempDirTest, IsRemovedOnceTheTestIsOver) {
+  xtest::TestRegistrar test = *current_test;
+  test.temp_dir_.clear();
+  const std::string dir = xtest::internal::GetTestTempDir(&test);
+  ASSERT_FALSE(dir.empty());
+  EXPECT_NE(dir, xtest::TestTempDir());
+  ASSERT_EQ(mkdir((dir + "/nested").c_str(), 0700), 0);
+  EXPECT_TRUE(WriteFile(dir + "/nested/file", "data"));
+
+  xtest::internal::ReleaseTestTempDir(&test);
+  EXPECT_TRUE(test.temp_dir_.empty());
+  // The directory is removed in the background.
+  for (int32_t i = 0; i < 500 && PathExists(dir); ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_FALSE(PathExists(dir));
+}
+
+TEST(RemoveDirectoryTreeTest, DoesNotFollowSymbolicLinks) {
+  const std::string dir = xtest::TestTempDir();
+  ASSERT_FALSE(dir.empty());
+  ASSERT_EQ(mkdir((dir + "/kept").c_str(), 0700), 0);
+  ASSERT_TRUE(WriteFile(dir + "/kept/file", "data"));
+  ASSERT_EQ(mkdir((dir + "/removed").c_str(), 0700), 0);
+  ASSERT_EQ(symlink((dir + "/kept").c_str(), (dir + "/removed/link").c_str()),
+            0);
+
+  EXPECT_TRUE(xtest::internal::RemoveDirectoryTree(dir + "/removed"));
+  EXPECT_FALSE(PathExists(dir + "/removed"));
+  EXPECT_TRUE(PathExists(dir + "/kept/file"));
+  EXPECT_FALSE(xtest::internal::RemoveDirectoryTree(dir + "/removed"));
+}
+#endif  // XTEST_OS_LINUX || XTEST_OS_MAC
+
+#endif  // XTEST_TESTS_XTEST_TEMPDIR_TEST_HH_
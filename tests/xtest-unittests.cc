@@ -32,12 +32,29 @@
 #include "xtest.hh"
 
 // Include header files containing unit tests.
+#include "xtest-affinity-test.hh"
 #include "xtest-assertions-test.hh"
+#include "xtest-cancellation-test.hh"
+#include "xtest-clock-test.hh"
+#include "xtest-context-test.hh"
+#include "xtest-faults-test.hh"
+#include "xtest-filter-test.hh"
+#include "xtest-history-test.hh"
+#include "xtest-isolation-test.hh"
+#include "xtest-journal-test.hh"
+#include "xtest-loopback-test.hh"
 #include "xtest-message-test.hh"
 #include "xtest-port-test.hh"
 #include "xtest-printers-test.hh"
+#include "xtest-runner-test.hh"
+#include "xtest-scheduler-test.hh"
+#include "xtest-server-test.hh"
+#include "xtest-soak-test.hh"
 #include "xtest-string-test.hh"
+#include "xtest-tags-test.hh"
+#include "xtest-tempdir-test.hh"
 #include "xtest-test.hh"
+#include "xtest-watchdog-test.hh"
 
 int32_t main(int32_t argc, char** argv) {
   xtest::InitXTest(&argc, argv);
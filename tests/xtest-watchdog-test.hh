@@ -0,0 +1,99 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef XTEST_TESTS_XTEST_WATCHDOG_TEST_HH_
+#define XTEST_TESTS_XTEST_WATCHDOG_TEST_HH_
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>  // NOLINT
+#include <csetjmp>
+#include <thread>  // NOLINT
+
+#include "internal/xtest-watchdog.hh"
+#include "xtest.hh"
+
+TEST_WITH_TIMEOUT(TestWatchdogTest, RegistersTheTestsOwnTimeout, 60000) {
+  EXPECT_EQ(current_test->timeout_, 60000);
+  EXPECT_EQ(xtest::internal::GetTestTimeout(current_test, 1000), 60000);
+
+  xtest::TestRegistrar test = *current_test;
+  test.timeout_ = 0;
+  EXPECT_EQ(xtest::internal::GetTestTimeout(&test, 1000), 1000);
+  EXPECT_EQ(xtest::internal::GetTestTimeout(&test, 0), 0);
+}
+
+TEST(TestWatchdogTest, DoesNotReportATestThatFinishesInTime) {
+  EXPECT_FALSE(xtest::internal::DisarmTestWatchdog());
+  xtest::internal::ArmTestWatchdog(current_test, 0, nullptr);
+  EXPECT_FALSE(xtest::internal::DisarmTestWatchdog());
+  xtest::internal::ArmTestWatchdog(current_test, 60000, nullptr);
+  EXPECT_FALSE(xtest::internal::DisarmTestWatchdog());
+}
+
+static thread_local std::jmp_buf jump_out_of_watched_test;
+
+static void JumpOutOfWatchedTest() {
+  std::longjmp(jump_out_of_watched_test, 1);
+}
+
+// Runs a test that never finishes on its own under the watchdog.
+static void RunHangingTest(const xtest::TestRegistrar* test, bool* timed_out) {
+  if (setjmp(jump_out_of_watched_test) == 0) {
+    xtest::internal::ArmTestWatchdog(test, 50, JumpOutOfWatchedTest);
+    for (;;)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  *timed_out = xtest::internal::DisarmTestWatchdog();
+}
+
+TEST(TestWatchdogTest, InterruptsATestThatRunsOutOfTime) {
+  // Keep the stack traces out of the output of the unit tests.
+  std::fflush(stderr);
+  const int32_t saved_stderr = dup(STDERR_FILENO);
+  const int32_t null_fd = open("/dev/null", O_WRONLY);
+  dup2(null_fd, STDERR_FILENO);
+  close(null_fd);
+
+  bool timed_out = false;
+  xtest::internal::Timer timer;
+  std::thread test_thread(RunHangingTest, current_test, &timed_out);
+  test_thread.join();
+  const xtest::TimeInMillis elapsed_time = timer.Elapsed();
+
+  std::fflush(stderr);
+  dup2(saved_stderr, STDERR_FILENO);
+  close(saved_stderr);
+
+  EXPECT_TRUE(timed_out);
+  EXPECT_GE(elapsed_time, 50);
+}
+
+#endif  // XTEST_TESTS_XTEST_WATCHDOG_TEST_HH_
@@ -0,0 +1,387 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/xtest-affinity.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "internal/xtest-port-arch.hh"
+
+#if XTEST_OS_LINUX
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "xtest-message.hh"
+
+namespace xtest {
+namespace internal {
+// Largest CPU number a CPU list may name.
+static const int32_t kMaxCpuNumber = 65535;
+
+// Parses the CPU number at `position` of `list` into `cpu`, moving `position`
+// past it.
+static bool ParseCpuNumber(const std::string& list, std::size_t* position,
+                           int32_t* cpu) {
+  const std::size_t begin = *position;
+  int32_t number = 0;
+  while (*position < list.size() &&
+         std::isdigit(static_cast<unsigned char>(list[*position]))) {
+    number = number * 10 + (list[*position] - '0');
+    if (number > kMaxCpuNumber)
+      return false;
+    ++*position;
+  }
+  *cpu = number;
+  return *position > begin;
+}
+
+// Parses `list`, a list of CPU numbers and ranges such as "0,2,4-7", into
+// `cpus`.
+bool ParseCpuList(const std::string& list, std::vector<int32_t>* cpus) {
+  cpus->clear();
+  std::size_t position = 0;
+  for (;;) {
+    int32_t first = 0;
+    if (!ParseCpuNumber(list, &position, &first))
+      return false;
+    int32_t last = first;
+    if (position < list.size() && list[position] == '-') {
+      ++position;
+      if (!ParseCpuNumber(list, &position, &last) || last < first)
+        return false;
+    }
+    for (int32_t cpu = first; cpu <= last; ++cpu)
+      cpus->push_back(cpu);
+    if (position == list.size())
+      return true;
+    if (list[position++] != ',')
+      return false;
+  }
+}
+
+// Returns the CPUs of `cpus` in the order the workers are pinned to them: one
+// hardware thread of every core before its siblings and, for "compact", the
+// CPUs of one NUMA node after the other or, for "scatter", round-robin over
+// the NUMA nodes.
+static std::vector<CpuInfo> OrderCpus(const std::vector<CpuInfo>& cpus,
+                                      const bool& scatter) {
+  // Rank of every CPU among the hardware threads of its core.
+  std::map<std::pair<int32_t, int32_t>, int32_t> threads_of_core;
+  std::vector<std::pair<int32_t, CpuInfo>> ranked_cpus;
+  for (const CpuInfo& cpu : cpus)
+    ranked_cpus.emplace_back(threads_of_core[{cpu.package, cpu.core}]++, cpu);
+  std::stable_sort(
+      ranked_cpus.begin(), ranked_cpus.end(),
+      [](const std::pair<int32_t, CpuInfo>& a,
+         const std::pair<int32_t, CpuInfo>& b) {
+        if (a.second.node != b.second.node)
+          return a.second.node < b.second.node;
+        if (a.first != b.first)
+          return a.first < b.first;
+        if (a.second.package != b.second.package)
+          return a.second.package < b.second.package;
+        return a.second.core < b.second.core;
+      });
+
+  std::vector<CpuInfo> order;
+  if (!scatter) {
+    for (const auto& ranked_cpu : ranked_cpus)
+      order.push_back(ranked_cpu.second);
+    return order;
+  }
+  std::map<int32_t, std::vector<CpuInfo>> cpus_of_node;
+  for (const auto& ranked_cpu : ranked_cpus)
+    cpus_of_node[ranked_cpu.second.node].push_back(ranked_cpu.second);
+  for (std::size_t i = 0; order.size() < cpus.size(); ++i) {
+    for (const auto& node : cpus_of_node)
+      if (i < node.second.size())
+        order.push_back(node.second[i]);
+  }
+  return order;
+}
+
+// Plans the CPUs of `num_workers` workers on `cpus` by `policy`.
+bool CpuAffinity::Plan(const std::string& policy,
+                       const std::vector<CpuInfo>& cpus,
+                       const std::size_t& num_workers, std::string* error) {
+  worker_cpus_.clear();
+  worker_nodes_.clear();
+  worker_node_cpus_.clear();
+  node_cpus_.clear();
+  if (cpus.empty()) {
+    *error = "the CPUs of this machine cannot be listed";
+    return false;
+  }
+
+  std::vector<CpuInfo> order;
+  if (policy == "compact" || policy == "scatter") {
+    order = OrderCpus(cpus, policy == "scatter");
+  } else {
+    std::vector<int32_t> listed_cpus;
+    if (!ParseCpuList(policy, &listed_cpus)) {
+      *error = "expected compact, scatter or a list of CPUs such as 0,2,4-7";
+      return false;
+    }
+    for (const int32_t& listed_cpu : listed_cpus) {
+      const auto cpu =
+          std::find_if(cpus.begin(), cpus.end(), [&](const CpuInfo& info) {
+            return info.cpu == listed_cpu;
+          });
+      if (cpu == cpus.end()) {
+        *error = "CPU " + StreamableToString(listed_cpu) +
+                 " is not one this process may run on";
+        return false;
+      }
+      order.push_back(*cpu);
+    }
+  }
+
+  std::map<int32_t, std::size_t> node_index;
+  for (const CpuInfo& cpu : cpus) {
+    const auto node = node_index.emplace(cpu.node, node_cpus_.size());
+    if (node.second)
+      node_cpus_.emplace_back();
+    node_cpus_[node.first->second].push_back(cpu.cpu);
+  }
+  numa_ = node_cpus_.size() > 1;
+  for (std::size_t i = 0; i < num_workers; ++i) {
+    const CpuInfo& cpu = order[i % order.size()];
+    worker_cpus_.push_back(cpu.cpu);
+    worker_nodes_.push_back(cpu.node);
+    worker_node_cpus_.push_back(node_index[cpu.node]);
+  }
+  return true;
+}
+
+#if XTEST_OS_LINUX
+// Largest number of NUMA nodes a memory policy may name.
+static const std::size_t kMaxNodes = 1024;
+
+// Memory policy of a thread.
+struct MemoryPolicy {
+  int32_t mode = MPOL_DEFAULT;
+  unsigned long nodes[kMaxNodes / (8 * sizeof(unsigned long))] = {};
+};
+
+// The CPU the calling thread was pinned to, `-1` if it was not, and the CPUs
+// of that CPU's NUMA node.
+static thread_local int32_t pinned_cpu = -1;
+static thread_local std::vector<int32_t> pinned_node_cpus;
+
+// True while the test running on the calling thread may use every CPU of
+// `pinned_node_cpus`.
+static thread_local bool placed_on_node = false;
+
+// CPUs and memory policy of the calling thread before it was pinned.
+static thread_local bool affinity_saved = false;
+static thread_local cpu_set_t saved_cpus;
+static thread_local MemoryPolicy saved_memory_policy;
+
+// Returns the contents of the file at `path`, whose first line is at most a few
+// kilobytes long, without trailing white space.
+static bool ReadSysFile(const std::string& path, std::string* contents) {
+  std::FILE* const file = std::fopen(path.c_str(), "r");
+  if (file == nullptr)
+    return false;
+  char line[4096];
+  const bool read = std::fgets(line, sizeof(line), file) != nullptr;
+  std::fclose(file);
+  if (!read)
+    return false;
+  *contents = line;
+  while (!contents->empty() &&
+         std::isspace(static_cast<unsigned char>(contents->back())))
+    contents->pop_back();
+  return true;
+}
+
+// Returns the number in the file at `path`, or `default_value` if there is
+// none.
+static int32_t ReadSysNumber(const std::string& path,
+                             const int32_t& default_value) {
+  std::string contents;
+  if (!ReadSysFile(path, &contents) || contents.empty())
+    return default_value;
+  return static_cast<int32_t>(std::strtol(contents.c_str(), nullptr, 10));
+}
+
+// Returns the CPUs the calling process may run on with where they sit.
+std::vector<CpuInfo> GetCpuTopology() {
+  std::vector<CpuInfo> cpus;
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    return cpus;
+
+  std::map<int32_t, int32_t> node_of_cpu;
+  if (DIR* const nodes = opendir("/sys/devices/system/node")) {
+    while (const dirent* const entry = readdir(nodes)) {
+      if (std::strncmp(entry->d_name, "node", 4) != 0 ||
+          !std::isdigit(static_cast<unsigned char>(entry->d_name[4])))
+        continue;
+      std::string list;
+      std::vector<int32_t> cpus_of_node;
+      if (!ReadSysFile(std::string("/sys/devices/system/node/") +
+                           entry->d_name + "/cpulist",
+                       &list) ||
+          !ParseCpuList(list, &cpus_of_node))
+        continue;
+      for (const int32_t& cpu : cpus_of_node)
+        node_of_cpu[cpu] = std::atoi(entry->d_name + 4);
+    }
+    closedir(nodes);
+  }
+
+  for (int32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (!CPU_ISSET(cpu, &allowed))
+      continue;
+    const std::string topology = "/sys/devices/system/cpu/cpu" +
+                                 StreamableToString(cpu) + "/topology/";
+    CpuInfo info;
+    info.cpu = cpu;
+    const auto node = node_of_cpu.find(cpu);
+    info.node = node != node_of_cpu.end() ? node->second : 0;
+    info.package = ReadSysNumber(topology + "physical_package_id", 0);
+    info.core = ReadSysNumber(topology + "core_id", cpu);
+    cpus.push_back(info);
+  }
+  return cpus;
+}
+
+// Restricts the calling thread to `cpus`.
+static bool SetThreadCpus(const std::vector<int32_t>& cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (const int32_t& cpu : cpus)
+    if (cpu < CPU_SETSIZE)
+      CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+static void GetMemoryPolicy(MemoryPolicy* policy) {
+  int mode = MPOL_DEFAULT;
+  if (syscall(SYS_get_mempolicy, &mode, policy->nodes, kMaxNodes, nullptr,
+              0) == 0)
+    policy->mode = mode;
+}
+
+static void SetMemoryPolicy(const MemoryPolicy& policy) {
+  syscall(SYS_set_mempolicy, policy.mode,
+          policy.mode == MPOL_DEFAULT ? nullptr : policy.nodes, kMaxNodes);
+}
+
+// Pins the calling thread, worker `worker`, to its CPU and has it prefer the
+// memory of that CPU's NUMA node.
+bool CpuAffinity::PinWorker(const std::size_t& worker) const {
+  if (worker_cpus_.empty())
+    return false;
+  const std::size_t index = worker % worker_cpus_.size();
+  if (pinned_cpu == worker_cpus_[index])
+    return true;
+  if (!affinity_saved) {
+    CPU_ZERO(&saved_cpus);
+    sched_getaffinity(0, sizeof(saved_cpus), &saved_cpus);
+    GetMemoryPolicy(&saved_memory_policy);
+    affinity_saved = true;
+  }
+  if (!SetThreadCpus({worker_cpus_[index]}))
+    return false;
+  pinned_cpu = worker_cpus_[index];
+  pinned_node_cpus = node_cpus_[worker_node_cpus_[index]];
+  placed_on_node = false;
+
+  // Memory is allocated where it is first touched by default, which is on the
+  // worker's node now; the preference also overrides a policy inherited from,
+  // e.g., `numactl --interleave`.
+  const std::size_t node = static_cast<std::size_t>(worker_nodes_[index]);
+  if (numa_ && node < kMaxNodes) {
+    MemoryPolicy policy;
+    policy.mode = MPOL_PREFERRED;
+    policy.nodes[node / (8 * sizeof(unsigned long))] |=
+        1UL << (node % (8 * sizeof(unsigned long)));
+    SetMemoryPolicy(policy);
+  }
+  return true;
+}
+
+// Lets the test about to run on the calling thread onto the CPUs it declared.
+void PlaceTest(const TestCost& cost) {
+  if (pinned_cpu < 0)
+    return;
+  const bool on_node = cost.cpus > 1;
+  if (on_node != placed_on_node &&
+      SetThreadCpus(on_node ? pinned_node_cpus
+                            : std::vector<int32_t>(1, pinned_cpu)))
+    placed_on_node = on_node;
+}
+
+// Returns the CPU the calling thread runs on if it was pinned, else `-1`.
+int32_t GetCurrentCpu() { return pinned_cpu < 0 ? -1 : sched_getcpu(); }
+
+// Gives the calling thread back the CPUs and the memory policy it had before
+// it was pinned.
+void UnpinCurrentThread() {
+  if (!affinity_saved)
+    return;
+  sched_setaffinity(0, sizeof(saved_cpus), &saved_cpus);
+  SetMemoryPolicy(saved_memory_policy);
+  affinity_saved = false;
+  pinned_cpu = -1;
+  placed_on_node = false;
+}
+#else
+// Threads are not pinned on this platform, where the CPUs are not listed.
+std::vector<CpuInfo> GetCpuTopology() { return std::vector<CpuInfo>(); }
+
+bool CpuAffinity::PinWorker(const std::size_t& /* worker */) const {
+  return false;
+}
+
+void PlaceTest(const TestCost& /* cost */) {}
+
+int32_t GetCurrentCpu() { return -1; }
+
+void UnpinCurrentThread() {}
+#endif  // XTEST_OS_LINUX
+}  // namespace internal
+}  // namespace xtest
@@ -32,6 +32,7 @@
 #include <cstdint>
 #include <cstdio>
 
+#include "internal/xtest-context.hh"
 #include "internal/xtest-port.hh"
 #include "internal/xtest-printers.hh"
 #include "xtest-registrar.hh"
@@ -43,6 +44,10 @@ AssertionContext::AssertionContext(const char* file, uint64_t line,
                                    TestRegistrar* const& current_test)
     : file_(file), line_(line), current_test_(current_test) {}
 
+// Constructs a AssertionContext for the test of the calling thread.
+AssertionContext::AssertionContext(const char* file, uint64_t line)
+    : file_(file), line_(line), current_test_(GetCurrentTest()) {}
+
 // Returns file name inside which the {EXPECT|ASSERT} assertion has been used.
 const char* AssertionContext::file() const noexcept { return file_; }
 
@@ -55,6 +60,29 @@ TestRegistrar* const AssertionContext::current_test() const noexcept {
   return current_test_;
 }
 
+// Marks the test of the assertion as `xtest::TestResult::PASSED`.
+void AssertionContext::MarkPassed() const {
+  if (current_test_ != nullptr)
+    current_test_->test_result_.MarkPassed();
+}
+
+// Marks the test of the assertion as `xtest::TestResult::FAILED`, or reports
+// the failure as one of the run without a test.
+void AssertionContext::MarkFailed() const {
+  if (current_test_ != nullptr) {
+    current_test_->test_result_.MarkFailed();
+    return;
+  }
+  StreamPrintf(stderr,
+               "%s(%lu): error: The assertion failed on a thread that works "
+               "for no test; start the thread as a `xtest::TestThread` or "
+               "give it a `xtest::ScopedTestContext` to fail its test "
+               "instead of the run.\n",
+               file_, line_);
+  StreamFlush(stderr);
+  ++XTEST_GLOBAL_INSTANCE_GET_(unattributed_failure_count);
+}
+
 // Returns a `AssertionResult` instance of success type in case of
 // {EXPECT|ASSERT} assertion success.
 AssertionResult AssertionSuccess() { return AssertionResult(true); }
@@ -67,35 +95,59 @@ AssertionResult AssertionFailure(const bool& is_fatal) {
 // Prints out the information of the test suite and the test name.
 void PrettyAssertionResultPrinter::OnTestAssertionStart(
     const TestRegistrar* const& test) {
+  if (test == nullptr)
+    return;
   ColoredPrintf(XTestColor::kGreen, "[%s] ",
                 ::xtest::GetStringAlignedTo(
                     "RUN", XTEST_DEFAULT_SUMMARY_STATUS_STR_WIDTH_, ALIGN_LEFT)
                     .c_str());
-  std::printf("%s.%s", test->suite_name_, test->test_name_);
-  std::printf("\n");
-  std::fflush(stdout);
+  StreamPrintf(stdout, "%s.%s", test->suite_name_, test->test_name_);
+  StreamPrintf(stdout, "\n");
+  StreamFlush(stdout);
 }
 
 // Prints out the information of the test suite and the test name with the
 // assertion result.
 void PrettyAssertionResultPrinter::OnTestAssertionEnd(
     const TestRegistrar* const& test, const TimeInMillis& elapsed_time) {
-  if (test->test_result_ == ::xtest::TestResult::PASSED)
+  if (test == nullptr)
+    return;
+  OnTestAssertionEnd(test, elapsed_time, test->test_result_);
+}
+
+// Prints out the information of the test suite and the test name with
+// `result`, the result of a single assertion.
+void PrettyAssertionResultPrinter::OnTestAssertionEnd(
+    const TestRegistrar* const& test, const TimeInMillis& elapsed_time,
+    const TestResult& result) {
+  if (test == nullptr)
+    return;
+  if (result == ::xtest::TestResult::PASSED)
     ColoredPrintf(
         XTestColor::kGreen, "[%s] ",
         ::xtest::GetStringAlignedTo(
             "OK", XTEST_DEFAULT_SUMMARY_STATUS_STR_WIDTH_, ALIGN_RIGHT)
             .c_str());
+  else if (result == ::xtest::TestResult::SKIPPED)
+    ColoredPrintf(
+        XTestColor::kYellow, "[%s] ",
+        ::xtest::GetStringAlignedTo(
+            "SKIPPED", XTEST_DEFAULT_SUMMARY_STATUS_STR_WIDTH_, ALIGN_CENTER)
+            .c_str());
   else
     ColoredPrintf(
         XTestColor::kRed, "[%s] ",
         ::xtest::GetStringAlignedTo(
             "FAILED", XTEST_DEFAULT_SUMMARY_STATUS_STR_WIDTH_, ALIGN_CENTER)
             .c_str());
-  std::printf("%s.%s (%lu ms)", test->suite_name_, test->test_name_,
-              elapsed_time);
-  std::printf("\n");
-  std::fflush(stdout);
+  if (test->cpu_ >= 0)
+    StreamPrintf(stdout, "%s.%s (%lu ms on CPU %d)", test->suite_name_,
+                 test->test_name_, elapsed_time, test->cpu_);
+  else
+    StreamPrintf(stdout, "%s.%s (%lu ms)", test->suite_name_,
+                 test->test_name_, elapsed_time);
+  StreamPrintf(stdout, "\n");
+  StreamFlush(stdout);
 }
 }  // namespace internal
 }  // namespace xtest
@@ -0,0 +1,85 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/xtest-cancellation.hh"
+
+#include <atomic>
+#include <new>
+
+#include "internal/xtest-port-arch.hh"
+#include "internal/xtest-port.hh"
+
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+#include <sys/mman.h>
+#endif
+
+namespace xtest {
+namespace internal {
+// Returns the flag the cancellation of the test run is kept in.  On POSIX it
+// lives in an anonymous shared mapping, which the worker processes forked
+// afterwards share with the parent instead of getting a copy of, so that a
+// failure in one of them is seen by all of them.
+static std::atomic<bool>* GetCancellationFlag() {
+  static std::atomic<bool>* const flag = []() {
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+    void* const memory =
+        mmap(nullptr, sizeof(std::atomic<bool>), PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED)
+      return new (memory) std::atomic<bool>(false);
+#endif
+    // Only the threads of this process see the cancellation then.
+    static std::atomic<bool> process_flag(false);
+    return &process_flag;
+  }();
+  return flag;
+}
+
+// Cancels the test run.
+void CancelTestRun() {
+  GetCancellationFlag()->store(true, std::memory_order_relaxed);
+}
+
+// Returns true once the test run has been cancelled.
+bool IsTestRunCancelled() {
+  return GetCancellationFlag()->load(std::memory_order_relaxed);
+}
+
+// Cancels the test run with `--xtest_fail_fast`.
+void CancelTestRunIfFailingFast() {
+  if (XTEST_FLAG_GET_(fail_fast))
+    CancelTestRun();
+}
+
+// Forgets the cancellation of the previous run.
+void ResetTestRunCancellation() {
+  GetCancellationFlag()->store(false, std::memory_order_relaxed);
+}
+}  // namespace internal
+}  // namespace xtest
@@ -0,0 +1,70 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "xtest-clock.hh"
+
+#include <chrono>  // NOLINT
+
+#include "internal/xtest-context.hh"
+#include "xtest-registrar.hh"
+
+namespace xtest {
+constexpr bool FakeClock::is_steady;
+
+// Fake time of the threads that are not working for a test with fake time.
+static AtomicFakeTime process_fake_time;
+
+// Returns the fake time of the test the calling thread works for, if it was
+// created with `TEST_WITH_FAKE_TIME()`, else that of the process.
+static AtomicFakeTime* GetFakeTime() {
+  TestRegistrar* const test = internal::GetCurrentTest();
+  if (test != nullptr && test->has_fake_time_)
+    return &test->fake_time_;
+  return &process_fake_time;
+}
+
+// Returns the current fake time.
+FakeClock::time_point FakeClock::now() noexcept {
+  return time_point(duration(GetFakeTime()->Load()));
+}
+
+// Moves the fake time forward by `time`.
+void FakeClock::Advance(const duration& time) {
+  if (time > duration::zero())
+    GetFakeTime()->Advance(time.count());
+}
+
+// Moves the fake time forward by `time`.
+void FakeClock::SleepFor(const duration& time) { Advance(time); }
+
+// Moves the fake time forward to `deadline`.
+void FakeClock::SleepUntil(const time_point& deadline) {
+  GetFakeTime()->AdvanceTo(deadline.time_since_epoch().count());
+}
+}  // namespace xtest
@@ -0,0 +1,258 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/xtest-context.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "internal/xtest-printers.hh"
+#include "xtest-registrar.hh"
+
+namespace xtest {
+namespace internal {
+// The context of the calling thread, see `GetCurrentTestContext()`.
+static thread_local TestContext current_context;
+
+// True on the helper threads of a test, see `ScopedTestContext`.
+static thread_local bool current_thread_is_helper = false;
+
+// True on the threads a fatal failure ends, see `RunHelperThread()`.
+static thread_local bool current_thread_ends_on_fatal_failure = false;
+
+// Guards `running_tests`.
+static std::mutex running_tests_mutex;
+
+// The tests running in this process, on any thread.
+static std::vector<TestRegistrar*> running_tests;
+
+// The test running in this process if it is the only one, for the threads
+// without a context; `nullptr` when no test or more than one test is running.
+static std::atomic<TestRegistrar*> sole_running_test(nullptr);
+
+// Updates `sole_running_test` from `running_tests`.  Called with
+// `running_tests_mutex` held.
+static void UpdateSoleRunningTest() {
+  sole_running_test.store(running_tests.size() == 1 ? running_tests.front()
+                                                    : nullptr);
+}
+
+HelperOutputList::~HelperOutputList() { TakeAll(); }
+
+// Adds `output` to the list.
+void HelperOutputList::Push(const OutputCapture& output) {
+  Node* const node = new Node{output, head_.load(std::memory_order_relaxed)};
+  while (!head_.compare_exchange_weak(node->next, node,
+                                      std::memory_order_release,
+                                      std::memory_order_relaxed)) {
+  }
+}
+
+// Removes everything pushed so far from the list and returns it in the order
+// it was pushed.
+std::vector<OutputCapture> HelperOutputList::TakeAll() {
+  std::vector<OutputCapture> outputs;
+  for (Node* node = head_.exchange(nullptr, std::memory_order_acquire);
+       node != nullptr;) {
+    Node* const next = node->next;
+    outputs.push_back(node->output);
+    delete node;
+    node = next;
+  }
+  std::reverse(outputs.begin(), outputs.end());
+  return outputs;
+}
+
+HelperThread::HelperThread(std::thread thread, std::function<void()> stop)
+    : thread_(std::move(thread)),
+      stop_(std::move(stop)),
+      joining_(false),
+      joined_(false) {}
+
+HelperThread::~HelperThread() { Join(); }
+
+// Stops and joins the thread, or waits for the caller that does.
+void HelperThread::Join() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (joining_) {
+    joined_condition_.wait(lock, [this] { return joined_.load(); });
+    return;
+  }
+  joining_ = true;
+  lock.unlock();
+  if (stop_)
+    stop_();
+  if (thread_.joinable())
+    thread_.join();
+  stop_ = nullptr;  // Releases what it holds on to.
+  lock.lock();
+  joined_.store(true);
+  joined_condition_.notify_all();
+}
+
+// Adds `thread` to the list, dropping the threads that were joined already.
+void HelperThreadList::Add(const std::shared_ptr<HelperThread>& thread) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  threads_.erase(std::remove_if(threads_.begin(), threads_.end(),
+                                [](const std::shared_ptr<HelperThread>& t) {
+                                  return t->joined();
+                                }),
+                 threads_.end());
+  threads_.push_back(thread);
+}
+
+// Joins every thread added so far.  Takes the list out before joining, as the
+// threads being joined may add more.
+void HelperThreadList::JoinAll() {
+  for (;;) {
+    std::vector<std::shared_ptr<HelperThread>> threads;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      threads.swap(threads_);
+    }
+    if (threads.empty())
+      return;
+    for (const std::shared_ptr<HelperThread>& thread : threads)
+      thread->Join();
+  }
+}
+
+// Takes over `thread` and adds it to the helper threads of the current test.
+std::shared_ptr<HelperThread> AdoptHelperThread(std::thread thread,
+                                                std::function<void()> stop) {
+  const auto helper =
+      std::make_shared<HelperThread>(std::move(thread), std::move(stop));
+  if (current_context.helper_threads != nullptr)
+    current_context.helper_threads->Add(helper);
+  return helper;
+}
+
+// Joins the helper threads of the current test.
+void JoinCurrentTestHelperThreads() {
+  if (current_context.helper_threads != nullptr)
+    current_context.helper_threads->JoinAll();
+}
+
+// Runs `body` as a helper thread of the test of `context` that a fatal failure
+// ends.
+void RunHelperThread(const TestContext& context,
+                     const std::function<void()>& body) {
+  const ScopedTestContext scope(context);
+  const bool saved_ends_on_fatal_failure = current_thread_ends_on_fatal_failure;
+  current_thread_ends_on_fatal_failure = true;
+  try {
+    body();
+  } catch (const HelperThreadFatalFailure&) {
+    // The failure is recorded already; the thread just ends.
+  }
+  current_thread_ends_on_fatal_failure = saved_ends_on_fatal_failure;
+}
+
+// Returns true if a fatal failure is to end the calling thread.
+bool HelperThreadEndsOnFatalFailure() {
+  return current_thread_is_helper && current_thread_ends_on_fatal_failure;
+}
+
+// Returns the context of the calling thread.
+TestContext GetCurrentTestContext() { return current_context; }
+
+// Returns the test the assertions made on the calling thread are recorded
+// against.
+TestRegistrar* GetCurrentTest() {
+  if (current_context.test != nullptr)
+    return current_context.test;
+  return sole_running_test.load();
+}
+
+// Returns true if the calling thread is a helper thread of a test.
+bool IsTestHelperThread() { return current_thread_is_helper; }
+
+// Returns true if the calling thread is the one running a test.
+bool IsTestThread() {
+  return current_context.test != nullptr && !current_thread_is_helper;
+}
+
+ScopedTestRun::ScopedTestRun(TestRegistrar* test)
+    : saved_context_(current_context), saved_helper_(current_thread_is_helper) {
+  current_context.test = test;
+  current_context.helper_output = &helper_output_;
+  current_context.helper_threads = &helper_threads_;
+  current_thread_is_helper = false;
+  std::lock_guard<std::mutex> lock(running_tests_mutex);
+  running_tests.push_back(test);
+  UpdateSoleRunningTest();
+}
+
+ScopedTestRun::~ScopedTestRun() {
+  helper_threads_.JoinAll();
+  {
+    std::lock_guard<std::mutex> lock(running_tests_mutex);
+    const auto test = std::find(running_tests.rbegin(), running_tests.rend(),
+                                current_context.test);
+    if (test != running_tests.rend())
+      running_tests.erase(std::next(test).base());
+    UpdateSoleRunningTest();
+  }
+  current_context = saved_context_;
+  current_thread_is_helper = saved_helper_;
+}
+
+// Prints the output the helper threads of the test have pushed so far.
+void ScopedTestRun::PrintHelperOutput() {
+  for (const OutputCapture& output : helper_output_.TakeAll())
+    for (const OutputCapture::Chunk& chunk : output.chunks())
+      StreamPrintf(chunk.first, "%s", chunk.second.c_str());
+  StreamFlush(stdout);
+  StreamFlush(stderr);
+}
+
+ScopedTestContext::ScopedTestContext(const TestContext& context)
+    : saved_context_(current_context),
+      saved_helper_(current_thread_is_helper),
+      capture_(context.helper_output != nullptr ? &output_ : nullptr) {
+  current_context = context;
+  current_thread_is_helper = context.test != nullptr;
+}
+
+ScopedTestContext::~ScopedTestContext() {
+  if (current_context.helper_output != nullptr && !output_.chunks().empty())
+    current_context.helper_output->Push(output_);
+  current_context = saved_context_;
+  current_thread_is_helper = saved_helper_;
+}
+}  // namespace internal
+}  // namespace xtest
@@ -0,0 +1,172 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/xtest-faults.hh"
+
+#include <algorithm>
+#include <cinttypes>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "internal/xtest-port-arch.hh"
+
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+#include <signal.h>
+#endif
+
+#include "xtest-message.hh"
+
+namespace xtest {
+namespace internal {
+// Returns a human readable description of `fault`.
+std::string DescribeFault(const Fault& fault) {
+  char address[32];
+  std::snprintf(address, sizeof(address), "0x%" PRIxPTR,
+                reinterpret_cast<uintptr_t>(fault.address));
+#if XTEST_OS_WINDOWS
+  return "signal " + StreamableToString(fault.signal) + " at address " +
+         address;
+#else
+  return "signal " + StreamableToString(fault.signal) + " (" +
+         strsignal(fault.signal) + ") at address " + address;
+#endif
+}
+
+#if XTEST_OS_WINDOWS
+void InstallFaultHandlers(FaultHandler /* handler */) {}
+
+void RestoreFaultHandlers() {}
+
+FaultHandler GetFaultHandler() { return nullptr; }
+
+void EnsureAlternateSignalStack() {}
+#else
+// The synchronous fault signals a test can raise.
+static const int32_t kFaultSignals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL};
+static const std::size_t kNumFaultSignals =
+    sizeof(kFaultSignals) / sizeof(kFaultSignals[0]);
+
+static FaultHandler fault_handler = nullptr;
+static struct sigaction saved_fault_actions[kNumFaultSignals];
+static bool fault_handlers_installed = false;
+
+// Handler of the fault signals: hands the fault to `fault_handler` and, if it
+// returns, lets the signal kill the process.
+static void HandleFault(int32_t signal, siginfo_t* info, void* /* context */) {
+  Fault fault;
+  fault.signal = signal;
+  fault.address = info != nullptr ? info->si_addr : nullptr;
+  if (fault_handler != nullptr)
+    fault_handler(fault);
+
+  // Returning re-executes the faulting instruction, which now kills the
+  // process; raising the signal covers one that was sent with `kill()`.
+  std::signal(signal, SIG_DFL);
+  raise(signal);
+}
+
+// Installs `handler` for the fault signals.
+void InstallFaultHandlers(FaultHandler handler) {
+  fault_handler = handler;
+  if (fault_handlers_installed)
+    return;
+  struct sigaction action;
+  std::memset(&action, 0, sizeof(action));
+  sigemptyset(&action.sa_mask);
+  action.sa_sigaction = HandleFault;
+  // The handler does not return but jumps out of the faulting test, so the
+  // signal must not stay blocked.
+  action.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_NODEFER;
+  for (std::size_t i = 0; i < kNumFaultSignals; ++i)
+    sigaction(kFaultSignals[i], &action, &saved_fault_actions[i]);
+  fault_handlers_installed = true;
+}
+
+// Restores the handlers saved by `InstallFaultHandlers()`.
+void RestoreFaultHandlers() {
+  if (!fault_handlers_installed)
+    return;
+  for (std::size_t i = 0; i < kNumFaultSignals; ++i)
+    sigaction(kFaultSignals[i], &saved_fault_actions[i], nullptr);
+  fault_handlers_installed = false;
+  fault_handler = nullptr;
+}
+
+// Returns the installed fault handler, if any.
+FaultHandler GetFaultHandler() {
+  return fault_handlers_installed ? fault_handler : nullptr;
+}
+
+// An alternate signal stack that is installed for the thread owning it and
+// uninstalled before it is freed.
+class AlternateSignalStack {
+ public:
+  AlternateSignalStack() : installed_(false) {}
+
+  ~AlternateSignalStack() {
+    if (!installed_)
+      return;
+    stack_t stack;
+    std::memset(&stack, 0, sizeof(stack));
+    stack.ss_flags = SS_DISABLE;
+    sigaltstack(&stack, nullptr);
+  }
+
+  void Install() {
+    if (installed_)
+      return;
+    // `SIGSTKSZ` is not a constant on every platform; take the larger of it
+    // and a size that is enough for the handler.
+    memory_.resize(std::max<std::size_t>(SIGSTKSZ, 64 * 1024));
+    stack_t stack;
+    std::memset(&stack, 0, sizeof(stack));
+    stack.ss_sp = memory_.data();
+    stack.ss_size = memory_.size();
+    installed_ = sigaltstack(&stack, nullptr) == 0;
+  }
+
+ private:
+  bool installed_;
+  std::vector<char> memory_;
+};
+
+// Gives the calling thread an alternate signal stack if it does not have one
+// yet.
+void EnsureAlternateSignalStack() {
+  static thread_local AlternateSignalStack alternate_stack;
+  alternate_stack.Install();
+}
+#endif  // XTEST_OS_WINDOWS
+}  // namespace internal
+}  // namespace xtest
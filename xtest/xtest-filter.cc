@@ -0,0 +1,201 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/xtest-filter.hh"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace xtest {
+namespace internal {
+constexpr int32_t TestFilter::kUnknown;
+constexpr int32_t TestFilter::kNoMatch;
+constexpr std::size_t TestFilter::kMaxTransitions;
+
+// Calls `add` with every non-empty ':'-separated pattern of `patterns`.
+template <typename AddPattern>
+static void ForEachPattern(const std::string& patterns, AddPattern add) {
+  std::size_t begin = 0;
+  while (begin <= patterns.size()) {
+    std::size_t end = patterns.find(':', begin);
+    if (end == std::string::npos)
+      end = patterns.size();
+    if (end > begin)
+      add(patterns.substr(begin, end - begin));
+    begin = end + 1;
+  }
+}
+
+// Compiles the patterns of `filter`.
+TestFilter::TestFilter(const std::string& filter)
+    : pattern_states_(1), class_char_(1, '\0') {
+  char_class_.fill(0);
+  const std::size_t dash = filter.find('-');
+  const std::string positive = filter.substr(0, dash);
+  // No positive pattern means all tests, as in googletest.
+  if (positive.empty())
+    AddPattern("*", kPositive);
+  ForEachPattern(positive, [this](const std::string& pattern) {
+    AddPattern(pattern, kPositive);
+  });
+  if (dash != std::string::npos) {
+    ForEachPattern(filter.substr(dash + 1),
+                   [this](const std::string& pattern) {
+                     AddPattern(pattern, kNegative);
+                   });
+  }
+  Reset();
+}
+
+// Returns true if the full name `test_name` matches the filter.
+bool TestFilter::Matches(const std::string& test_name) {
+  if (name_states_.size() * class_char_.size() > kMaxTransitions)
+    Reset();
+  int32_t state = start_;
+  for (const char& chr : test_name) {
+    state = Step(state, char_class_[static_cast<unsigned char>(chr)]);
+    if (state == kNoMatch)
+      return false;
+  }
+  const uint8_t matches = name_states_[state].matches;
+  return (matches & kPositive) != 0 && (matches & kNegative) == 0;
+}
+
+// Adds the states of `pattern`, sharing those of the patterns added before
+// that start the same way.
+void TestFilter::AddPattern(const std::string& pattern, const Match& match) {
+  int32_t state = 0;
+  for (std::size_t i = 0; i < pattern.size(); ++i) {
+    int32_t next = kUnknown;
+    if (pattern[i] == '*') {
+      // "**" matches what '*' does.
+      if (i > 0 && pattern[i - 1] == '*')
+        continue;
+      next = pattern_states_[state].on_star;
+    } else if (pattern[i] == '?') {
+      next = pattern_states_[state].on_any_char;
+    } else {
+      int32_t& char_class = char_class_[static_cast<unsigned char>(pattern[i])];
+      if (char_class == 0) {
+        char_class = static_cast<int32_t>(class_char_.size());
+        class_char_.push_back(pattern[i]);
+      }
+      const auto found = pattern_states_[state].on_char.find(pattern[i]);
+      if (found != pattern_states_[state].on_char.end())
+        next = found->second;
+    }
+    if (next == kUnknown) {
+      next = static_cast<int32_t>(pattern_states_.size());
+      pattern_states_.emplace_back();
+      if (pattern[i] == '*') {
+        pattern_states_[next].loops = true;
+        pattern_states_[state].on_star = next;
+      } else if (pattern[i] == '?') {
+        pattern_states_[state].on_any_char = next;
+      } else {
+        pattern_states_[state].on_char[pattern[i]] = next;
+      }
+    }
+    state = next;
+  }
+  pattern_states_[state].matches |= match;
+}
+
+// Adds `state` to `states` together with the states it enters without input.
+void TestFilter::AddClosure(const int32_t& state,
+                            std::vector<int32_t>* states) const {
+  states->push_back(state);
+  if (pattern_states_[state].on_star != kUnknown)
+    AddClosure(pattern_states_[state].on_star, states);
+}
+
+// Returns the deterministic state of the set `pattern_states`, adding it if it
+// is new.
+int32_t TestFilter::GetNameState(std::vector<int32_t> pattern_states) {
+  std::sort(pattern_states.begin(), pattern_states.end());
+  pattern_states.erase(
+      std::unique(pattern_states.begin(), pattern_states.end()),
+      pattern_states.end());
+  const auto found = name_state_ids_.find(pattern_states);
+  if (found != name_state_ids_.end())
+    return found->second;
+
+  const int32_t id = static_cast<int32_t>(name_states_.size());
+  NameState name_state;
+  for (const int32_t& state : pattern_states)
+    name_state.matches |= pattern_states_[state].matches;
+  // Nothing leaves the state of no pattern.
+  name_state.next.assign(class_char_.size(),
+                         pattern_states.empty() ? kNoMatch : kUnknown);
+  name_state.pattern_states = pattern_states;
+  name_states_.push_back(name_state);
+  name_state_ids_.emplace(std::move(pattern_states), id);
+  return id;
+}
+
+// Returns the deterministic state `name_state` goes to on a character of
+// `char_class`, computing it the first time.
+int32_t TestFilter::Step(const int32_t& name_state,
+                         const int32_t& char_class) {
+  const int32_t known = name_states_[name_state].next[char_class];
+  if (known != kUnknown)
+    return known;
+
+  std::vector<int32_t> next_states;
+  for (const int32_t& state : name_states_[name_state].pattern_states) {
+    const PatternState& pattern_state = pattern_states_[state];
+    const auto on_char = pattern_state.on_char.find(class_char_[char_class]);
+    if (char_class != 0 && on_char != pattern_state.on_char.end())
+      AddClosure(on_char->second, &next_states);
+    if (pattern_state.on_any_char != kUnknown)
+      AddClosure(pattern_state.on_any_char, &next_states);
+    if (pattern_state.loops)
+      AddClosure(state, &next_states);
+  }
+  const int32_t next = GetNameState(std::move(next_states));
+  name_states_[name_state].next[char_class] = next;
+  return next;
+}
+
+// Drops the deterministic states, keeping only the state of no pattern and the
+// start state.
+void TestFilter::Reset() {
+  name_states_.clear();
+  name_state_ids_.clear();
+  GetNameState({});
+  std::vector<int32_t> start_states;
+  AddClosure(0, &start_states);
+  start_ = GetNameState(std::move(start_states));
+}
+}  // namespace internal
+}  // namespace xtest
@@ -0,0 +1,167 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/xtest-history.hh"
+
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "internal/xtest-port-arch.hh"
+#include "internal/xtest-port.hh"
+#include "xtest-registrar.hh"
+
+namespace xtest {
+namespace internal {
+// Weight of the latest elapsed time of a test in its moving average.
+static constexpr double kHistoryWeight = 0.3;
+
+// Returns the full name "suite_name.test_name" of `test`.
+static std::string GetFullTestName(const TestRegistrar* test) {
+  return std::string(test->suite_name_) + '.' + test->test_name_;
+}
+
+// Reads the history kept in the file at `path`, replacing the current one.
+bool TestHistory::Load(const std::string& path) {
+  entries_.clear();
+  total_mean_time_ = 0.0;
+  std::FILE* const file = std::fopen(path.c_str(), "r");
+  if (file == nullptr)
+    return errno == ENOENT;
+
+  std::string line;
+  int32_t c;
+  while ((c = std::fgetc(file)) != EOF) {
+    if (c != '\n') {
+      line.push_back(static_cast<char>(c));
+      continue;
+    }
+    const std::size_t name_end = line.find(' ');
+    if (name_end != std::string::npos && name_end > 0) {
+      const char* const fields = line.c_str() + name_end;
+      char* runs_end = nullptr;
+      char* time_end = nullptr;
+      char* rate_end = nullptr;
+      char* recency_end = nullptr;
+      TestHistoryEntry entry;
+      entry.runs = static_cast<uint32_t>(std::strtoul(fields, &runs_end, 10));
+      entry.mean_time = std::strtod(runs_end, &time_end);
+      entry.failure_rate = std::strtod(time_end, &rate_end);
+      entry.runs_since_failure =
+          static_cast<uint32_t>(std::strtoul(rate_end, &recency_end, 10));
+      if (rate_end == time_end || recency_end == rate_end) {
+        // Written before failures were kept; assume the test never failed.
+        entry.failure_rate = 0.0;
+        entry.runs_since_failure = entry.runs;
+      }
+      // Lines that do not parse, e.g., one cut short, are left out.
+      if (runs_end != fields && time_end != runs_end && entry.runs > 0 &&
+          std::isfinite(entry.mean_time) && entry.mean_time >= 0.0 &&
+          std::isfinite(entry.failure_rate) && entry.failure_rate >= 0.0) {
+        entries_[line.substr(0, name_end)] = entry;
+        total_mean_time_ += entry.mean_time;
+      }
+    }
+    line.clear();
+  }
+  const bool read_error = std::ferror(file) != 0;
+  std::fclose(file);
+  return !read_error;
+}
+
+// Writes the history to the file at `path`.
+bool TestHistory::Save(const std::string& path) const {
+  const std::string temp_path = path + ".tmp";
+  std::FILE* const file = std::fopen(temp_path.c_str(), "w");
+  if (file == nullptr)
+    return false;
+  for (const auto& entry : entries_) {
+    std::fprintf(file, "%s %u %.2f %.4f %u\n", entry.first.c_str(),
+                 entry.second.runs, entry.second.mean_time,
+                 entry.second.failure_rate, entry.second.runs_since_failure);
+  }
+  const bool write_error = std::ferror(file) != 0;
+  if (std::fclose(file) != 0 || write_error) {
+    std::remove(temp_path.c_str());
+    return false;
+  }
+#if XTEST_OS_WINDOWS
+  // `rename()` does not replace an existing file on Windows.
+  std::remove(path.c_str());
+#endif
+  return std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+// Adds the elapsed time and the result of `test` to its history.
+void TestHistory::Record(const TestRegistrar* test) {
+  TestHistoryEntry& entry = entries_[GetFullTestName(test)];
+  const double elapsed_time = static_cast<double>(test->elapsed_time_);
+  const bool failed = test->test_result_ == TestResult::FAILED;
+  total_mean_time_ -= entry.mean_time;
+  if (entry.runs == 0) {
+    entry.mean_time = elapsed_time;
+    entry.failure_rate = failed ? 1.0 : 0.0;
+  } else {
+    entry.mean_time += kHistoryWeight * (elapsed_time - entry.mean_time);
+    entry.failure_rate +=
+        kHistoryWeight * ((failed ? 1.0 : 0.0) - entry.failure_rate);
+  }
+  ++entry.runs;
+  entry.runs_since_failure = failed ? 0 : entry.runs_since_failure + 1;
+  total_mean_time_ += entry.mean_time;
+}
+
+// Returns the elapsed time `test` is expected to take in milliseconds.
+TimeInMillis TestHistory::ExpectedTime(const TestRegistrar* test) const {
+  if (entries_.empty())
+    return 0;
+  const auto entry = entries_.find(GetFullTestName(test));
+  const double mean_time = entry == entries_.end()
+                               ? total_mean_time_ / entries_.size()
+                               : entry->second.mean_time;
+  return static_cast<TimeInMillis>(std::llround(mean_time));
+}
+
+// Returns how likely `test` is to fail, for running the likeliest failures
+// first.
+double TestHistory::FailurePriority(const TestRegistrar* test) const {
+  const auto entry = entries_.find(GetFullTestName(test));
+  if (entry == entries_.end())
+    return 3.0;  // Above the 2.0 of a test that failed on every run.
+  double priority = entry->second.failure_rate;
+  if (entry->second.runs_since_failure < entry->second.runs)
+    priority += 1.0 / (1.0 + entry->second.runs_since_failure);
+  return priority;
+}
+}  // namespace internal
+}  // namespace xtest
@@ -0,0 +1,1038 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/xtest-isolation.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "internal/xtest-port-arch.hh"
+
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "internal/xtest-cancellation.hh"
+#include "internal/xtest-port.hh"
+#include "internal/xtest-printers.hh"
+#include "internal/xtest-scheduler.hh"
+#include "internal/xtest-tempdir.hh"
+#include "internal/xtest-watchdog.hh"
+#include "xtest-assertions.hh"
+#include "xtest-message.hh"
+#include "xtest-registrar.hh"
+
+namespace xtest {
+namespace internal {
+// Returns a human readable description of a `waitpid()` status, e.g.,
+// "killed by signal 11 (Segmentation fault)".
+std::string DescribeExitStatus(const int32_t& status) {
+#if XTEST_OS_WINDOWS
+  return "exited with code " + StreamableToString(status);
+#else
+  if (WIFSIGNALED(status)) {
+    return "killed by signal " + StreamableToString(WTERMSIG(status)) + " (" +
+           strsignal(WTERMSIG(status)) + ")";
+  }
+  if (WIFEXITED(status))
+    return "exited with code " + StreamableToString(WEXITSTATUS(status));
+  return "terminated with status " + StreamableToString(status);
+#endif
+}
+
+// Returns the length of the shortest prefix of a sequence of `num_tests` tests
+// after which a test fails.
+std::size_t FindShortestFailingPrefix(
+    const std::size_t& num_tests,
+    const std::function<bool(std::size_t length)>& fails_after) {
+  // The test passes after the first `passing` tests and fails after the first
+  // `failing` ones.
+  std::size_t passing = 0;
+  std::size_t failing = num_tests;
+  while (failing - passing > 1) {
+    const std::size_t length = passing + (failing - passing) / 2;
+    if (fails_after(length))
+      failing = length;
+    else
+      passing = length;
+  }
+  return failing;
+}
+
+#if XTEST_OS_WINDOWS
+// Runs `tests` in order with `run_test` in a child process forked from the
+// calling process.
+//
+// There is no `fork()` on Windows, so no test is run.
+ChildRunResult RunTestsInChildProcess(
+    const std::vector<TestRegistrar*>& /* tests */, TestRunner /* run_test */) {
+  return ChildRunResult::kNotReached;
+}
+
+// Marks `test`, which let a `std::bad_alloc` out, as `FAILED` and says that it
+// ran out of memory.
+void ReportAllocationFailure(TestRegistrar* test) {
+  test->test_result_ = TestResult::FAILED;
+  ++XTEST_GLOBAL_INSTANCE_GET_(failure_count);
+  PrettyAssertionResultPrinter::OnTestAssertionStart(test);
+  StreamPrintf(stderr,
+               "error: %s.%s ran out of memory: an allocation failed with "
+               "std::bad_alloc\n",
+               test->suite_name_, test->test_name_);
+  PrettyAssertionResultPrinter::OnTestAssertionEnd(test, test->elapsed_time_);
+}
+
+// Runs the tests in `plan` with `run_test` in worker processes forked from the
+// calling process.
+//
+// There is no `fork()` on Windows, so the tests are run on worker threads.
+void RunTestPlanInProcesses(const TestPlan& plan,
+                            const WorkerPoolOptions& options,
+                            TestRunner run_test,
+                            TestCompletionListener on_test_completed) {
+  XTEST_LOG_(WARNING) << "Process isolation is not supported on this "
+                         "platform; running the tests on worker threads.";
+  RunTestPlanInParallel(plan, options.num_workers, run_test,
+                        on_test_completed, options.cpu_affinity);
+}
+#else
+// Largest number of tests handed out to a worker at once.  Batches shrink as
+// the run nears its end so that the workers finish at about the same time.
+static const std::size_t kMaxBatchSize = 64;
+
+// Header of the record a worker sends back for every test it has run.  It is
+// followed by `num_chunks` chunks of captured console output, each one made up
+// of an `OutputChunkHeader` and `size` bytes of text.
+struct TestResultRecord {
+  uint32_t index;          // Index of the test in the flattened plan.
+  TestResult result;       // Result of the test.
+  TimeInMillis elapsed;    // Elapsed time in milliseconds.
+  uint64_t failure_count;  // Number of assertions that failed in the test.
+  uint32_t num_chunks;     // Number of chunks of captured output.
+  int32_t cpu;             // CPU the test started on, or `-1`.
+
+  // True if the worker exits after this test, e.g., because the test went over
+  // `WorkerPoolOptions::max_rss`, leaving the rest of its batch to others.
+  bool worker_exits;
+};
+
+struct OutputChunkHeader {
+  int32_t fd;     // `STDOUT_FILENO` or `STDERR_FILENO`.
+  uint32_t size;  // Size of the text in bytes.
+};
+
+// The parent's view of a worker process.
+struct WorkerProcess {
+  pid_t pid = -1;
+  int32_t to_worker = -1;    // Write end of the pipe the batches are sent on.
+  int32_t from_worker = -1;  // Read end of the pipe the results come back on.
+
+  // Tests handed out to the worker that it has not reported back yet.  The
+  // front one is the test the worker is running.
+  std::deque<std::size_t> batch;
+
+  // Measures the time since the worker reported its last result, which is the
+  // time the test at the front of `batch` has been running for.
+  Timer since_last_result;
+
+  // True once the worker said it exits after the result it sent last.
+  bool exiting = false;
+
+  // Peak resident set size in bytes of the test at the front of `batch` if the
+  // worker was killed for going over `WorkerPoolOptions::max_rss`, else `0`.
+  uint64_t peak_rss = 0;
+
+  // Files the worker's `stdout` and `stderr` write to, so that what a test
+  // prints behind the back of `StreamPrintf()` is captured too, see
+  // `TakeRawOutput()`; `-1` if they could not be created.
+  int32_t output_files[2] = {-1, -1};
+};
+
+// Writes `size` bytes to `fd` retrying on interrupts and short writes.
+static bool WriteFully(const int32_t& fd, const void* data, std::size_t size) {
+  const char* bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    const ssize_t written = write(fd, bytes, size);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+    bytes += written;
+    size -= static_cast<std::size_t>(written);
+  }
+  return true;
+}
+
+// Reads exactly `size` bytes from `fd` retrying on interrupts and short reads.
+// Returns false on end of file or error.
+static bool ReadFully(const int32_t& fd, void* data, std::size_t size) {
+  char* bytes = static_cast<char*>(data);
+  while (size > 0) {
+    const ssize_t bytes_read = read(fd, bytes, size);
+    if (bytes_read < 0 && errno == EINTR)
+      continue;
+    if (bytes_read <= 0)
+      return false;
+    bytes += bytes_read;
+    size -= static_cast<std::size_t>(bytes_read);
+  }
+  return true;
+}
+
+// Creates an unlinked temporary file for a worker's `stdout` or `stderr` to
+// write to.  Returns `-1` on failure.
+static int32_t CreateOutputFile() {
+  std::string path = GetTempDirBase() + "/xtest-output-XXXXXX";
+  const int32_t file = mkstemp(&path[0]);
+  if (file >= 0)
+    unlink(path.c_str());
+  return file;
+}
+
+// Appends what was written to `file` since it was last emptied to `output`, as
+// printed on `stream`, and empties it.
+static void TakeOutputFile(const int32_t& file, FILE* stream,
+                           OutputCapture* output) {
+  std::string text;
+  char buffer[4096];
+  off_t offset = 0;
+  for (;;) {
+    const ssize_t size = pread(file, buffer, sizeof(buffer), offset);
+    if (size < 0 && errno == EINTR)
+      continue;
+    if (size <= 0)
+      break;
+    text.append(buffer, static_cast<std::size_t>(size));
+    offset += size;
+  }
+  if (ftruncate(file, 0) == 0)
+    lseek(file, 0, SEEK_SET);
+  if (!text.empty())
+    output->Append(stream, text);
+}
+
+// Takes what the test running on the calling worker wrote straight to its
+// `stdout` and `stderr`, e.g., with `printf()` or `std::cout`, into `output`.
+// `output_files` are the files the streams of the worker write to.
+static void TakeRawOutput(const int32_t* output_files, OutputCapture* output) {
+  std::fflush(stdout);
+  std::fflush(stderr);
+  TakeOutputFile(output_files[0], stdout, output);
+  TakeOutputFile(output_files[1], stderr, output);
+}
+
+// Interval in milliseconds at which the parent polls the resident set size of
+// the busy workers when there is a `WorkerPoolOptions::max_rss`.
+static const TimeInMillis kMemoryPollInterval = 50;
+
+// True once an allocation failed in a worker capped by `LimitWorkerMemory()`.
+static bool worker_allocation_failed = false;
+
+// True once the failed allocation was reported by `ReportAllocationFailure()`.
+static bool worker_allocation_reported = false;
+
+// Memory limit in bytes of the calling worker, see `LimitWorkerMemory()`; `0`
+// if it has none.
+static uint64_t worker_max_rss = 0;
+
+// Address space in bytes the calling worker had left when an allocation last
+// failed, which the failed request was larger than; `0` if unknown.
+static uint64_t worker_address_space_left = 0;
+
+// Returns the peak resident set size in bytes of the process `pid` since it
+// was last reset by `ResetPeakRss()`, or `0` if it cannot be told.
+static uint64_t GetPeakRss(const pid_t& pid) {
+#if XTEST_OS_LINUX
+  char path[64];
+  std::snprintf(path, sizeof(path), "/proc/%d/status",
+                static_cast<int32_t>(pid));
+  std::FILE* const status = std::fopen(path, "r");
+  if (status == nullptr)
+    return 0;
+  uint64_t peak_rss = 0;
+  char line[256];
+  while (std::fgets(line, sizeof(line), status) != nullptr) {
+    unsigned long long kilobytes = 0;  // NOLINT
+    if (std::sscanf(line, "VmHWM: %llu kB", &kilobytes) == 1) {
+      peak_rss = static_cast<uint64_t>(kilobytes) * 1024;
+      break;
+    }
+  }
+  std::fclose(status);
+  return peak_rss;
+#else
+  // Only the calling process can be measured, and its peak cannot be reset.
+  if (pid != getpid())
+    return 0;
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+  return static_cast<uint64_t>(usage.ru_maxrss);  // In bytes on macOS.
+#endif
+}
+
+// Resets the peak resident set size of the calling process, where supported,
+// so that it is measured per test.
+static void ResetPeakRss() {
+#if XTEST_OS_LINUX
+  const int32_t fd = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+  // Writing "5" resets the peak resident set size, see proc(5).
+  if (write(fd, "5", 1) < 0) {
+    // Then the peak is that of the worker's lifetime so far.
+  }
+  close(fd);
+#endif
+}
+
+// Returns the address space in bytes the calling process may still map under
+// its `RLIMIT_AS`, or `0` if it cannot be told.  Reads with plain system calls:
+// it is called when there may be no memory left for stdio.
+static uint64_t GetAddressSpaceLeft() {
+#if XTEST_OS_LINUX
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_AS, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY)
+    return 0;
+  const int32_t statm = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+  if (statm < 0)
+    return 0;
+  char buffer[64];
+  const ssize_t size = read(statm, buffer, sizeof(buffer) - 1);
+  close(statm);
+  if (size <= 0)
+    return 0;
+  buffer[size] = '\0';
+  const uint64_t mapped = std::strtoull(buffer, nullptr, 10) *
+                          static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  const uint64_t limit_bytes = static_cast<uint64_t>(limit.rlim_cur);
+  return mapped < limit_bytes ? limit_bytes - mapped : 0;
+#else
+  return 0;
+#endif
+}
+
+// New handler of a worker capped by `LimitWorkerMemory()`: remembers that the
+// test ran out of memory, and how much room the allocation did not fit in, and
+// fails the allocation.
+static void OnAllocationFailure() {
+  worker_allocation_failed = true;
+  worker_address_space_left = GetAddressSpaceLeft();
+  throw std::bad_alloc();
+}
+
+// Returns the end of the message saying that a test ran out of memory in a
+// worker capped at `max_rss` bytes, with the size of the allocation that failed
+// as far as it can be told.
+static std::string DescribeAllocationFailure(const uint64_t& max_rss) {
+  std::string description =
+      "ran out of memory under the limit of " + FormatByteSize(max_rss) +
+      ": an allocation ";
+  if (worker_address_space_left > 0)
+    description +=
+        "of more than " + FormatByteSize(worker_address_space_left) + " ";
+  return description + "failed";
+}
+
+// Caps the address space of the calling worker at what it has mapped now plus
+// twice `max_rss` bytes, so that a test allocating far more than it may fails
+// right away instead of pushing the machine into swap before it is noticed.
+// A test that merely goes over `max_rss` is left to the RSS checks, which can
+// tell by how much.
+static void LimitWorkerMemory(const uint64_t& max_rss) {
+#if XTEST_OS_LINUX
+  std::FILE* const statm = std::fopen("/proc/self/statm", "r");
+  if (statm != nullptr) {
+    unsigned long long pages = 0;  // NOLINT
+    if (std::fscanf(statm, "%llu", &pages) == 1) {
+      struct rlimit limit;
+      if (getrlimit(RLIMIT_AS, &limit) == 0) {
+        rlim_t address_space = static_cast<rlim_t>(
+            pages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) +
+            2 * max_rss);
+        if (limit.rlim_max != RLIM_INFINITY && address_space > limit.rlim_max)
+          address_space = limit.rlim_max;
+        limit.rlim_cur = address_space;
+        setrlimit(RLIMIT_AS, &limit);
+      }
+    }
+    std::fclose(statm);
+  }
+#endif
+  worker_max_rss = max_rss;
+  std::set_new_handler(OnAllocationFailure);
+}
+
+// Marks `test`, which went over the `max_rss` bytes it may use with a peak
+// resident set size of `peak_rss` bytes, or failed an allocation under that
+// limit, as `FAILED` and says so in its output.
+static void ReportOutOfMemory(TestRegistrar* test, const uint64_t& peak_rss,
+                              const uint64_t& max_rss) {
+  test->test_result_ = TestResult::FAILED;
+  ++XTEST_GLOBAL_INSTANCE_GET_(failure_count);
+  PrettyAssertionResultPrinter::OnTestAssertionStart(test);
+  if (worker_allocation_failed)
+    StreamPrintf(stderr, "error: %s.%s %s\n", test->suite_name_,
+                 test->test_name_, DescribeAllocationFailure(max_rss).c_str());
+  else
+    StreamPrintf(stderr,
+                 "error: %s.%s went over the memory limit of %s with a peak "
+                 "RSS of %s\n",
+                 test->suite_name_, test->test_name_,
+                 FormatByteSize(max_rss).c_str(),
+                 FormatByteSize(peak_rss).c_str());
+  PrettyAssertionResultPrinter::OnTestAssertionEnd(test, test->elapsed_time_);
+}
+
+// Marks `test`, which let a `std::bad_alloc` out, as `FAILED` and says that it
+// ran out of memory, under the limit of the worker if it is one.
+void ReportAllocationFailure(TestRegistrar* test) {
+  test->test_result_ = TestResult::FAILED;
+  ++XTEST_GLOBAL_INSTANCE_GET_(failure_count);
+  PrettyAssertionResultPrinter::OnTestAssertionStart(test);
+  if (worker_max_rss > 0 && worker_allocation_failed) {
+    StreamPrintf(stderr, "error: %s.%s %s\n", test->suite_name_,
+                 test->test_name_,
+                 DescribeAllocationFailure(worker_max_rss).c_str());
+    worker_allocation_reported = true;
+  } else {
+    StreamPrintf(stderr,
+                 "error: %s.%s ran out of memory: an allocation failed with "
+                 "std::bad_alloc\n",
+                 test->suite_name_, test->test_name_);
+  }
+  PrettyAssertionResultPrinter::OnTestAssertionEnd(test, test->elapsed_time_);
+}
+
+// Body of a worker process: runs the batches of tests sent by the parent until
+// it sends an empty batch or closes the pipe, or after the first batch with
+// `options.fork_per_batch`.  A test that goes over `options.max_rss` is the
+// last one the worker runs.  Unless `output_files` is null the streams of the
+// worker write to those files, whose text is sent back with the output of the
+// test that wrote it.
+static void WorkerMain(const int32_t& from_parent, const int32_t& to_parent,
+                       const std::vector<TestRegistrar*>& tests,
+                       TestRunner run_test, const WorkerPoolOptions& options,
+                       const int32_t* output_files) {
+  if (options.max_rss > 0)
+    LimitWorkerMemory(options.max_rss);
+  for (bool first_batch = true; first_batch || !options.fork_per_batch;
+       first_batch = false) {
+    uint32_t count = 0;
+    if (!ReadFully(from_parent, &count, sizeof(count)) || count == 0)
+      return;
+    std::vector<uint32_t> batch(count);
+    if (!ReadFully(from_parent, batch.data(), count * sizeof(uint32_t)))
+      return;
+
+    for (const uint32_t& index : batch) {
+      OutputCapture output;
+      if (output_files != nullptr)
+        output.set_before_append([output_files, &output]() {
+          TakeRawOutput(output_files, &output);
+        });
+      const uint64_t failures_before =
+          XTEST_GLOBAL_INSTANCE_GET_(failure_count);
+      if (options.max_rss > 0) {
+        ResetPeakRss();
+        worker_allocation_failed = worker_allocation_reported = false;
+      }
+      bool over_memory_limit = false;
+      // The tests of a cancelled run are sent back without a result.
+      if (!IsTestRunCancelled()) {
+        ScopedOutputCapture capture(&output);
+        run_test(tests[index]);
+        if (options.max_rss > 0) {
+          const uint64_t peak_rss = GetPeakRss(getpid());
+          over_memory_limit =
+              worker_allocation_failed || peak_rss > options.max_rss;
+          if (over_memory_limit && !worker_allocation_reported)
+            ReportOutOfMemory(tests[index], peak_rss, options.max_rss);
+        }
+      }
+      if (output_files != nullptr)
+        TakeRawOutput(output_files, &output);
+
+      TestResultRecord record;
+      record.index = index;
+      record.result = tests[index]->test_result_;
+      record.elapsed = tests[index]->elapsed_time_;
+      record.cpu = tests[index]->cpu_;
+      record.failure_count =
+          XTEST_GLOBAL_INSTANCE_GET_(failure_count) - failures_before;
+      record.num_chunks = static_cast<uint32_t>(output.chunks().size());
+      record.worker_exits = over_memory_limit;
+      if (!WriteFully(to_parent, &record, sizeof(record)))
+        return;
+      for (const OutputCapture::Chunk& chunk : output.chunks()) {
+        OutputChunkHeader header;
+        header.fd = chunk.first == stderr ? STDERR_FILENO : STDOUT_FILENO;
+        header.size = static_cast<uint32_t>(chunk.second.size());
+        if (!WriteFully(to_parent, &header, sizeof(header)) ||
+            !WriteFully(to_parent, chunk.second.data(), chunk.second.size()))
+          return;
+      }
+      // Whatever the test left behind would count against the next one.
+      if (over_memory_limit)
+        return;
+    }
+  }
+}
+
+// Closes the parent's ends of the worker's pipes.
+static void ClosePipes(WorkerProcess* worker) {
+  if (worker->to_worker >= 0)
+    close(worker->to_worker);
+  if (worker->from_worker >= 0)
+    close(worker->from_worker);
+  worker->to_worker = worker->from_worker = -1;
+}
+
+// Closes the output files of the worker.
+static void CloseOutputFiles(WorkerProcess* worker) {
+  for (int32_t& file : worker->output_files) {
+    if (file >= 0)
+      close(file);
+    file = -1;
+  }
+}
+
+// Forks a new worker process and connects it to the parent with a pair of
+// pipes.  Returns false if the worker could not be started.
+static bool SpawnWorker(const std::vector<TestRegistrar*>& tests,
+                        TestRunner run_test, const WorkerPoolOptions& options,
+                        std::vector<WorkerProcess>* workers,
+                        WorkerProcess* worker) {
+  int32_t batch_pipe[2];
+  int32_t result_pipe[2];
+  CloseOutputFiles(worker);
+  if (pipe(batch_pipe) != 0)
+    return false;
+  if (pipe(result_pipe) != 0) {
+    close(batch_pipe[0]);
+    close(batch_pipe[1]);
+    return false;
+  }
+
+  // Without the files the output of the worker goes straight to the console.
+  worker->output_files[0] = CreateOutputFile();
+  worker->output_files[1] = CreateOutputFile();
+  const bool raw_output =
+      worker->output_files[0] >= 0 && worker->output_files[1] >= 0;
+
+  // Anything left in the stdio buffers would otherwise be printed twice.
+  std::fflush(stdout);
+  std::fflush(stderr);
+  const pid_t pid = fork();
+  if (pid < 0) {
+    close(batch_pipe[0]);
+    close(batch_pipe[1]);
+    close(result_pipe[0]);
+    close(result_pipe[1]);
+    CloseOutputFiles(worker);
+    return false;
+  }
+
+  if (pid == 0) {
+    if (raw_output) {
+      KeepStdoutTtyState();
+      dup2(worker->output_files[0], STDOUT_FILENO);
+      dup2(worker->output_files[1], STDERR_FILENO);
+    }
+    // The other workers' pipes are inherited too; close them so that the
+    // other workers see the end of file when the parent goes away.
+    for (WorkerProcess& other : *workers) {
+      ClosePipes(&other);
+      if (&other != worker)
+        CloseOutputFiles(&other);
+    }
+    close(batch_pipe[1]);
+    close(result_pipe[0]);
+    if (options.cpu_affinity != nullptr)
+      options.cpu_affinity->PinWorker(
+          static_cast<std::size_t>(worker - workers->data()));
+    WorkerMain(batch_pipe[0], result_pipe[1], tests, run_test, options,
+               raw_output ? worker->output_files : nullptr);
+    std::fflush(stdout);
+    std::fflush(stderr);
+    _exit(EXIT_SUCCESS);
+  }
+
+  close(batch_pipe[0]);
+  close(result_pipe[1]);
+  worker->pid = pid;
+  worker->to_worker = batch_pipe[1];
+  worker->from_worker = result_pipe[0];
+  worker->batch.clear();
+  worker->exiting = false;
+  worker->peak_rss = 0;
+  return true;
+}
+
+// Returns the number of tests at the front of `pending` to hand out to a
+// worker at once when the batch size is not fixed: about half of a fair share
+// of the remaining expected time, see `TestRegistrar::expected_time_`, where
+// every test counts as at least a millisecond.
+static std::size_t GetGuidedBatchSize(const std::vector<TestRegistrar*>& tests,
+                                      const std::size_t& num_workers,
+                                      const std::deque<std::size_t>& pending) {
+  TimeInMillis remaining_time = 0;
+  for (const std::size_t& index : pending)
+    remaining_time += std::max<TimeInMillis>(tests[index]->expected_time_, 1);
+  const TimeInMillis share =
+      remaining_time / static_cast<TimeInMillis>(2 * num_workers);
+
+  std::size_t batch_size = 0;
+  TimeInMillis batch_time = 0;
+  while (batch_size < pending.size() && batch_size < kMaxBatchSize) {
+    batch_time +=
+        std::max<TimeInMillis>(tests[pending[batch_size]]->expected_time_, 1);
+    if (batch_size > 0 && batch_time > share)
+      break;
+    ++batch_size;
+  }
+  return batch_size;
+}
+
+// Hands out the next batch of `pending` tests to `worker`, number
+// `worker_index`, skipping the tests whose resources another worker holds, see
+// `ResourceLocks`.  The worker is left idle if there is no test it can claim.
+// Returns false if the batch could not be sent, in which case the tests are put
+// back.
+static bool DispatchBatch(const std::vector<TestRegistrar*>& tests,
+                          const WorkerPoolOptions& options,
+                          const std::size_t& num_workers,
+                          std::deque<std::size_t>* pending,
+                          ResourceLocks* resource_locks,
+                          const std::size_t& worker_index,
+                          WorkerProcess* worker) {
+  const std::size_t batch_size =
+      options.batch_size != 0
+          ? options.batch_size
+          : GetGuidedBatchSize(tests, num_workers, *pending);
+
+  std::vector<uint32_t> batch;
+  for (auto it = pending->begin();
+       it != pending->end() && batch.size() < batch_size;) {
+    if (!resource_locks->TryClaim(*it, worker_index)) {
+      ++it;
+      continue;
+    }
+    batch.push_back(static_cast<uint32_t>(*it));
+    it = pending->erase(it);
+  }
+  // An empty batch would tell the worker to exit.
+  if (batch.empty())
+    return true;
+
+  const uint32_t count = static_cast<uint32_t>(batch.size());
+  if (!WriteFully(worker->to_worker, &count, sizeof(count)) ||
+      !WriteFully(worker->to_worker, batch.data(),
+                  batch.size() * sizeof(uint32_t))) {
+    for (auto it = batch.rbegin(); it != batch.rend(); ++it) {
+      resource_locks->Release(*it);
+      pending->push_front(*it);
+    }
+    return false;
+  }
+  worker->batch.assign(batch.begin(), batch.end());
+  worker->since_last_result = Timer();
+  return true;
+}
+
+// Reads the next result record from `worker` and hands it to `printer`,
+// releasing the resources of the test.  Returns false if the worker went away
+// before sending a complete record.
+static bool ReceiveResult(WorkerProcess* worker, OrderedResultPrinter* printer,
+                          ResourceLocks* resource_locks) {
+  TestResultRecord record;
+  if (!ReadFully(worker->from_worker, &record, sizeof(record)))
+    return false;
+  if (record.index >= printer->tests().size())
+    return false;
+
+  OutputCapture* output = printer->output(record.index);
+  for (uint32_t i = 0; i < record.num_chunks; ++i) {
+    OutputChunkHeader header;
+    if (!ReadFully(worker->from_worker, &header, sizeof(header)))
+      return false;
+    std::string text(header.size, '\0');
+    if (header.size > 0 &&
+        !ReadFully(worker->from_worker, &text[0], header.size))
+      return false;
+    output->Append(header.fd == STDERR_FILENO ? stderr : stdout, text);
+  }
+
+  TestRegistrar* const test = printer->tests()[record.index];
+  test->test_result_ = record.result;
+  test->elapsed_time_ = record.elapsed;
+  test->cpu_ = record.cpu;
+  XTEST_GLOBAL_INSTANCE_GET_(failure_count) += record.failure_count;
+  if (!worker->batch.empty())
+    worker->batch.pop_front();
+  worker->exiting = record.worker_exits;
+  worker->since_last_result = Timer();
+  resource_locks->Release(record.index);
+  printer->OnTestCompleted(record.index);
+  return true;
+}
+
+// Closes the pipes to `worker`, waits for it to exit and marks it as gone so
+// that a new worker is forked in its place.  Returns its wait status.
+static int32_t ReapWorker(WorkerProcess* worker) {
+  ClosePipes(worker);
+  int32_t status = 0;
+  while (waitpid(worker->pid, &status, 0) < 0 && errno == EINTR) {
+  }
+  worker->pid = -1;
+  return status;
+}
+
+// Returns the time the test at the front of `worker`'s batch may run for
+// before the worker is killed, or `0` if there is no limit.  The worker's own
+// watchdog is given the time to interrupt the test, or to give up on it, first.
+static TimeInMillis GetWorkerTimeLimit(const std::vector<TestRegistrar*>& tests,
+                                       const WorkerPoolOptions& options,
+                                       const WorkerProcess& worker) {
+  const TimeInMillis timeout =
+      GetTestTimeout(tests[worker.batch.front()], options.test_timeout);
+  return timeout > 0 ? timeout + 2 * kTimeoutGracePeriod : 0;
+}
+
+// Returns the time to wait for the busy `workers` before one of them is due to
+// be killed, in the form `poll()` takes it.
+static int32_t GetPollTimeout(const std::vector<TestRegistrar*>& tests,
+                              const WorkerPoolOptions& options,
+                              const std::vector<WorkerProcess*>& workers) {
+  TimeInMillis poll_timeout = -1;
+  for (WorkerProcess* const& worker : workers) {
+    const TimeInMillis limit = GetWorkerTimeLimit(tests, options, *worker);
+    if (limit == 0)
+      continue;
+    const TimeInMillis remaining =
+        std::max<TimeInMillis>(limit - worker->since_last_result.Elapsed(), 0);
+    if (poll_timeout < 0 || remaining < poll_timeout)
+      poll_timeout = remaining;
+  }
+  return static_cast<int32_t>(poll_timeout);
+}
+
+// Puts the tests of `worker`'s batch back in front of `pending` and releases
+// their resources.
+static void PutBackBatch(WorkerProcess* worker,
+                         std::deque<std::size_t>* pending,
+                         ResourceLocks* resource_locks) {
+  for (auto it = worker->batch.rbegin(); it != worker->batch.rend(); ++it) {
+    resource_locks->Release(*it);
+    pending->push_front(*it);
+  }
+  worker->batch.clear();
+}
+
+// Reaps a worker that went away.  The test it was running is marked as
+// `FAILED` and the rest of its batch is put back in front of `pending`.
+static void OnWorkerDied(WorkerProcess* worker, OrderedResultPrinter* printer,
+                         const WorkerPoolOptions& options,
+                         std::deque<std::size_t>* pending,
+                         ResourceLocks* resource_locks) {
+  const int32_t status = ReapWorker(worker);
+  if (worker->batch.empty())
+    return;
+
+  const std::size_t index = worker->batch.front();
+  worker->batch.pop_front();
+  TestRegistrar* const test = printer->tests()[index];
+  test->test_result_ = TestResult::FAILED;
+  test->elapsed_time_ = worker->since_last_result.Elapsed();
+  ++XTEST_GLOBAL_INSTANCE_GET_(failure_count);
+  {
+    // What the test printed through `StreamPrintf()` before the worker died is
+    // lost with it, so at least report which test took the worker down and
+    // how, after what it wrote straight to its streams.
+    OutputCapture* output = printer->output(index);
+    output->Clear();
+    ScopedOutputCapture capture(output);
+    PrettyAssertionResultPrinter::OnTestAssertionStart(test);
+    if (worker->output_files[0] >= 0 && worker->output_files[1] >= 0) {
+      TakeOutputFile(worker->output_files[0], stdout, output);
+      TakeOutputFile(worker->output_files[1], stderr, output);
+    }
+    const TimeInMillis timeout = GetTestTimeout(test, options.test_timeout);
+    if (worker->peak_rss > 0)
+      StreamPrintf(stderr,
+                   "error: Worker process running %s.%s went over the memory "
+                   "limit of %s with a peak RSS of %s and was killed\n",
+                   test->suite_name_, test->test_name_,
+                   FormatByteSize(options.max_rss).c_str(),
+                   FormatByteSize(worker->peak_rss).c_str());
+    else if (timeout > 0 && test->elapsed_time_ >= timeout)
+      StreamPrintf(stderr,
+                   "error: Worker process running %s.%s timed out after "
+                   "%" PRId64 " ms and %s\n",
+                   test->suite_name_, test->test_name_,
+                   static_cast<int64_t>(timeout),
+                   DescribeExitStatus(status).c_str());
+    else
+      StreamPrintf(stderr, "error: Worker process running %s.%s %s\n",
+                   test->suite_name_, test->test_name_,
+                   DescribeExitStatus(status).c_str());
+    PrettyAssertionResultPrinter::OnTestAssertionEnd(test, test->elapsed_time_);
+  }
+  resource_locks->Release(index);
+  printer->OnTestCompleted(index);
+  PutBackBatch(worker, pending, resource_locks);
+}
+
+// Reaps a worker that exits after the result it sent last, see
+// `TestResultRecord::worker_exits`, and puts the rest of its batch back in
+// front of `pending`.
+static void RetireWorker(WorkerProcess* worker,
+                         std::deque<std::size_t>* pending,
+                         ResourceLocks* resource_locks) {
+  ReapWorker(worker);
+  PutBackBatch(worker, pending, resource_locks);
+}
+
+// Runs `tests` in order with `run_test` in a child process forked from the
+// calling process, with their console output discarded, and returns how the
+// last of them did.
+ChildRunResult RunTestsInChildProcess(const std::vector<TestRegistrar*>& tests,
+                                      TestRunner run_test) {
+  if (tests.empty())
+    return ChildRunResult::kNotReached;
+  int32_t result_pipe[2];
+  if (pipe(result_pipe) != 0)
+    return ChildRunResult::kNotReached;
+
+  std::fflush(stdout);
+  std::fflush(stderr);
+  const pid_t pid = fork();
+  if (pid < 0) {
+    close(result_pipe[0]);
+    close(result_pipe[1]);
+    return ChildRunResult::kNotReached;
+  }
+
+  if (pid == 0) {
+    close(result_pipe[0]);
+    const int32_t null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) {
+      dup2(null_fd, STDOUT_FILENO);
+      dup2(null_fd, STDERR_FILENO);
+      close(null_fd);
+    }
+    // The child tells the parent when it gets to the last test, and then how
+    // that test did, so that dying in the last test and dying before it can
+    // be told apart.
+    for (std::size_t i = 0; i + 1 < tests.size(); ++i)
+      run_test(tests[i]);
+    const char reached = 'R';
+    WriteFully(result_pipe[1], &reached, sizeof(reached));
+    run_test(tests.back());
+    const char result =
+        tests.back()->test_result_ == TestResult::FAILED ? 'F' : 'P';
+    WriteFully(result_pipe[1], &result, sizeof(result));
+    _exit(EXIT_SUCCESS);
+  }
+
+  close(result_pipe[1]);
+  char report[2] = {'\0', '\0'};
+  std::size_t report_size = 0;
+  while (report_size < sizeof(report)) {
+    const ssize_t bytes_read = read(result_pipe[0], report + report_size,
+                                    sizeof(report) - report_size);
+    if (bytes_read < 0 && errno == EINTR)
+      continue;
+    if (bytes_read <= 0)
+      break;
+    report_size += static_cast<std::size_t>(bytes_read);
+  }
+  close(result_pipe[0]);
+  int32_t status = 0;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+  }
+
+  if (report_size == 0)
+    return ChildRunResult::kNotReached;
+  if (report_size == 1 || report[1] == 'F')
+    return ChildRunResult::kFailed;
+  return ChildRunResult::kPassed;
+}
+
+// Runs the tests in `plan` with `run_test` in worker processes forked from the
+// calling process.
+void RunTestPlanInProcesses(const TestPlan& plan,
+                            const WorkerPoolOptions& options,
+                            TestRunner run_test,
+                            TestCompletionListener on_test_completed) {
+  OrderedResultPrinter printer(plan, on_test_completed);
+  const std::vector<TestRegistrar*>& tests = printer.tests();
+  const std::vector<std::size_t> order = OrderTestsLongestFirst(tests);
+  std::deque<std::size_t> pending(order.begin(), order.end());
+
+  // A worker that dies while we write to it must not take the parent down.
+  void (*SavedSigPipeHandler)(int) = std::signal(SIGPIPE, SIG_IGN);
+
+  std::vector<WorkerProcess> workers(std::min(
+      std::max<std::size_t>(options.num_workers, 1),
+      std::max<std::size_t>(tests.size(), 1)));
+  ResourceLocks resource_locks(tests, options.num_workers);
+  bool can_spawn = true;
+  for (;;) {
+    // Start (or restart) workers and hand out work to the idle ones.
+    for (std::size_t worker_index = 0; worker_index < workers.size();
+         ++worker_index) {
+      WorkerProcess& worker = workers[worker_index];
+      if (pending.empty() || IsTestRunCancelled())
+        break;
+      if (!worker.batch.empty())
+        continue;
+      if (worker.pid < 0) {
+        if (!can_spawn)
+          continue;
+        if (!SpawnWorker(tests, run_test, options, &workers, &worker)) {
+          XTEST_LOG_(WARNING) << "Could not start a worker process: "
+                              << std::strerror(errno);
+          can_spawn = false;
+          continue;
+        }
+      }
+      if (!DispatchBatch(tests, options, workers.size(), &pending,
+                         &resource_locks, worker_index, &worker))
+        OnWorkerDied(&worker, &printer, options, &pending, &resource_locks);
+    }
+
+    std::vector<pollfd> fds;
+    std::vector<WorkerProcess*> busy_workers;
+    for (WorkerProcess& worker : workers) {
+      if (worker.pid < 0 || worker.batch.empty())
+        continue;
+      pollfd fd;
+      fd.fd = worker.from_worker;
+      fd.events = POLLIN;
+      fd.revents = 0;
+      fds.push_back(fd);
+      busy_workers.push_back(&worker);
+    }
+    if (fds.empty())
+      break;
+
+    int32_t poll_timeout = GetPollTimeout(tests, options, busy_workers);
+    if (options.max_rss > 0 &&
+        (poll_timeout < 0 || poll_timeout > kMemoryPollInterval))
+      poll_timeout = static_cast<int32_t>(kMemoryPollInterval);
+    if (poll(fds.data(), fds.size(), poll_timeout) < 0) {
+      if (errno == EINTR)
+        continue;
+      XTEST_LOG_(FATAL) << "poll() failed: " << std::strerror(errno);
+    }
+    for (std::size_t i = 0; i < fds.size(); ++i) {
+      WorkerProcess* const worker = busy_workers[i];
+      if (fds[i].revents == 0) {
+        // A worker stuck in a test that ran out of time is killed.
+        const TimeInMillis limit = GetWorkerTimeLimit(tests, options, *worker);
+        if (limit > 0 && worker->since_last_result.Elapsed() >= limit) {
+          kill(worker->pid, SIGKILL);
+          OnWorkerDied(worker, &printer, options, &pending, &resource_locks);
+          continue;
+        }
+        // So is one whose test goes over the memory limit before the worker
+        // gets to tell, e.g., while it is swapping.
+        const uint64_t peak_rss =
+            options.max_rss > 0 ? GetPeakRss(worker->pid) : 0;
+        if (peak_rss > options.max_rss) {
+          worker->peak_rss = peak_rss;
+          kill(worker->pid, SIGKILL);
+          OnWorkerDied(worker, &printer, options, &pending, &resource_locks);
+        }
+        continue;
+      }
+      if (!ReceiveResult(worker, &printer, &resource_locks))
+        OnWorkerDied(worker, &printer, options, &pending, &resource_locks);
+      else if (worker->exiting)
+        RetireWorker(worker, &pending, &resource_locks);
+      else if (options.fork_per_batch && worker->batch.empty())
+        ReapWorker(worker);  // It exits after its batch; fork a fresh one.
+    }
+  }
+
+  // A cancelled run completes the tests it did not hand out without running
+  // them.
+  if (IsTestRunCancelled()) {
+    for (const std::size_t& index : pending)
+      printer.OnTestCompleted(index);
+    pending.clear();
+  }
+
+  // Tests are left over only if no worker process could be started at all;
+  // run them here rather than not at all.
+  if (!pending.empty()) {
+    XTEST_LOG_(WARNING) << "No worker process left; running the remaining "
+                           "tests in-process.";
+    for (const std::size_t& index : pending) {
+      {
+        ScopedOutputCapture capture(printer.output(index));
+        run_test(tests[index]);
+      }
+      printer.OnTestCompleted(index);
+    }
+  }
+
+  // An empty batch tells the workers to exit.
+  for (WorkerProcess& worker : workers) {
+    if (worker.pid < 0)
+      continue;
+    const uint32_t count = 0;
+    WriteFully(worker.to_worker, &count, sizeof(count));
+    ReapWorker(&worker);
+  }
+  for (WorkerProcess& worker : workers)
+    CloseOutputFiles(&worker);
+  std::signal(SIGPIPE, SavedSigPipeHandler);
+}
+#endif  // XTEST_OS_WINDOWS
+}  // namespace internal
+}  // namespace xtest
@@ -0,0 +1,254 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/xtest-journal.hh"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "internal/xtest-port-arch.hh"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "internal/xtest-port.hh"
+#include "xtest-registrar.hh"
+
+namespace xtest {
+namespace internal {
+// The file backing a journal grows in steps of at least this many bytes.
+static constexpr std::size_t kJournalGrowthSize = 64 * 1024;
+
+// Returns the name `result` is recorded as in the journal.
+static const char* GetResultName(const TestResult& result) {
+  switch (result) {
+    case TestResult::FAILED:
+      return "FAILED";
+    case TestResult::SKIPPED:
+      return "SKIPPED";
+    default:
+      return "PASSED";
+  }
+}
+
+TestJournal::TestJournal()
+    : fd_(-1), data_(nullptr), size_(0), capacity_(0) {}
+
+TestJournal::~TestJournal() { Close(); }
+
+#if XTEST_OS_WINDOWS
+// There is no `mmap()` on Windows; the journal is appended to with `write()`
+// instead, which still hands every line to the operating system right away.
+bool TestJournal::Open(const std::string& path) {
+  Close();
+  fd_ = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY,
+              _S_IREAD | _S_IWRITE);
+  return fd_ >= 0;
+}
+
+void TestJournal::Append(const TestRegistrar* test) {
+  if (!is_open())
+    return;
+  char line[64];
+  std::snprintf(line, sizeof(line), "%s %" PRId64 " ",
+                GetResultName(test->test_result_),
+                static_cast<int64_t>(test->elapsed_time_));
+  const std::string record = std::string(line) + test->suite_name_ + '.' +
+                             test->test_name_ + '\n';
+  _write(fd_, record.c_str(), static_cast<unsigned int>(record.size()));
+}
+
+void TestJournal::Close() {
+  if (!is_open())
+    return;
+  _close(fd_);
+  fd_ = -1;
+}
+
+bool TestJournal::Reserve(const std::size_t& /* size */) { return true; }
+#else
+// Opens the journal at `path` for appending, creating the file if it does not
+// exist.
+bool TestJournal::Open(const std::string& path) {
+  Close();
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd_ < 0)
+    return false;
+
+  struct stat file_stat;
+  if (fstat(fd_, &file_stat) < 0) {
+    const int32_t saved_errno = errno;
+    Close();
+    errno = saved_errno;
+    return false;
+  }
+  capacity_ = static_cast<std::size_t>(file_stat.st_size);
+  if (capacity_ > 0) {
+    void* const data =
+        mmap(nullptr, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+      const int32_t saved_errno = errno;
+      capacity_ = 0;
+      Close();
+      errno = saved_errno;
+      return false;
+    }
+    data_ = static_cast<char*>(data);
+  }
+
+  // Continue after the last complete line; anything after it is the zero
+  // filled rest of the file or a line cut short by a crash.
+  size_ = 0;
+  while (size_ < capacity_ && data_[size_] != '\0')
+    ++size_;
+  while (size_ > 0 && data_[size_ - 1] != '\n')
+    --size_;
+  if (size_ < capacity_)
+    std::memset(data_ + size_, 0, capacity_ - size_);
+  return true;
+}
+
+// Makes room for at least `size` more bytes, growing and remapping the file if
+// needed.
+bool TestJournal::Reserve(const std::size_t& size) {
+  if (size_ + size <= capacity_)
+    return true;
+
+  std::size_t capacity = capacity_ * 2;
+  if (capacity < size_ + size + kJournalGrowthSize)
+    capacity = size_ + size + kJournalGrowthSize;
+  if (ftruncate(fd_, static_cast<off_t>(capacity)) < 0)
+    return false;
+  void* const data =
+      mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (data == MAP_FAILED)
+    return false;
+  if (data_ != nullptr)
+    munmap(data_, capacity_);
+  data_ = static_cast<char*>(data);
+  capacity_ = capacity;
+  return true;
+}
+
+// Appends the result of `test` to the journal.
+void TestJournal::Append(const TestRegistrar* test) {
+  if (!is_open())
+    return;
+  char line[64];
+  std::snprintf(line, sizeof(line), "%s %" PRId64 " ",
+                GetResultName(test->test_result_),
+                static_cast<int64_t>(test->elapsed_time_));
+  const std::string record = std::string(line) + test->suite_name_ + '.' +
+                             test->test_name_ + '\n';
+  if (!Reserve(record.size())) {
+    XTEST_LOG_(WARNING) << "Could not grow the test journal: "
+                        << std::strerror(errno);
+    return;
+  }
+  std::memcpy(data_ + size_, record.c_str(), record.size());
+  size_ += record.size();
+}
+
+// Cuts the file back to the journal's length and closes it.
+void TestJournal::Close() {
+  if (!is_open())
+    return;
+  if (data_ != nullptr)
+    munmap(data_, capacity_);
+  if (ftruncate(fd_, static_cast<off_t>(size_)) < 0) {
+    // The zero filled rest of the file is ignored when it is read back.
+  }
+  close(fd_);
+  fd_ = -1;
+  data_ = nullptr;
+  size_ = 0;
+  capacity_ = 0;
+}
+#endif  // XTEST_OS_WINDOWS
+
+// Reads the results recorded in the journal at `path` into `entries`.
+bool ReadTestJournal(const std::string& path, JournalEntries* entries) {
+  std::FILE* const journal = std::fopen(path.c_str(), "rb");
+  if (journal == nullptr)
+    return errno == ENOENT;
+
+  std::string contents;
+  char buffer[4096];
+  std::size_t read_size;
+  while ((read_size = std::fread(buffer, 1, sizeof(buffer), journal)) > 0)
+    contents.append(buffer, read_size);
+  const bool read_error = std::ferror(journal) != 0;
+  std::fclose(journal);
+  if (read_error)
+    return false;
+
+  const std::size_t end = contents.find('\0');
+  if (end != std::string::npos)
+    contents.resize(end);
+
+  std::size_t begin = 0;
+  for (;;) {
+    const std::size_t line_end = contents.find('\n', begin);
+    if (line_end == std::string::npos)
+      break;  // The last line was cut short.
+    const std::string line = contents.substr(begin, line_end - begin);
+    begin = line_end + 1;
+
+    const std::size_t result_end = line.find(' ');
+    const std::size_t time_end = line.find(' ', result_end + 1);
+    if (result_end == std::string::npos || time_end == std::string::npos)
+      continue;
+    const std::string result = line.substr(0, result_end);
+    JournalEntry entry;
+    if (result == GetResultName(TestResult::PASSED))
+      entry.result = TestResult::PASSED;
+    else if (result == GetResultName(TestResult::FAILED))
+      entry.result = TestResult::FAILED;
+    else if (result == GetResultName(TestResult::SKIPPED))
+      entry.result = TestResult::SKIPPED;
+    else
+      continue;
+    entry.elapsed_time = std::strtoll(line.c_str() + result_end + 1, nullptr,
+                                      10);
+    (*entries)[line.substr(time_end + 1)] = entry;
+  }
+  return true;
+}
+}  // namespace internal
+}  // namespace xtest
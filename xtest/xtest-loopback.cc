@@ -0,0 +1,369 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "xtest-loopback.hh"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "internal/xtest-port-arch.hh"
+
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "internal/xtest-tempdir.hh"
+
+namespace xtest {
+#if XTEST_OS_WINDOWS
+struct LoopbackServer::State {};
+
+LoopbackServer::LoopbackServer(Handler /* handler */,
+                               const Transport& transport)
+    : transport_(transport),
+      port_(0),
+      error_("loopback servers are not supported on this platform") {}
+
+LoopbackServer::~LoopbackServer() {}
+
+int32_t LoopbackServer::Connect() const { return -1; }
+
+void LoopbackServer::Run(const std::shared_ptr<State>& /* state */,
+                         const internal::TestContext& /* context */) {}
+
+bool LoopbackServer::ServeConnection(State* /* state */,
+                                     LoopbackConnection* /* connection */,
+                                     const int16_t& /* events */) {
+  return false;
+}
+#else
+// Flags of `send()`: a client that hangs up early must not take the process
+// down with `SIGPIPE`.  macOS has no such flag but a socket option instead.
+#if XTEST_OS_LINUX
+static const int32_t kSendFlags = MSG_NOSIGNAL;
+#else
+static const int32_t kSendFlags = 0;
+#endif
+
+// Returns `what` followed by the description of `errno`.
+static std::string DescribeSystemError(const std::string& what) {
+  return what + ": " + std::strerror(errno);
+}
+
+// Makes the calls on `socket` return instead of blocking.  Returns false on
+// failure.
+static bool SetNonBlocking(const int32_t& socket) {
+  const int32_t flags = fcntl(socket, F_GETFL, 0);
+  return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Sets the options of a connected socket.  Requests and replies of a test are
+// small, so they are sent right away rather than coalesced.
+static void SetConnectionOptions(const int32_t& socket, const bool& tcp) {
+  const int32_t enable = 1;
+  if (tcp)
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+#if XTEST_OS_MAC
+  setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof(enable));
+#endif
+}
+
+// Returns the address of the TCP port `port` of 127.0.0.1.
+static sockaddr_in GetLoopbackAddress(const uint16_t& port) {
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  return address;
+}
+
+// Returns the address of the Unix domain socket at `path`, which fits.
+static sockaddr_un GetUnixAddress(const std::string& path) {
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return address;
+}
+
+// Binds `listener` to `address` and listens on it.  Sets `error` on failure.
+static bool Listen(const int32_t& listener, const sockaddr* address,
+                   const socklen_t& length, std::string* error) {
+  if (bind(listener, address, length) != 0) {
+    *error = DescribeSystemError("bind() failed");
+    return false;
+  }
+  if (listen(listener, SOMAXCONN) != 0 || !SetNonBlocking(listener)) {
+    *error = DescribeSystemError("listen() failed");
+    return false;
+  }
+  return true;
+}
+
+struct LoopbackServer::State {
+  State(Handler handler, const bool& tcp)
+      : handler(std::move(handler)),
+        tcp(tcp),
+        listen_socket(-1),
+        wake_pipe{-1, -1} {}
+
+  // Closes the sockets and removes the Unix domain socket.
+  ~State() {
+    for (const int32_t& fd : {listen_socket, wake_pipe[0], wake_pipe[1]})
+      if (fd >= 0)
+        close(fd);
+    if (!socket_dir.empty()) {
+      unlink(socket_path.c_str());
+      rmdir(socket_dir.c_str());
+    }
+  }
+
+  // Wakes up the event loop to stop it.
+  void Stop() {
+    const char stop = 's';
+    while (write(wake_pipe[1], &stop, sizeof(stop)) < 0 && errno == EINTR) {
+    }
+  }
+
+  Handler handler;
+  bool tcp;                 // TCP rather than a Unix domain socket.
+  int32_t listen_socket;    // Non-blocking listening socket, or `-1`.
+  int32_t wake_pipe[2];     // Written to stop the event loop.
+  std::string socket_dir;   // Directory of the Unix domain socket.
+  std::string socket_path;  // Path of the Unix domain socket.
+};
+
+// Starts listening on a new socket of `transport`.
+LoopbackServer::LoopbackServer(Handler handler, const Transport& transport)
+    : transport_(transport), port_(0) {
+  const bool tcp = transport_ == Transport::kTcp;
+  const std::shared_ptr<State> state =
+      std::make_shared<State>(std::move(handler), tcp);
+  const int32_t listener = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    error_ = DescribeSystemError("socket() failed");
+    return;
+  }
+
+  bool listening = false;
+  if (tcp) {
+    sockaddr_in address = GetLoopbackAddress(0);
+    socklen_t length = sizeof(address);
+    listening = Listen(listener, reinterpret_cast<sockaddr*>(&address),
+                       length, &error_) &&
+                getsockname(listener, reinterpret_cast<sockaddr*>(&address),
+                            &length) == 0;
+    port_ = ntohs(address.sin_port);
+    address_ = "127.0.0.1:" + std::to_string(port_);
+  } else {
+    // In a directory of its own: the path of a Unix domain socket is limited
+    // to about a hundred characters, which that of a test's scratch directory
+    // may go over.
+    std::string pattern = internal::GetTempDirBase() + "/xtest-socket-XXXXXX";
+    if (mkdtemp(&pattern[0]) != nullptr) {
+      state->socket_dir = pattern;
+      state->socket_path = address_ = pattern + "/socket";
+    }
+    if (state->socket_dir.empty()) {
+      error_ = DescribeSystemError("mkdtemp() failed");
+    } else if (address_.size() >= sizeof(sockaddr_un::sun_path)) {
+      error_ = "socket path \"" + address_ + "\" is too long";
+    } else {
+      const sockaddr_un address = GetUnixAddress(address_);
+      listening = Listen(listener,
+                         reinterpret_cast<const sockaddr*>(&address),
+                         sizeof(address), &error_);
+    }
+  }
+  state->listen_socket = listener;
+  if (listening && pipe(state->wake_pipe) != 0) {
+    error_ = DescribeSystemError("pipe() failed");
+    listening = false;
+  }
+  if (!listening)
+    return;
+
+  // Only the thread and the stopper hold on to the state, which goes once the
+  // thread is joined, by the destructor or by the test.
+  thread_ = internal::AdoptHelperThread(
+      std::thread(&LoopbackServer::Run, state,
+                  internal::GetCurrentTestContext()),
+      [state]() { state->Stop(); });
+}
+
+// Stops the event loop, closes every connection and removes the socket.
+LoopbackServer::~LoopbackServer() {
+  if (thread_ != nullptr)
+    thread_->Join();
+}
+
+// Returns a new blocking socket connected to the server.
+int32_t LoopbackServer::Connect() const {
+  if (!listening())
+    return -1;
+  const bool tcp = transport_ == Transport::kTcp;
+  const int32_t client = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+  if (client < 0)
+    return -1;
+  int32_t result = 0;
+  if (tcp) {
+    const sockaddr_in address = GetLoopbackAddress(port_);
+    result = connect(client, reinterpret_cast<const sockaddr*>(&address),
+                     sizeof(address));
+  } else {
+    const sockaddr_un address = GetUnixAddress(address_);
+    result = connect(client, reinterpret_cast<const sockaddr*>(&address),
+                     sizeof(address));
+  }
+  if (result != 0) {
+    const int32_t saved_errno = errno;
+    close(client);
+    errno = saved_errno;
+    return -1;
+  }
+  SetConnectionOptions(client, tcp);
+  return client;
+}
+
+// Body of the event loop thread.
+void LoopbackServer::Run(const std::shared_ptr<State>& state,
+                         const internal::TestContext& context) {
+  const internal::ScopedTestContext scope(context);
+  std::vector<std::unique_ptr<LoopbackConnection>> connections;
+  std::vector<pollfd> fds;
+  for (;;) {
+    fds.clear();
+    fds.push_back(pollfd{state->wake_pipe[0], POLLIN, 0});
+    fds.push_back(pollfd{state->listen_socket, POLLIN, 0});
+    for (const std::unique_ptr<LoopbackConnection>& connection : connections) {
+      pollfd fd = {connection->socket_, 0, 0};
+      if (!connection->input_closed_ && !connection->closing_)
+        fd.events |= POLLIN;
+      if (!connection->output_.empty())
+        fd.events |= POLLOUT;
+      fds.push_back(fd);
+    }
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (fds[0].revents != 0)
+      break;
+
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < connections.size(); ++i) {
+      if (!ServeConnection(state.get(), connections[i].get(),
+                           fds[i + 2].revents)) {
+        close(connections[i]->socket_);
+        continue;
+      }
+      if (kept != i)
+        connections[kept] = std::move(connections[i]);
+      ++kept;
+    }
+    connections.resize(kept);
+
+    // The connections accepted now are polled from the next round on.
+    if ((fds[1].revents & POLLIN) == 0)
+      continue;
+    for (;;) {
+      const int32_t client = accept(state->listen_socket, nullptr, nullptr);
+      if (client < 0 && errno == EINTR)
+        continue;
+      if (client < 0)
+        break;  // Every pending connection was accepted.
+      if (!SetNonBlocking(client)) {
+        close(client);
+        continue;
+      }
+      SetConnectionOptions(client, state->tcp);
+      connections.emplace_back(new LoopbackConnection(client));
+    }
+  }
+  for (const std::unique_ptr<LoopbackConnection>& connection : connections)
+    close(connection->socket_);
+}
+
+// Reads from, hands to the handler and writes to `connection`.
+bool LoopbackServer::ServeConnection(State* state,
+                                     LoopbackConnection* connection,
+                                     const int16_t& events) {
+  if ((events & (POLLIN | POLLHUP | POLLERR)) != 0 &&
+      !connection->input_closed_ && !connection->closing_) {
+    bool received = false;
+    char buffer[4096];
+    for (;;) {
+      const ssize_t size =
+          recv(connection->socket_, buffer, sizeof(buffer), 0);
+      if (size > 0) {
+        connection->input_.append(buffer, static_cast<std::size_t>(size));
+        received = true;
+      } else if (size == 0) {
+        connection->input_closed_ = received = true;
+        break;
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      } else if (errno != EINTR) {
+        return false;
+      }
+    }
+    if (received)
+      state->handler(connection);
+  }
+
+  std::string& output = connection->output_;
+  while (!output.empty()) {
+    const ssize_t size =
+        send(connection->socket_, output.data(), output.size(), kSendFlags);
+    if (size > 0)
+      output.erase(0, static_cast<std::size_t>(size));
+    else if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return true;  // The rest is sent once the socket is writable again.
+    else if (size == 0 || errno != EINTR)
+      return false;
+  }
+  return !connection->input_closed_ && !connection->closing_;
+}
+#endif  // XTEST_OS_WINDOWS
+}  // namespace xtest
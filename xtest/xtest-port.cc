@@ -29,6 +29,11 @@
 
 #include "internal/xtest-port.hh"
 
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
 
@@ -62,5 +67,67 @@ XTestLog::~XTestLog() {
   if (severity_ == XTEST_FATAL)
     std::abort();
 }
+
+// Parses a duration such as "120s", "2m", "1.5h" or "500ms" into `duration` in
+// milliseconds.
+bool ParseDuration(const char* str, TimeInMillis* duration) {
+  static const struct {
+    const char* suffix;
+    double millis;
+  } kUnits[] = {{"", 1000.0},   {"ms", 1.0},      {"s", 1000.0},
+                {"m", 60000.0}, {"h", 3600000.0}};
+
+  char* end = nullptr;
+  const double value = std::strtod(str, &end);
+  if (end == str || !std::isfinite(value) || value < 0.0)
+    return false;
+  for (const auto& unit : kUnits) {
+    if (std::strcmp(end, unit.suffix) == 0) {
+      *duration = static_cast<TimeInMillis>(std::llround(value * unit.millis));
+      return true;
+    }
+  }
+  return false;
+}
+
+// Parses a size such as "512M", "2G", "1.5G" or "64K" into `size` in bytes.
+bool ParseByteSize(const char* str, uint64_t* size) {
+  static const struct {
+    const char* suffix;
+    double bytes;
+  } kUnits[] = {{"", 1.0},
+                {"K", 1024.0},
+                {"M", 1024.0 * 1024.0},
+                {"G", 1024.0 * 1024.0 * 1024.0},
+                {"T", 1024.0 * 1024.0 * 1024.0 * 1024.0}};
+
+  char* end = nullptr;
+  const double value = std::strtod(str, &end);
+  if (end == str || !std::isfinite(value) || value < 0.0)
+    return false;
+  for (const auto& unit : kUnits) {
+    if (std::strcmp(end, unit.suffix) == 0) {
+      *size = static_cast<uint64_t>(std::llround(value * unit.bytes));
+      return true;
+    }
+  }
+  return false;
+}
+
+// Formats `size` bytes for humans, e.g., "1.5 GiB" or "512.0 MiB".
+std::string FormatByteSize(const uint64_t& size) {
+  static const char* const kUnits[] = {"KiB", "MiB", "GiB", "TiB"};
+  if (size < 1024)
+    return StreamableToString(size) + " B";
+  double value = static_cast<double>(size) / 1024.0;
+  std::size_t unit = 0;
+  while (value >= 1024.0 && unit + 1 < sizeof(kUnits) / sizeof(kUnits[0])) {
+    value /= 1024.0;
+    ++unit;
+  }
+  char formatted[32];
+  std::snprintf(formatted, sizeof(formatted), "%.1f %s", value, kUnits[unit]);
+  return formatted;
+}
 }  // namespace internal
 }  // namespace xtest
@@ -31,8 +31,10 @@
 
 #include <cstdarg>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <functional>
 #include <string>
 
 #include "internal/xtest-port-arch.hh"
@@ -45,6 +47,90 @@
 
 namespace xtest {
 namespace internal {
+// The `OutputCapture` installed for the calling thread, see
+// `ScopedOutputCapture`.
+static thread_local OutputCapture* current_output_capture = nullptr;
+
+// `1` if `stdout` was a TTY when `KeepStdoutTtyState()` was called, else `0`,
+// or `-1` until it is called, in which case `ColoredPrintf()` checks itself.
+static int32_t kept_stdout_is_tty = -1;
+
+// Appends `text` printed on `stream` to the capture.  Consecutive text printed
+// on the same stream is merged into a single chunk.
+void OutputCapture::Append(FILE* stream, const std::string& text) {
+  if (before_append_) {
+    std::function<void()> before_append;
+    before_append.swap(before_append_);
+    before_append();
+    before_append_.swap(before_append);
+  }
+  if (!chunks_.empty() && chunks_.back().first == stream)
+    chunks_.back().second += text;
+  else
+    chunks_.emplace_back(stream, text);
+}
+
+// Writes the captured chunks to their streams in the order they were captured
+// and flushes the streams.
+void OutputCapture::Replay() const {
+  for (const Chunk& chunk : chunks_) {
+    std::fwrite(chunk.second.data(), sizeof(char), chunk.second.size(),
+                chunk.first);
+    std::fflush(chunk.first);
+  }
+}
+
+// Discards everything captured so far.
+void OutputCapture::Clear() { chunks_.clear(); }
+
+ScopedOutputCapture::ScopedOutputCapture(OutputCapture* capture)
+    : saved_(current_output_capture) {
+  current_output_capture = capture;
+}
+
+ScopedOutputCapture::~ScopedOutputCapture() {
+  current_output_capture = saved_;
+}
+
+// Returns the `OutputCapture` installed for the calling thread or `nullptr`.
+OutputCapture* GetCurrentOutputCapture() { return current_output_capture; }
+
+// `va_list` version of `StreamPrintf()`.
+void StreamVPrintf(FILE* stream, const char* fmt, va_list args) {
+  if (current_output_capture == nullptr) {
+    std::vfprintf(stream, fmt, args);
+    return;
+  }
+
+  va_list args_copy;
+  va_copy(args_copy, args);
+  const int32_t size = std::vsnprintf(nullptr, 0, fmt, args_copy);
+  va_end(args_copy);
+  if (size <= 0)
+    return;
+
+  std::string text(static_cast<std::size_t>(size) + 1, '\0');
+  std::vsnprintf(&text[0], text.size(), fmt, args);
+  text.resize(static_cast<std::size_t>(size));
+  current_output_capture->Append(stream, text);
+}
+
+// Prints to `stream` like `std::fprintf()` unless an `OutputCapture` is
+// installed for the calling thread in which case the text is appended to the
+// capture instead.
+void StreamPrintf(FILE* stream, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  StreamVPrintf(stream, fmt, args);
+  va_end(args);
+}
+
+// Flushes `stream` unless the calling thread's output is being captured.
+void StreamFlush(FILE* stream) {
+  if (current_output_capture == nullptr)
+    std::fflush(stream);
+}
+
 #if XTEST_OS_WINDOWS
 // Returns the character attribute for the given color.
 static WORD GetColorAttribute(XTestColor color) {
@@ -149,6 +235,11 @@ bool ShouldUseColor(bool stdout_is_tty) {
          String::CStringEquals(xtest_color, "1");
 }
 
+// Remembers whether `stdout` is a TTY for `ColoredPrintf()`.
+void KeepStdoutTtyState() {
+  kept_stdout_is_tty = posix::IsAtty(posix::FileNo(stdout)) != 0 ? 1 : 0;
+}
+
 // Prints text with colors in both Windows and Unix-like systems by setting the
 // console text attributes and emitting colors respectively.  If the output is
 // redirected to a file then we disable color output.
@@ -164,14 +255,25 @@ void ColoredPrintf(const XTestColor& color, const char* fmt, ...) {
 // intentionally redirect `ColoredPrintf()` function's output to a context
 // buffer in order to check it.
 #if defined(XTEST_TESTING_DISABLED)
-  if (!ShouldUseColor(posix::IsAtty(posix::FileNo(stdout)) != 0)) {
-    std::vprintf(fmt, args);
+  const bool stdout_is_tty = kept_stdout_is_tty >= 0
+                                 ? kept_stdout_is_tty == 1
+                                 : posix::IsAtty(posix::FileNo(stdout)) != 0;
+  if (!ShouldUseColor(stdout_is_tty)) {
+    StreamVPrintf(stdout, fmt, args);
     va_end(args);
     return;
   }
 #endif
 
 #if XTEST_OS_WINDOWS
+  // Console text attributes cannot be captured, so captured output is printed
+  // without colors.
+  if (current_output_capture != nullptr) {
+    StreamVPrintf(stdout, fmt, args);
+    va_end(args);
+    return;
+  }
+
   // Get a `HANDLE` type to `STD_OUTPUT_HANDLE` which is 4294967285 and later is
   // cast to (signed) integer.
   const HANDLE stdout_handle = GetStdHandle(STD_OUTPUT_HANDLE);
@@ -196,9 +298,9 @@ void ColoredPrintf(const XTestColor& color, const char* fmt, ...) {
   // Restores the text color.
   SetConsoleTextAttribute(stdout_handle, old_color_attrs);
 #else
-  std::printf("\x1b[0;3%sm", GetAnsiColorCode(color).c_str());
-  std::vprintf(fmt, args);
-  std::printf("\x1b[m");  // Resets the terminal to default.
+  StreamPrintf(stdout, "\x1b[0;3%sm", GetAnsiColorCode(color).c_str());
+  StreamVPrintf(stdout, fmt, args);
+  StreamPrintf(stdout, "\x1b[m");  // Resets the terminal to default.
 #endif
 
   va_end(args);
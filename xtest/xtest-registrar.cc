@@ -30,6 +30,8 @@
 #include "xtest-registrar.hh"
 
 #include <cstdint>
+#include <initializer_list>
+#include <vector>
 
 #include "internal/xtest-port.hh"
 #include "xtest-message.hh"
@@ -37,16 +39,45 @@
 namespace xtest {
 // We initialize 'TestRegistry' instance here which then later gets served to
 // each file that include 'xtest-registrar.hh'.
-TestRegistry XTestRegistryInstance = {{}, 0};
+TestRegistry XTestRegistryInstance = {{}, {}, {}};
 
 // Constructs a new TestRegistrar instance.  Also links test functions from
 // similar test suites together.
 TestRegistrar::TestRegistrar(const char* suite_name, const char* test_name,
-                             TestFunction test_func)
+                             TestFunction test_func, TimeInMillis timeout,
+                             std::initializer_list<const char*> resources,
+                             const TestCost& cost,
+                             std::initializer_list<const char*> tags,
+                             bool fake_time)
     : suite_name_(suite_name),
       test_func_(test_func),
       test_name_(test_name),
-      test_result_(TestResult::UNKNOWN) {
+      test_result_(TestResult::UNKNOWN),
+      elapsed_time_(0),
+      expected_time_(0),
+      timeout_(timeout),
+      resources_(resources),
+      cost_(cost),
+      tags_(tags),
+      cpu_(-1),
+      has_fake_time_(fake_time) {
   XTestRegistryInstance.test_registry_table_[suite_name_].push_back(this);
 }
+
+// Registers `resources` as used by every test of `suite_name`.
+TestSuiteResourceRegistrar::TestSuiteResourceRegistrar(
+    const char* suite_name, std::initializer_list<const char*> resources) {
+  std::vector<const char*>& suite_resources =
+      XTestRegistryInstance.suite_resources_[suite_name];
+  suite_resources.insert(suite_resources.end(), resources.begin(),
+                         resources.end());
+}
+
+// Registers `tags` as carried by every test of `suite_name`.
+TestSuiteTagRegistrar::TestSuiteTagRegistrar(
+    const char* suite_name, std::initializer_list<const char*> tags) {
+  std::vector<const char*>& suite_tags =
+      XTestRegistryInstance.suite_tags_[suite_name];
+  suite_tags.insert(suite_tags.end(), tags.begin(), tags.end());
+}
 }  // namespace xtest
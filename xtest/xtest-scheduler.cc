@@ -0,0 +1,607 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/xtest-scheduler.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>  // NOLINT
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>  // NOLINT
+#include <numeric>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>  // NOLINT
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "internal/xtest-cancellation.hh"
+#include "internal/xtest-port.hh"
+#include "internal/xtest-printers.hh"
+#include "xtest-registrar.hh"
+#include "xtest.hh"
+
+namespace xtest {
+namespace internal {
+OrderedResultPrinter::OrderedResultPrinter(
+    const TestPlan& plan, TestCompletionListener on_test_completed)
+    : plan_(plan),
+      on_test_completed_(on_test_completed),
+      next_to_print_(0),
+      suite_printed_(false) {
+  for (std::size_t suite = 0; suite < plan_.size(); ++suite) {
+    for (TestRegistrar* const& test : plan_[suite].second) {
+      tests_.push_back(test);
+      suite_of_test_.push_back(suite);
+    }
+  }
+  outputs_.resize(tests_.size());
+  completed_.resize(tests_.size(), false);
+}
+
+// Marks test `index` as completed and prints the results of the tests that are
+// ready to be printed.
+void OrderedResultPrinter::OnTestCompleted(const std::size_t& index) {
+  completed_[index] = true;
+  if (on_test_completed_ != nullptr)
+    on_test_completed_(tests_[index]);
+  for (; next_to_print_ < tests_.size() && completed_[next_to_print_];
+       ++next_to_print_) {
+    const std::size_t suite = suite_of_test_[next_to_print_];
+    // The header is held back until a test of the suite was run.
+    if (!suite_printed_ &&
+        tests_[next_to_print_]->test_result_ != TestResult::UNKNOWN) {
+      PrettyUnitTestResultPrinter::OnTestStart(plan_[suite]);
+      suite_printed_ = true;
+    }
+    outputs_[next_to_print_].Replay();
+    outputs_[next_to_print_].Clear();
+    if (suite_printed_ && (next_to_print_ + 1 == tests_.size() ||
+                           suite_of_test_[next_to_print_ + 1] != suite)) {
+      PrettyUnitTestResultPrinter::OnTestEnd(plan_[suite]);
+      suite_printed_ = false;
+    }
+  }
+}
+
+// Returns the names of the resources `test` uses, sorted and without
+// duplicates.
+std::vector<std::string> GetTestResources(const TestRegistrar* test) {
+  std::vector<std::string> resources(test->resources_.begin(),
+                                     test->resources_.end());
+  const auto suite_resources =
+      XTestRegistryInstance.suite_resources_.find(test->suite_name_);
+  if (suite_resources != XTestRegistryInstance.suite_resources_.end())
+    resources.insert(resources.end(), suite_resources->second.begin(),
+                     suite_resources->second.end());
+  std::sort(resources.begin(), resources.end());
+  resources.erase(std::unique(resources.begin(), resources.end()),
+                  resources.end());
+  return resources;
+}
+
+// Returns the number of memory units a test of memory class `mem` takes up.
+std::size_t GetMemoryUnits(const MemoryClass& mem) {
+  switch (mem) {
+    case MemoryClass::kMedium:
+      return 1;
+    case MemoryClass::kLarge:
+      return 2;
+    default:
+      return 0;
+  }
+}
+
+// Constructs the locks for `tests`, which are identified by their index, run
+// by workers that share `cpu_slots` CPU slots.
+ResourceLocks::ResourceLocks(const std::vector<TestRegistrar*>& tests,
+                             const std::size_t& cpu_slots)
+    : worker_of_test_(tests.size(), 0),
+      cpu_slots_(std::max<std::size_t>(cpu_slots, 1)),
+      empty_(true),
+      cpu_slots_in_use_(0),
+      memory_units_in_use_(0) {
+  for (const TestRegistrar* const& test : tests) {
+    resources_of_test_.push_back(GetTestResources(test));
+    cpu_slots_of_test_.push_back(std::min<std::size_t>(
+        static_cast<std::size_t>(std::max(test->cost_.cpus, 1)), cpu_slots_));
+    memory_units_of_test_.push_back(
+        std::min(GetMemoryUnits(test->cost_.mem), kMemoryUnits));
+    if (!resources_of_test_.back().empty() ||
+        cpu_slots_of_test_.back() > 1 || memory_units_of_test_.back() > 0)
+      empty_ = false;
+  }
+}
+
+// Returns the largest of `values`, or `0` if there is none.
+std::size_t ResourceLocks::Largest(const std::multiset<std::size_t>& values) {
+  return values.empty() ? 0 : *values.rbegin();
+}
+
+// Claims the resources of test `test` for `worker`.  Returns false, claiming
+// none of them, if another worker holds any of them or if the workers would
+// take up more CPU slots or memory units than there are.
+bool ResourceLocks::TryClaim(const std::size_t& test,
+                             const std::size_t& worker) {
+  if (empty_)
+    return true;
+  const std::vector<std::string>& resources = resources_of_test_[test];
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const std::string& resource : resources) {
+    const auto held = held_.find(resource);
+    if (held != held_.end() && held->second.first != worker)
+      return false;
+  }
+
+  // The worker runs its tests one after the other, so it only takes up more
+  // than it does already if this test is costlier than the ones it holds.
+  WorkerUsage& usage = usage_of_worker_[worker];
+  const std::size_t cpu_slots = Largest(usage.cpu_slots);
+  const std::size_t memory_units = Largest(usage.memory_units);
+  const std::size_t cpu_slots_in_use =
+      cpu_slots_in_use_ - cpu_slots +
+      std::max(cpu_slots, cpu_slots_of_test_[test]);
+  const std::size_t memory_units_in_use =
+      memory_units_in_use_ - memory_units +
+      std::max(memory_units, memory_units_of_test_[test]);
+  if (cpu_slots_in_use > cpu_slots_ || memory_units_in_use > kMemoryUnits)
+    return false;
+
+  for (const std::string& resource : resources) {
+    std::pair<std::size_t, std::size_t>& held = held_[resource];
+    held.first = worker;
+    ++held.second;
+  }
+  usage.cpu_slots.insert(cpu_slots_of_test_[test]);
+  usage.memory_units.insert(memory_units_of_test_[test]);
+  cpu_slots_in_use_ = cpu_slots_in_use;
+  memory_units_in_use_ = memory_units_in_use;
+  worker_of_test_[test] = worker;
+  return true;
+}
+
+// Releases the resources claimed for test `test`.
+void ResourceLocks::Release(const std::size_t& test) {
+  if (empty_)
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const std::string& resource : resources_of_test_[test]) {
+    const auto held = held_.find(resource);
+    if (held != held_.end() && --held->second.second == 0)
+      held_.erase(held);
+  }
+
+  WorkerUsage& usage = usage_of_worker_[worker_of_test_[test]];
+  const auto cpu_slots = usage.cpu_slots.find(cpu_slots_of_test_[test]);
+  const auto memory_units =
+      usage.memory_units.find(memory_units_of_test_[test]);
+  if (cpu_slots == usage.cpu_slots.end() ||
+      memory_units == usage.memory_units.end())
+    return;
+  cpu_slots_in_use_ -= Largest(usage.cpu_slots);
+  memory_units_in_use_ -= Largest(usage.memory_units);
+  usage.cpu_slots.erase(cpu_slots);
+  usage.memory_units.erase(memory_units);
+  cpu_slots_in_use_ += Largest(usage.cpu_slots);
+  memory_units_in_use_ += Largest(usage.memory_units);
+}
+
+// Constructs a pool of `num_workers` workers.  The worker threads are not
+// started until `Start()` is called.
+WorkStealingPool::WorkStealingPool(std::size_t num_workers)
+    : tasks_left_(0), tasks_completed_(0) {
+  if (num_workers == 0)
+    num_workers = 1;
+  for (std::size_t i = 0; i < num_workers; ++i)
+    queues_.emplace_back(new WorkerQueue);
+}
+
+// Joins the worker threads if `Join()` has not been called yet.
+WorkStealingPool::~WorkStealingPool() { Join(); }
+
+// Distributes `tasks` round-robin over the workers' queues, preserving their
+// order, and starts the worker threads that call `task` for every one of them,
+// once `claim`, if any, succeeds for it.
+void WorkStealingPool::Start(const std::vector<std::size_t>& tasks,
+                             const Task& task, const Claim& claim) {
+  task_ = task;
+  claim_ = claim;
+  tasks_left_ = tasks.size();
+  tasks_completed_ = 0;
+  for (std::size_t i = 0; i < tasks.size(); ++i)
+    queues_[i % queues_.size()]->tasks.push_back(tasks[i]);
+  for (std::size_t worker = 0; worker < queues_.size(); ++worker)
+    threads_.emplace_back(&WorkStealingPool::WorkerMain, this, worker);
+}
+
+// Blocks until every task has been run and the worker threads have exited.
+void WorkStealingPool::Join() {
+  for (std::thread& thread : threads_)
+    if (thread.joinable())
+      thread.join();
+  threads_.clear();
+}
+
+// Pops the first task `worker` can claim from `queue`, from the front or, when
+// stealing, from the back.  Returns false if there is none.
+bool WorkStealingPool::PopClaimableTask(std::size_t worker, WorkerQueue* queue,
+                                        bool steal, std::size_t* task) {
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  const std::size_t size = queue->tasks.size();
+  for (std::size_t i = 0; i < size; ++i) {
+    const std::size_t position = steal ? size - 1 - i : i;
+    if (claim_ != nullptr && !claim_(worker, queue->tasks[position]))
+      continue;
+    *task = queue->tasks[position];
+    queue->tasks.erase(queue->tasks.begin() +
+                       static_cast<std::ptrdiff_t>(position));
+    return true;
+  }
+  return false;
+}
+
+// Pops the next task for `worker`, from its own queue if possible or else
+// steals one from another worker, waiting for a running task to complete if
+// there is none it can claim.  Returns false when there is no task left.
+bool WorkStealingPool::PopTask(std::size_t worker, std::size_t* task) {
+  for (;;) {
+    std::size_t tasks_completed;
+    {
+      std::lock_guard<std::mutex> lock(progress_mutex_);
+      if (tasks_left_ == 0)
+        return false;
+      tasks_completed = tasks_completed_;
+    }
+
+    // Steal from the back of the other workers' queues once our own queue is
+    // empty, starting with our neighbour so that the thieves spread over the
+    // victims.
+    bool popped = false;
+    for (std::size_t i = 0; i < queues_.size() && !popped; ++i) {
+      WorkerQueue* const queue = queues_[(worker + i) % queues_.size()].get();
+      popped = PopClaimableTask(worker, queue, i != 0, task);
+    }
+    if (popped) {
+      std::lock_guard<std::mutex> lock(progress_mutex_);
+      if (--tasks_left_ == 0)
+        progress_.notify_all();
+      return true;
+    }
+
+    // Every task left is either being taken by another worker or held up by a
+    // running task; wait for either to happen.
+    std::unique_lock<std::mutex> lock(progress_mutex_);
+    progress_.wait(lock, [this, &tasks_completed]() {
+      return tasks_left_ == 0 || tasks_completed_ != tasks_completed;
+    });
+  }
+}
+
+// Runs tasks on the calling thread until there is no task left.
+void WorkStealingPool::WorkerMain(std::size_t worker) {
+  std::size_t task;
+  while (PopTask(worker, &task)) {
+    task_(worker, task);
+    std::lock_guard<std::mutex> lock(progress_mutex_);
+    ++tasks_completed_;
+    progress_.notify_all();
+  }
+}
+
+// Returns a hash of the full name "suite_name.test_name" of a test.
+//
+// The hash (64-bit FNV-1a) only depends on the name, unlike the order of the
+// tests in the registry which depends on where the linker placed the names, so
+// it stays the same across rebuilds, machines and platforms.
+uint64_t HashTestName(const char* suite_name, const char* test_name) {
+  const uint64_t kFnvOffsetBasis = 14695981039346656037ULL;
+  const uint64_t kFnvPrime = 1099511628211ULL;
+  uint64_t hash = kFnvOffsetBasis;
+  const auto mix = [&hash, kFnvPrime](const char* str) {
+    for (; *str != '\0'; ++str) {
+      hash ^= static_cast<unsigned char>(*str);
+      hash *= kFnvPrime;
+    }
+  };
+  mix(suite_name);
+  mix(".");
+  mix(test_name);
+  return hash;
+}
+
+// Returns true if and only if `test` belongs to shard `shard_index` out of
+// `total_shards` shards.
+bool IsTestOnShard(const TestRegistrar* test, const int32_t& total_shards,
+                   const int32_t& shard_index) {
+  if (total_shards <= 1)
+    return true;
+  return HashTestName(test->suite_name_, test->test_name_) %
+             static_cast<uint64_t>(total_shards) ==
+         static_cast<uint64_t>(shard_index);
+}
+
+// Returns the indices of `tests` in the order to run them in: longest expected
+// time first.
+std::vector<std::size_t> OrderTestsLongestFirst(
+    const std::vector<TestRegistrar*>& tests) {
+  std::vector<std::size_t> order(tests.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&tests](const std::size_t& a, const std::size_t& b) {
+                     return tests[a]->expected_time_ > tests[b]->expected_time_;
+                   });
+  return order;
+}
+
+// Splits `tests` into `total_shards` shards expected to take about equally
+// long and returns the shard of every test.
+std::vector<int32_t> PackTestsIntoShards(
+    const std::vector<TestRegistrar*>& tests, const int32_t& total_shards) {
+  std::vector<std::size_t> order(tests.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(),
+            [&tests](const std::size_t& a, const std::size_t& b) {
+              const TestRegistrar* const lhs = tests[a];
+              const TestRegistrar* const rhs = tests[b];
+              if (lhs->expected_time_ != rhs->expected_time_)
+                return lhs->expected_time_ > rhs->expected_time_;
+              const int32_t suite_order =
+                  std::strcmp(lhs->suite_name_, rhs->suite_name_);
+              if (suite_order != 0)
+                return suite_order < 0;
+              return std::strcmp(lhs->test_name_, rhs->test_name_) < 0;
+            });
+
+  // Every test costs at least a millisecond, so that the many tests too fast
+  // to measure are spread evenly as well.
+  std::vector<TimeInMillis> load(std::max(total_shards, 1), 0);
+  std::vector<int32_t> shard_of_test(tests.size(), 0);
+  for (const std::size_t& index : order) {
+    const auto least_loaded = std::min_element(load.begin(), load.end());
+    *least_loaded += std::max<TimeInMillis>(tests[index]->expected_time_, 1);
+    shard_of_test[index] =
+        static_cast<int32_t>(least_loaded - load.begin());
+  }
+  return shard_of_test;
+}
+
+// Returns the seed to shuffle the tests with for the value of the
+// `--xtest_random_seed` flag.
+uint32_t GetRandomSeedFromFlag(const uint32_t& random_seed_flag) {
+  if (random_seed_flag >= 1 && random_seed_flag <= kMaxRandomSeed)
+    return random_seed_flag;
+  const uint64_t now = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count());
+  return static_cast<uint32_t>(now % kMaxRandomSeed) + 1;
+}
+
+// Returns a random index in [0, `size`) drawn from `random` without the bias
+// of a plain modulo.
+static std::size_t GetRandomIndex(std::mt19937* random,
+                                  const std::size_t& size) {
+  const uint64_t range = uint64_t{1} << 32;
+  const uint64_t limit = range - range % size;
+  uint64_t value;
+  do {
+    value = (*random)();
+  } while (value >= limit);
+  return static_cast<std::size_t>(value % size);
+}
+
+// Shuffles the range [`begin`, `end`) with a Fisher-Yates shuffle driven by
+// `random`.
+template <typename Iterator>
+static void ShuffleRange(std::mt19937* random, Iterator begin, Iterator end) {
+  std::size_t size = static_cast<std::size_t>(end - begin);
+  for (; size > 1; --size)
+    std::swap(begin[size - 1], begin[GetRandomIndex(random, size)]);
+}
+
+// Shuffles the order of the test suites of `plan` and of the tests within
+// every test suite, keeping the tests of a suite together.
+void ShuffleTestPlan(TestPlan* plan, const uint32_t& seed) {
+  // Start from the suites in name order rather than in registry order, which
+  // depends on where the linker placed the names, so that a seed replays the
+  // same order after a rebuild too.
+  std::sort(plan->begin(), plan->end(),
+            [](const XTestUnitTestPair& lhs, const XTestUnitTestPair& rhs) {
+              return std::strcmp(lhs.first, rhs.first) < 0;
+            });
+  std::mt19937 random(seed);
+  ShuffleRange(&random, plan->begin(), plan->end());
+  for (XTestUnitTestPair& test_suite : *plan) {
+    std::vector<TestRegistrar*> tests(test_suite.second.begin(),
+                                      test_suite.second.end());
+    ShuffleRange(&random, tests.begin(), tests.end());
+    test_suite.second.assign(tests.begin(), tests.end());
+  }
+}
+
+// Puts the tests of `plan` in the order they come in `order`, keeping the tests
+// of a suite together.
+void OrderTestPlan(TestPlan* plan,
+                   const std::vector<const TestRegistrar*>& order) {
+  std::unordered_map<const TestRegistrar*, std::size_t> rank;
+  for (std::size_t index = 0; index < order.size(); ++index)
+    rank.emplace(order[index], index);
+  const auto get_rank = [&](const TestRegistrar* test) {
+    const auto found = rank.find(test);
+    return found != rank.end() ? found->second : order.size();
+  };
+  for (XTestUnitTestPair& test_suite : *plan) {
+    test_suite.second.sort(
+        [&](const TestRegistrar* const& lhs, const TestRegistrar* const& rhs) {
+          return get_rank(lhs) < get_rank(rhs);
+        });
+  }
+  std::stable_sort(
+      plan->begin(), plan->end(),
+      [&](const XTestUnitTestPair& lhs, const XTestUnitTestPair& rhs) {
+        const std::size_t lhs_rank =
+            lhs.second.empty() ? order.size() : get_rank(lhs.second.front());
+        const std::size_t rhs_rank =
+            rhs.second.empty() ? order.size() : get_rank(rhs.second.front());
+        return lhs_rank < rhs_rank;
+      });
+}
+
+// Reads the integer environment variable `name` into `value`.  Returns false
+// if the variable is not set; exits the program if it is not an integer.
+static bool ReadInt32FromEnvironment(const char* name, int32_t* value) {
+  const char* const str = posix::GetEnv(name);
+  if (str == nullptr)
+    return false;
+
+  char* end = nullptr;
+  errno = 0;
+  const long parsed = std::strtol(str, &end, 10);  // NOLINT
+  if (*str == '\0' || *end != '\0' || errno == ERANGE || parsed < INT32_MIN ||
+      parsed > INT32_MAX) {
+    ColoredPrintf(XTestColor::kRed,
+                  "Invalid environment variables: %s=%s is not an integer.\n",
+                  name, str);
+    std::fflush(stdout);
+    std::exit(EXIT_FAILURE);
+  }
+  *value = static_cast<int32_t>(parsed);
+  return true;
+}
+
+// Reads the test sharding environment variables `XTEST_TOTAL_SHARDS` and
+// `XTEST_SHARD_INDEX`, or their Bazel counterparts `TEST_TOTAL_SHARDS` and
+// `TEST_SHARD_INDEX`, into `total_shards` and `shard_index`.
+//
+// Returns false, leaving the output parameters alone, when sharding is not
+// requested.  Exits the program when the variables hold invalid values, as
+// running every test on every shard would silently multiply the work.  Also
+// touches the file named by `TEST_SHARD_STATUS_FILE`, if any, to tell Bazel
+// that this binary supports sharding.
+bool ReadShardingEnvironment(int32_t* total_shards, int32_t* shard_index) {
+  const char* const status_file = posix::GetEnv("TEST_SHARD_STATUS_FILE");
+  if (status_file != nullptr && *status_file != '\0') {
+    FILE* const file = std::fopen(status_file, "a");
+    if (file == nullptr) {
+      XTEST_LOG_(WARNING) << "Could not touch the shard status file "
+                          << status_file << ": " << std::strerror(errno);
+    } else {
+      std::fclose(file);
+    }
+  }
+
+  int32_t total = -1;
+  int32_t index = -1;
+  const bool has_total =
+      ReadInt32FromEnvironment("XTEST_TOTAL_SHARDS", &total) ||
+      ReadInt32FromEnvironment("TEST_TOTAL_SHARDS", &total);
+  const bool has_index =
+      ReadInt32FromEnvironment("XTEST_SHARD_INDEX", &index) ||
+      ReadInt32FromEnvironment("TEST_SHARD_INDEX", &index);
+  if (!has_total && !has_index)
+    return false;
+
+  if (!has_total || !has_index || total <= 0 || index < 0 || index >= total) {
+    ColoredPrintf(XTestColor::kRed,
+                  "Invalid environment variables: the total number of shards "
+                  "is %d and the shard index is %d; both must be set and the "
+                  "index must be in [0, total).\n",
+                  total, index);
+    std::fflush(stdout);
+    std::exit(EXIT_FAILURE);
+  }
+  *total_shards = total;
+  *shard_index = index;
+  return true;
+}
+
+// Returns the number of worker threads to use for the value of the
+// `--xtest_jobs` flag; `0` means one worker thread per online CPU.
+std::size_t GetNumberOfJobs(const uint32_t& jobs) {
+  if (jobs != 0)
+    return jobs;
+  const std::size_t cpus = std::thread::hardware_concurrency();
+  return cpus == 0 ? 1 : cpus;
+}
+
+// Runs the tests in `plan` with `run_test` on `num_jobs` worker threads.
+//
+// The tests are started longest expected time first, except that two tests that
+// use the same resource never run at the same time and that the tests running
+// at the same time take up at most `num_jobs` CPUs.  Every test's console
+// output is captured while it runs and printed, together with the test suite
+// header and footer, in the order of `plan` as soon as the test and all the
+// tests before it have completed, on a worker thread, serialized by
+// `printer_mutex`.
+void RunTestPlanInParallel(const TestPlan& plan, const std::size_t& num_jobs,
+                           TestRunner run_test,
+                           TestCompletionListener on_test_completed,
+                           const CpuAffinity* cpu_affinity) {
+  OrderedResultPrinter printer(plan, on_test_completed);
+  const std::vector<TestRegistrar*>& tests = printer.tests();
+  std::mutex printer_mutex;
+
+  const std::vector<std::size_t> order = OrderTestsLongestFirst(tests);
+  const std::size_t num_workers =
+      std::min(num_jobs, std::max<std::size_t>(tests.size(), 1));
+  ResourceLocks resource_locks(tests, num_jobs);
+  WorkStealingPool::Claim claim = nullptr;
+  if (!resource_locks.empty())
+    claim = [&resource_locks](std::size_t worker, std::size_t task) {
+      return resource_locks.TryClaim(task, worker);
+    };
+
+  WorkStealingPool pool(num_workers);
+  pool.Start(
+      order,
+      [&](std::size_t worker, std::size_t task) {
+        if (cpu_affinity != nullptr)
+          cpu_affinity->PinWorker(worker);
+        // A cancelled run drains the remaining tests without running them.
+        if (!IsTestRunCancelled()) {
+          ScopedOutputCapture capture(printer.output(task));
+          run_test(tests[task]);
+        }
+        resource_locks.Release(task);
+        // The worker that completes the oldest outstanding test prints it
+        // along with the completed tests queued up behind it.
+        std::lock_guard<std::mutex> lock(printer_mutex);
+        printer.OnTestCompleted(task);
+      },
+      claim);
+  pool.Join();
+}
+}  // namespace internal
+}  // namespace xtest
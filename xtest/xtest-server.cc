@@ -0,0 +1,239 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/xtest-server.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>  // NOLINT
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "internal/xtest-port-arch.hh"
+
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "internal/xtest-port.hh"
+#include "internal/xtest-printers.hh"
+
+namespace xtest {
+namespace internal {
+// Splits a request line into the xtest command line flags it holds.
+std::vector<std::string> SplitTestRequest(const std::string& request) {
+  std::vector<std::string> flags;
+  std::string flag;
+  for (const char& chr : request) {
+    if (chr == ' ' || chr == '\t' || chr == '\r' || chr == '\n') {
+      if (!flag.empty())
+        flags.push_back(flag);
+      flag.clear();
+      continue;
+    }
+    flag += chr;
+  }
+  if (!flag.empty())
+    flags.push_back(flag);
+  return flags;
+}
+
+#if XTEST_OS_WINDOWS
+// Serves test runs on the Unix domain socket at `socket_path`.
+//
+// Unix domain sockets are not supported here, so the tests are run only once.
+int32_t ServeTests(const std::string& socket_path,
+                   TestRequestHandler handle_request) {
+  XTEST_LOG_(WARNING) << "--" XTEST_FLAG_PREFIX_ "serve is not supported on "
+                         "this platform; running the tests once.";
+  handle_request({});
+  return EXIT_SUCCESS;
+}
+#else
+// Longest request line the server accepts.
+static constexpr std::size_t kMaxRequestSize = 64 * 1024;
+
+// Time in ms to wait for before accepting again when the process or the system
+// ran out of file descriptors, doubled on every failure up to the maximum.
+static constexpr int64_t kMinAcceptBackoff = 10;
+static constexpr int64_t kMaxAcceptBackoff = 1000;
+
+// Set by the `SIGINT` and `SIGTERM` handlers to stop the server.
+static volatile std::sig_atomic_t stop_serving = 0;
+
+static void StopServing(int /* signal */) { stop_serving = 1; }
+
+// Reads the request line from `connection`.  Returns false if the client went
+// away before sending a complete line.
+static bool ReadTestRequest(const int32_t& connection, std::string* request) {
+  char chr = '\0';
+  while (request->size() < kMaxRequestSize) {
+    const ssize_t read_size = read(connection, &chr, 1);
+    if (read_size < 0 && errno == EINTR && !stop_serving)
+      continue;
+    if (read_size <= 0)
+      return false;
+    if (chr == '\n')
+      return true;
+    *request += chr;
+  }
+  return false;
+}
+
+// Runs the request sent on `connection` with the standard output and error
+// streams redirected to it.
+static void HandleConnection(const int32_t& connection,
+                             TestRequestHandler handle_request) {
+  std::string request;
+  if (!ReadTestRequest(connection, &request))
+    return;
+
+  std::fflush(stdout);
+  std::fflush(stderr);
+  const int32_t saved_stdout = dup(STDOUT_FILENO);
+  const int32_t saved_stderr = dup(STDERR_FILENO);
+  dup2(connection, STDOUT_FILENO);
+  dup2(connection, STDERR_FILENO);
+
+  handle_request(SplitTestRequest(request));
+
+  std::fflush(stdout);
+  std::fflush(stderr);
+  dup2(saved_stdout, STDOUT_FILENO);
+  dup2(saved_stderr, STDERR_FILENO);
+  close(saved_stdout);
+  close(saved_stderr);
+}
+
+// Creates a Unix domain socket listening at `socket_path`, replacing a stale
+// socket left behind by a previous server.  Returns -1 on failure.
+static int32_t ListenOn(const std::string& socket_path) {
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
+
+  struct stat file_stat;
+  if (lstat(socket_path.c_str(), &file_stat) == 0 &&
+      S_ISSOCK(file_stat.st_mode))
+    unlink(socket_path.c_str());
+
+  const int32_t listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0)
+    return -1;
+  if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) <
+          0 ||
+      listen(listener, SOMAXCONN) < 0) {
+    const int32_t saved_errno = errno;
+    close(listener);
+    errno = saved_errno;
+    return -1;
+  }
+  return listener;
+}
+
+// Serves test runs on the Unix domain socket at `socket_path` until the process
+// receives `SIGINT` or `SIGTERM`, or accepting a connection fails for good.
+int32_t ServeTests(const std::string& socket_path,
+                   TestRequestHandler handle_request) {
+  const int32_t listener = ListenOn(socket_path);
+  if (listener < 0) {
+    ColoredPrintf(XTestColor::kRed,
+                  "Could not serve tests on socket \"%s\": %s\n",
+                  socket_path.c_str(), std::strerror(errno));
+    std::exit(EXIT_FAILURE);
+  }
+
+  // No `SA_RESTART` so that a signal interrupts a blocking `accept()`.
+  struct sigaction stop_action;
+  std::memset(&stop_action, 0, sizeof(stop_action));
+  stop_action.sa_handler = StopServing;
+  sigemptyset(&stop_action.sa_mask);
+  struct sigaction saved_sigint, saved_sigterm;
+  sigaction(SIGINT, &stop_action, &saved_sigint);
+  sigaction(SIGTERM, &stop_action, &saved_sigterm);
+  // A client that hangs up early must not take the server down.
+  void (*SavedSigPipeHandler)(int) = std::signal(SIGPIPE, SIG_IGN);
+
+  std::printf("Serving tests on %s\n", socket_path.c_str());
+  std::fflush(stdout);
+  stop_serving = 0;
+  int32_t exit_code = EXIT_SUCCESS;
+  int64_t backoff = kMinAcceptBackoff;
+  while (!stop_serving) {
+    const int32_t connection = accept(listener, nullptr, nullptr);
+    if (connection < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      // Out of file descriptors, e.g., while the tests of the previous request
+      // still hold some: the connection waits in the backlog until some are
+      // released.
+      if (errno == EMFILE || errno == ENFILE) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(backoff));
+        backoff = std::min(backoff * 2, kMaxAcceptBackoff);
+        continue;
+      }
+      ColoredPrintf(XTestColor::kRed,
+                    "Could not accept a connection on socket \"%s\": %s\n",
+                    socket_path.c_str(), std::strerror(errno));
+      exit_code = EXIT_FAILURE;
+      break;
+    }
+    backoff = kMinAcceptBackoff;
+    HandleConnection(connection, handle_request);
+    // Tests may have duplicated the standard streams and left the copies
+    // open; shut the connection down so that the client still sees the end
+    // of the output.
+    shutdown(connection, SHUT_RDWR);
+    close(connection);
+  }
+
+  close(listener);
+  unlink(socket_path.c_str());
+  std::signal(SIGPIPE, SavedSigPipeHandler);
+  sigaction(SIGINT, &saved_sigint, nullptr);
+  sigaction(SIGTERM, &saved_sigterm, nullptr);
+  return exit_code;
+}
+#endif  // XTEST_OS_WINDOWS
+}  // namespace internal
+}  // namespace xtest
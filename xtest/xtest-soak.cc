@@ -0,0 +1,136 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/xtest-soak.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "internal/xtest-port-arch.hh"
+
+#if XTEST_OS_LINUX
+#include <dirent.h>
+#endif
+
+namespace xtest {
+namespace internal {
+// Sets `usage` to the resources the calling process holds.
+bool GetResourceUsage(ResourceUsage* usage) {
+#if XTEST_OS_LINUX
+  std::FILE* const status = std::fopen("/proc/self/status", "r");
+  if (status == nullptr)
+    return false;
+  char line[256];
+  while (std::fgets(line, sizeof(line), status) != nullptr) {
+    unsigned long long value = 0;  // NOLINT
+    if (std::sscanf(line, "VmRSS: %llu kB", &value) == 1)
+      usage->rss = static_cast<uint64_t>(value) * 1024;
+    else if (std::sscanf(line, "Threads: %llu", &value) == 1)
+      usage->threads = static_cast<uint64_t>(value);
+  }
+  std::fclose(status);
+
+  DIR* const fds = opendir("/proc/self/fd");
+  if (fds == nullptr)
+    return false;
+  usage->open_fds = 0;
+  while (const dirent* const fd = readdir(fds)) {
+    if (fd->d_name[0] != '.')
+      ++usage->open_fds;
+  }
+  closedir(fds);
+  // The directory being listed is open too.
+  if (usage->open_fds > 0)
+    --usage->open_fds;
+  return true;
+#else
+  (void)usage;
+  return false;
+#endif  // XTEST_OS_LINUX
+}
+
+// Adds the `sample` of the next interval.
+void SampleSeries::Add(const double& sample) {
+  pending_sum_ += sample;
+  if (++pending_count_ < stride_)
+    return;
+  samples_.push_back(pending_sum_ / static_cast<double>(stride_));
+  pending_sum_ = 0.0;
+  pending_count_ = 0;
+  if (samples_.size() < kMaxSamples)
+    return;
+  for (std::size_t i = 0; i < samples_.size() / 2; ++i)
+    samples_[i] = (samples_[2 * i] + samples_[2 * i + 1]) / 2.0;
+  samples_.resize(samples_.size() / 2);
+  stride_ *= 2;
+}
+
+// Returns the line fitted to `samples` by least squares.
+LinearTrend FitLinearTrend(const std::vector<double>& samples) {
+  LinearTrend trend;
+  const std::size_t n = samples.size();
+  if (n < 2)
+    return trend;
+  const double mean_x = static_cast<double>(n - 1) / 2.0;
+  double mean_y = 0.0;
+  for (const double& sample : samples)
+    mean_y += sample;
+  mean_y /= static_cast<double>(n);
+
+  double sxx = 0.0;
+  double sxy = 0.0;
+  double syy = 0.0;
+  for (std::size_t i = 0; i < n; ++i) {
+    const double dx = static_cast<double>(i) - mean_x;
+    const double dy = samples[i] - mean_y;
+    sxx += dx * dx;
+    sxy += dx * dy;
+    syy += dy * dy;
+  }
+  if (syy == 0.0)
+    return trend;
+  trend.slope = sxy / sxx;
+  trend.r_squared = (sxy * sxy) / (sxx * syy);
+  return trend;
+}
+
+// Returns true if `samples` grow steadily, i.e., like a leak rather than noise.
+bool IsSteadyGrowth(const std::vector<double>& samples,
+                    const double& min_growth) {
+  if (samples.size() < kMinTrendSamples)
+    return false;
+  const LinearTrend trend = FitLinearTrend(samples);
+  return trend.slope > 0.0 &&
+         trend.slope * static_cast<double>(samples.size() - 1) >= min_growth &&
+         trend.r_squared >= kMinSteadyGrowthRSquared;
+}
+}  // namespace internal
+}  // namespace xtest
@@ -0,0 +1,208 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "internal/xtest-tags.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "xtest-message.hh"
+#include "xtest-registrar.hh"
+
+namespace xtest {
+namespace internal {
+// Returns the tags of `test`, sorted and without duplicates.
+std::vector<std::string> GetTestTags(const TestRegistrar* test) {
+  std::vector<std::string> tags(test->tags_.begin(), test->tags_.end());
+  const auto suite_tags =
+      XTestRegistryInstance.suite_tags_.find(test->suite_name_);
+  if (suite_tags != XTestRegistryInstance.suite_tags_.end())
+    tags.insert(tags.end(), suite_tags->second.begin(),
+                suite_tags->second.end());
+  std::sort(tags.begin(), tags.end());
+  tags.erase(std::unique(tags.begin(), tags.end()), tags.end());
+  return tags;
+}
+
+// Returns true if `chr` may be part of a tag.
+static bool IsTagChar(const char& chr) {
+  return std::isalnum(static_cast<unsigned char>(chr)) || chr == '_' ||
+         chr == '-' || chr == '.' || chr == ':' || chr == '/';
+}
+
+// A recursive descent parser of a `--xtest_tags` expression that computes the
+// set of tests matching every part of it as it goes:
+//
+//   or  := and ( '|' and )*
+//   and := not ( ( ',' | '&' ) not )*
+//   not := '!' not | '(' or ')' | tag
+class TagIndex::Parser {
+ public:
+  Parser(const TagIndex& index, const std::string& expression)
+      : index_(index), expression_(expression), position_(0) {}
+
+  // Parses the whole expression into `tests`.  Returns false, with `error`
+  // saying why, if it is not a valid expression.
+  bool Parse(Bitset* tests, std::string* error) {
+    *tests = ParseOr();
+    SkipSpaces();
+    if (error_.empty() && position_ < expression_.size())
+      Fail("unexpected '" + std::string(1, expression_[position_]) + "'");
+    if (!error_.empty()) {
+      *error = error_;
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  Bitset ParseOr() {
+    Bitset tests = ParseAnd();
+    while (error_.empty() && Consume('|')) {
+      const Bitset rhs = ParseAnd();
+      for (std::size_t i = 0; i < tests.size(); ++i)
+        tests[i] |= rhs[i];
+    }
+    return tests;
+  }
+
+  Bitset ParseAnd() {
+    Bitset tests = ParseNot();
+    while (error_.empty() && (Consume(',') || Consume('&'))) {
+      const Bitset rhs = ParseNot();
+      for (std::size_t i = 0; i < tests.size(); ++i)
+        tests[i] &= rhs[i];
+    }
+    return tests;
+  }
+
+  Bitset ParseNot() {
+    if (Consume('!')) {
+      Bitset tests = ParseNot();
+      const Bitset all = AllTests();
+      for (std::size_t i = 0; i < tests.size(); ++i)
+        tests[i] = ~tests[i] & all[i];
+      return tests;
+    }
+    if (Consume('(')) {
+      const Bitset tests = ParseOr();
+      if (error_.empty() && !Consume(')'))
+        Fail("expected ')'");
+      return tests;
+    }
+
+    SkipSpaces();
+    const std::size_t begin = position_;
+    while (position_ < expression_.size() && IsTagChar(expression_[position_]))
+      ++position_;
+    if (begin == position_) {
+      Fail("expected a tag");
+      return NoTests();
+    }
+    const auto tests = index_.tests_with_tag_.find(
+        expression_.substr(begin, position_ - begin));
+    return tests != index_.tests_with_tag_.end() ? tests->second : NoTests();
+  }
+
+  // Skips the spaces before the next token and consumes it if it is `token`.
+  bool Consume(const char& token) {
+    SkipSpaces();
+    if (position_ >= expression_.size() || expression_[position_] != token)
+      return false;
+    ++position_;
+    return true;
+  }
+
+  void SkipSpaces() {
+    while (position_ < expression_.size() &&
+           std::isspace(static_cast<unsigned char>(expression_[position_])))
+      ++position_;
+  }
+
+  // Records the first error, at the current position.
+  void Fail(const std::string& what) {
+    if (error_.empty())
+      error_ = what + " at position " + StreamableToString(position_ + 1) +
+               " of \"" + expression_ + "\"";
+  }
+
+  Bitset NoTests() const { return Bitset((index_.num_tests_ + 63) / 64, 0); }
+
+  Bitset AllTests() const {
+    Bitset tests((index_.num_tests_ + 63) / 64, ~uint64_t{0});
+    if (index_.num_tests_ % 64 != 0)
+      tests.back() = (uint64_t{1} << (index_.num_tests_ % 64)) - 1;
+    return tests;
+  }
+
+  const TagIndex& index_;
+  const std::string& expression_;
+  std::size_t position_;
+  std::string error_;
+};
+
+// Builds the index of the tags of `tests`, which are identified by their
+// index.
+TagIndex::TagIndex(const std::vector<TestRegistrar*>& tests)
+    : num_tests_(tests.size()) {
+  const std::size_t num_words = (num_tests_ + 63) / 64;
+  for (std::size_t i = 0; i < tests.size(); ++i) {
+    for (const std::string& tag : GetTestTags(tests[i])) {
+      Bitset& tests_with_tag = tests_with_tag_[tag];
+      tests_with_tag.resize(num_words, 0);
+      tests_with_tag[i / 64] |= uint64_t{1} << (i % 64);
+    }
+  }
+}
+
+// Sets `selected` to whether every test matches `expression`.  Returns false,
+// with `error` saying why, if `expression` is not a valid expression.
+bool TagIndex::Select(const std::string& expression,
+                      std::vector<bool>* selected, std::string* error) const {
+  Bitset tests;
+  if (!Parser(*this, expression).Parse(&tests, error))
+    return false;
+  selected->assign(num_tests_, false);
+  for (std::size_t i = 0; i < num_tests_; ++i)
+    (*selected)[i] = (tests[i / 64] >> (i % 64)) & 1;
+  return true;
+}
+
+// Returns true if `expression` is a valid `--xtest_tags` expression, else sets
+// `error` to why it is not.
+bool IsValidTagExpression(const std::string& expression, std::string* error) {
+  const TagIndex index({});
+  std::vector<bool> selected;
+  return index.Select(expression, &selected, error);
+}
+}  // namespace internal
+}  // namespace xtest
@@ -0,0 +1,272 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/xtest-tempdir.hh"
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "internal/xtest-port-arch.hh"
+
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+#include <ftw.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if XTEST_OS_LINUX
+#include <linux/magic.h>
+#include <sys/vfs.h>
+#endif
+
+namespace xtest {
+namespace internal {
+#if XTEST_OS_WINDOWS
+std::string GetTempDirBase() { return std::string(); }
+
+void CreateTempDirRoot() {}
+
+void RemoveTempDirRoot() {}
+
+std::string GetTestTempDir(TestRegistrar* /* test */) { return std::string(); }
+
+void ReleaseTestTempDir(TestRegistrar* /* test */) {}
+
+bool RemoveDirectoryTree(const std::string& /* path */) { return false; }
+#else
+// Returns true if `path` is a directory the process can create files in.
+static bool IsWritableDirectory(const char* path) {
+  struct stat status;
+  return path != nullptr && *path != '\0' && stat(path, &status) == 0 &&
+         S_ISDIR(status.st_mode) && access(path, W_OK | X_OK) == 0;
+}
+
+// Returns true if `path` is on a tmpfs, i.e., kept in memory.
+static bool IsOnTmpfs(const char* path) {
+#if XTEST_OS_LINUX
+  struct statfs status;
+  return statfs(path, &status) == 0 && status.f_type == TMPFS_MAGIC;
+#else
+  return false;
+#endif
+}
+
+// Returns the directory the scratch directories of the tests go under.
+std::string GetTempDirBase() {
+  const char* const in_memory[] = {"/dev/shm", std::getenv("XDG_RUNTIME_DIR"),
+                                   std::getenv("TMPDIR"), "/tmp"};
+  for (const char* candidate : in_memory)
+    if (IsWritableDirectory(candidate) && IsOnTmpfs(candidate))
+      return candidate;
+  const char* const on_disk[] = {std::getenv("TMPDIR"), "/tmp"};
+  for (const char* candidate : on_disk)
+    if (IsWritableDirectory(candidate))
+      return candidate;
+  return ".";
+}
+
+// Guards `temp_dir_root` and the `temp_dir_` of the tests.
+static std::mutex temp_dir_mutex;
+
+// Directory created by `CreateTempDirRoot()`, empty if there is none.
+static std::string temp_dir_root;
+
+// Process that created `temp_dir_root`.
+static pid_t temp_dir_root_pid = 0;
+
+// Creates a fresh directory, only accessible to the user, from `pattern`, whose
+// last six characters are "XXXXXX".  Returns its path, or an empty string if it
+// could not be created.
+static std::string MakeUniqueDirectory(const std::string& pattern) {
+  std::vector<char> path(pattern.begin(), pattern.end());
+  path.push_back('\0');
+  if (mkdtemp(path.data()) == nullptr)
+    return std::string();
+  return path.data();
+}
+
+// Creates `temp_dir_root` unless this process has it already.  Called with
+// `temp_dir_mutex` held.
+static void CreateTempDirRootLocked() {
+  // A forked worker process shares the directory of its parent.
+  if (!temp_dir_root.empty())
+    return;
+  temp_dir_root = MakeUniqueDirectory(GetTempDirBase() + "/xtest-XXXXXX");
+  temp_dir_root_pid = getpid();
+}
+
+// Creates the directory the scratch directories of the run go under.
+void CreateTempDirRoot() {
+  std::lock_guard<std::mutex> lock(temp_dir_mutex);
+  CreateTempDirRootLocked();
+}
+
+// Returns the scratch directory of `test`, creating it on the first call.
+std::string GetTestTempDir(TestRegistrar* test) {
+  if (test == nullptr)
+    return std::string();
+  std::lock_guard<std::mutex> lock(temp_dir_mutex);
+  if (test->temp_dir_.empty()) {
+    // Outside of `RUN_ALL_TESTS()` the directory is created on demand.
+    CreateTempDirRootLocked();
+    if (temp_dir_root.empty())
+      return std::string();
+    test->temp_dir_ = MakeUniqueDirectory(temp_dir_root + "/" +
+                                          test->suite_name_ + "." +
+                                          test->test_name_ + "-XXXXXX");
+  }
+  return test->temp_dir_;
+}
+
+// Set when `RemoveDirectoryEntry()` fails to remove an entry.
+static thread_local bool directory_entry_left = false;
+
+// Called by `nftw()` for every entry of the tree being removed, children first.
+static int32_t RemoveDirectoryEntry(const char* path,
+                                    const struct stat* /* status */,
+                                    int32_t /* type */,
+                                    struct FTW* /* position */) {
+  if (std::remove(path) != 0)
+    directory_entry_left = true;
+  return 0;  // Carry on with the other entries.
+}
+
+// Removes `path` and everything under it.
+bool RemoveDirectoryTree(const std::string& path) {
+  directory_entry_left = false;
+  const int32_t kMaxOpenDirectories = 16;
+  if (nftw(path.c_str(), RemoveDirectoryEntry, kMaxOpenDirectories,
+           FTW_DEPTH | FTW_PHYS) != 0)
+    return false;
+  return !directory_entry_left;
+}
+
+// The thread of a process that removes the scratch directories of the tests
+// once they are over.
+struct TempDirCleaner {
+  std::mutex mutex;
+  std::condition_variable changed;
+
+  // Directories to remove, in the order the tests released them.
+  std::deque<std::string> pending;
+
+  bool stopping = false;
+  std::thread thread;
+};
+
+// The cleaner of this process, started by the first directory released.
+static TempDirCleaner* cleaner = nullptr;
+
+// Process the cleaner was started in.  A forked worker process inherits the
+// parent's `cleaner` but not its thread.
+static pid_t cleaner_pid = 0;
+
+// Guards starting and stopping `cleaner`.
+static std::mutex cleaner_mutex;
+
+// Body of the cleaner thread: removes the directories as they are released
+// until it is stopped.
+static void RemoveReleasedDirectories(TempDirCleaner* state) {
+  std::unique_lock<std::mutex> lock(state->mutex);
+  for (;;) {
+    state->changed.wait(
+        lock, [state] { return state->stopping || !state->pending.empty(); });
+    if (state->stopping)
+      return;
+    const std::string path = std::move(state->pending.front());
+    state->pending.pop_front();
+    lock.unlock();
+    RemoveDirectoryTree(path);
+    lock.lock();
+  }
+}
+
+// Returns the cleaner of this process, starting it if needed.
+static TempDirCleaner* StartCleaner() {
+  std::lock_guard<std::mutex> lock(cleaner_mutex);
+  if (cleaner != nullptr && cleaner_pid == getpid())
+    return cleaner;
+  // The cleaner a forked worker process inherited from its parent is left
+  // alone; its mutex may have been held by the parent's cleaner thread.
+  cleaner_pid = getpid();
+  cleaner = new TempDirCleaner;
+  cleaner->thread = std::thread(RemoveReleasedDirectories, cleaner);
+  return cleaner;
+}
+
+// Stops the cleaner thread of this process, if it was started.  What it has not
+// removed yet is left to the caller.
+static void StopCleaner() {
+  std::lock_guard<std::mutex> lock(cleaner_mutex);
+  if (cleaner == nullptr || cleaner_pid != getpid())
+    return;
+  {
+    std::lock_guard<std::mutex> state_lock(cleaner->mutex);
+    cleaner->stopping = true;
+    cleaner->changed.notify_all();
+  }
+  cleaner->thread.join();
+  delete cleaner;
+  cleaner = nullptr;
+}
+
+// Hands the scratch directory of `test` to the cleaner thread.
+void ReleaseTestTempDir(TestRegistrar* test) {
+  std::string path;
+  {
+    std::lock_guard<std::mutex> lock(temp_dir_mutex);
+    path.swap(test->temp_dir_);
+  }
+  if (path.empty())
+    return;
+  TempDirCleaner* const state = StartCleaner();
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->pending.push_back(std::move(path));
+  state->changed.notify_one();
+}
+
+// Removes the directory created by `CreateTempDirRoot()`.
+void RemoveTempDirRoot() {
+  StopCleaner();
+  std::lock_guard<std::mutex> lock(temp_dir_mutex);
+  if (temp_dir_root.empty() || temp_dir_root_pid != getpid())
+    return;
+  RemoveDirectoryTree(temp_dir_root);
+  temp_dir_root.clear();
+}
+#endif  // XTEST_OS_WINDOWS
+}  // namespace internal
+}  // namespace xtest
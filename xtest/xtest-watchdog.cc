@@ -0,0 +1,412 @@
+// Copyright 2022, The xtest authors.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of The xtest authors. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/xtest-watchdog.hh"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "internal/xtest-port-arch.hh"
+
+#if XTEST_OS_LINUX || XTEST_OS_MAC
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+#if XTEST_OS_LINUX
+#include <dirent.h>
+#include <sys/syscall.h>
+#endif
+
+#include "internal/xtest-port.hh"
+#include "xtest-registrar.hh"
+
+namespace xtest {
+namespace internal {
+// Returns the time `test` may run for.
+TimeInMillis GetTestTimeout(const TestRegistrar* test,
+                            const TimeInMillis& default_timeout) {
+  return test->timeout_ > 0 ? test->timeout_ : default_timeout;
+}
+
+using WatchdogClock = std::chrono::steady_clock;
+
+#if XTEST_OS_LINUX
+typedef pid_t ThreadId;
+static ThreadId GetCurrentThreadId() {
+  return static_cast<pid_t>(syscall(SYS_gettid));
+}
+static uint64_t GetThreadNumber(const ThreadId& thread) {
+  return static_cast<uint64_t>(thread);
+}
+static bool IsSameThread(const ThreadId& a, const ThreadId& b) {
+  return a == b;
+}
+#elif XTEST_OS_MAC
+typedef pthread_t ThreadId;
+static ThreadId GetCurrentThreadId() { return pthread_self(); }
+static uint64_t GetThreadNumber(const ThreadId& thread) {
+  uint64_t number = 0;
+  pthread_threadid_np(thread, &number);
+  return number;
+}
+static bool IsSameThread(const ThreadId& a, const ThreadId& b) {
+  return pthread_equal(a, b) != 0;
+}
+#else
+typedef std::thread::id ThreadId;
+static ThreadId GetCurrentThreadId() { return std::this_thread::get_id(); }
+#endif
+
+// A test the watchdog is watching.
+struct WatchedTest {
+  const TestRegistrar* test;
+  TimeInMillis timeout;
+
+  // Time the test runs out of time at and, once it has, the time it is given
+  // up on at if it has not been left by then.
+  WatchdogClock::time_point deadline;
+
+  ThreadId thread;  // Thread running the test.
+
+  // The `interrupt_requested` flag of the thread running the test.
+  std::atomic<bool>* interrupt_requested;
+
+  bool timed_out;  // True once the test has run out of time.
+  bool dumping;    // True while the stacks are dumped for it.
+};
+
+// The watchdog of a process.
+struct Watchdog {
+  std::mutex mutex;
+  std::condition_variable changed;
+
+  // Tests being watched keyed by the thread running them.
+  std::map<std::thread::id, WatchedTest> tests;
+
+  bool stopping = false;
+  std::thread thread;
+};
+
+// The watchdog of this process, started by the first test it watches.
+static Watchdog* watchdog = nullptr;
+
+// Guards starting and stopping `watchdog`.
+static std::mutex watchdog_mutex;
+
+// Set by the watchdog for the thread running a test that ran out of time, so
+// that its stack dump handler interrupts the test.
+static thread_local std::atomic<bool> interrupt_requested(false);
+
+// Handler interrupting the test running on this thread.
+static thread_local TimeoutInterruptHandler interrupt_handler = nullptr;
+
+// True while the test running on this thread is being watched.
+static thread_local bool test_watched = false;
+
+#if XTEST_OS_WINDOWS
+// Reports that `timed_out` ran out of time.  Threads cannot be interrupted on
+// Windows, so the process exits.
+static void ReportTimeout(const WatchedTest& timed_out,
+                          const std::vector<ThreadId>& /* test_threads */) {
+  std::fprintf(stderr,
+               "\n[ TIMEOUT  ] %s.%s did not finish within %lld ms; the test "
+               "cannot be interrupted on this platform, exiting.\n",
+               timed_out.test->suite_name_, timed_out.test->test_name_,
+               static_cast<long long>(timed_out.timeout));
+  std::fflush(stderr);
+  std::_Exit(EXIT_FAILURE);
+}
+#else
+// Signal a thread is sent to dump its stack.  It is ignored by default, so one
+// that is delivered after the handler has been restored does no harm.
+static const int32_t kStackDumpSignal = SIGURG;
+
+// Largest number of stack frames a thread prints.
+static const int32_t kMaxStackFrames = 64;
+
+// Time a thread is given to dump its stack.
+static const TimeInMillis kStackDumpTimeout = 1000;
+
+// Process the watchdog was started in.  A forked worker process inherits the
+// parent's `watchdog` but not its thread.
+static pid_t watchdog_pid = 0;
+
+// Number of stack dumps the threads of the process have completed.
+static std::atomic<uint32_t> stack_dumps_completed(0);
+
+static struct sigaction saved_stack_dump_action;
+
+// Handler of `kStackDumpSignal`: prints the stack of the calling thread and
+// interrupts the test it is running if the watchdog asked for it.
+static void DumpStack(int32_t /* signal */) {
+  const int32_t saved_errno = errno;
+  void* frames[kMaxStackFrames];
+  const int32_t num_frames = backtrace(frames, kMaxStackFrames);
+  backtrace_symbols_fd(frames, num_frames, STDERR_FILENO);
+  stack_dumps_completed.fetch_add(1);
+  errno = saved_errno;
+  if (interrupt_requested.exchange(false) && interrupt_handler != nullptr)
+    interrupt_handler();
+}
+
+static void InstallStackDumpHandler() {
+  // The first call of `backtrace()` loads the unwinder, which is not safe to
+  // do in a signal handler.
+  void* frame = nullptr;
+  backtrace(&frame, 1);
+
+  struct sigaction action;
+  sigemptyset(&action.sa_mask);
+  action.sa_handler = DumpStack;
+  // The handler of an interrupted test does not return but jumps out of the
+  // test, so the signal must not stay blocked.
+  action.sa_flags = SA_NODEFER | SA_RESTART;
+  sigaction(kStackDumpSignal, &action, &saved_stack_dump_action);
+}
+
+static void RestoreStackDumpHandler() {
+  sigaction(kStackDumpSignal, &saved_stack_dump_action, nullptr);
+}
+
+static bool SignalThread(const ThreadId& thread, const int32_t& signal) {
+#if XTEST_OS_LINUX
+  return syscall(SYS_tgkill, getpid(), thread, signal) == 0;
+#else
+  return pthread_kill(thread, signal) == 0;
+#endif
+}
+
+// Returns the threads of the process, or `test_threads`, the threads running
+// tests, where they cannot be listed.
+static std::vector<ThreadId> ListThreads(
+    const std::vector<ThreadId>& test_threads) {
+#if XTEST_OS_LINUX
+  DIR* const tasks = opendir("/proc/self/task");
+  if (tasks == nullptr)
+    return test_threads;
+  std::vector<ThreadId> threads;
+  while (const dirent* const task = readdir(tasks)) {
+    if (task->d_name[0] != '.')
+      threads.push_back(static_cast<ThreadId>(std::atoi(task->d_name)));
+  }
+  closedir(tasks);
+  return threads;
+#else
+  return test_threads;
+#endif
+}
+
+// Has `thread` print its stack on `stderr` and waits for it to finish.
+static void DumpStackOf(const ThreadId& thread) {
+  std::fflush(stderr);
+  const uint32_t dumps_completed = stack_dumps_completed.load();
+  if (!SignalThread(thread, kStackDumpSignal))
+    return;
+  Timer timer;
+  while (stack_dumps_completed.load() == dumps_completed) {
+    if (timer.Elapsed() >= kStackDumpTimeout) {
+      std::fprintf(stderr, "  (not responding)\n");
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+// Reports that `timed_out` ran out of time: dumps the stacks of all threads,
+// the thread running the test last, and interrupts the test.
+static void ReportTimeout(const WatchedTest& timed_out,
+                          const std::vector<ThreadId>& test_threads) {
+  std::fprintf(stderr,
+               "\n[ TIMEOUT  ] %s.%s did not finish within %lld ms; stack "
+               "traces of all threads follow.\n",
+               timed_out.test->suite_name_, timed_out.test->test_name_,
+               static_cast<long long>(timed_out.timeout));
+  const ThreadId self = GetCurrentThreadId();
+  for (const ThreadId& thread : ListThreads(test_threads)) {
+    if (IsSameThread(thread, self) || IsSameThread(thread, timed_out.thread))
+      continue;
+    std::fprintf(stderr, "\nThread %llu:\n",
+                 static_cast<unsigned long long>(GetThreadNumber(thread)));
+    DumpStackOf(thread);
+  }
+  std::fprintf(
+      stderr, "\nThread %llu (running %s.%s):\n",
+      static_cast<unsigned long long>(GetThreadNumber(timed_out.thread)),
+      timed_out.test->suite_name_, timed_out.test->test_name_);
+  timed_out.interrupt_requested->store(true);
+  DumpStackOf(timed_out.thread);
+  std::fflush(stderr);
+}
+#endif  // XTEST_OS_WINDOWS
+
+// Body of the watchdog thread: waits for the earliest deadline of the tests
+// being watched and reports the tests that run out of time.
+static void WatchTests(Watchdog* state) {
+  std::unique_lock<std::mutex> lock(state->mutex);
+  while (!state->stopping) {
+    WatchedTest* next = nullptr;
+    for (auto& entry : state->tests) {
+      if (next == nullptr || entry.second.deadline < next->deadline)
+        next = &entry.second;
+    }
+    if (next == nullptr) {
+      state->changed.wait(lock);
+      continue;
+    }
+    if (WatchdogClock::now() < next->deadline) {
+      state->changed.wait_until(lock, next->deadline);
+      continue;
+    }
+
+    if (next->timed_out) {
+      std::fprintf(stderr,
+                   "[ TIMEOUT  ] %s.%s did not return within %lld ms of being "
+                   "interrupted; exiting.\n",
+                   next->test->suite_name_, next->test->test_name_,
+                   static_cast<long long>(kTimeoutGracePeriod));
+      std::fflush(stderr);
+      std::_Exit(EXIT_FAILURE);
+    }
+
+    // The test stays watched while the stacks are dumped, see
+    // `DisarmTestWatchdog()`.
+    next->timed_out = true;
+    next->dumping = true;
+    const WatchedTest timed_out = *next;
+    std::vector<ThreadId> test_threads;
+    for (const auto& entry : state->tests)
+      test_threads.push_back(entry.second.thread);
+    lock.unlock();
+    ReportTimeout(timed_out, test_threads);
+    lock.lock();
+    next->dumping = false;
+    next->deadline = WatchdogClock::now() +
+                     std::chrono::milliseconds(kTimeoutGracePeriod);
+    state->changed.notify_all();
+  }
+}
+
+// Returns the watchdog of this process, starting it if needed.
+static Watchdog* StartWatchdog() {
+  std::lock_guard<std::mutex> lock(watchdog_mutex);
+#if XTEST_OS_WINDOWS
+  if (watchdog != nullptr)
+    return watchdog;
+#else
+  if (watchdog != nullptr && watchdog_pid == getpid())
+    return watchdog;
+  // The watchdog a forked worker process inherited from its parent is left
+  // alone; its mutex may have been held by the parent's watchdog thread.
+  watchdog_pid = getpid();
+  InstallStackDumpHandler();
+#endif
+  watchdog = new Watchdog;
+  watchdog->thread = std::thread(WatchTests, watchdog);
+  return watchdog;
+}
+
+// Starts watching `test`, which the calling thread is about to run, for running
+// longer than `timeout` milliseconds.
+void ArmTestWatchdog(const TestRegistrar* test, const TimeInMillis& timeout,
+                     TimeoutInterruptHandler interrupt) {
+  if (timeout <= 0)
+    return;
+  Watchdog* const state = StartWatchdog();
+  interrupt_handler = interrupt;
+  interrupt_requested.store(false);
+
+  WatchedTest watched;
+  watched.test = test;
+  watched.timeout = timeout;
+  watched.deadline =
+      WatchdogClock::now() + std::chrono::milliseconds(timeout);
+  watched.thread = GetCurrentThreadId();
+  watched.interrupt_requested = &interrupt_requested;
+  watched.timed_out = false;
+  watched.dumping = false;
+
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->tests[std::this_thread::get_id()] = watched;
+  test_watched = true;
+  state->changed.notify_all();
+}
+
+// Stops watching the test running on the calling thread.
+bool DisarmTestWatchdog() {
+  if (!test_watched)
+    return false;
+  test_watched = false;
+
+  Watchdog* const state = watchdog;
+  std::unique_lock<std::mutex> lock(state->mutex);
+  const auto watched = state->tests.find(std::this_thread::get_id());
+  state->changed.wait(lock, [&] { return !watched->second.dumping; });
+  const bool timed_out = watched->second.timed_out;
+  state->tests.erase(watched);
+  state->changed.notify_all();
+  // The test is left by now; an interrupt that comes too late must not jump.
+  interrupt_requested.store(false);
+  return timed_out;
+}
+
+// Stops the watchdog thread of this process, if it was started.
+void StopTestWatchdog() {
+  std::lock_guard<std::mutex> lock(watchdog_mutex);
+  if (watchdog == nullptr)
+    return;
+#if !XTEST_OS_WINDOWS
+  if (watchdog_pid != getpid())
+    return;
+#endif
+  {
+    std::lock_guard<std::mutex> state_lock(watchdog->mutex);
+    watchdog->stopping = true;
+    watchdog->changed.notify_all();
+  }
+  watchdog->thread.join();
+  delete watchdog;
+  watchdog = nullptr;
+#if !XTEST_OS_WINDOWS
+  RestoreStackDumpHandler();
+#endif
+}
+}  // namespace internal
+}  // namespace xtest
@@ -29,23 +29,43 @@
 
 #include "xtest.hh"
 
+#include <algorithm>
 #include <chrono>  // NOLINT
 #include <cinttypes>
 #include <csetjmp>
 #include <csignal>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <cwchar>
 #include <iomanip>
 #include <iostream>
 #include <limits>
 #include <list>
+#include <new>
+#include <numeric>
 #include <sstream>
 #include <string>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "internal/xtest-port.hh"
+#include "internal/xtest-affinity.hh"
+#include "internal/xtest-cancellation.hh"
+#include "internal/xtest-context.hh"
+#include "internal/xtest-faults.hh"
+#include "internal/xtest-filter.hh"
+#include "internal/xtest-history.hh"
+#include "internal/xtest-isolation.hh"
+#include "internal/xtest-journal.hh"
 #include "internal/xtest-printers.hh"
+#include "internal/xtest-scheduler.hh"
+#include "internal/xtest-server.hh"
+#include "internal/xtest-soak.hh"
+#include "internal/xtest-tags.hh"
+#include "internal/xtest-tempdir.hh"
+#include "internal/xtest-watchdog.hh"
 #include "xtest-message.hh"
 
 // When this flag is specified, the xtest's help message is printed on the
@@ -57,10 +77,136 @@ XTEST_FLAG_DEFINE_bool_(shuffle, false,
                         "True if and only if " XTEST_NAME_
                         " should randomize tests' order on every run.");
 
+// Seed to shuffle the tests with, in [1, 99999]; `0` picks one from the
+// current time.  The seed is printed so that an order can be replayed.
+XTEST_FLAG_DEFINE_uint32_(random_seed, 0,
+                          "Random number seed to use for shuffling test "
+                          "orders; 0 picks one from the current time.");
+
 // Prints the list of all tests with there suite names.
 XTEST_FLAG_DEFINE_bool_(list_tests, false,
                         "List all tests without running them.");
 
+// Number of worker threads to run the tests on.  `1` runs the tests serially on
+// the main thread and `0` uses one worker thread per online CPU.
+XTEST_FLAG_DEFINE_uint32_(jobs, 1,
+                          "Number of threads to run the tests on; 0 means one "
+                          "thread per online CPU.");
+
+// CPUs the workers of a parallel run are pinned to: "compact", "scatter" or a
+// list of CPUs such as "0,2,4-7", see `internal::CpuAffinity`.  Empty leaves
+// the workers to the kernel.
+XTEST_FLAG_DEFINE_string_(cpu_affinity, "",
+                          "CPUs to pin the workers to: compact, scatter or a "
+                          "list such as 0,2,4-7; empty means no pinning.");
+
+// Isolation of the tests from each other.  "none" runs the tests in this
+// process and "process" runs them in forked worker processes so that a
+// crashing test does not take the whole run down.  "zygote" forks a fresh
+// worker for every batch of tests from the warmed up parent process.
+XTEST_FLAG_DEFINE_string_(isolate, "none",
+                          "Isolation of the tests from each other.  Valid "
+                          "values: none, process and zygote.");
+
+// Number of tests each worker forked with `--xtest_isolate=zygote` runs before
+// it exits.  `0` hands out batches that shrink as the run nears its end.
+XTEST_FLAG_DEFINE_uint32_(zygote_batch, 1,
+                          "Number of tests each zygote worker runs before it "
+                          "exits; 0 means batches shrinking toward the end.");
+
+// Runs only the tests whose full names ("Suite.Test") match this filter of
+// positive and negative glob patterns, see `internal::TestFilter`.  An empty
+// filter runs all tests.
+XTEST_FLAG_DEFINE_string_(filter, "",
+                          "Glob patterns of the full names of the tests to "
+                          "run, e.g., Foo.*-Foo.Slow*; empty means all tests.");
+
+// Runs only the tests whose tags match this expression, e.g., "fast,!network".
+// See `internal::TagIndex`.  An empty expression runs all tests.
+XTEST_FLAG_DEFINE_string_(tags, "",
+                          "Expression over the tags of the tests to run, e.g., "
+                          "fast,!network; empty means all tests.");
+
+// When true the tests whose suite or test name starts with "DISABLED_" are run
+// too.
+XTEST_FLAG_DEFINE_bool_(also_run_disabled_tests, false,
+                        "Run disabled tests too.");
+
+// Path of the Unix domain socket to serve test runs on instead of running the
+// tests once.  See `internal::ServeTests()`.
+XTEST_FLAG_DEFINE_string_(serve, "",
+                          "Unix domain socket to serve test runs on instead of "
+                          "running the tests once.");
+
+// Path of the journal every completed test is recorded in as soon as it
+// completes.  See `internal::TestJournal`.
+XTEST_FLAG_DEFINE_string_(journal, "",
+                          "File to record the result of every test in as soon "
+                          "as it completes.");
+
+// Path of the journal of an earlier run to resume: the tests recorded in it are
+// not run again, and the run is recorded in it unless `--xtest_journal` says
+// otherwise.
+XTEST_FLAG_DEFINE_string_(resume, "",
+                          "Journal of an earlier run whose recorded tests are "
+                          "not run again.");
+
+// Path of the file the elapsed times of the tests are kept in across runs.
+// The tests are scheduled longest first and shards are balanced by expected
+// running time.  See `internal::TestHistory`.
+XTEST_FLAG_DEFINE_string_(history, "",
+                          "File to keep the elapsed times of the tests in "
+                          "across runs to schedule the longest tests first.");
+
+// Wall-clock time the run may take, e.g., "120s".  Only the tests likeliest to
+// fail that are expected to fit in it, according to the `--xtest_history`
+// file, are run.  Empty means no limit.
+XTEST_FLAG_DEFINE_string_(time_budget, "",
+                          "Time the run may take, e.g., 120s; only the tests "
+                          "likeliest to fail that fit in it are run.");
+
+// Wall-clock time to keep running the tests for, shuffled, e.g., "2h", while
+// the resources of the process are tracked for steady growth.  Empty runs the
+// tests once.
+XTEST_FLAG_DEFINE_string_(soak, "",
+                          "Time to keep running the tests for while checking "
+                          "for leaks, e.g., 2h; empty runs them once.");
+
+// Time a test may run for, e.g., "30s", unless it was registered with
+// `TEST_WITH_TIMEOUT()`.  A test that runs out of time is interrupted, after
+// the stacks of all threads are dumped, and fails.  Empty or `0` means no
+// limit.
+XTEST_FLAG_DEFINE_string_(timeout, "",
+                          "Time a test may run for, e.g., 30s, before it is "
+                          "interrupted and fails.");
+
+// Largest resident set size a test may reach, e.g., "2G" or "512M", with
+// `--xtest_isolate`.  A test that goes over it fails with its peak resident set
+// size and its worker process is replaced.  Empty means no limit.
+XTEST_FLAG_DEFINE_string_(max_rss, "",
+                          "Largest resident set size a test may reach in a "
+                          "worker process, e.g., 2G.");
+
+// When true a test that raises `SIGSEGV`, `SIGBUS`, `SIGFPE` or `SIGILL` is
+// jumped out of and fails, and the run goes on with the next test.
+XTEST_FLAG_DEFINE_bool_(catch_faults, false,
+                        "Fail a test that crashes on a fault signal and go on "
+                        "with the next test.");
+
+// When true the run is cancelled on the first failure: no further test is
+// started, in any worker, and the tests still running see `XTEST_CANCELLED()`
+// turn true so that they can stop early.
+XTEST_FLAG_DEFINE_bool_(fail_fast, false,
+                        "Stop the run on the first test failure.");
+
+// Full name ("Suite.Test") of a test that fails only after some of the tests
+// run before it.  Instead of running the tests, the tests before it are
+// bisected in forked child processes for the shortest run of them after which
+// it fails.
+XTEST_FLAG_DEFINE_string_(bisect_order, "",
+                          "Test that fails only after other tests, to find "
+                          "the shortest run of tests it fails after.");
+
 // This flag enables using colors in terminal output. Available values are "yes"
 // to enable colors, "no" (disable colors), or "auto" (the default) to let XTest
 // decide.
@@ -71,8 +217,11 @@ XTEST_FLAG_DEFINE_string_(
     "being sent to a terminal and the TERM environment variable "
     "is set to a terminal type that supports colors.");
 
-XTEST_GLOBAL_DEFINE_uint64_(failure_count, 0,
-                            "Global counter for the number of failed tests.");
+XTEST_GLOBAL_DEFINE_atomic_uint64_(
+    failure_count, 0, "Global counter for the number of failed tests.");
+XTEST_GLOBAL_DEFINE_atomic_uint64_(
+    unattributed_failure_count, 0,
+    "Global counter for the failed assertions of no test.");
 XTEST_GLOBAL_DEFINE_uint64_(test_count, 0,
                             "Global counter for the number of tests run.");
 XTEST_GLOBAL_DEFINE_uint64_(test_suite_count, 0,
@@ -85,16 +234,59 @@ XTEST_STATIC_DECLARE_vector_(argvs, std::string,
                              "main executable.  Set by InitXTest().");
 
 namespace xtest {
+// Stores the environment information of the test running on this thread to
+// later make a long jump using `std::longjmp()` and register the test result
+// as `TestResult::FAILED`.
+//
+// Every thread that runs tests has its own instance, so a fatal assertion in a
+// test running on one worker thread only unwinds that test.
+static thread_local std::jmp_buf jump_out_of_test;
+
+// True while this thread is inside of a test, i.e., while `jump_out_of_test`
+// holds a valid environment to jump to.
+static thread_local bool jump_out_of_test_armed = false;
+
+// Signal and address of the fault the test running on this thread was jumped
+// out of by `impl::FaultHandler()`; `signal` is `0` if there was none.
+static thread_local internal::Fault test_fault = {0, nullptr};
+
 namespace impl {
-// Calls std::longjmp() with jump_out_of_test_ instance as its first
+// Calls std::longjmp() with jump_out_of_test instance as its first
 // argument.
 //
 // This function calls the std::longjmp() function with the std::jmp_buf
-// instance jump_out_of_test_ as its first argument when the SIGABRT is raised
-// inside of the function run_registered_test() that runs the registered test
-// suites.
+// instance jump_out_of_test as its first argument when the SIGABRT is raised
+// inside of a test run by the function RunRegisteredTests().  The signal is
+// delivered to the thread that called `abort()`, so the jump lands in the test
+// that raised it.  An abort raised outside of a test, e.g., on a helper thread
+// spawned by a test, is not ours to handle and terminates the program.
 void SignalHandler(int param) {
-  std::longjmp(XTestRegistryInstance.jump_out_of_test_, 1);
+  if (!jump_out_of_test_armed) {
+    std::signal(param, SIG_DFL);
+    std::raise(param);
+    return;
+  }
+  std::longjmp(jump_out_of_test, 1);
+}
+
+// Jumps out of the test running on this thread when it raises a fault signal,
+// e.g., on a null dereference, with `--xtest_catch_faults`.  Called from the
+// signal handler, on the alternate signal stack of the thread, so that a test
+// that overflowed its stack is jumped out of too.  A fault outside of a test
+// is left to kill the process.
+void FaultHandler(const internal::Fault& fault) {
+  if (!jump_out_of_test_armed)
+    return;
+  test_fault = fault;
+  std::longjmp(jump_out_of_test, 1);
+}
+
+// Jumps out of the test running on this thread when the watchdog interrupts
+// it for running out of time, see `internal::ArmTestWatchdog()`.  Called from
+// a signal handler on the thread running the test.
+void TimeoutHandler() {
+  if (jump_out_of_test_armed)
+    std::longjmp(jump_out_of_test, 1);
 }
 }  // namespace impl
 
@@ -116,6 +308,23 @@ static bool XTestIsInitialized() {
   return XTEST_GLOBAL_INSTANCE_GET_(argvs).size() > 0;
 }
 
+// True once `BuildTestPlan()` has set the test and test suite counters to the
+// number of selected tests and test suites.  Until then the counters are
+// computed from the whole registry.
+static bool test_plan_counted = false;
+
+// Tests left out of the run because they did not fit in the
+// `--xtest_time_budget`, in plan order.
+static std::vector<const TestRegistrar*> tests_over_time_budget;
+
+// Number of tests left out of the run because they are disabled, see
+// `IsTestDisabled()`, that would have been run otherwise.
+static uint64_t disabled_test_count = 0;
+
+// Number of tests of the plan that were not run because the run was cancelled
+// by `--xtest_fail_fast`.
+static uint64_t cancelled_test_count = 0;
+
 // Returns a string of length `width` all filled with the character `chr`.
 //
 // This function is mainly used to decorate the box used in the test summary
@@ -215,7 +424,7 @@ std::string Message::GetString() const {
 
 // Returns the total number of test functions.
 std::uint64_t GetTestNumber() {
-  if (XTEST_GLOBAL_INSTANCE_GET_(test_count) != 0)
+  if (XTEST_GLOBAL_INSTANCE_GET_(test_count) != 0 || test_plan_counted)
     return XTEST_GLOBAL_INSTANCE_GET_(test_count);
   XTEST_GLOBAL_INSTANCE_GET_(test_count) = 0;
   for (const XTestUnitTestPair& test_suite :
@@ -226,7 +435,7 @@ std::uint64_t GetTestNumber() {
 
 // Returns the total number of test suites.
 std::uint64_t GetTestSuiteNumber() {
-  if (XTEST_GLOBAL_INSTANCE_GET_(test_suite_count) != 0)
+  if (XTEST_GLOBAL_INSTANCE_GET_(test_suite_count) != 0 || test_plan_counted)
     return XTEST_GLOBAL_INSTANCE_GET_(test_suite_count);
   XTEST_GLOBAL_INSTANCE_GET_(test_suite_count) = 0;
   for (const XTestUnitTestPair& test_suite :
@@ -235,6 +444,27 @@ std::uint64_t GetTestSuiteNumber() {
   return XTEST_GLOBAL_INSTANCE_GET_(test_suite_count);
 }
 
+// Marks `test` as `SKIPPED`, unless it failed already.
+void SkipTest(TestRegistrar* test) { test->test_result_.MarkSkipped(); }
+
+// Returns the context of the calling thread.
+TestContext GetTestContext() { return internal::GetCurrentTestContext(); }
+
+// Returns the scratch directory of the test the calling thread works for.
+std::string TestTempDir() {
+  return internal::GetTestTempDir(internal::GetCurrentTest());
+}
+
+// Returns true once the run has been cancelled, marking `test` as `SKIPPED`
+// unless it failed already or is `nullptr`.
+bool IsTestCancelled(TestRegistrar* test) {
+  if (!internal::IsTestRunCancelled())
+    return false;
+  if (test != nullptr)
+    SkipTest(test);
+  return true;
+}
+
 // Returns the `XTestUnitTest` instance of failed tests.
 //
 // Iterates over the `XTestRegistryInstance.test_registry_table_` instance and
@@ -349,6 +579,58 @@ void PrettyUnitTestResultPrinter::PrintFailedTests() {
   std::fflush(stdout);
 }
 
+// Returns the tests that skipped themselves with `XTEST_SKIP()`.
+static std::vector<const TestRegistrar*> GetSkippedTests() {
+  std::vector<const TestRegistrar*> skipped_tests;
+  for (const auto& test_suite : XTestRegistryInstance.test_registry_table_) {
+    for (const TestRegistrar* const& test : test_suite.second)
+      if (test->test_result_ == TestResult::SKIPPED)
+        skipped_tests.push_back(test);
+  }
+  return skipped_tests;
+}
+
+// Prints the tests that skipped themselves with `XTEST_SKIP()`.  This function
+// should only be called when tests did.
+void PrettyUnitTestResultPrinter::PrintSelfSkippedTests(
+    const std::vector<const TestRegistrar*>& skipped_tests) {
+  const std::string skipped = GetStringAlignedTo(
+      "SKIPPED", XTEST_DEFAULT_SUMMARY_STATUS_STR_WIDTH_, ALIGN_CENTER);
+  internal::ColoredPrintf(internal::XTestColor::kYellow, "[%s] ",
+                          skipped.c_str());
+  std::printf("%lu %s, listed below:\n", skipped_tests.size(),
+              skipped_tests.size() == 1 ? "test" : "tests");
+  for (const TestRegistrar* const& test : skipped_tests) {
+    internal::ColoredPrintf(internal::XTestColor::kYellow, "[%s] ",
+                            skipped.c_str());
+    PrettyUnitTestResultPrinter::PrintTestName(test->suite_name_,
+                                               test->test_name_);
+    std::printf("\n");
+  }
+  std::fflush(stdout);
+}
+
+// Prints the tests left out of the run because they did not fit in the
+// `--xtest_time_budget`.  This function should only be called when tests were
+// left out.
+void PrettyUnitTestResultPrinter::PrintSkippedTests() {
+  const std::string skipped = GetStringAlignedTo(
+      "SKIPPED", XTEST_DEFAULT_SUMMARY_STATUS_STR_WIDTH_, ALIGN_CENTER);
+  internal::ColoredPrintf(internal::XTestColor::kYellow, "[%s] ",
+                          skipped.c_str());
+  std::printf("%lu %s over the time budget, listed below:\n",
+              tests_over_time_budget.size(),
+              tests_over_time_budget.size() == 1 ? "test" : "tests");
+  for (const TestRegistrar* const& test : tests_over_time_budget) {
+    internal::ColoredPrintf(internal::XTestColor::kYellow, "[%s] ",
+                            skipped.c_str());
+    PrettyUnitTestResultPrinter::PrintTestName(test->suite_name_,
+                                               test->test_name_);
+    std::printf("\n");
+  }
+  std::fflush(stdout);
+}
+
 // Prints the number of test suites and tests to run.  Should only be called
 // before starting iteration over the registered test suites.
 void PrettyUnitTestResultPrinter::OnTestIterationStart() {
@@ -372,11 +654,47 @@ void PrettyUnitTestResultPrinter::OnTestIterationEnd() {
       GetStringAlignedTo("PASSED", XTEST_DEFAULT_SUMMARY_STATUS_STR_WIDTH_,
                          ALIGN_CENTER)
           .c_str());
-  std::printf("%lu %s.\n", GetTestNumber() - GetFailedTestCount(),
+  const std::vector<const TestRegistrar*> skipped_tests = GetSkippedTests();
+  std::printf("%lu %s.\n",
+              GetTestNumber() - GetFailedTestCount() - skipped_tests.size(),
               GetTestNumber() == 1 ? "test" : "tests");
 
+  if (!skipped_tests.empty())
+    PrettyUnitTestResultPrinter::PrintSelfSkippedTests(skipped_tests);
   if (GetFailedTestCount() != 0)
     PrettyUnitTestResultPrinter::PrintFailedTests();
+  const uint64_t unattributed_failure_count =
+      XTEST_GLOBAL_INSTANCE_GET_(unattributed_failure_count);
+  if (unattributed_failure_count != 0) {
+    internal::ColoredPrintf(
+        internal::XTestColor::kRed, "[%s] ",
+        GetStringAlignedTo("FAILED", XTEST_DEFAULT_SUMMARY_STATUS_STR_WIDTH_,
+                           ALIGN_CENTER)
+            .c_str());
+    std::printf("%lu %s on threads that work for no test.\n",
+                unattributed_failure_count,
+                unattributed_failure_count == 1 ? "assertion failed"
+                                                : "assertions failed");
+  }
+  if (!tests_over_time_budget.empty())
+    PrettyUnitTestResultPrinter::PrintSkippedTests();
+  if (cancelled_test_count != 0) {
+    internal::ColoredPrintf(
+        internal::XTestColor::kYellow, "[%s] ",
+        GetStringAlignedTo("SKIPPED", XTEST_DEFAULT_SUMMARY_STATUS_STR_WIDTH_,
+                           ALIGN_CENTER)
+            .c_str());
+    std::printf("%lu %s not run after the first failure.\n",
+                cancelled_test_count,
+                cancelled_test_count == 1 ? "test" : "tests");
+  }
+  if (disabled_test_count != 0) {
+    std::printf("\n");
+    internal::ColoredPrintf(internal::XTestColor::kYellow,
+                            "  YOU HAVE %lu DISABLED %s\n\n",
+                            disabled_test_count,
+                            disabled_test_count == 1 ? "TEST" : "TESTS");
+  }
 
   std::fflush(stdout);
 }
@@ -404,10 +722,166 @@ void PrettyUnitTestResultPrinter::OnEnvironmentsTearDownStart() {
   std::fflush(stdout);
 }
 
-// Lists the tests with their suite names on the console when called.
-static void ListTestsWithSuiteName() {
+// Returns true if `test` is disabled, i.e., if its suite or test name starts
+// with "DISABLED_".  A disabled test is not run unless
+// `--xtest_also_run_disabled_tests` is given.
+static bool IsTestDisabled(const TestRegistrar* const& test) {
+  return std::strncmp(test->suite_name_, "DISABLED_", 9) == 0 ||
+         std::strncmp(test->test_name_, "DISABLED_", 9) == 0;
+}
+
+// Returns every registered test, in registry order.
+static const std::vector<TestRegistrar*>& GetRegisteredTests() {
+  static const std::vector<TestRegistrar*> registered_tests = []() {
+    std::vector<TestRegistrar*> tests;
+    for (const auto& test_suite : XTestRegistryInstance.test_registry_table_)
+      tests.insert(tests.end(), test_suite.second.begin(),
+                   test_suite.second.end());
+    return tests;
+  }();
+  return registered_tests;
+}
+
+// Returns the index of the tags of the registered tests, in the order of
+// `GetRegisteredTests()`.  The index is built once, by the first run that
+// selects tests by `--xtest_tags`, and reused by every later one, e.g., by
+// every request of `--xtest_serve`.
+static const internal::TagIndex& GetTagIndex() {
+  static const internal::TagIndex tag_index(GetRegisteredTests());
+  return tag_index;
+}
+
+// Sets `selected` to whether every registered test, in the order of
+// `GetRegisteredTests()`, is selected by `--xtest_tags`.
+static void SelectTestsByTags(std::vector<bool>* selected) {
+  const std::string& tags = XTEST_FLAG_GET_(tags);
+  std::string error;
+  if (tags.empty() || !GetTagIndex().Select(tags, selected, &error))
+    selected->assign(GetRegisteredTests().size(), true);
+}
+
+// Test history of earlier runs the tests are scheduled by and the elapsed
+// times of this run are added to; see `--xtest_history`.
+static internal::TestHistory test_history;
+
+// Reads the `--xtest_history` file, if any, and sets the expected time of
+// every registered test from it.
+static void LoadTestHistory() {
+  const std::string& path = XTEST_FLAG_GET_(history);
+  if (!path.empty() && !test_history.Load(path)) {
+    XTEST_LOG_(WARNING) << "Could not read the test history \"" << path
+                        << "\": " << std::strerror(errno)
+                        << "; running the tests in their usual order.";
+  }
+  for (const auto& test_suite : XTestRegistryInstance.test_registry_table_) {
+    for (TestRegistrar* const& test : test_suite.second)
+      test->expected_time_ = path.empty() ? 0 : test_history.ExpectedTime(test);
+  }
+}
+
+// Writes the test history with the elapsed times of this run added to the
+// `--xtest_history` file, if any.
+static void SaveTestHistory() {
+  const std::string& path = XTEST_FLAG_GET_(history);
+  if (!path.empty() && !test_history.Save(path)) {
+    XTEST_LOG_(WARNING) << "Could not write the test history \"" << path
+                        << "\": " << std::strerror(errno);
+  }
+}
+
+// Builds the plan of the tests to run.
+//
+// Selects the registered tests matching `--xtest_filter` whose tags match
+// `--xtest_tags`, leaving the disabled ones out, that belong to this test shard
+// (see `internal::ReadShardingEnvironment()`) keeping them grouped by test
+// suite and sets the global test and test suite counters to the number of
+// selected tests and test suites.  Test suites without any selected test are
+// left out.  With a test history the shards are balanced by expected time
+// (see `internal::PackTestsIntoShards()`), otherwise they are picked by test
+// name.  Sets `sharded` to whether this is one shard of many.
+static internal::TestPlan BuildTestPlan(bool* sharded) {
+  int32_t total_shards = 1;
+  int32_t shard_index = 0;
+  internal::ReadShardingEnvironment(&total_shards, &shard_index);
+  *sharded = total_shards > 1;
+  internal::TestFilter filter(XTEST_FLAG_GET_(filter));
+
+  const std::vector<TestRegistrar*>& registered_tests = GetRegisteredTests();
+  std::vector<bool> selected_by_tags;
+  SelectTestsByTags(&selected_by_tags);
+  std::vector<TestRegistrar*> selected_tests;
+  disabled_test_count = 0;
+  for (std::size_t i = 0; i < registered_tests.size(); ++i) {
+    TestRegistrar* const test = registered_tests[i];
+    const std::string test_name =
+        std::string(test->suite_name_) + '.' + test->test_name_;
+    if (!selected_by_tags[i] || !filter.Matches(test_name))
+      continue;
+    if (IsTestDisabled(test) && !XTEST_FLAG_GET_(also_run_disabled_tests)) {
+      ++disabled_test_count;
+      continue;
+    }
+    selected_tests.push_back(test);
+  }
+  std::unordered_set<const TestRegistrar*> tests_on_shard;
+  if (total_shards > 1 && !test_history.empty()) {
+    const std::vector<int32_t> shard_of_test =
+        internal::PackTestsIntoShards(selected_tests, total_shards);
+    for (std::size_t i = 0; i < selected_tests.size(); ++i)
+      if (shard_of_test[i] == shard_index)
+        tests_on_shard.insert(selected_tests[i]);
+  } else {
+    for (const TestRegistrar* const& test : selected_tests)
+      if (internal::IsTestOnShard(test, total_shards, shard_index))
+        tests_on_shard.insert(test);
+  }
+
+  internal::TestPlan plan;
+  uint64_t test_count = 0;
   for (const XTestUnitTestPair& test_suite :
        XTestRegistryInstance.test_registry_table_) {
+    XTestUnitTestPair selected(test_suite.first, {});
+    for (TestRegistrar* const& test : test_suite.second)
+      if (tests_on_shard.count(test) != 0)
+        selected.second.push_back(test);
+    if (selected.second.empty())
+      continue;
+    test_count += selected.second.size();
+    plan.push_back(std::move(selected));
+  }
+
+  XTEST_GLOBAL_INSTANCE_SET_(test_count, test_count);
+  XTEST_GLOBAL_INSTANCE_SET_(test_suite_count, plan.size());
+  test_plan_counted = true;
+
+  if (total_shards > 1 && !XTEST_FLAG_GET_(list_tests)) {
+    internal::ColoredPrintf(internal::XTestColor::kYellow,
+                            "Note: This is test shard %d of %d.\n",
+                            shard_index + 1, total_shards);
+  }
+  return plan;
+}
+
+// Functions registered with `AddWarmUpHook()` and whether they have been run.
+static std::vector<void (*)()> warm_up_hooks;
+static bool warm_up_hooks_run = false;
+
+// Registers `hook` to be called once, right before the first test is run.
+void AddWarmUpHook(void (*hook)()) { warm_up_hooks.push_back(hook); }
+
+// Runs the warm-up hooks registered with `AddWarmUpHook()` unless they have
+// already been run.
+static void RunWarmUpHooks() {
+  if (warm_up_hooks_run)
+    return;
+  warm_up_hooks_run = true;
+  for (void (*const& hook)() : warm_up_hooks)
+    hook();
+}
+
+// Lists the tests of `plan` with their suite names on the console when called.
+static void ListTestsWithSuiteName(const internal::TestPlan& plan) {
+  for (const XTestUnitTestPair& test_suite : plan) {
     bool printed_test_suite_name = false;
     for (const TestRegistrar* const& test : test_suite.second) {
       if (!printed_test_suite_name) {
@@ -423,55 +897,432 @@ static void ListTestsWithSuiteName() {
   std::fflush(stdout);
 }
 
+// Time a test may run for unless it says otherwise, from `--xtest_timeout`.
+// `0` means no limit.
+static TimeInMillis default_test_timeout = 0;
+
+// Marks `test`, which ran for longer than `timeout` milliseconds, as `FAILED`
+// and says so in its output.
+static void ReportTestTimeout(TestRegistrar* test,
+                              const TimeInMillis& timeout) {
+  test->test_result_ = TestResult::FAILED;
+  ++XTEST_GLOBAL_INSTANCE_GET_(failure_count);
+  internal::PrettyAssertionResultPrinter::OnTestAssertionStart(test);
+  internal::StreamPrintf(stderr,
+                         "error: %s.%s timed out after %" PRId64 " ms\n",
+                         test->suite_name_, test->test_name_,
+                         static_cast<int64_t>(timeout));
+  internal::PrettyAssertionResultPrinter::OnTestAssertionEnd(
+      test, test->elapsed_time_);
+}
+
+// Marks `test`, which raised `fault`, as `FAILED` and says so in its output.
+static void ReportTestFault(TestRegistrar* test, const internal::Fault& fault) {
+  test->test_result_ = TestResult::FAILED;
+  ++XTEST_GLOBAL_INSTANCE_GET_(failure_count);
+  internal::PrettyAssertionResultPrinter::OnTestAssertionStart(test);
+  internal::StreamPrintf(stderr, "error: %s.%s crashed on %s\n",
+                         test->suite_name_, test->test_name_,
+                         internal::DescribeFault(fault).c_str());
+  internal::PrettyAssertionResultPrinter::OnTestAssertionEnd(
+      test, test->elapsed_time_);
+}
+
+// Says in the output of `test` that it skipped itself with `XTEST_SKIP()`.
+static void ReportTestSkipped(const TestRegistrar* test) {
+  internal::PrettyAssertionResultPrinter::OnTestAssertionStart(test);
+  internal::PrettyAssertionResultPrinter::OnTestAssertionEnd(
+      test, test->elapsed_time_);
+}
+
+// Runs a single test on the calling thread and records its result and elapsed
+// time in `test`.
+//
+// In case an `ASSERT_*` assertion fails inside of the test the abort signal it
+// raises is caught by `impl::SignalHandler()`, which jumps back here to mark
+// the test as `FAILED`.  A test that runs out of time is interrupted by the
+// watchdog the same way, through `impl::TimeoutHandler()`, and so is one that
+// crashes with `--xtest_catch_faults`, through `impl::FaultHandler()`.
+//
+// The assertions made on the calling thread, and on the helper threads the
+// test starts with `TestThread`, are recorded against `test`, see
+// `internal::ScopedTestRun`.  The output of the helper threads is printed after
+// the test's own.  Its scratch directory, if it asked for one with
+// `TestTempDir()`, is removed in the background once it is over.
+static void RunTest(TestRegistrar* test) {
+  if (test->test_func_ == nullptr)
+    return;
+  const TimeInMillis timeout =
+      internal::GetTestTimeout(test, default_test_timeout);
+  if (XTEST_FLAG_GET_(catch_faults))
+    internal::EnsureAlternateSignalStack();
+  test_fault.signal = 0;
+  internal::PlaceTest(test->cost_);
+  test->cpu_ = internal::GetCurrentCpu();
+  // Every run of a test with fake time starts at the same time.
+  test->fake_time_.Store(0);
+  internal::ScopedTestRun test_run(test);
+  internal::Timer timer;
+  bool out_of_memory = false;
+  // We are setting a jump here to later mark the test result as `FAILED` in
+  // case the `test->test_func_` raised an abort signal result of an
+  // `ASSERT_*` assertion.  This step is reduntant but it is done to make
+  // readers understand that the `abort` signal will be caught here and the
+  // test suite will be exited.
+  if (setjmp(jump_out_of_test)) {
+    test->test_result_ = TestResult::FAILED;
+  } else {
+    jump_out_of_test_armed = true;
+    internal::ArmTestWatchdog(test, timeout, impl::TimeoutHandler);
+    try {
+      test->test_func_(test);
+      test->test_result_.MarkPassed();
+    } catch (const std::bad_alloc&) {
+      // E.g., under the memory limit of `--xtest_max_rss`.
+      out_of_memory = true;
+    }
+  }
+  jump_out_of_test_armed = false;
+  // A fault or a timeout may have jumped out of the test before its helper
+  // threads were over.
+  test_run.JoinHelperThreads();
+  test_run.PrintHelperOutput();
+  internal::ReleaseTestTempDir(test);
+  const bool timed_out = internal::DisarmTestWatchdog();
+  test->elapsed_time_ = timer.Elapsed();
+  if (timed_out)
+    ReportTestTimeout(test, timeout);
+  else if (test_fault.signal != 0)
+    ReportTestFault(test, test_fault);
+  else if (out_of_memory)
+    internal::ReportAllocationFailure(test);
+  else if (test->test_result_ == TestResult::SKIPPED)
+    ReportTestSkipped(test);
+}
+
+// Journal the tests are recorded in as they complete; see `--xtest_journal`.
+static internal::TestJournal test_journal;
+
+// Records the result of `test` once it has completed and cancels the run if it
+// failed with `--xtest_fail_fast`, which also covers the failures that are not
+// assertions, e.g., timeouts and crashes.  Called one test at a time, in the
+// order the tests complete: with `--xtest_jobs` on the worker thread that ran
+// the test, serialized by the `printer_mutex` of `RunTestPlanInParallel()`,
+// else on the main thread.  A test that was not run because the run was
+// cancelled is not recorded.
+static void OnTestCompleted(TestRegistrar* test) {
+  if (test->test_result_ == TestResult::UNKNOWN)
+    return;
+  if (test->test_result_ == TestResult::FAILED)
+    internal::CancelTestRunIfFailingFast();
+  test_journal.Append(test);
+  test_history.Record(test);
+}
+
 // Runs the registered test suite.
 //
 // This function runs the registered test suite in the
-// `xtest::XTestRegistryInstance.test_registry_table_` instance while also
-// handling the abort signals raised by `ASSERT_*` assertions.
+// `xtest::XTestRegistryInstance.test_registry_table_` instance one test at a
+// time on the calling thread.
 //
 // In case an assertion fails then this function marks that test suite as
-// `FAILED` while silently continuing executing rest of the test suites.
+// `FAILED` while silently continuing executing rest of the test suites, unless
+// the failure cancelled the run with `--xtest_fail_fast`.
 static void RunRegisteredTestSuite(const std::list<TestRegistrar*>& tests) {
-  void (*SavedSignalHandler)(int);
-  SavedSignalHandler = std::signal(SIGABRT, impl::SignalHandler);
   for (TestRegistrar* const& test : tests) {
-    if (test->test_func_ == nullptr)
+    if (internal::IsTestRunCancelled())
+      return;
+    RunTest(test);
+    OnTestCompleted(test);
+  }
+}
+
+// Leaves the tests recorded in the `--xtest_resume` journal out of `plan` and
+// restores their recorded results, so that a run that was killed part way
+// through continues with the tests it did not complete while the summary still
+// covers all of them.  Returns the tests whose results were restored.
+static std::vector<TestRegistrar*> ResumeFromJournal(internal::TestPlan* plan) {
+  const std::string& path = XTEST_FLAG_GET_(resume);
+  internal::JournalEntries entries;
+  if (!internal::ReadTestJournal(path, &entries)) {
+    internal::ColoredPrintf(internal::XTestColor::kRed,
+                            "Could not read the test journal \"%s\": %s\n",
+                            path.c_str(), std::strerror(errno));
+    std::exit(EXIT_FAILURE);
+  }
+
+  std::vector<TestRegistrar*> resumed;
+  internal::TestPlan remaining;
+  for (const XTestUnitTestPair& test_suite : *plan) {
+    XTestUnitTestPair kept(test_suite.first, {});
+    for (TestRegistrar* const& test : test_suite.second) {
+      const auto entry = entries.find(std::string(test->suite_name_) + '.' +
+                                      test->test_name_);
+      if (entry == entries.end()) {
+        kept.second.push_back(test);
+        continue;
+      }
+      test->test_result_ = entry->second.result;
+      test->elapsed_time_ = entry->second.elapsed_time;
+      if (test->test_result_ == TestResult::FAILED)
+        ++XTEST_GLOBAL_INSTANCE_GET_(failure_count);
+      resumed.push_back(test);
+    }
+    if (!kept.second.empty())
+      remaining.push_back(std::move(kept));
+  }
+  *plan = std::move(remaining);
+
+  if (!resumed.empty()) {
+    internal::ColoredPrintf(internal::XTestColor::kYellow,
+                            "Note: Resuming from \"%s\"; %lu tests already "
+                            "run are skipped.\n",
+                            path.c_str(), resumed.size());
+  }
+  return resumed;
+}
+
+// Leaves the tests that are not expected to fit in the `--xtest_time_budget`
+// out of `plan`, running the tests likeliest to fail first, and records them in
+// `tests_over_time_budget` for the summary.
+//
+// The tests are ranked by `internal::TestHistory::FailurePriority()` and then
+// by expected time, cheapest first, and taken in that order as long as their
+// expected times add up to no more than the budget times `num_jobs`, the
+// number of tests running at once.  A test expected to take longer than the
+// budget on its own is never taken.  What is left of the plan runs in that
+// order too, see `internal::OrderTestPlan()`, unless `--xtest_shuffle` shuffles
+// it afterwards, and the test and test suite counters are lowered to what is
+// left.
+static void ApplyTimeBudget(internal::TestPlan* plan,
+                            const std::size_t& num_jobs) {
+  TimeInMillis budget = 0;
+  if (!internal::ParseDuration(XTEST_FLAG_GET_(time_budget).c_str(), &budget))
+    return;
+  if (test_history.empty()) {
+    XTEST_LOG_(WARNING) << "There is no test history from --" XTEST_FLAG_PREFIX_
+                           "history to tell how long the tests take; "
+                           "running all tests regardless of the time budget.";
+    return;
+  }
+
+  std::vector<TestRegistrar*> ranked;
+  for (const XTestUnitTestPair& test_suite : *plan)
+    ranked.insert(ranked.end(), test_suite.second.begin(),
+                  test_suite.second.end());
+  std::vector<double> priority;
+  for (const TestRegistrar* const& test : ranked)
+    priority.push_back(test_history.FailurePriority(test));
+  std::vector<std::size_t> order(ranked.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&](const std::size_t& a, const std::size_t& b) {
+                     if (priority[a] != priority[b])
+                       return priority[a] > priority[b];
+                     return ranked[a]->expected_time_ <
+                            ranked[b]->expected_time_;
+                   });
+
+  const TimeInMillis capacity =
+      budget * static_cast<TimeInMillis>(std::max<std::size_t>(num_jobs, 1));
+  TimeInMillis planned_time = 0;
+  std::unordered_set<const TestRegistrar*> selected;
+  std::vector<const TestRegistrar*> selected_order;
+  for (const std::size_t& index : order) {
+    const TimeInMillis expected_time = ranked[index]->expected_time_;
+    if (expected_time > budget || planned_time + expected_time > capacity)
+      continue;
+    planned_time += expected_time;
+    selected.insert(ranked[index]);
+    selected_order.push_back(ranked[index]);
+  }
+
+  internal::TestPlan remaining;
+  uint64_t dropped_suites = 0;
+  for (const XTestUnitTestPair& test_suite : *plan) {
+    XTestUnitTestPair kept(test_suite.first, {});
+    for (TestRegistrar* const& test : test_suite.second) {
+      if (selected.count(test) != 0)
+        kept.second.push_back(test);
+      else
+        tests_over_time_budget.push_back(test);
+    }
+    if (!kept.second.empty()) {
+      remaining.push_back(std::move(kept));
       continue;
-    internal::Timer timer;
-    // We are setting a jump here to later mark the test result as `FAILED` in
-    // case the `test->test_func_` raised an abort signal result of an
-    // `ASSERT_*` assertion.  This step is reduntant but it is done to make
-    // readers understand that the `abort` signal will be caught here and the
-    // test suite will be exited.
-    if (setjmp(XTestRegistryInstance.jump_out_of_test_)) {
-      test->test_result_ = TestResult::FAILED;
-    } else {
-      test->test_func_(test);
-      if (test->test_result_ == TestResult::UNKNOWN)
-        test->test_result_ = TestResult::PASSED;
     }
-    test->elapsed_time_ = timer.Elapsed();
+    // A suite some of whose tests were resumed from a journal still ran.
+    bool resumed = false;
+    for (const TestRegistrar* const& test :
+         XTestRegistryInstance.test_registry_table_.at(test_suite.first))
+      resumed = resumed || test->test_result_ != TestResult::UNKNOWN;
+    if (!resumed)
+      ++dropped_suites;
   }
+  internal::OrderTestPlan(&remaining, selected_order);
+  *plan = std::move(remaining);
+  XTEST_GLOBAL_INSTANCE_GET_(test_count) -= tests_over_time_budget.size();
+  XTEST_GLOBAL_INSTANCE_GET_(test_suite_count) -= dropped_suites;
+
+  internal::ColoredPrintf(
+      internal::XTestColor::kYellow,
+      "Note: Running %lu of %lu tests, expected to take %.1f s of the %.1f s "
+      "time budget.\n",
+      selected.size(), ranked.size(),
+      static_cast<double>(planned_time) / static_cast<double>(capacity) *
+          static_cast<double>(budget) / 1000.0,
+      static_cast<double>(budget) / 1000.0);
 }
 
-// Runs all the registered test suites and returns the failure count.
+// Opens the journal the run is recorded in, if any, and records the results
+// restored from the journal of the run being resumed in it unless it is the
+// same journal.
+static void OpenTestJournal(const std::vector<TestRegistrar*>& resumed) {
+  const std::string& path = XTEST_FLAG_GET_(journal).empty()
+                                ? XTEST_FLAG_GET_(resume)
+                                : XTEST_FLAG_GET_(journal);
+  if (path.empty())
+    return;
+  if (!test_journal.Open(path)) {
+    internal::ColoredPrintf(internal::XTestColor::kRed,
+                            "Could not open the test journal \"%s\": %s\n",
+                            path.c_str(), std::strerror(errno));
+    std::exit(EXIT_FAILURE);
+  }
+  if (path != XTEST_FLAG_GET_(resume)) {
+    for (const TestRegistrar* const& test : resumed)
+      test_journal.Append(test);
+  }
+}
+
+// Shuffles `plan` with `--xtest_shuffle` and prints the seed it was shuffled
+// with.
+static void ShuffleTestPlanIfRequested(internal::TestPlan* plan) {
+  if (!XTEST_FLAG_GET_(shuffle))
+    return;
+  const uint32_t seed =
+      internal::GetRandomSeedFromFlag(XTEST_FLAG_GET_(random_seed));
+  internal::ShuffleTestPlan(plan, seed);
+  internal::ColoredPrintf(internal::XTestColor::kYellow,
+                          "Note: Randomizing tests' orders with a seed of "
+                          "%u.\n",
+                          seed);
+}
+
+// Counts the tests of `plan` that were not run because the run was cancelled
+// in `cancelled_test_count` and leaves them, and the test suites none of whose
+// tests were run, out of the test and test suite counters.
+static void CountCancelledTests(const internal::TestPlan& plan) {
+  uint64_t cancelled_suites = 0;
+  for (const XTestUnitTestPair& test_suite : plan) {
+    uint64_t cancelled_tests = 0;
+    for (const TestRegistrar* const& test : test_suite.second)
+      if (test->test_result_ == TestResult::UNKNOWN)
+        ++cancelled_tests;
+    cancelled_test_count += cancelled_tests;
+    if (cancelled_tests == test_suite.second.size())
+      ++cancelled_suites;
+  }
+  XTEST_GLOBAL_INSTANCE_GET_(test_count) -= cancelled_test_count;
+  XTEST_GLOBAL_INSTANCE_GET_(test_suite_count) -= cancelled_suites;
+}
+
+// Runs the tests of the test plan once and returns the failure count.
 //
-// This function runs all the registered test suites in the
+// This function runs the selected tests in the
 // `xtest::XTestRegistryInstance.test_registry_table_` instance while also
-// handling the abort signals raised by `ASSERT_*` assertions.
-uint64_t RunRegisteredTests() {
+// handling the abort signals raised by `ASSERT_*` assertions.  With
+// `--xtest_jobs` other than `1` the tests run on a pool of worker threads, and
+// with `--xtest_isolate=process` or `--xtest_isolate=zygote` in a pool of
+// worker processes, while their output is still printed in the same order as a
+// serial run.  On threads that is the output printed through the framework
+// only: the tests share the file descriptors of the streams, so what they write
+// to them directly shows up as they write it.  With `--xtest_fail_fast` the
+// first failure cancels the run, see `internal::CancelTestRun()`.
+static uint64_t RunTestPlanOnce() {
+  LoadTestHistory();
+  bool sharded = false;
+  internal::TestPlan plan = BuildTestPlan(&sharded);
   if (XTEST_FLAG_GET_(list_tests)) {
-    ListTestsWithSuiteName();
+    // In the order the tests would run in.
+    ShuffleTestPlanIfRequested(&plan);
+    ListTestsWithSuiteName(plan);
     return XTEST_GLOBAL_INSTANCE_GET_(failure_count);
   }
 
+  std::vector<TestRegistrar*> resumed;
+  if (!XTEST_FLAG_GET_(resume).empty())
+    resumed = ResumeFromJournal(&plan);
+  const std::size_t num_jobs = internal::GetNumberOfJobs(XTEST_FLAG_GET_(jobs));
+  if (!XTEST_FLAG_GET_(time_budget).empty())
+    ApplyTimeBudget(&plan, num_jobs);
+  ShuffleTestPlanIfRequested(&plan);
+  OpenTestJournal(resumed);
+
+  RunWarmUpHooks();
+
+  default_test_timeout = 0;
+  if (!XTEST_FLAG_GET_(timeout).empty())
+    internal::ParseDuration(XTEST_FLAG_GET_(timeout).c_str(),
+                            &default_test_timeout);
+  // Before any worker process is forked, so that they share the cancellation
+  // and the directory the scratch directories of the tests go under.
+  internal::ResetTestRunCancellation();
+  internal::CreateTempDirRoot();
   PrettyUnitTestResultPrinter::OnTestExecutionStart();
-  for (const XTestUnitTestPair& test_suite :
-       XTestRegistryInstance.test_registry_table_) {
-    PrettyUnitTestResultPrinter::OnTestStart(test_suite);
-    RunRegisteredTestSuite(test_suite.second);
-    PrettyUnitTestResultPrinter::OnTestEnd(test_suite);
+  void (*SavedSignalHandler)(int);
+  SavedSignalHandler = std::signal(SIGABRT, impl::SignalHandler);
+  if (XTEST_FLAG_GET_(catch_faults))
+    internal::InstallFaultHandlers(impl::FaultHandler);
+  internal::CpuAffinity cpu_affinity;
+  std::string cpu_affinity_error;
+  if (!XTEST_FLAG_GET_(cpu_affinity).empty())
+    cpu_affinity.Plan(XTEST_FLAG_GET_(cpu_affinity),
+                      internal::GetCpuTopology(), num_jobs,
+                      &cpu_affinity_error);
+  const internal::CpuAffinity* const worker_cpus =
+      cpu_affinity.empty() ? nullptr : &cpu_affinity;
+  if (XTEST_FLAG_GET_(isolate) != "none") {
+    internal::WorkerPoolOptions options;
+    options.num_workers = num_jobs;
+    options.cpu_affinity = worker_cpus;
+    options.test_timeout = default_test_timeout;
+    if (!XTEST_FLAG_GET_(max_rss).empty())
+      internal::ParseByteSize(XTEST_FLAG_GET_(max_rss).c_str(),
+                              &options.max_rss);
+    if (XTEST_FLAG_GET_(isolate) == "zygote") {
+      options.batch_size = XTEST_FLAG_GET_(zygote_batch);
+      options.fork_per_batch = true;
+    }
+    internal::RunTestPlanInProcesses(plan, options, RunTest, OnTestCompleted);
+  } else if (num_jobs > 1) {
+    internal::RunTestPlanInParallel(plan, num_jobs, RunTest, OnTestCompleted,
+                                    worker_cpus);
+  } else {
+    // The main thread is the only worker.
+    if (worker_cpus != nullptr)
+      worker_cpus->PinWorker(0);
+    for (const XTestUnitTestPair& test_suite : plan) {
+      if (internal::IsTestRunCancelled())
+        break;
+      PrettyUnitTestResultPrinter::OnTestStart(test_suite);
+      RunRegisteredTestSuite(test_suite.second);
+      PrettyUnitTestResultPrinter::OnTestEnd(test_suite);
+    }
+    internal::UnpinCurrentThread();
   }
+  internal::StopTestWatchdog();
+  internal::RemoveTempDirRoot();
+  if (XTEST_FLAG_GET_(catch_faults))
+    internal::RestoreFaultHandlers();
+  std::signal(SIGABRT, SavedSignalHandler);
+  if (internal::IsTestRunCancelled())
+    CountCancelledTests(plan);
+  test_journal.Close();
+  // Every shard must pack the shards from the same history, so a shard that
+  // finishes early must not change it under the others.
+  if (!sharded)
+    SaveTestHistory();
   PrettyUnitTestResultPrinter::OnTestExecutionEnd();
   return XTEST_GLOBAL_INSTANCE_GET_(failure_count);
 }
@@ -510,6 +1361,9 @@ static const std::string ParseFlagValue(const char* const flag,
       std::string(XTEST_FLAG_PREFIX_) + flag_name;
   const std::size_t flag_str_without_prefix_len =
       flag_str_without_prefix.size();
+  if (std::strncmp(flag + prefix_len, flag_str_without_prefix.c_str(),
+                   flag_str_without_prefix_len) != 0)
+    return std::string();
 
   // Skips the flag name.
   const char* flag_end = flag + (prefix_len + flag_str_without_prefix_len);
@@ -569,6 +1423,36 @@ static bool ParseFlag(const char* flag, const char* flag_name, String* value) {
   return true;
 }
 
+// Parses a string for an unsigned integer flag, in the form of "--flag=value".
+//
+// On success, stores the value of the flag in *value, and returns true.  On
+// failure, returns false without changing *value.
+static bool ParseFlag(const char* const flag, const char* const flag_name,
+                      uint32_t* value) {
+  // Gets the value of the flag as a string.
+  const std::string value_str = ParseFlagValue(flag, flag_name, false);
+  const char* const value_cstr = value_str.c_str();
+
+  // Aborts if the parsing failed.
+  if (*value_cstr == '\0')
+    return false;
+
+  char* end = nullptr;
+  const unsigned long long parsed =  // NOLINT
+      std::strtoull(value_cstr, &end, 10);
+  if (*end != '\0' || value_cstr[0] == '-' ||
+      parsed > std::numeric_limits<uint32_t>::max()) {
+    XTEST_LOG_(WARNING) << "Invalid value \"" << value_cstr << "\" for flag --"
+                        << XTEST_FLAG_PREFIX_ << flag_name
+                        << "; expected a non-negative integer.";
+    return false;
+  }
+
+  // Sets *value to the value of the flag.
+  *value = static_cast<uint32_t>(parsed);
+  return true;
+}
+
 static const char kColorEncodedHelpMessage[] =
     "This program contains tests written using xtest.  You can use the\n"
     "following command line flags to control its behaviour:\n"
@@ -578,17 +1462,136 @@ static const char kColorEncodedHelpMessage[] =
     "list_tests@D\n"
     "     List the names of all tests instead of running them. The name\n"
     "     of TEST(Foo, Bar) is \"Foo.Bar\".\n"
+    "  @G--" XTEST_FLAG_PREFIX_
+    "filter=@YPOSITIVE_PATTERNS[@G-@YNEGATIVE_PATTERNS]@D\n"
+    "     Run only the tests whose full names match one of the positive\n"
+    "     patterns but none of the negative patterns. '?' matches any single\n"
+    "     character; '*' matches any substring; ':' separates two patterns.\n"
+    "     E.g., \"Foo.*:Bar.*-Foo.Slow*\".\n"
+    "  @G--" XTEST_FLAG_PREFIX_
+    "tags=@YEXPRESSION@D\n"
+    "     Run only the tests whose tags (TEST_WITH_TAGS, XTEST_TAGS) match\n"
+    "     EXPRESSION, made of tags, ! (not), , or & (and), | (or) and\n"
+    "     parentheses, e.g., \"fast,!network\".\n"
+    "  @G--" XTEST_FLAG_PREFIX_
+    "also_run_disabled_tests@D\n"
+    "     Run disabled tests too, i.e., the tests whose suite or test name\n"
+    "     starts with DISABLED_.\n"
     "\n"
     "Test Execution:\n"
     "   @G--" XTEST_FLAG_PREFIX_
     "shuffle@D\n"
-    "     Randomize tests' order. (In development)\n"
+    "     Randomize tests' order on every run, also with --" XTEST_FLAG_PREFIX_
+    "jobs.\n"
+    "   @G--" XTEST_FLAG_PREFIX_
+    "random_seed=@Y[@GNUMBER@Y]@D\n"
+    "     Random number seed to use for shuffling test orders (between 1 and\n"
+    "     99999, or 0 to use a seed based on the current time).\n"
+    "   @G--" XTEST_FLAG_PREFIX_
+    "jobs=@Y[@GNUMBER@Y]@D\n"
+    "     Run the tests on NUMBER threads, 0 means one thread per CPU. The\n"
+    "     output is printed in the same order as a serial run, except for\n"
+    "     what the tests write to stdout or stderr themselves, e.g., with\n"
+    "     printf() or std::cout, which keeps its place only with\n"
+    "     --" XTEST_FLAG_PREFIX_
+    "isolate. Tests that use the same resource (TEST_WITH_RESOURCES,\n"
+    "     XTEST_RESOURCE) never run at the same time.\n"
+    "   @G--" XTEST_FLAG_PREFIX_
+    "cpu_affinity=@Y(@Gcompact@Y|@Gscatter@Y|@GCPUS@Y)@D\n"
+    "     Pin every worker to a CPU and its memory to the CPU's NUMA node:\n"
+    "     @Gcompact@D fills one node after the other, @Gscatter@D spreads the\n"
+    "     workers over the nodes and CPUS is a list such as @G0,2,4-7@D. The\n"
+    "     CPU every test ran on is printed after its elapsed time.\n"
+    "   @G--" XTEST_FLAG_PREFIX_
+    "isolate=@Y(@Gnone@Y|@Gprocess@Y|@Gzygote@Y)@D\n"
+    "     Run the tests in worker processes, as many as --" XTEST_FLAG_PREFIX_
+    "jobs,\n"
+    "     so that a crashing test only fails itself. @Gzygote@D forks a fresh\n"
+    "     worker for every batch of tests from the warmed up process. The\n"
+    "     default is @Gnone@D.\n"
+    "   @G--" XTEST_FLAG_PREFIX_
+    "zygote_batch=@Y[@GNUMBER@Y]@D\n"
+    "     Number of tests each zygote worker runs before it exits, 0 means\n"
+    "     batches shrinking toward the end of the run. The default is @G1@D.\n"
+    "   @G--" XTEST_FLAG_PREFIX_
+    "max_rss=@YSIZE@D\n"
+    "     Fail a test run by a worker process of --" XTEST_FLAG_PREFIX_
+    "isolate whose resident\n"
+    "     set size goes over SIZE, e.g., @G2G@D or @G512M@D, and replace its "
+    "worker.\n"
+    "   @G--" XTEST_FLAG_PREFIX_
+    "history=@YPATH@D\n"
+    "     Keep the elapsed times of the tests in the file PATH across runs\n"
+    "     and run the longest tests first. Shards are balanced by expected\n"
+    "     time; all shards must read the same file, so sharded runs do not\n"
+    "     update it.\n"
+    "   @G--" XTEST_FLAG_PREFIX_
+    "time_budget=@YDURATION@D\n"
+    "     Run only the tests likeliest to fail, by their --" XTEST_FLAG_PREFIX_
+    "history,\n"
+    "     that are expected to fit in DURATION, e.g., @G120s@D, @G2m@D or "
+    "@G500ms@D.\n"
+    "     New tests and tests that failed recently come first, then the\n"
+    "     cheapest ones. The tests left out are listed in the summary.\n"
+    "   @G--" XTEST_FLAG_PREFIX_
+    "soak=@YDURATION@D\n"
+    "     Keep running the tests, shuffled, for DURATION, e.g., @G2h@D. The\n"
+    "     resident set size, open file descriptors and threads of the process\n"
+    "     are sampled after every iteration, and steady growth fails the run\n"
+    "     as a leak.\n"
+    "   @G--" XTEST_FLAG_PREFIX_
+    "timeout=@YDURATION@D\n"
+    "     Interrupt and fail a test that runs for longer than DURATION, e.g.,\n"
+    "     @G30s@D, unless it was defined with TEST_WITH_TIMEOUT(). The stack\n"
+    "     traces of all threads are printed first. A test that does not stop\n"
+    "     when interrupted ends the run, or only its worker process with\n"
+    "     --" XTEST_FLAG_PREFIX_
+    "isolate.\n"
+    "   @G--" XTEST_FLAG_PREFIX_
+    "fail_fast@D\n"
+    "     Stop starting tests, in every worker, once a test fails. Running\n"
+    "     tests can poll XTEST_CANCELLED() to stop early; the tests that were\n"
+    "     not run are counted in the summary.\n"
+    "\n"
+    "Order Dependencies:\n"
+    "  @G--" XTEST_FLAG_PREFIX_
+    "bisect_order=@YSUITE.TEST@D\n"
+    "     Instead of running the tests, find the shortest run of the tests\n"
+    "     before SUITE.TEST, in the order of a serial run with the same\n"
+    "     flags, e.g., --" XTEST_FLAG_PREFIX_
+    "shuffle and --" XTEST_FLAG_PREFIX_
+    "random_seed, after which it fails.\n"
+    "     Every try runs in a forked child process.\n"
     "\n"
     "Test Output:\n"
     "  @G--" XTEST_FLAG_PREFIX_
     "color=@Y(@Gyes@Y|@Gno@Y|@Gauto@Y)@D\n"
     "      Enable/disable colored output. The default is @Gauto@D.\n"
     "\n"
+    "Test Server:\n"
+    "  @G--" XTEST_FLAG_PREFIX_
+    "serve=@YPATH@D\n"
+    "     Serve test runs on the Unix domain socket PATH until interrupted.\n"
+    "     A client sends a line of xtest flags and reads the output of the\n"
+    "     run until the connection is closed.\n"
+    "\n"
+    "Crash Recovery:\n"
+    "  @G--" XTEST_FLAG_PREFIX_
+    "journal=@YPATH@D\n"
+    "     Record the result of every test in the file PATH as soon as it\n"
+    "     completes, so that the results survive the process being killed.\n"
+    "  @G--" XTEST_FLAG_PREFIX_
+    "resume=@YPATH@D\n"
+    "     Skip the tests recorded in the journal PATH of an earlier run,\n"
+    "     count their recorded results, and keep recording the run in PATH.\n"
+    "  @G--" XTEST_FLAG_PREFIX_
+    "catch_faults@D\n"
+    "     Fail a test that crashes on SIGSEGV, SIGBUS, SIGFPE or SIGILL, with\n"
+    "     the signal and the faulting address, and go on with the next test\n"
+    "     in the same process. State the test corrupted may break later\n"
+    "     tests; --" XTEST_FLAG_PREFIX_
+    "isolate is the safe alternative.\n"
+    "\n"
     "Others:\n"
     "   @G--" XTEST_FLAG_PREFIX_
     "help@D\n"
@@ -614,6 +1617,25 @@ static void ParseXTestFlag(const char* const flag) {
   XTEST_INTERNAL_PARSE_FLAG(color);
   XTEST_INTERNAL_PARSE_FLAG(list_tests);
   XTEST_INTERNAL_PARSE_FLAG(shuffle);
+  XTEST_INTERNAL_PARSE_FLAG(random_seed);
+  XTEST_INTERNAL_PARSE_FLAG(jobs);
+  XTEST_INTERNAL_PARSE_FLAG(cpu_affinity);
+  XTEST_INTERNAL_PARSE_FLAG(isolate);
+  XTEST_INTERNAL_PARSE_FLAG(zygote_batch);
+  XTEST_INTERNAL_PARSE_FLAG(filter);
+  XTEST_INTERNAL_PARSE_FLAG(serve);
+  XTEST_INTERNAL_PARSE_FLAG(journal);
+  XTEST_INTERNAL_PARSE_FLAG(resume);
+  XTEST_INTERNAL_PARSE_FLAG(history);
+  XTEST_INTERNAL_PARSE_FLAG(time_budget);
+  XTEST_INTERNAL_PARSE_FLAG(soak);
+  XTEST_INTERNAL_PARSE_FLAG(timeout);
+  XTEST_INTERNAL_PARSE_FLAG(max_rss);
+  XTEST_INTERNAL_PARSE_FLAG(catch_faults);
+  XTEST_INTERNAL_PARSE_FLAG(fail_fast);
+  XTEST_INTERNAL_PARSE_FLAG(tags);
+  XTEST_INTERNAL_PARSE_FLAG(also_run_disabled_tests);
+  XTEST_INTERNAL_PARSE_FLAG(bisect_order);
 #undef XTEST_INTERNAL_PARSE_FLAG
 }
 
@@ -636,6 +1658,395 @@ void PostFlagParsing() {
     internal::PrintColorEncoded(kColorEncodedHelpMessage);
     std::exit(EXIT_SUCCESS);
   }
+
+  if (XTEST_FLAG_GET_(isolate) != "none" &&
+      XTEST_FLAG_GET_(isolate) != "process" &&
+      XTEST_FLAG_GET_(isolate) != "zygote") {
+    XTEST_LOG_(WARNING) << "Unknown value \"" << XTEST_FLAG_GET_(isolate)
+                        << "\" for flag --" XTEST_FLAG_PREFIX_
+                           "isolate; running the tests in-process.";
+    XTEST_FLAG_SET_(isolate, "none");
+  }
+
+  if (XTEST_FLAG_GET_(random_seed) > internal::kMaxRandomSeed) {
+    XTEST_LOG_(WARNING) << "Random seed " << XTEST_FLAG_GET_(random_seed)
+                        << " is out of range [1, " << internal::kMaxRandomSeed
+                        << "]; picking one from the current time.";
+    XTEST_FLAG_SET_(random_seed, 0);
+  }
+
+  std::string tags_error;
+  if (!XTEST_FLAG_GET_(tags).empty() &&
+      !internal::IsValidTagExpression(XTEST_FLAG_GET_(tags), &tags_error)) {
+    XTEST_LOG_(WARNING) << "Invalid expression for flag --" XTEST_FLAG_PREFIX_
+                           "tags: "
+                        << tags_error << "; running the tests of all tags.";
+    XTEST_FLAG_SET_(tags, "");
+  }
+
+  TimeInMillis time_budget = 0;
+  if (!XTEST_FLAG_GET_(time_budget).empty() &&
+      !internal::ParseDuration(XTEST_FLAG_GET_(time_budget).c_str(),
+                               &time_budget)) {
+    XTEST_LOG_(WARNING) << "Invalid duration \"" << XTEST_FLAG_GET_(time_budget)
+                        << "\" for flag --" XTEST_FLAG_PREFIX_
+                           "time_budget; running all tests.";
+    XTEST_FLAG_SET_(time_budget, "");
+  }
+
+  TimeInMillis soak = 0;
+  if (!XTEST_FLAG_GET_(soak).empty() &&
+      !internal::ParseDuration(XTEST_FLAG_GET_(soak).c_str(), &soak)) {
+    XTEST_LOG_(WARNING) << "Invalid duration \"" << XTEST_FLAG_GET_(soak)
+                        << "\" for flag --" XTEST_FLAG_PREFIX_
+                           "soak; running the tests once.";
+    XTEST_FLAG_SET_(soak, "");
+  }
+
+  TimeInMillis timeout = 0;
+  if (!XTEST_FLAG_GET_(timeout).empty() &&
+      !internal::ParseDuration(XTEST_FLAG_GET_(timeout).c_str(), &timeout)) {
+    XTEST_LOG_(WARNING) << "Invalid duration \"" << XTEST_FLAG_GET_(timeout)
+                        << "\" for flag --" XTEST_FLAG_PREFIX_
+                           "timeout; running the tests without a timeout.";
+    XTEST_FLAG_SET_(timeout, "");
+  }
+
+  uint64_t max_rss = 0;
+  if (!XTEST_FLAG_GET_(max_rss).empty() &&
+      !internal::ParseByteSize(XTEST_FLAG_GET_(max_rss).c_str(), &max_rss)) {
+    XTEST_LOG_(WARNING) << "Invalid size \"" << XTEST_FLAG_GET_(max_rss)
+                        << "\" for flag --" XTEST_FLAG_PREFIX_
+                           "max_rss; running the tests without a memory limit.";
+    XTEST_FLAG_SET_(max_rss, "");
+  } else if (!XTEST_FLAG_GET_(max_rss).empty() &&
+             XTEST_FLAG_GET_(isolate) == "none") {
+    XTEST_LOG_(WARNING) << "Flag --" XTEST_FLAG_PREFIX_
+                           "max_rss only applies to tests run in worker "
+                           "processes, see --" XTEST_FLAG_PREFIX_
+                           "isolate; running the tests without a memory limit.";
+  }
+
+  std::string cpu_affinity_error;
+  if (!XTEST_FLAG_GET_(cpu_affinity).empty() &&
+      !internal::CpuAffinity().Plan(XTEST_FLAG_GET_(cpu_affinity),
+                                    internal::GetCpuTopology(), 1,
+                                    &cpu_affinity_error)) {
+    XTEST_LOG_(WARNING) << "Invalid value \"" << XTEST_FLAG_GET_(cpu_affinity)
+                        << "\" for flag --" XTEST_FLAG_PREFIX_
+                           "cpu_affinity: "
+                        << cpu_affinity_error
+                        << "; running the tests on any CPU.";
+    XTEST_FLAG_SET_(cpu_affinity, "");
+  }
+}
+
+// Forgets the results and counters of the previous run so that the tests can
+// be run again in the same process.
+static void ResetTestResults() {
+  XTEST_GLOBAL_INSTANCE_SET_(failure_count, 0);
+  XTEST_GLOBAL_INSTANCE_SET_(unattributed_failure_count, 0);
+  XTEST_GLOBAL_INSTANCE_SET_(test_count, 0);
+  XTEST_GLOBAL_INSTANCE_SET_(test_suite_count, 0);
+  XTEST_GLOBAL_INSTANCE_SET_(failed_test_count, 0);
+  test_plan_counted = false;
+  tests_over_time_budget.clear();
+  disabled_test_count = 0;
+  cancelled_test_count = 0;
+  for (const auto& test_suite : XTestRegistryInstance.test_registry_table_) {
+    for (TestRegistrar* const& test : test_suite.second) {
+      test->test_result_ = TestResult::UNKNOWN;
+      test->elapsed_time_ = 0;
+    }
+  }
+}
+
+// Runs one request of the `--xtest_serve` test server: applies the xtest
+// command line `flags` on top of the flags the server was started with, runs
+// the tests from a clean slate and restores the flags afterwards.
+static uint64_t RunTestRequest(const std::vector<std::string>& flags) {
+  const internal::XTestFlagSaver saved_flags;
+  for (const std::string& flag : flags)
+    ParseXTestFlag(flag.c_str());
+  XTEST_FLAG_SET_(serve, "");
+  if (XTEST_FLAG_GET_(help)) {
+    internal::PrintColorEncoded(kColorEncodedHelpMessage);
+    return 0;
+  }
+  PostFlagParsing();
+  ResetTestResults();
+  return RunTestPlanOnce();
+}
+
+// Prints the result of running the `--xtest_bisect_order` test after the first
+// `length` tests run before it in one step of the bisection.
+static void PrintBisectionStep(const TestRegistrar* test,
+                               const std::size_t& length,
+                               const internal::ChildRunResult& result) {
+  internal::ColoredPrintf(
+      internal::XTestColor::kGreen, "[%s] ",
+      GetStringAlignedTo("BISECT", XTEST_DEFAULT_SUMMARY_STATUS_STR_WIDTH_,
+                         ALIGN_CENTER)
+          .c_str());
+  PrettyUnitTestResultPrinter::PrintTestName(test->suite_name_,
+                                             test->test_name_);
+  std::printf(" after %lu %s: ", length, length == 1 ? "test" : "tests");
+  if (result == internal::ChildRunResult::kPassed) {
+    internal::ColoredPrintf(internal::XTestColor::kGreen, "passed\n");
+  } else if (result == internal::ChildRunResult::kFailed) {
+    internal::ColoredPrintf(internal::XTestColor::kRed, "failed\n");
+  } else {
+    internal::ColoredPrintf(internal::XTestColor::kYellow,
+                            "not reached, a test before it crashed\n");
+  }
+  std::fflush(stdout);
+}
+
+// Finds and prints the shortest run of `tests`, the tests before `target` in
+// the order of a serial run, after which `target` fails.  Returns false, and
+// prints why, if the failure of `target` does not depend on them.
+static bool BisectTestsBefore(TestRegistrar* target,
+                              const std::vector<TestRegistrar*>& tests) {
+  const std::string target_name =
+      std::string(target->suite_name_) + '.' + target->test_name_;
+  const auto run_after = [&tests, target](const std::size_t& length) {
+    std::vector<TestRegistrar*> run(tests.begin(), tests.begin() + length);
+    run.push_back(target);
+    const internal::ChildRunResult result =
+        internal::RunTestsInChildProcess(run, RunTest);
+    PrintBisectionStep(target, length, result);
+    return result;
+  };
+
+  internal::ColoredPrintf(internal::XTestColor::kYellow,
+                          "Note: Bisecting the %lu tests run before %s.\n",
+                          tests.size(), target_name.c_str());
+  if (run_after(0) != internal::ChildRunResult::kPassed) {
+    internal::ColoredPrintf(internal::XTestColor::kYellow,
+                            "%s does not pass on its own, so its failure does "
+                            "not depend on the tests before it.\n",
+                            target_name.c_str());
+    return false;
+  }
+  const internal::ChildRunResult result =
+      tests.empty() ? internal::ChildRunResult::kPassed
+                    : run_after(tests.size());
+  if (result == internal::ChildRunResult::kPassed) {
+    internal::ColoredPrintf(internal::XTestColor::kYellow,
+                            "%s does not fail after the tests before it; the "
+                            "failure does not reproduce in this order.\n",
+                            target_name.c_str());
+    return false;
+  }
+  if (result == internal::ChildRunResult::kNotReached) {
+    internal::ColoredPrintf(internal::XTestColor::kYellow,
+                            "A test before %s crashes the run before it gets "
+                            "to %s; fix or filter out that test first.\n",
+                            target_name.c_str(), target_name.c_str());
+    return false;
+  }
+
+  const std::size_t length = internal::FindShortestFailingPrefix(
+      tests.size(), [&run_after](std::size_t length) {
+        return run_after(length) == internal::ChildRunResult::kFailed;
+      });
+  TestRegistrar* const polluter = tests[length - 1];
+  internal::ColoredPrintf(internal::XTestColor::kRed,
+                          "%s fails after the first %lu of the %lu tests "
+                          "before it, the last of which is %s.%s.\n",
+                          target_name.c_str(), length, tests.size(),
+                          polluter->suite_name_, polluter->test_name_);
+  const bool fails_after_polluter =
+      internal::RunTestsInChildProcess({polluter, target}, RunTest) ==
+      internal::ChildRunResult::kFailed;
+  std::printf("%s %s right after %s.%s alone.\n", target_name.c_str(),
+              fails_after_polluter ? "also fails" : "passes",
+              polluter->suite_name_, polluter->test_name_);
+  return true;
+}
+
+// Finds the shortest run of the tests before the `--xtest_bisect_order` test,
+// in the order of a serial run of the test plan, after which the test fails,
+// and returns `0` if there is one.
+//
+// Every try runs the tests in a child process forked from this one (see
+// `internal::RunTestsInChildProcess()`), so that the tries do not pollute each
+// other, and bisects the tests before it (see
+// `internal::FindShortestFailingPrefix()`): about log2(n) child runs for n
+// tests, plus a run of the test alone and one after all n tests to check that
+// the failure depends on the order at all.
+static uint64_t BisectTestOrder() {
+  const std::string& target_name = XTEST_FLAG_GET_(bisect_order);
+#if XTEST_OS_WINDOWS
+  internal::ColoredPrintf(internal::XTestColor::kRed,
+                          "--" XTEST_FLAG_PREFIX_
+                          "bisect_order needs fork(), which this platform "
+                          "does not have.\n");
+  return 1;
+#endif  // XTEST_OS_WINDOWS
+  LoadTestHistory();
+  bool sharded = false;
+  internal::TestPlan plan = BuildTestPlan(&sharded);
+  ShuffleTestPlanIfRequested(&plan);
+
+  std::vector<TestRegistrar*> tests;
+  TestRegistrar* target = nullptr;
+  for (const XTestUnitTestPair& test_suite : plan) {
+    for (TestRegistrar* const& test : test_suite.second) {
+      if (target_name ==
+          std::string(test->suite_name_) + '.' + test->test_name_) {
+        target = test;
+        break;
+      }
+      tests.push_back(test);
+    }
+    if (target != nullptr)
+      break;
+  }
+  if (target == nullptr) {
+    internal::ColoredPrintf(internal::XTestColor::kRed,
+                            "Test \"%s\" is not among the tests to run; pass "
+                            "the flags of the run it failed in.\n",
+                            target_name.c_str());
+    return 1;
+  }
+
+  RunWarmUpHooks();
+  void (*SavedSignalHandler)(int);
+  SavedSignalHandler = std::signal(SIGABRT, impl::SignalHandler);
+  const bool found = BisectTestsBefore(target, tests);
+  std::fflush(stdout);
+  std::signal(SIGABRT, SavedSignalHandler);
+  return found ? 0 : 1;
+}
+
+// A resource of the process tracked by `--xtest_soak`.
+struct SoakResource {
+  const char* name;
+  uint64_t internal::ResourceUsage::*usage;
+
+  // Growth over the iterations of a soak run below which steady growth is not
+  // reported, so that, e.g., a page or two is not taken for a leak.
+  double min_growth;
+
+  // Formats an amount of the resource for humans.
+  std::string (*format)(const uint64_t& amount);
+};
+
+static std::string FormatCount(const uint64_t& count) {
+  return internal::StreamableToString(count);
+}
+
+static const SoakResource kSoakResources[] = {
+    {"resident set size", &internal::ResourceUsage::rss, 1024.0 * 1024.0,
+     internal::FormatByteSize},
+    {"open file descriptors", &internal::ResourceUsage::open_fds, 2.0,
+     FormatCount},
+    {"threads", &internal::ResourceUsage::threads, 2.0, FormatCount},
+};
+
+// Prints how every resource of `kSoakResources` changed over the iterations of
+// a soak run, from `first`, sampled after the first iteration, to `last`, and
+// returns the number of resources that grew steadily.  `series` holds the
+// samples of every resource after the iterations that followed the first one,
+// which warms the process up, e.g., fills its caches.
+static uint64_t PrintSoakSummary(
+    const internal::ResourceUsage& first, const internal::ResourceUsage& last,
+    const std::vector<internal::SampleSeries>& series) {
+  uint64_t leak_count = 0;
+  for (std::size_t i = 0; i < series.size(); ++i) {
+    const SoakResource& resource = kSoakResources[i];
+    const std::vector<double>& samples = series[i].samples();
+    const bool leaks = internal::IsSteadyGrowth(samples, resource.min_growth);
+    leak_count += leaks ? 1 : 0;
+    internal::ColoredPrintf(
+        leaks ? internal::XTestColor::kRed : internal::XTestColor::kGreen,
+        "[%s] ",
+        GetStringAlignedTo(leaks ? "LEAK" : "SOAK",
+                           XTEST_DEFAULT_SUMMARY_STATUS_STR_WIDTH_,
+                           ALIGN_CENTER)
+            .c_str());
+    std::printf("%s: %s after the first iteration, %s after the last",
+                resource.name, resource.format(first.*resource.usage).c_str(),
+                resource.format(last.*resource.usage).c_str());
+    if (samples.size() >= internal::kMinTrendSamples) {
+      const internal::LinearTrend trend = internal::FitLinearTrend(samples);
+      std::printf(", trend R^2 %.2f", trend.r_squared);
+    }
+    std::printf("%s\n", leaks ? ", growing steadily" : "");
+  }
+  if (series.front().samples().size() < internal::kMinTrendSamples) {
+    internal::ColoredPrintf(internal::XTestColor::kYellow,
+                            "Note: Too few iterations to tell a leak from "
+                            "noise; soak for longer.\n");
+  }
+  std::fflush(stdout);
+  return leak_count;
+}
+
+// Runs the tests over and over for the `--xtest_soak` duration, shuffled with a
+// new seed every iteration, and returns the failure count of all iterations
+// plus the number of resources of the process that grew steadily, see
+// `PrintSoakSummary()`.
+static uint64_t SoakTests() {
+  TimeInMillis duration = 0;
+  internal::ParseDuration(XTEST_FLAG_GET_(soak).c_str(), &duration);
+  const internal::XTestFlagSaver saved_flags;
+  XTEST_FLAG_SET_(shuffle, true);
+  uint32_t seed = internal::GetRandomSeedFromFlag(XTEST_FLAG_GET_(random_seed));
+
+  internal::ResourceUsage first;
+  internal::ResourceUsage last;
+  std::vector<internal::SampleSeries> series(
+      sizeof(kSoakResources) / sizeof(kSoakResources[0]));
+  bool usage_measured = true;
+  uint64_t iteration = 0;
+  uint64_t failure_count = 0;
+  internal::Timer timer;
+  do {
+    internal::ColoredPrintf(internal::XTestColor::kYellow,
+                            "\nSoaking the tests (iteration %lu) . . .\n\n",
+                            ++iteration);
+    XTEST_FLAG_SET_(random_seed, seed);
+    seed = seed % internal::kMaxRandomSeed + 1;
+    ResetTestResults();
+    failure_count += RunTestPlanOnce();
+
+    usage_measured = usage_measured && internal::GetResourceUsage(&last);
+    if (iteration == 1)
+      first = last;
+    for (std::size_t i = 0; i < series.size() && iteration > 1; ++i)
+      series[i].Add(static_cast<double>(last.*kSoakResources[i].usage));
+  } while (timer.Elapsed() < duration && !internal::IsTestRunCancelled());
+
+  internal::ColoredPrintf(internal::XTestColor::kGreen, "\n[%s] ",
+                          GetStrFilledWith('=').c_str());
+  std::printf("Soaked the tests for %lld ms in %lu iterations.\n",
+              static_cast<long long>(timer.Elapsed()), iteration);
+  if (!usage_measured) {
+    internal::ColoredPrintf(internal::XTestColor::kYellow,
+                            "Note: The resources of the process cannot be "
+                            "measured on this platform.\n");
+    return failure_count;
+  }
+  return failure_count + PrintSoakSummary(first, last, series);
+}
+
+// Runs all the registered test suites and returns the failure count.
+//
+// With `--xtest_bisect_order` the tests are instead bisected for the ones a
+// test fails after, see `BisectTestOrder()`.  With `--xtest_serve` the tests
+// are instead run once per request received on the test server's socket (see
+// `internal::ServeTests()`) until the server is stopped.  With `--xtest_soak`
+// they are run over and over, see `SoakTests()`.
+uint64_t RunRegisteredTests() {
+  if (!XTEST_FLAG_GET_(bisect_order).empty())
+    return BisectTestOrder();
+  if (!XTEST_FLAG_GET_(serve).empty())
+    return internal::ServeTests(XTEST_FLAG_GET_(serve), RunTestRequest);
+  if (!XTEST_FLAG_GET_(soak).empty())
+    return SoakTests();
+  return RunTestPlanOnce();
 }
 
 // Initializes xtest.  This must be called before calling `RUN_ALL_TESTS()`.